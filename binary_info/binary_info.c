@@ -3,10 +3,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "azure_c_shared_utility/strings.h"
 #include "mem_reporter.h"
 #include "iothub_client_version.h"
+#include "elf_file.h"
+#include "symbol_diff.h"
+#include "linker_map.h"
+#include "reference_graph.h"
 
 #ifdef USE_PROVISIONING_CLIENT
     #include "azure_prov_client/prov_device_client.h"
@@ -14,10 +19,12 @@
 
 #ifdef WIN32
     static const char* EXECUTABLE_EXT = ".exe";
+    static const char* LINKER_MAP_EXT = ".map";
     static const char* BINARY_LL_PATH_FMT = "%s\\binary_info\\lower_layer\\%s%s_%s\\release\\%s%s_%s%s";
     static const char* BINARY_UL_PATH_FMT = "%s\\binary_info\\upper_layer\\%s%s_%s\\release\\%s%s_%s%s";
 #else
     static const char* EXECUTABLE_EXT = "";
+    static const char* LINKER_MAP_EXT = ".map";
     static const char* BINARY_LL_PATH_FMT = "%s/binary_info/lower_layer/%s%s_%s/%s%s_%s%s";
     static const char* BINARY_UL_PATH_FMT = "%s/binary_info/upper_layer/%s%s_%s/%s%s_%s%s";
 #endif
@@ -39,6 +46,11 @@ static const char* LOWER_LAYER_SUFFIX = "ll";
 
 #define TOLOWER(c) (((c>='A') && (c<='Z'))?c-'A'+'a':c)
 
+#define SECTION_METRIC_COUNT    12
+#define SYMBOL_DIFF_METRIC_COUNT 9
+#define SECTION_DIFF_METRIC_COUNT 9
+#define DEFAULT_TOP_SYMBOLS     20
+
 typedef enum ARGUEMENT_TYPE_TAG
 {
     ARGUEMENT_TYPE_UNKNOWN,
@@ -46,7 +58,10 @@ typedef enum ARGUEMENT_TYPE_TAG
     ARGUEMENT_TYPE_OUTPUT_FILE,
     ARGUEMENT_TYPE_SKIP_UPPER_LAYER,
     ARGUEMENT_TYPE_OUTPUT_TYPE,
-    ARGUEMENT_TYPE_CONN_STRING
+    ARGUEMENT_TYPE_CONN_STRING,
+    ARGUEMENT_TYPE_TOP_SYMBOLS,
+    ARGUEMENT_TYPE_BASELINE_DIR,
+    ARGUEMENT_TYPE_WHY_LINKED
 } ARGUEMENT_TYPE;
 
 static const char* get_binary_file(PROTOCOL_TYPE rpt_type)
@@ -97,6 +112,586 @@ static bool is_lower_layer(FEATURE_TYPE rpt_type)
     return result;
 }
 
+static void get_analysis_info(const BINARY_INFO* bin_info, MEM_ANALYSIS_INFO* analysis_info)
+{
+    memset(analysis_info, 0, sizeof(MEM_ANALYSIS_INFO));
+    analysis_info->iothub_version = bin_info->iothub_version;
+    analysis_info->iothub_protocol = bin_info->iothub_protocol;
+    analysis_info->operation_type = bin_info->operation_type;
+    analysis_info->feature_type = bin_info->feature_type;
+}
+
+// Shows what a build variant, lto or gc-sections for instance, removes from the baseline build
+static int report_section_diff(const BINARY_INFO* bin_info, REPORT_HANDLE report_handle, const ELF_SECTION_SIZES* sizes, const char* baseline_path)
+{
+    int result;
+    ELF_FILE_HANDLE baseline_file;
+    ELF_SECTION_SIZES baseline_sizes;
+    if ((baseline_file = elf_file_open(baseline_path)) == NULL)
+    {
+        (void)printf("Failed opening the baseline binary %s\r\n", baseline_path);
+        result = __LINE__;
+    }
+    else
+    {
+        if (elf_file_get_section_sizes(baseline_file, &baseline_sizes) != 0)
+        {
+            (void)printf("Failed reading the baseline ELF sections\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            MEM_ANALYSIS_INFO diff_info;
+            REPORT_METRIC metrics[SECTION_DIFF_METRIC_COUNT];
+            size_t count = 0;
+            double flash = (double)(sizes->text + sizes->rodata + sizes->data);
+            double baseline_flash = (double)(baseline_sizes.text + baseline_sizes.rodata + baseline_sizes.data);
+            get_analysis_info(bin_info, &diff_info);
+
+            metrics[count].name = "baselineFlashSize";
+            metrics[count++].value = baseline_flash;
+            metrics[count].name = "flashDelta";
+            metrics[count++].value = flash - baseline_flash;
+            metrics[count].name = "flashDeltaPct";
+            metrics[count++].value = baseline_flash > 0 ? (flash - baseline_flash) * 100.0 / baseline_flash : 0;
+            metrics[count].name = "staticRamDelta";
+            metrics[count++].value = (double)(sizes->data + sizes->bss) - (double)(baseline_sizes.data + baseline_sizes.bss);
+            metrics[count].name = "textDelta";
+            metrics[count++].value = (double)sizes->text - (double)baseline_sizes.text;
+            metrics[count].name = "rodataDelta";
+            metrics[count++].value = (double)sizes->rodata - (double)baseline_sizes.rodata;
+            metrics[count].name = "dataDelta";
+            metrics[count++].value = (double)sizes->data - (double)baseline_sizes.data;
+            metrics[count].name = "bssDelta";
+            metrics[count++].value = (double)sizes->bss - (double)baseline_sizes.bss;
+            metrics[count].name = "ehFrameDelta";
+            metrics[count++].value = (double)sizes->eh_frame - (double)baseline_sizes.eh_frame;
+
+            report_metrics(report_handle, &diff_info, "ROM_SECTION_DIFF", metrics, count);
+            result = 0;
+        }
+        elf_file_close(baseline_file);
+    }
+    return result;
+}
+
+// The file length includes symbols and debug info, what a device has to hold is
+// flash for text, rodata and data and static ram for data and bss
+static int report_section_sizes(const BINARY_INFO* bin_info, REPORT_HANDLE report_handle, ELF_FILE_HANDLE elf_file, const char* baseline_path)
+{
+    int result;
+    ELF_SECTION_SIZES sizes;
+    if (elf_file_get_section_sizes(elf_file, &sizes) != 0)
+    {
+        (void)printf("Failed reading the ELF sections\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        MEM_ANALYSIS_INFO section_info;
+        REPORT_METRIC metrics[SECTION_METRIC_COUNT];
+        size_t count = 0;
+
+        get_analysis_info(bin_info, &section_info);
+
+        metrics[count].name = "flashSize";
+        metrics[count++].value = (double)(sizes.text + sizes.rodata + sizes.data);
+        metrics[count].name = "staticRamSize";
+        metrics[count++].value = (double)(sizes.data + sizes.bss);
+        metrics[count].name = "textSize";
+        metrics[count++].value = (double)sizes.text;
+        metrics[count].name = "rodataSize";
+        metrics[count++].value = (double)sizes.rodata;
+        metrics[count].name = "dataSize";
+        metrics[count++].value = (double)sizes.data;
+        metrics[count].name = "bssSize";
+        metrics[count++].value = (double)sizes.bss;
+        metrics[count].name = "ehFrameSize";
+        metrics[count++].value = (double)sizes.eh_frame;
+        metrics[count].name = "relocationSize";
+        metrics[count++].value = (double)sizes.relocations;
+        metrics[count].name = "debugSize";
+        metrics[count++].value = (double)sizes.debug;
+        metrics[count].name = "symbolSize";
+        metrics[count++].value = (double)sizes.symbols;
+        metrics[count].name = "otherSize";
+        metrics[count++].value = (double)sizes.other;
+        metrics[count].name = "fileSize";
+        metrics[count++].value = (double)elf_file_get_length(elf_file);
+
+        report_metrics(report_handle, &section_info, "ROM_SECTIONS", metrics, count);
+        if (baseline_path != NULL)
+        {
+            result = report_section_diff(bin_info, report_handle, &sizes, baseline_path);
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void report_top_symbols(const BINARY_INFO* bin_info, REPORT_HANDLE report_handle, const ELF_SYMBOL* symbols, size_t symbol_count, ELF_SYMBOL_TYPE symbol_type, const char* rpt_name)
+{
+    REPORT_METRIC* metrics;
+    if ((metrics = (REPORT_METRIC*)malloc((bin_info->top_symbols + 1) * sizeof(REPORT_METRIC))) == NULL)
+    {
+        (void)printf("Failed allocating symbol metrics\r\n");
+    }
+    else
+    {
+        MEM_ANALYSIS_INFO symbol_info;
+        size_t count = 0;
+        get_analysis_info(bin_info, &symbol_info);
+        // The symbols are sorted largest first
+        for (size_t index = 0; index < symbol_count && count < bin_info->top_symbols; index++)
+        {
+            if (symbols[index].type == symbol_type)
+            {
+                metrics[count].name = symbols[index].name;
+                metrics[count++].value = (double)symbols[index].size;
+            }
+        }
+        report_metrics(report_handle, &symbol_info, rpt_name, metrics, count);
+        free(metrics);
+    }
+}
+
+static void report_symbol_changes(const BINARY_INFO* bin_info, REPORT_HANDLE report_handle, const SYMBOL_DELTA* deltas, size_t delta_count, SYMBOL_CHANGE change, const char* rpt_name)
+{
+    REPORT_METRIC* metrics;
+    if ((metrics = (REPORT_METRIC*)malloc((bin_info->top_symbols + 1) * sizeof(REPORT_METRIC))) == NULL)
+    {
+        (void)printf("Failed allocating symbol metrics\r\n");
+    }
+    else
+    {
+        MEM_ANALYSIS_INFO symbol_info;
+        size_t count = 0;
+        get_analysis_info(bin_info, &symbol_info);
+        // The deltas are sorted by the largest change first
+        for (size_t index = 0; index < delta_count && count < bin_info->top_symbols; index++)
+        {
+            if (deltas[index].change == change)
+            {
+                metrics[count].name = deltas[index].name;
+                metrics[count++].value = (double)deltas[index].delta;
+            }
+        }
+        report_metrics(report_handle, &symbol_info, rpt_name, metrics, count);
+        free(metrics);
+    }
+}
+
+static int report_symbol_diff(const BINARY_INFO* bin_info, REPORT_HANDLE report_handle, const ELF_SYMBOL* symbols, size_t symbol_count, const char* baseline_path)
+{
+    int result;
+    ELF_FILE_HANDLE baseline_file;
+    if ((baseline_file = elf_file_open(baseline_path)) == NULL)
+    {
+        (void)printf("Failed opening the baseline binary %s\r\n", baseline_path);
+        result = __LINE__;
+    }
+    else
+    {
+        ELF_SYMBOL* baseline_symbols;
+        size_t baseline_count;
+        if (elf_file_get_symbols(baseline_file, &baseline_symbols, &baseline_count) != 0)
+        {
+            (void)printf("Failed reading the baseline symbols\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            SYMBOL_DELTA* deltas;
+            size_t delta_count;
+            SYMBOL_DIFF_SUMMARY summary;
+            if (symbol_diff_compare(baseline_symbols, baseline_count, symbols, symbol_count, &deltas, &delta_count, &summary) != 0)
+            {
+                (void)printf("Failed comparing the symbols with the baseline\r\n");
+                result = __LINE__;
+            }
+            else
+            {
+                MEM_ANALYSIS_INFO diff_info;
+                REPORT_METRIC metrics[SYMBOL_DIFF_METRIC_COUNT];
+                size_t count = 0;
+                get_analysis_info(bin_info, &diff_info);
+
+                metrics[count].name = "addedCount";
+                metrics[count++].value = (double)summary.count[SYMBOL_CHANGE_ADDED];
+                metrics[count].name = "addedBytes";
+                metrics[count++].value = (double)summary.bytes[SYMBOL_CHANGE_ADDED];
+                metrics[count].name = "removedCount";
+                metrics[count++].value = (double)summary.count[SYMBOL_CHANGE_REMOVED];
+                metrics[count].name = "removedBytes";
+                metrics[count++].value = (double)summary.bytes[SYMBOL_CHANGE_REMOVED];
+                metrics[count].name = "grownCount";
+                metrics[count++].value = (double)summary.count[SYMBOL_CHANGE_GROWN];
+                metrics[count].name = "grownBytes";
+                metrics[count++].value = (double)summary.bytes[SYMBOL_CHANGE_GROWN];
+                metrics[count].name = "shrunkCount";
+                metrics[count++].value = (double)summary.count[SYMBOL_CHANGE_SHRUNK];
+                metrics[count].name = "shrunkBytes";
+                metrics[count++].value = (double)summary.bytes[SYMBOL_CHANGE_SHRUNK];
+                metrics[count].name = "netBytes";
+                metrics[count++].value = (double)(summary.bytes[SYMBOL_CHANGE_ADDED] + summary.bytes[SYMBOL_CHANGE_REMOVED] +
+                    summary.bytes[SYMBOL_CHANGE_GROWN] + summary.bytes[SYMBOL_CHANGE_SHRUNK]);
+                report_metrics(report_handle, &diff_info, "ROM_SYMBOL_DIFF", metrics, count);
+
+                report_symbol_changes(bin_info, report_handle, deltas, delta_count, SYMBOL_CHANGE_ADDED, "ROM_SYMBOLS_ADDED");
+                report_symbol_changes(bin_info, report_handle, deltas, delta_count, SYMBOL_CHANGE_REMOVED, "ROM_SYMBOLS_REMOVED");
+                report_symbol_changes(bin_info, report_handle, deltas, delta_count, SYMBOL_CHANGE_GROWN, "ROM_SYMBOLS_GROWN");
+                report_symbol_changes(bin_info, report_handle, deltas, delta_count, SYMBOL_CHANGE_SHRUNK, "ROM_SYMBOLS_SHRUNK");
+                free(deltas);
+                result = 0;
+            }
+            free(baseline_symbols);
+        }
+        elf_file_close(baseline_file);
+    }
+    return result;
+}
+
+// The baseline path is NULL when there is no other build to compare with
+static int report_symbols(const BINARY_INFO* bin_info, REPORT_HANDLE report_handle, ELF_FILE_HANDLE elf_file, const char* baseline_path)
+{
+    int result;
+    ELF_SYMBOL* symbols;
+    size_t symbol_count;
+    if (elf_file_get_symbols(elf_file, &symbols, &symbol_count) != 0)
+    {
+        (void)printf("Failed reading the symbols, the binary might be stripped\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        report_top_symbols(bin_info, report_handle, symbols, symbol_count, ELF_SYMBOL_FUNCTION, "ROM_TOP_FUNCTIONS");
+        report_top_symbols(bin_info, report_handle, symbols, symbol_count, ELF_SYMBOL_OBJECT, "ROM_TOP_OBJECTS");
+        if (baseline_path != NULL)
+        {
+            result = report_symbol_diff(bin_info, report_handle, symbols, symbol_count, baseline_path);
+        }
+        else
+        {
+            result = 0;
+        }
+        free(symbols);
+    }
+    return result;
+}
+
+typedef struct LIBRARY_SIZE_TAG
+{
+    const char* name;
+    uint64_t flash;
+    uint64_t ram;
+} LIBRARY_SIZE;
+
+static int compare_library_flash(const void* left, const void* right)
+{
+    int result;
+    const LIBRARY_SIZE* left_library = (const LIBRARY_SIZE*)left;
+    const LIBRARY_SIZE* right_library = (const LIBRARY_SIZE*)right;
+    if (left_library->flash != right_library->flash)
+    {
+        result = left_library->flash > right_library->flash ? -1 : 1;
+    }
+    else
+    {
+        result = strcmp(left_library->name, right_library->name);
+    }
+    return result;
+}
+
+static size_t sum_library_sizes(ELF_FILE_HANDLE elf_file, const LINKER_MAP_CONTRIBUTION* contributions, size_t contribution_count, LIBRARY_SIZE* libraries)
+{
+    size_t library_count = 0;
+    for (size_t index = 0; index < contribution_count; index++)
+    {
+        ELF_SECTION_CLASS section_class;
+        // Sections the image does not have were merged away or discarded
+        if (elf_file_get_section_class(elf_file, contributions[index].section, &section_class) == 0)
+        {
+            size_t library_index;
+            for (library_index = 0; library_index < library_count; library_index++)
+            {
+                if (strcmp(libraries[library_index].name, contributions[index].library) == 0)
+                {
+                    break;
+                }
+            }
+            if (library_index == library_count)
+            {
+                libraries[library_count].name = contributions[index].library;
+                libraries[library_count].flash = 0;
+                libraries[library_count].ram = 0;
+                library_count++;
+            }
+
+            // Same split as ROM_SECTIONS, data takes flash and ram
+            if (section_class == ELF_SECTION_TEXT || section_class == ELF_SECTION_RODATA || section_class == ELF_SECTION_DATA)
+            {
+                libraries[library_index].flash += contributions[index].size;
+            }
+            if (section_class == ELF_SECTION_DATA || section_class == ELF_SECTION_BSS)
+            {
+                libraries[library_index].ram += contributions[index].size;
+            }
+        }
+    }
+    qsort(libraries, library_count, sizeof(LIBRARY_SIZE), compare_library_flash);
+    return library_count;
+}
+
+// Only statically linked libraries are part of the image, a shared libc or openssl
+// is not counted
+static int report_libraries(const BINARY_INFO* bin_info, REPORT_HANDLE report_handle, ELF_FILE_HANDLE elf_file, const char* binary_path)
+{
+    int result;
+    STRING_HANDLE map_path;
+    if ((map_path = STRING_construct_sprintf("%s%s", binary_path, LINKER_MAP_EXT)) == NULL)
+    {
+        (void)printf("Failed constructing linker map filename\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        LINKER_MAP_CONTRIBUTION* contributions;
+        size_t contribution_count;
+        if (linker_map_read(STRING_c_str(map_path), &contributions, &contribution_count) != 0)
+        {
+            (void)printf("Failed reading the linker map, the binary was built without add_linker_map\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            LIBRARY_SIZE* libraries;
+            REPORT_METRIC* metrics;
+            if ((libraries = (LIBRARY_SIZE*)malloc((contribution_count + 1) * sizeof(LIBRARY_SIZE))) == NULL)
+            {
+                (void)printf("Failed allocating library sizes\r\n");
+                result = __LINE__;
+            }
+            else
+            {
+                if ((metrics = (REPORT_METRIC*)malloc((contribution_count + 1) * sizeof(REPORT_METRIC))) == NULL)
+                {
+                    (void)printf("Failed allocating library metrics\r\n");
+                    result = __LINE__;
+                }
+                else
+                {
+                    MEM_ANALYSIS_INFO library_info;
+                    size_t library_count = sum_library_sizes(elf_file, contributions, contribution_count, libraries);
+                    size_t count = 0;
+                    get_analysis_info(bin_info, &library_info);
+
+                    for (size_t index = 0; index < library_count; index++)
+                    {
+                        if (libraries[index].flash > 0)
+                        {
+                            metrics[count].name = libraries[index].name;
+                            metrics[count++].value = (double)libraries[index].flash;
+                        }
+                    }
+                    report_metrics(report_handle, &library_info, "ROM_LIBRARIES", metrics, count);
+
+                    count = 0;
+                    for (size_t index = 0; index < library_count; index++)
+                    {
+                        if (libraries[index].ram > 0)
+                        {
+                            metrics[count].name = libraries[index].name;
+                            metrics[count++].value = (double)libraries[index].ram;
+                        }
+                    }
+                    report_metrics(report_handle, &library_info, "RAM_LIBRARIES", metrics, count);
+                    free(metrics);
+                    result = 0;
+                }
+                free(libraries);
+            }
+            free(contributions);
+        }
+        STRING_delete(map_path);
+    }
+    return result;
+}
+
+// A symbol name is looked up first, anything else is taken as an object file from the map
+static size_t find_why_linked_targets(const BINARY_INFO* bin_info, const ELF_SYMBOL* symbols, size_t symbol_count, const char* binary_path, bool* is_target)
+{
+    size_t result = 0;
+    size_t name_len = strlen(bin_info->why_linked);
+    for (size_t index = 0; index < symbol_count; index++)
+    {
+        // gcc's clones of a static, foo.part.0, foo.isra.0, foo.constprop.0 or foo.cold, stand for it
+        if (strncmp(symbols[index].name, bin_info->why_linked, name_len) == 0 && (symbols[index].name[name_len] == '\0' || symbols[index].name[name_len] == '.'))
+        {
+            is_target[index] = true;
+            result++;
+        }
+    }
+
+    if (result == 0)
+    {
+        STRING_HANDLE map_path;
+        if ((map_path = STRING_construct_sprintf("%s%s", binary_path, LINKER_MAP_EXT)) == NULL)
+        {
+            (void)printf("Failed constructing linker map filename\r\n");
+        }
+        else
+        {
+            LINKER_MAP_RANGE* ranges;
+            size_t range_count;
+            if (linker_map_find_object(STRING_c_str(map_path), bin_info->why_linked, &ranges, &range_count) == 0)
+            {
+                for (size_t index = 0; index < symbol_count; index++)
+                {
+                    for (size_t range_index = 0; range_index < range_count; range_index++)
+                    {
+                        if (symbols[index].address >= ranges[range_index].address && symbols[index].address < ranges[range_index].address + ranges[range_index].size)
+                        {
+                            is_target[index] = true;
+                            result++;
+                            break;
+                        }
+                    }
+                }
+                free(ranges);
+            }
+            STRING_delete(map_path);
+        }
+    }
+    return result;
+}
+
+static void report_why_chain(const BINARY_INFO* bin_info, REPORT_HANDLE report_handle, REFERENCE_GRAPH_HANDLE graph, const ELF_SYMBOL* symbols, const size_t* chain, size_t chain_len, uint64_t retained_bytes)
+{
+    REPORT_METRIC* metrics;
+    STRING_HANDLE* edge_names;
+    if ((metrics = (REPORT_METRIC*)malloc((chain_len + 1) * sizeof(REPORT_METRIC))) == NULL)
+    {
+        (void)printf("Failed allocating chain metrics\r\n");
+    }
+    else
+    {
+        if ((edge_names = (STRING_HANDLE*)calloc(chain_len + 1, sizeof(STRING_HANDLE))) == NULL)
+        {
+            (void)printf("Failed allocating chain names\r\n");
+        }
+        else
+        {
+            MEM_ANALYSIS_INFO chain_info;
+            size_t count = 0;
+            get_analysis_info(bin_info, &chain_info);
+
+            metrics[count].name = "retainedBytes";
+            metrics[count++].value = (double)retained_bytes;
+
+            (void)printf("%s is linked through:\r\n    %s\r\n", bin_info->why_linked, symbols[chain[0]].name);
+            for (size_t index = 1; index < chain_len; index++)
+            {
+                uint64_t cut_bytes = reference_graph_get_cut_bytes(graph, chain[index - 1], chain[index]);
+                (void)printf("    -> %s, cutting this reference drops %llu bytes\r\n", symbols[chain[index]].name, (unsigned long long)cut_bytes);
+                if ((edge_names[index] = STRING_construct_sprintf("%s -> %s", symbols[chain[index - 1]].name, symbols[chain[index]].name)) != NULL)
+                {
+                    metrics[count].name = STRING_c_str(edge_names[index]);
+                    metrics[count++].value = (double)cut_bytes;
+                }
+            }
+            (void)printf("%s keeps %llu bytes in the image\r\n", bin_info->why_linked, (unsigned long long)retained_bytes);
+            report_metrics(report_handle, &chain_info, "ROM_WHY_LINKED", metrics, count);
+
+            for (size_t index = 0; index <= chain_len; index++)
+            {
+                STRING_delete(edge_names[index]);
+            }
+            free(edge_names);
+        }
+        free(metrics);
+    }
+}
+
+static void report_why_unresolved(const BINARY_INFO* bin_info, REPORT_HANDLE report_handle)
+{
+    REPORT_METRIC metrics[2];
+    MEM_ANALYSIS_INFO chain_info;
+    size_t count = 0;
+    get_analysis_info(bin_info, &chain_info);
+
+    metrics[count].name = "retainedBytes";
+    metrics[count++].value = 0;
+    metrics[count].name = "unresolved";
+    metrics[count++].value = 1;
+    report_metrics(report_handle, &chain_info, "ROM_WHY_LINKED", metrics, count);
+}
+
+// Explains which chain of references from main pulled the symbol or object into the binary
+static int report_why_linked(const BINARY_INFO* bin_info, REPORT_HANDLE report_handle, ELF_FILE_HANDLE elf_file, const char* binary_path)
+{
+    int result;
+    ELF_SYMBOL* symbols;
+    ELF_REFERENCE* references;
+    size_t symbol_count;
+    size_t reference_count;
+    (void)printf("Why is %s linked into %s\r\n", bin_info->why_linked, binary_path);
+    if (elf_file_get_references(elf_file, &symbols, &symbol_count, &references, &reference_count) != 0)
+    {
+        (void)printf("Failed reading the references, the binary was built without -Duse_why_linked=ON or stripped\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        bool* is_target;
+        if ((is_target = (bool*)calloc(symbol_count + 1, sizeof(bool))) == NULL)
+        {
+            (void)printf("Failed allocating symbol flags\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            REFERENCE_GRAPH_HANDLE graph;
+            if (find_why_linked_targets(bin_info, symbols, symbol_count, binary_path, is_target) == 0)
+            {
+                // The compiler leaves no symbol for a static it inlined into every caller
+                (void)printf("%s is not a symbol or object file of this binary, or a static inlined into its callers\r\n", bin_info->why_linked);
+                report_why_unresolved(bin_info, report_handle);
+                result = __LINE__;
+            }
+            else if ((graph = reference_graph_create(symbols, symbol_count, references, reference_count)) == NULL)
+            {
+                (void)printf("Failed creating the reference graph\r\n");
+                result = __LINE__;
+            }
+            else
+            {
+                size_t* chain;
+                size_t chain_len;
+                if (reference_graph_find_chain(graph, is_target, &chain, &chain_len) != 0)
+                {
+                    (void)printf("Nothing references %s, the linker kept it on its own or it is called without a relocation\r\n", bin_info->why_linked);
+                    report_why_unresolved(bin_info, report_handle);
+                    result = __LINE__;
+                }
+                else
+                {
+                    report_why_chain(bin_info, report_handle, graph, symbols, chain, chain_len, reference_graph_get_retained_bytes(graph, is_target));
+                    free(chain);
+                    result = 0;
+                }
+                reference_graph_destroy(graph);
+            }
+            free(is_target);
+        }
+        free(references);
+        free(symbols);
+    }
+    return result;
+}
+
 static int calculate_filesize(BINARY_INFO* bin_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE rpt_type, const char* binary_path_fmt)
 {
     int result;
@@ -127,21 +722,52 @@ static int calculate_filesize(BINARY_INFO* bin_info, REPORT_HANDLE report_handle
 
         bin_info->iothub_protocol = rpt_type;
         STRING_HANDLE filename_handle = STRING_construct_sprintf(binary_path_fmt, bin_info->cmake_dir, prov_exe, binary_name, suffix, prov_exe, binary_name, suffix, EXECUTABLE_EXT);
+        STRING_HANDLE baseline_handle = NULL;
         if (filename_handle == NULL)
         {
             (void)printf("Failed constructing filename\r\n");
             result = __LINE__;
         }
+        else if (bin_info->baseline_dir != NULL &&
+            (baseline_handle = STRING_construct_sprintf(binary_path_fmt, bin_info->baseline_dir, prov_exe, binary_name, suffix, prov_exe, binary_name, suffix, EXECUTABLE_EXT)) == NULL)
+        {
+            (void)printf("Failed constructing baseline filename\r\n");
+            STRING_delete(filename_handle);
+            result = __LINE__;
+        }
         else
         {
-            target_file = fopen(STRING_c_str(filename_handle), "rb");
-            if (target_file == NULL)
+            ELF_FILE_HANDLE elf_file;
+            if ((elf_file = elf_file_open(STRING_c_str(filename_handle))) != NULL)
+            {
+                // The file length is kept for comparison with the older reports
+                bin_info->binary_size = (long)elf_file_get_length(elf_file);
+                report_binary_sizes(report_handle, bin_info);
+                const char* baseline_path = baseline_handle == NULL ? NULL : STRING_c_str(baseline_handle);
+                result = report_section_sizes(bin_info, report_handle, elf_file, baseline_path);
+                // A stripped binary still has its sections and its map
+                if (report_symbols(bin_info, report_handle, elf_file, baseline_path) != 0)
+                {
+                    result = __LINE__;
+                }
+                if (report_libraries(bin_info, report_handle, elf_file, STRING_c_str(filename_handle)) != 0)
+                {
+                    result = __LINE__;
+                }
+                if (bin_info->why_linked != NULL && report_why_linked(bin_info, report_handle, elf_file, STRING_c_str(filename_handle)) != 0)
+                {
+                    result = __LINE__;
+                }
+                elf_file_close(elf_file);
+            }
+            else if ((target_file = fopen(STRING_c_str(filename_handle), "rb")) == NULL)
             {
                 // If the file isn't there then don't report on it and just return
                 result = __LINE__;
             }
             else
             {
+                // Not an ELF image, only the file length is known
                 fseek(target_file, 0, SEEK_END);
                 bin_info->binary_size = ftell(target_file);
                 fclose(target_file);
@@ -149,13 +775,14 @@ static int calculate_filesize(BINARY_INFO* bin_info, REPORT_HANDLE report_handle
                 report_binary_sizes(report_handle, bin_info);
                 result = 0;
             }
+            STRING_delete(baseline_handle);
             STRING_delete(filename_handle);
         }
     }
     return result;
 }
 
-// -c "<CMAKE DIRECTORY>" -t <report rpt_type - json, csv> -l
+// -c "<CMAKE DIRECTORY>" -t <report rpt_type - json, csv> -l -n <top symbols> -b "<BASELINE CMAKE DIRECTORY>" -w <symbol or object file>
 static int parse_command_line(int argc, char* argv[], BINARY_INFO* bin_info)
 {
     int result = 0;
@@ -185,6 +812,15 @@ static int parse_command_line(int argc, char* argv[], BINARY_INFO* bin_info)
                     case 's':
                         argument_type = ARGUEMENT_TYPE_CONN_STRING;
                         break;
+                    case 'n':
+                        argument_type = ARGUEMENT_TYPE_TOP_SYMBOLS;
+                        break;
+                    case 'b':
+                        argument_type = ARGUEMENT_TYPE_BASELINE_DIR;
+                        break;
+                    case 'w':
+                        argument_type = ARGUEMENT_TYPE_WHY_LINKED;
+                        break;
                 }
             }
             /*if (argv[index][0] == '-' && (argv[index][1] == 'c' || argv[index][1] == 'C'))
@@ -233,6 +869,15 @@ static int parse_command_line(int argc, char* argv[], BINARY_INFO* bin_info)
             case ARGUEMENT_TYPE_CONN_STRING:
                 bin_info->azure_conn_string = argv[index];
                 break;
+            case ARGUEMENT_TYPE_TOP_SYMBOLS:
+                bin_info->top_symbols = atol(argv[index]);
+                break;
+            case ARGUEMENT_TYPE_BASELINE_DIR:
+                bin_info->baseline_dir = argv[index];
+                break;
+            case ARGUEMENT_TYPE_WHY_LINKED:
+                bin_info->why_linked = argv[index];
+                break;
             case ARGUEMENT_TYPE_UNKNOWN:
             default:
                 result = __LINE__;
@@ -251,6 +896,7 @@ int main(int argc, char* argv[])
     REPORT_HANDLE report_handle;
     memset(&bin_info, 0, sizeof(bin_info));
     bin_info.sdk_type = SDK_TYPE_C;
+    bin_info.top_symbols = DEFAULT_TOP_SYMBOLS;
 
     if (parse_command_line(argc, argv, &bin_info) != 0)
     {
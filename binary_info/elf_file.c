@@ -0,0 +1,914 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "elf_file.h"
+
+// The layout is read by hand so binary_info can look at a cross compiled
+// image on any host, elf.h is not available everywhere
+#define ELF_IDENT_LEN           16
+#define ELF_CLASS_OFFSET        4
+#define ELF_DATA_OFFSET         5
+#define ELF_CLASS_32            1
+#define ELF_CLASS_64            2
+#define ELF_DATA_BIG_ENDIAN     2
+
+#define ELF32_HEADER_LEN        52
+#define ELF64_HEADER_LEN        64
+#define ELF32_SECTION_LEN       40
+#define ELF64_SECTION_LEN       64
+
+// Section count and string table index are in section 0 when they do not fit the header
+#define ELF_SECTION_INDEX_EXTENDED  0xffff
+
+#define SHT_SYMTAB              2
+#define SHT_STRTAB              3
+#define SHT_RELA                4
+#define SHT_NOBITS              8
+#define SHT_REL                 9
+#define SHT_DYNSYM              11
+#define SHT_RELR                19
+
+#define ELF32_SYMBOL_LEN        16
+#define ELF64_SYMBOL_LEN        24
+
+#define STT_OBJECT              1
+#define STT_FUNC                2
+#define STT_TLS                 6
+
+#define STT_SECTION             3
+
+#define SHN_UNDEF               0
+#define SHN_ABS                 0xfff1
+
+#define ELF32_REL_LEN           8
+#define ELF32_RELA_LEN          12
+#define ELF64_REL_LEN           16
+#define ELF64_RELA_LEN          24
+
+#define EM_X86_64               62
+#define R_X86_64_PC32           2
+#define R_X86_64_PLT32          4
+#define R_X86_64_GOTPCREL       9
+#define R_X86_64_GOTPCRELX      41
+#define R_X86_64_REX_GOTPCRELX  42
+// The field the cpu adds the pc relative value to is 4 bytes, the addend takes it off again
+#define X86_64_PC_FIELD_LEN     4
+
+#define INITIAL_REFERENCES      1024
+
+#define SHF_WRITE               0x1
+#define SHF_ALLOC               0x2
+#define SHF_EXECINSTR           0x4
+
+typedef struct ELF_SECTION_TAG
+{
+    const char* name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t address;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+    uint32_t info;
+} ELF_SECTION;
+
+typedef struct SYMBOL_ENTRY_TAG
+{
+    const char* name;
+    uint64_t value;
+    uint64_t size;
+    uint8_t type;
+    uint8_t bind;
+    uint16_t section_index;
+} SYMBOL_ENTRY;
+
+typedef struct ELF_FILE_TAG
+{
+    unsigned char* data;
+    size_t length;
+    bool is_64;
+    bool big_endian;
+    uint16_t machine;
+    uint64_t entry;
+    uint64_t section_offset;
+    size_t section_len;
+    size_t section_count;
+    size_t name_index;
+} ELF_FILE;
+
+static uint64_t read_value(const ELF_FILE* elf, uint64_t offset, size_t len)
+{
+    uint64_t result = 0;
+    if (offset + len <= elf->length)
+    {
+        for (size_t index = 0; index < len; index++)
+        {
+            size_t byte_index = elf->big_endian ? index : len - 1 - index;
+            result = (result << 8) | elf->data[offset + byte_index];
+        }
+    }
+    return result;
+}
+
+static int read_section(const ELF_FILE* elf, size_t index, ELF_SECTION* section)
+{
+    int result;
+    uint64_t header = elf->section_offset + (uint64_t)index * elf->section_len;
+    if (header + elf->section_len > elf->length)
+    {
+        (void)printf("Failure section header %zu is past the end of the file\r\n", index);
+        result = __LINE__;
+    }
+    else
+    {
+        uint32_t name_offset = (uint32_t)read_value(elf, header, 4);
+        section->type = (uint32_t)read_value(elf, header + 4, 4);
+        if (elf->is_64)
+        {
+            section->flags = read_value(elf, header + 8, 8);
+            section->address = read_value(elf, header + 16, 8);
+            section->offset = read_value(elf, header + 24, 8);
+            section->size = read_value(elf, header + 32, 8);
+            section->link = (uint32_t)read_value(elf, header + 40, 4);
+            section->info = (uint32_t)read_value(elf, header + 44, 4);
+        }
+        else
+        {
+            section->flags = read_value(elf, header + 8, 4);
+            section->address = read_value(elf, header + 12, 4);
+            section->offset = read_value(elf, header + 16, 4);
+            section->size = read_value(elf, header + 20, 4);
+            section->link = (uint32_t)read_value(elf, header + 24, 4);
+            section->info = (uint32_t)read_value(elf, header + 28, 4);
+        }
+
+        section->name = "";
+        if (elf->name_index != 0 && elf->name_index < elf->section_count && index != elf->name_index)
+        {
+            ELF_SECTION names;
+            if (read_section(elf, elf->name_index, &names) == 0 && name_offset < names.size && names.offset + names.size <= elf->length)
+            {
+                const char* name = (const char*)elf->data + names.offset + name_offset;
+                if (memchr(name, '\0', (size_t)(names.size - name_offset)) != NULL)
+                {
+                    section->name = name;
+                }
+            }
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static bool is_name_prefix(const char* name, const char* prefix)
+{
+    return strncmp(name, prefix, strlen(prefix)) == 0;
+}
+
+static ELF_SECTION_CLASS get_section_class(const ELF_SECTION* section)
+{
+    ELF_SECTION_CLASS result;
+    if (section->type == SHT_REL || section->type == SHT_RELA || section->type == SHT_RELR)
+    {
+        result = ELF_SECTION_RELOCATIONS;
+    }
+    else if (is_name_prefix(section->name, ".debug") || is_name_prefix(section->name, ".zdebug") || is_name_prefix(section->name, ".stab"))
+    {
+        result = ELF_SECTION_DEBUG;
+    }
+    else if (strcmp(section->name, ".eh_frame") == 0 || strcmp(section->name, ".eh_frame_hdr") == 0 || strcmp(section->name, ".gcc_except_table") == 0)
+    {
+        result = ELF_SECTION_EH_FRAME;
+    }
+    else if ((section->flags & SHF_ALLOC) == 0)
+    {
+        // .shstrtab is a string table as well but only holds the section names
+        result = (section->type == SHT_SYMTAB || (section->type == SHT_STRTAB && strcmp(section->name, ".strtab") == 0)) ? ELF_SECTION_SYMBOLS : ELF_SECTION_OTHER;
+    }
+    else if (section->type == SHT_NOBITS)
+    {
+        result = ELF_SECTION_BSS;
+    }
+    else if ((section->flags & SHF_EXECINSTR) != 0)
+    {
+        result = ELF_SECTION_TEXT;
+    }
+    else if ((section->flags & SHF_WRITE) != 0)
+    {
+        result = ELF_SECTION_DATA;
+    }
+    else
+    {
+        result = ELF_SECTION_RODATA;
+    }
+    return result;
+}
+
+static void add_section_size(const ELF_SECTION* section, ELF_SECTION_SIZES* sizes)
+{
+    switch (get_section_class(section))
+    {
+        case ELF_SECTION_TEXT:
+            sizes->text += section->size;
+            break;
+        case ELF_SECTION_RODATA:
+            sizes->rodata += section->size;
+            break;
+        case ELF_SECTION_DATA:
+            sizes->data += section->size;
+            break;
+        case ELF_SECTION_BSS:
+            sizes->bss += section->size;
+            break;
+        case ELF_SECTION_EH_FRAME:
+            sizes->eh_frame += section->size;
+            break;
+        case ELF_SECTION_RELOCATIONS:
+            sizes->relocations += section->size;
+            break;
+        case ELF_SECTION_DEBUG:
+            sizes->debug += section->size;
+            break;
+        case ELF_SECTION_SYMBOLS:
+            sizes->symbols += section->size;
+            break;
+        case ELF_SECTION_OTHER:
+        default:
+            sizes->other += section->size;
+            break;
+    }
+}
+
+static int compare_symbol_name(const void* left, const void* right)
+{
+    return strcmp(((const ELF_SYMBOL*)left)->name, ((const ELF_SYMBOL*)right)->name);
+}
+
+static int compare_symbol_size(const void* left, const void* right)
+{
+    int result;
+    const ELF_SYMBOL* left_symbol = (const ELF_SYMBOL*)left;
+    const ELF_SYMBOL* right_symbol = (const ELF_SYMBOL*)right;
+    if (left_symbol->size != right_symbol->size)
+    {
+        result = left_symbol->size > right_symbol->size ? -1 : 1;
+    }
+    else
+    {
+        result = strcmp(left_symbol->name, right_symbol->name);
+    }
+    return result;
+}
+
+static int find_symbol_table(const ELF_FILE* elf, ELF_SECTION* symbols, ELF_SECTION* names, size_t* table_index)
+{
+    int result = __LINE__;
+    for (size_t index = 1; index < elf->section_count; index++)
+    {
+        ELF_SECTION section;
+        if (read_section(elf, index, &section) != 0)
+        {
+            break;
+        }
+        // The full table wins over the dynamic one
+        else if (section.type == SHT_SYMTAB || (section.type == SHT_DYNSYM && result != 0))
+        {
+            if (section.link < elf->section_count && read_section(elf, section.link, names) == 0)
+            {
+                *symbols = section;
+                *table_index = index;
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
+
+static void read_symbol_entry(const ELF_FILE* elf, uint64_t entry, const ELF_SECTION* names, SYMBOL_ENTRY* symbol)
+{
+    uint32_t name_offset = (uint32_t)read_value(elf, entry, 4);
+    uint8_t info;
+    if (elf->is_64)
+    {
+        info = (uint8_t)read_value(elf, entry + 4, 1);
+        symbol->section_index = (uint16_t)read_value(elf, entry + 6, 2);
+        symbol->value = read_value(elf, entry + 8, 8);
+        symbol->size = read_value(elf, entry + 16, 8);
+    }
+    else
+    {
+        symbol->value = read_value(elf, entry + 4, 4);
+        symbol->size = read_value(elf, entry + 8, 4);
+        info = (uint8_t)read_value(elf, entry + 12, 1);
+        symbol->section_index = (uint16_t)read_value(elf, entry + 14, 2);
+    }
+    symbol->type = info & 0xf;
+    symbol->bind = info >> 4;
+
+    symbol->name = "";
+    if (name_offset < names->size)
+    {
+        const char* name = (const char*)elf->data + names->offset + name_offset;
+        if (memchr(name, '\0', (size_t)(names->size - name_offset)) != NULL)
+        {
+            symbol->name = name;
+        }
+    }
+}
+
+static bool read_symbol(const ELF_FILE* elf, uint64_t entry, const ELF_SECTION* names, ELF_SYMBOL* symbol)
+{
+    bool result;
+    SYMBOL_ENTRY symbol_entry;
+    read_symbol_entry(elf, entry, names, &symbol_entry);
+    switch (symbol_entry.type)
+    {
+        case STT_FUNC:
+            symbol->type = ELF_SYMBOL_FUNCTION;
+            result = true;
+            break;
+        case STT_OBJECT:
+        case STT_TLS:
+            symbol->type = ELF_SYMBOL_OBJECT;
+            result = true;
+            break;
+        default:
+            result = false;
+            break;
+    }
+
+    // Imports and absolute values take no room in the image
+    if (result && (symbol_entry.size == 0 || symbol_entry.section_index == SHN_UNDEF || symbol_entry.section_index == SHN_ABS || symbol_entry.name[0] == '\0'))
+    {
+        result = false;
+    }
+    else if (result)
+    {
+        symbol->name = symbol_entry.name;
+        symbol->address = symbol_entry.value;
+        symbol->size = symbol_entry.size;
+    }
+    return result;
+}
+
+static int parse_header(ELF_FILE* elf)
+{
+    int result;
+    if (elf->length < ELF_IDENT_LEN || memcmp(elf->data, "\177ELF", 4) != 0)
+    {
+        // Not an ELF file, a PE image on windows
+        result = __LINE__;
+    }
+    else if (elf->data[ELF_CLASS_OFFSET] != ELF_CLASS_32 && elf->data[ELF_CLASS_OFFSET] != ELF_CLASS_64)
+    {
+        (void)printf("Failure unknown ELF class %d\r\n", elf->data[ELF_CLASS_OFFSET]);
+        result = __LINE__;
+    }
+    else
+    {
+        elf->is_64 = elf->data[ELF_CLASS_OFFSET] == ELF_CLASS_64;
+        elf->big_endian = elf->data[ELF_DATA_OFFSET] == ELF_DATA_BIG_ENDIAN;
+        if (elf->length < (elf->is_64 ? ELF64_HEADER_LEN : ELF32_HEADER_LEN))
+        {
+            (void)printf("Failure ELF header is truncated\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            elf->machine = (uint16_t)read_value(elf, 0x12, 2);
+            if (elf->is_64)
+            {
+                elf->entry = read_value(elf, 0x18, 8);
+                elf->section_offset = read_value(elf, 0x28, 8);
+                elf->section_len = (size_t)read_value(elf, 0x3A, 2);
+                elf->section_count = (size_t)read_value(elf, 0x3C, 2);
+                elf->name_index = (size_t)read_value(elf, 0x3E, 2);
+            }
+            else
+            {
+                elf->entry = read_value(elf, 0x18, 4);
+                elf->section_offset = read_value(elf, 0x20, 4);
+                elf->section_len = (size_t)read_value(elf, 0x2E, 2);
+                elf->section_count = (size_t)read_value(elf, 0x30, 2);
+                elf->name_index = (size_t)read_value(elf, 0x32, 2);
+            }
+
+            if (elf->section_len < (size_t)(elf->is_64 ? ELF64_SECTION_LEN : ELF32_SECTION_LEN))
+            {
+                (void)printf("Failure unexpected section header size %zu\r\n", elf->section_len);
+                result = __LINE__;
+            }
+            else if (elf->section_offset != 0 && (elf->section_count == 0 || elf->name_index == ELF_SECTION_INDEX_EXTENDED))
+            {
+                ELF_SECTION first;
+                size_t name_index = elf->name_index;
+                elf->name_index = 0;
+                if (read_section(elf, 0, &first) != 0)
+                {
+                    result = __LINE__;
+                }
+                else
+                {
+                    if (elf->section_count == 0)
+                    {
+                        elf->section_count = (size_t)first.size;
+                    }
+                    elf->name_index = name_index == ELF_SECTION_INDEX_EXTENDED ? first.link : name_index;
+                    result = 0;
+                }
+            }
+            else
+            {
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
+
+ELF_FILE_HANDLE elf_file_open(const char* path)
+{
+    ELF_FILE* result;
+    FILE* target_file;
+    if (path == NULL)
+    {
+        result = NULL;
+    }
+    else if ((target_file = fopen(path, "rb")) == NULL)
+    {
+        // A transport that was not built is simply not reported
+        result = NULL;
+    }
+    else
+    {
+        long file_len;
+        if (fseek(target_file, 0, SEEK_END) != 0 || (file_len = ftell(target_file)) <= 0 || fseek(target_file, 0, SEEK_SET) != 0)
+        {
+            (void)printf("Failure getting the length of %s\r\n", path);
+            result = NULL;
+        }
+        else if ((result = (ELF_FILE*)calloc(1, sizeof(ELF_FILE))) == NULL)
+        {
+            (void)printf("Failure allocating elf file\r\n");
+        }
+        else if ((result->data = (unsigned char*)malloc((size_t)file_len)) == NULL)
+        {
+            (void)printf("Failure allocating %ld bytes for %s\r\n", file_len, path);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->length = (size_t)file_len;
+            if (fread(result->data, 1, result->length, target_file) != result->length)
+            {
+                (void)printf("Failure reading %s\r\n", path);
+                elf_file_close(result);
+                result = NULL;
+            }
+            else if (parse_header(result) != 0)
+            {
+                elf_file_close(result);
+                result = NULL;
+            }
+        }
+        (void)fclose(target_file);
+    }
+    return result;
+}
+
+void elf_file_close(ELF_FILE_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        free(handle->data);
+        free(handle);
+    }
+}
+
+size_t elf_file_get_length(ELF_FILE_HANDLE handle)
+{
+    size_t result;
+    if (handle == NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        result = handle->length;
+    }
+    return result;
+}
+
+int elf_file_get_section_sizes(ELF_FILE_HANDLE handle, ELF_SECTION_SIZES* sizes)
+{
+    int result;
+    if (handle == NULL || sizes == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        memset(sizes, 0, sizeof(ELF_SECTION_SIZES));
+        result = 0;
+        // Section 0 is always the empty one
+        for (size_t index = 1; index < handle->section_count; index++)
+        {
+            ELF_SECTION section;
+            if (read_section(handle, index, &section) != 0)
+            {
+                result = __LINE__;
+                break;
+            }
+            add_section_size(&section, sizes);
+        }
+    }
+    return result;
+}
+
+int elf_file_get_section_class(ELF_FILE_HANDLE handle, const char* section_name, ELF_SECTION_CLASS* section_class)
+{
+    int result;
+    if (handle == NULL || section_name == NULL || section_class == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result = __LINE__;
+        for (size_t index = 1; index < handle->section_count; index++)
+        {
+            ELF_SECTION section;
+            if (read_section(handle, index, &section) != 0)
+            {
+                break;
+            }
+            else if (strcmp(section.name, section_name) == 0)
+            {
+                *section_class = get_section_class(&section);
+                result = 0;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+static int compare_symbol_address(const void* left, const void* right)
+{
+    int result;
+    const ELF_SYMBOL* left_symbol = (const ELF_SYMBOL*)left;
+    const ELF_SYMBOL* right_symbol = (const ELF_SYMBOL*)right;
+    if (left_symbol->address != right_symbol->address)
+    {
+        result = left_symbol->address < right_symbol->address ? -1 : 1;
+    }
+    else
+    {
+        // The larger one of two aliases is kept
+        result = left_symbol->size > right_symbol->size ? -1 : (left_symbol->size < right_symbol->size ? 1 : strcmp(left_symbol->name, right_symbol->name));
+    }
+    return result;
+}
+
+static int compare_reference(const void* left, const void* right)
+{
+    int result;
+    const ELF_REFERENCE* left_reference = (const ELF_REFERENCE*)left;
+    const ELF_REFERENCE* right_reference = (const ELF_REFERENCE*)right;
+    if (left_reference->from != right_reference->from)
+    {
+        result = left_reference->from < right_reference->from ? -1 : 1;
+    }
+    else if (left_reference->to != right_reference->to)
+    {
+        result = left_reference->to < right_reference->to ? -1 : 1;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+// Index of the symbol the address lies in, symbol_count when there is none
+static size_t find_symbol_at(const ELF_SYMBOL* symbols, size_t symbol_count, uint64_t address)
+{
+    size_t result = symbol_count;
+    size_t low = 0;
+    size_t high = symbol_count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (symbols[middle].address <= address)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low > 0 && address < symbols[low - 1].address + symbols[low - 1].size)
+    {
+        result = low - 1;
+    }
+    return result;
+}
+
+static bool is_pc_relative(const ELF_FILE* elf, uint32_t relocation_type)
+{
+    return elf->machine == EM_X86_64 && (relocation_type == R_X86_64_PC32 || relocation_type == R_X86_64_PLT32 ||
+        relocation_type == R_X86_64_GOTPCREL || relocation_type == R_X86_64_GOTPCRELX || relocation_type == R_X86_64_REX_GOTPCRELX);
+}
+
+static bool is_root_section(const char* name)
+{
+    return strcmp(name, ".init_array") == 0 || strcmp(name, ".fini_array") == 0 || strcmp(name, ".preinit_array") == 0 ||
+        strcmp(name, ".ctors") == 0 || strcmp(name, ".dtors") == 0;
+}
+
+static size_t read_graph_symbols(const ELF_FILE* elf, const ELF_SECTION* symbol_table, const ELF_SECTION* names, ELF_SYMBOL* symbols)
+{
+    size_t count = 0;
+    size_t entry_len = elf->is_64 ? ELF64_SYMBOL_LEN : ELF32_SYMBOL_LEN;
+    size_t entry_count = (size_t)(symbol_table->size / entry_len);
+    for (size_t index = 0; index < entry_count; index++)
+    {
+        SYMBOL_ENTRY entry;
+        read_symbol_entry(elf, symbol_table->offset + (uint64_t)index * entry_len, names, &entry);
+        // Thread locals are addressed relative to the thread, they would collide with the image
+        if ((entry.type == STT_FUNC || entry.type == STT_OBJECT) && entry.size > 0 && entry.section_index != SHN_UNDEF && entry.section_index != SHN_ABS && entry.name[0] != '\0')
+        {
+            symbols[count].name = entry.name;
+            symbols[count].type = entry.type == STT_FUNC ? ELF_SYMBOL_FUNCTION : ELF_SYMBOL_OBJECT;
+            symbols[count].address = entry.value;
+            symbols[count].size = entry.size;
+            count++;
+        }
+    }
+
+    qsort(symbols, count, sizeof(ELF_SYMBOL), compare_symbol_address);
+    if (count > 0)
+    {
+        size_t unique = 1;
+        for (size_t index = 1; index < count; index++)
+        {
+            if (symbols[index].address != symbols[unique - 1].address)
+            {
+                symbols[unique++] = symbols[index];
+            }
+        }
+        count = unique;
+    }
+    return count;
+}
+
+static int add_reference(ELF_REFERENCE** references, size_t* reference_count, size_t* capacity, size_t from, size_t to)
+{
+    int result = 0;
+    if (*reference_count == *capacity)
+    {
+        size_t new_capacity = *capacity == 0 ? INITIAL_REFERENCES : *capacity * 2;
+        ELF_REFERENCE* new_references = (ELF_REFERENCE*)realloc(*references, new_capacity * sizeof(ELF_REFERENCE));
+        if (new_references == NULL)
+        {
+            (void)printf("Failure allocating %zu references\r\n", new_capacity);
+            result = __LINE__;
+        }
+        else
+        {
+            *references = new_references;
+            *capacity = new_capacity;
+        }
+    }
+    if (result == 0)
+    {
+        (*references)[*reference_count].from = from;
+        (*references)[*reference_count].to = to;
+        (*reference_count)++;
+    }
+    return result;
+}
+
+static int read_relocations(const ELF_FILE* elf, const ELF_SECTION* relocations, const ELF_SECTION* symbol_table, const ELF_SECTION* names,
+    const ELF_SYMBOL* symbols, size_t symbol_count, ELF_REFERENCE** references, size_t* reference_count, size_t* capacity)
+{
+    int result = 0;
+    ELF_SECTION target;
+    // The unwind tables point at every function, they do not keep anything alive
+    if (read_section(elf, relocations->info, &target) == 0 && (target.flags & SHF_ALLOC) != 0 && !is_name_prefix(target.name, ".eh_frame"))
+    {
+        bool has_addend = relocations->type == SHT_RELA;
+        size_t entry_len = elf->is_64 ? (has_addend ? ELF64_RELA_LEN : ELF64_REL_LEN) : (has_addend ? ELF32_RELA_LEN : ELF32_REL_LEN);
+        size_t symbol_len = elf->is_64 ? ELF64_SYMBOL_LEN : ELF32_SYMBOL_LEN;
+        size_t entry_count = (size_t)(relocations->size / entry_len);
+        bool from_root = is_root_section(target.name);
+        for (size_t index = 0; index < entry_count && result == 0; index++)
+        {
+            uint64_t entry = relocations->offset + (uint64_t)index * entry_len;
+            uint64_t offset;
+            uint64_t info;
+            int64_t addend = 0;
+            size_t symbol_index;
+            uint32_t relocation_type;
+            if (elf->is_64)
+            {
+                offset = read_value(elf, entry, 8);
+                info = read_value(elf, entry + 8, 8);
+                addend = has_addend ? (int64_t)read_value(elf, entry + 16, 8) : 0;
+                symbol_index = (size_t)(info >> 32);
+                relocation_type = (uint32_t)(info & 0xffffffff);
+            }
+            else
+            {
+                offset = read_value(elf, entry, 4);
+                info = read_value(elf, entry + 4, 4);
+                addend = has_addend ? (int32_t)read_value(elf, entry + 8, 4) : 0;
+                symbol_index = (size_t)(info >> 8);
+                relocation_type = (uint32_t)(info & 0xff);
+            }
+
+            if ((uint64_t)symbol_index * symbol_len < symbol_table->size)
+            {
+                SYMBOL_ENTRY symbol;
+                read_symbol_entry(elf, symbol_table->offset + (uint64_t)symbol_index * symbol_len, names, &symbol);
+                // Imports from a shared library are not part of the image
+                if (symbol.section_index != SHN_UNDEF)
+                {
+                    uint64_t address = symbol.value;
+                    size_t to;
+                    size_t from;
+                    if (symbol.type == STT_SECTION)
+                    {
+                        // A static referenced through its section, the addend says where in it
+                        address += (uint64_t)addend + (is_pc_relative(elf, relocation_type) ? X86_64_PC_FIELD_LEN : 0);
+                    }
+                    to = find_symbol_at(symbols, symbol_count, address);
+                    from = find_symbol_at(symbols, symbol_count, offset);
+                    if (from == symbol_count && from_root)
+                    {
+                        from = ELF_REFERENCE_ROOT;
+                    }
+                    if (to != symbol_count && from != symbol_count && from != to)
+                    {
+                        result = add_reference(references, reference_count, capacity, from, to);
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+int elf_file_get_references(ELF_FILE_HANDLE handle, ELF_SYMBOL** symbols, size_t* symbol_count, ELF_REFERENCE** references, size_t* reference_count)
+{
+    int result;
+    ELF_SECTION symbol_table;
+    ELF_SECTION names;
+    size_t table_index;
+    if (handle == NULL || symbols == NULL || symbol_count == NULL || references == NULL || reference_count == NULL)
+    {
+        result = __LINE__;
+    }
+    else if (find_symbol_table(handle, &symbol_table, &names, &table_index) != 0 || symbol_table.type != SHT_SYMTAB)
+    {
+        (void)printf("Failure the file has no symbol table, it was stripped\r\n");
+        result = __LINE__;
+    }
+    else if (symbol_table.offset + symbol_table.size > handle->length || names.offset + names.size > handle->length)
+    {
+        (void)printf("Failure the symbol table is past the end of the file\r\n");
+        result = __LINE__;
+    }
+    else if ((*symbols = (ELF_SYMBOL*)malloc((size_t)(symbol_table.size / (handle->is_64 ? ELF64_SYMBOL_LEN : ELF32_SYMBOL_LEN) + 1) * sizeof(ELF_SYMBOL))) == NULL)
+    {
+        (void)printf("Failure allocating the symbols\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t capacity = 0;
+        size_t entry_symbol;
+        bool has_relocations = false;
+        *references = NULL;
+        *reference_count = 0;
+        *symbol_count = read_graph_symbols(handle, &symbol_table, &names, *symbols);
+
+        // The entry point is where everything starts, main is referenced from there
+        result = 0;
+        if ((entry_symbol = find_symbol_at(*symbols, *symbol_count, handle->entry)) != *symbol_count)
+        {
+            result = add_reference(references, reference_count, &capacity, ELF_REFERENCE_ROOT, entry_symbol);
+        }
+        for (size_t index = 1; index < handle->section_count && result == 0; index++)
+        {
+            ELF_SECTION section;
+            if (read_section(handle, index, &section) != 0)
+            {
+                result = __LINE__;
+            }
+            // The dynamic relocations point at the dynamic symbols, only the kept ones are read
+            else if ((section.type == SHT_REL || section.type == SHT_RELA) && section.link == table_index && section.offset + section.size <= handle->length)
+            {
+                has_relocations = true;
+                result = read_relocations(handle, &section, &symbol_table, &names, *symbols, *symbol_count, references, reference_count, &capacity);
+            }
+        }
+
+        if (result == 0 && !has_relocations)
+        {
+            (void)printf("Failure the file has no relocations, it was built without -Duse_why_linked=ON\r\n");
+            result = __LINE__;
+        }
+
+        if (result != 0)
+        {
+            free(*references);
+            free(*symbols);
+        }
+        else
+        {
+            qsort(*references, *reference_count, sizeof(ELF_REFERENCE), compare_reference);
+            if (*reference_count > 0)
+            {
+                size_t unique = 1;
+                for (size_t index = 1; index < *reference_count; index++)
+                {
+                    if (compare_reference(&(*references)[index], &(*references)[unique - 1]) != 0)
+                    {
+                        (*references)[unique++] = (*references)[index];
+                    }
+                }
+                *reference_count = unique;
+            }
+        }
+    }
+    return result;
+}
+
+int elf_file_get_symbols(ELF_FILE_HANDLE handle, ELF_SYMBOL** symbols, size_t* symbol_count)
+{
+    int result;
+    ELF_SECTION symbol_table;
+    ELF_SECTION names;
+    size_t table_index;
+    if (handle == NULL || symbols == NULL || symbol_count == NULL)
+    {
+        result = __LINE__;
+    }
+    else if (find_symbol_table(handle, &symbol_table, &names, &table_index) != 0)
+    {
+        (void)printf("Failure the file has no symbol table\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t entry_len = handle->is_64 ? ELF64_SYMBOL_LEN : ELF32_SYMBOL_LEN;
+        size_t entry_count = (size_t)(symbol_table.size / entry_len);
+        if (symbol_table.offset + symbol_table.size > handle->length || names.offset + names.size > handle->length)
+        {
+            (void)printf("Failure the symbol table is past the end of the file\r\n");
+            result = __LINE__;
+        }
+        else if ((*symbols = (ELF_SYMBOL*)malloc((entry_count + 1) * sizeof(ELF_SYMBOL))) == NULL)
+        {
+            (void)printf("Failure allocating %zu symbols\r\n", entry_count);
+            result = __LINE__;
+        }
+        else
+        {
+            size_t count = 0;
+            size_t merged = 0;
+            for (size_t index = 0; index < entry_count; index++)
+            {
+                if (read_symbol(handle, symbol_table.offset + (uint64_t)index * entry_len, &names, &(*symbols)[count]))
+                {
+                    count++;
+                }
+            }
+
+            // Merge the file local statics by name so two builds can be compared
+            qsort(*symbols, count, sizeof(ELF_SYMBOL), compare_symbol_name);
+            for (size_t index = 0; index < count; index++)
+            {
+                if (merged > 0 && strcmp((*symbols)[merged - 1].name, (*symbols)[index].name) == 0)
+                {
+                    (*symbols)[merged - 1].size += (*symbols)[index].size;
+                }
+                else
+                {
+                    (*symbols)[merged++] = (*symbols)[index];
+                }
+            }
+            qsort(*symbols, merged, sizeof(ELF_SYMBOL), compare_symbol_size);
+            *symbol_count = merged;
+            result = 0;
+        }
+    }
+    return result;
+}
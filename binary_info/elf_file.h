@@ -0,0 +1,103 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ELF_FILE_H
+#define ELF_FILE_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+typedef struct ELF_FILE_TAG* ELF_FILE_HANDLE;
+
+// Where a section ends up on a device
+typedef enum ELF_SECTION_CLASS_TAG
+{
+    ELF_SECTION_TEXT,
+    ELF_SECTION_RODATA,
+    ELF_SECTION_DATA,
+    ELF_SECTION_BSS,
+    ELF_SECTION_EH_FRAME,
+    ELF_SECTION_RELOCATIONS,
+    ELF_SECTION_DEBUG,
+    ELF_SECTION_SYMBOLS,
+    ELF_SECTION_OTHER
+} ELF_SECTION_CLASS;
+
+// Section bytes grouped by where they end up on a device
+typedef struct ELF_SECTION_SIZES_TAG
+{
+    // Executable code, .text, .init, .plt ...
+    uint64_t text;
+    // Read only data, .rodata, the dynamic symbol tables and notes
+    uint64_t rodata;
+    // Initialized writable data, lives in flash and is copied to ram at startup
+    uint64_t data;
+    // Zero initialized data, only takes ram
+    uint64_t bss;
+    // Unwind tables, .eh_frame, .eh_frame_hdr and .gcc_except_table
+    uint64_t eh_frame;
+    uint64_t relocations;
+    uint64_t debug;
+    // .symtab and .strtab, gone once the binary is stripped
+    uint64_t symbols;
+    // Sections that are not loaded and fit nowhere else, .comment and such
+    uint64_t other;
+} ELF_SECTION_SIZES;
+
+typedef enum ELF_SYMBOL_TYPE_TAG
+{
+    ELF_SYMBOL_FUNCTION,
+    ELF_SYMBOL_OBJECT
+} ELF_SYMBOL_TYPE;
+
+typedef struct ELF_SYMBOL_TAG
+{
+    // Points into the file, valid until the file is closed
+    const char* name;
+    ELF_SYMBOL_TYPE type;
+    uint64_t address;
+    uint64_t size;
+} ELF_SYMBOL;
+
+// Set as the source of the references the image holds itself, the entry point and
+// the init and fini arrays
+#define ELF_REFERENCE_ROOT      ((size_t)-1)
+
+typedef struct ELF_REFERENCE_TAG
+{
+    // Indexes into the symbols returned with the references
+    size_t from;
+    size_t to;
+} ELF_REFERENCE;
+
+// Reads the whole file, NULL when it is missing or not an ELF file
+extern ELF_FILE_HANDLE elf_file_open(const char* path);
+extern void elf_file_close(ELF_FILE_HANDLE handle);
+
+extern size_t elf_file_get_length(ELF_FILE_HANDLE handle);
+extern int elf_file_get_section_sizes(ELF_FILE_HANDLE handle, ELF_SECTION_SIZES* sizes);
+// Fails when the file has no section with that name
+extern int elf_file_get_section_class(ELF_FILE_HANDLE handle, const char* section_name, ELF_SECTION_CLASS* section_class);
+
+// The defined functions and objects with a size, largest first. Statics that share a name
+// across files are merged into one entry. The list is freed with free(), stripped files
+// only have the dynamic symbols.
+extern int elf_file_get_symbols(ELF_FILE_HANDLE handle, ELF_SYMBOL** symbols, size_t* symbol_count);
+
+// The defined functions and objects sorted by address, not merged by name, and which of them
+// references which. This needs the relocations the linker keeps with --emit-relocs, and
+// -ffunction-sections for the calls between the functions of one file. Both lists are
+// freed with free().
+extern int elf_file_get_references(ELF_FILE_HANDLE handle, ELF_SYMBOL** symbols, size_t* symbol_count, ELF_REFERENCE** references, size_t* reference_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ELF_FILE_H
@@ -0,0 +1,486 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "linker_map.h"
+
+#define MAP_LINE_LEN            4096
+#define INITIAL_CONTRIBUTIONS   64
+
+// Everything before this line lists archive members and discarded sections
+static const char* const MEMORY_MAP_START = "Linker script and memory map";
+static const char* const GOLD_MEMORY_MAP_START = "Memory map";
+static const char* const MEMORY_MAP_END = "OUTPUT(";
+static const char* const DISCARD_SECTION = "/DISCARD/";
+static const char* const FILL_ENTRY = "*fill*";
+static const char* const GOLD_FILL_ENTRY = "** fill";
+static const char* const GOLD_ZERO_FILL_ENTRY = "** zero fill";
+static const char* const GOLD_GENERATED_ENTRY = "**";
+
+static const char* const PADDING_LIBRARY = "padding";
+static const char* const LINKER_LIBRARY = "linker";
+static const char* const APPLICATION_LIBRARY = "application";
+static const char* const TLS_LIBRARY = "tls";
+static const char* const LIBC_LIBRARY = "libc";
+
+static const char* const TLS_LIBRARIES[] = { "ssl", "crypto", "wolfssl", "mbedtls", "mbedx509", "mbedcrypto", "bearssl" };
+static const char* const LIBC_LIBRARIES[] = { "c", "c_nonshared", "gcc", "gcc_eh", "m", "pthread", "dl", "rt", "nosys", "stdc++", "supc++" };
+// Output sections ld fills itself, it lists them under the first input file, usually Scrt1.o
+static const char* const LINKER_SECTIONS[] = { ".interp", ".note.gnu.build-id", ".hash", ".gnu.hash", ".dynsym", ".dynstr", ".gnu.version", ".gnu.version_d",
+    ".gnu.version_r", ".rela.dyn", ".rela.plt", ".rel.dyn", ".rel.plt", ".relr.dyn", ".plt", ".plt.got", ".plt.sec", ".iplt", ".got", ".got.plt", ".igot", ".igot.plt",
+    ".dynamic", ".eh_frame_hdr" };
+
+typedef struct MAP_PARSER_TAG
+{
+    LINKER_MAP_CONTRIBUTION* contributions;
+    size_t count;
+    size_t capacity;
+    char section[LINKER_MAP_NAME_LEN];
+    // Merged string sections overlap in the map, only bytes past this are counted
+    uint64_t section_end;
+    // A long input section name is on a line of its own, the numbers follow on the next
+    bool pending_input;
+    bool pending_generated;
+    // Set when the ranges of one object are looked for instead of the library sizes
+    const char* object_name;
+    LINKER_MAP_RANGE* ranges;
+    size_t range_count;
+    size_t range_capacity;
+} MAP_PARSER;
+
+static bool is_in_list(const char* name, const char* const* list, size_t list_count)
+{
+    bool result = false;
+    for (size_t index = 0; index < list_count; index++)
+    {
+        if (strcmp(name, list[index]) == 0)
+        {
+            result = true;
+            break;
+        }
+    }
+    return result;
+}
+
+static void copy_name(char* target, const char* source, size_t source_len, size_t target_len)
+{
+    size_t copy_len = source_len < target_len - 1 ? source_len : target_len - 1;
+    memcpy(target, source, copy_len);
+    target[copy_len] = '\0';
+}
+
+static const char* get_base_name(const char* path, const char* path_end)
+{
+    const char* result = path;
+    for (const char* iterator = path; iterator < path_end; iterator++)
+    {
+        if (*iterator == '/' || *iterator == '\\')
+        {
+            result = iterator + 1;
+        }
+    }
+    return result;
+}
+
+void linker_map_get_library(const char* input_file, char* library, size_t library_len)
+{
+    if (input_file != NULL && library != NULL && library_len > 0)
+    {
+        const char* archive_end = strchr(input_file, '(');
+        if (archive_end != NULL)
+        {
+            // ./deps/libaziotsharedutil.a(xlogging.c.o)
+            const char* name = get_base_name(input_file, archive_end);
+            const char* name_end = archive_end;
+            if (strncmp(name, "lib", 3) == 0)
+            {
+                name += 3;
+            }
+            if (name_end - name > 2 && strncmp(name_end - 2, ".a", 2) == 0)
+            {
+                name_end -= 2;
+            }
+            else if (name_end - name > 4 && strncmp(name_end - 4, ".lib", 4) == 0)
+            {
+                name_end -= 4;
+            }
+            copy_name(library, name, (size_t)(name_end - name), library_len);
+
+            if (is_in_list(library, TLS_LIBRARIES, sizeof(TLS_LIBRARIES) / sizeof(TLS_LIBRARIES[0])))
+            {
+                copy_name(library, TLS_LIBRARY, strlen(TLS_LIBRARY), library_len);
+            }
+            else if (is_in_list(library, LIBC_LIBRARIES, sizeof(LIBC_LIBRARIES) / sizeof(LIBC_LIBRARIES[0])))
+            {
+                copy_name(library, LIBC_LIBRARY, strlen(LIBC_LIBRARY), library_len);
+            }
+        }
+        else
+        {
+            // The startup objects crt1.o, Scrt1.o, crtbegin.o ...
+            const char* name = get_base_name(input_file, input_file + strlen(input_file));
+            const char* crt = strstr(name, "crt");
+            const char* group = (crt != NULL && crt - name <= 2) ? LIBC_LIBRARY : APPLICATION_LIBRARY;
+            copy_name(library, group, strlen(group), library_len);
+        }
+    }
+}
+
+static int add_contribution(MAP_PARSER* parser, const char* library, uint64_t address, uint64_t size)
+{
+    int result = 0;
+    size_t index;
+    uint64_t end;
+    uint64_t start;
+    // ld lists the alignment between two input sections as fill, gold leaves a gap
+    if (parser->section_end != 0 && address > parser->section_end)
+    {
+        result = add_contribution(parser, PADDING_LIBRARY, parser->section_end, address - parser->section_end);
+    }
+    end = address + size;
+    start = address > parser->section_end ? address : parser->section_end;
+    size = end > start ? end - start : 0;
+    if (end > parser->section_end)
+    {
+        parser->section_end = end;
+    }
+
+    for (index = 0; index < parser->count; index++)
+    {
+        if (strcmp(parser->contributions[index].section, parser->section) == 0 && strcmp(parser->contributions[index].library, library) == 0)
+        {
+            break;
+        }
+    }
+
+    if (result == 0 && index == parser->count)
+    {
+        if (parser->count == parser->capacity)
+        {
+            size_t capacity = parser->capacity == 0 ? INITIAL_CONTRIBUTIONS : parser->capacity * 2;
+            LINKER_MAP_CONTRIBUTION* contributions = (LINKER_MAP_CONTRIBUTION*)realloc(parser->contributions, capacity * sizeof(LINKER_MAP_CONTRIBUTION));
+            if (contributions == NULL)
+            {
+                (void)printf("Failure allocating %zu map contributions\r\n", capacity);
+                result = __LINE__;
+            }
+            else
+            {
+                parser->contributions = contributions;
+                parser->capacity = capacity;
+            }
+        }
+        if (result == 0)
+        {
+            memset(&parser->contributions[index], 0, sizeof(LINKER_MAP_CONTRIBUTION));
+            copy_name(parser->contributions[index].section, parser->section, strlen(parser->section), LINKER_MAP_NAME_LEN);
+            copy_name(parser->contributions[index].library, library, strlen(library), LINKER_MAP_NAME_LEN);
+            parser->count++;
+        }
+    }
+    if (result == 0)
+    {
+        parser->contributions[index].size += size;
+    }
+    return result;
+}
+
+static bool is_object_match(const char* input_file, const char* object_name)
+{
+    bool result = false;
+    size_t file_len = strlen(input_file);
+    size_t name_len = strlen(object_name);
+    // An archive member ends with a closing parenthesis
+    if (file_len > 0 && input_file[file_len - 1] == ')')
+    {
+        file_len--;
+    }
+    if (name_len > 0 && file_len >= name_len && strncmp(input_file + file_len - name_len, object_name, name_len) == 0)
+    {
+        char before = file_len == name_len ? '/' : input_file[file_len - name_len - 1];
+        result = before == '/' || before == '\\' || before == '(';
+    }
+    return result;
+}
+
+static int add_range(MAP_PARSER* parser, uint64_t address, uint64_t size)
+{
+    int result = 0;
+    if (parser->range_count == parser->range_capacity)
+    {
+        size_t capacity = parser->range_capacity == 0 ? INITIAL_CONTRIBUTIONS : parser->range_capacity * 2;
+        LINKER_MAP_RANGE* ranges = (LINKER_MAP_RANGE*)realloc(parser->ranges, capacity * sizeof(LINKER_MAP_RANGE));
+        if (ranges == NULL)
+        {
+            (void)printf("Failure allocating %zu map ranges\r\n", capacity);
+            result = __LINE__;
+        }
+        else
+        {
+            parser->ranges = ranges;
+            parser->range_capacity = capacity;
+        }
+    }
+    if (result == 0)
+    {
+        parser->ranges[parser->range_count].address = address;
+        parser->ranges[parser->range_count].size = size;
+        parser->range_count++;
+    }
+    return result;
+}
+
+static int add_input_section(MAP_PARSER* parser, const char* numbers)
+{
+    int result;
+    unsigned long long address;
+    unsigned long long size;
+    char input_file[MAP_LINE_LEN];
+    // Symbol lines have an address and a name but no size
+    if (sscanf(numbers, " 0x%llx 0x%llx %4095[^\r\n]", &address, &size, input_file) != 3 || size == 0 || strcmp(parser->section, DISCARD_SECTION) == 0)
+    {
+        result = 0;
+    }
+    else
+    {
+        char library[LINKER_MAP_NAME_LEN];
+        size_t file_len = strlen(input_file);
+        while (file_len > 0 && input_file[file_len - 1] == ' ')
+        {
+            input_file[--file_len] = '\0';
+        }
+        if (is_in_list(parser->section, LINKER_SECTIONS, sizeof(LINKER_SECTIONS) / sizeof(LINKER_SECTIONS[0])))
+        {
+            // Not part of any object, the same as gold's ** entries
+            result = parser->object_name != NULL ? 0 : add_contribution(parser, LINKER_LIBRARY, (uint64_t)address, (uint64_t)size);
+        }
+        else if (parser->object_name != NULL)
+        {
+            result = is_object_match(input_file, parser->object_name) ? add_range(parser, (uint64_t)address, (uint64_t)size) : 0;
+        }
+        else
+        {
+            linker_map_get_library(input_file, library, sizeof(library));
+            result = add_contribution(parser, library, (uint64_t)address, (uint64_t)size);
+        }
+    }
+    return result;
+}
+
+// ld writes the padding as *fill* and gold as ** fill, the numbers follow
+static const char* get_fill_numbers(const char* line)
+{
+    const char* result;
+    const char* entry = line + strspn(line, " \t");
+    if (strncmp(entry, FILL_ENTRY, strlen(FILL_ENTRY)) == 0)
+    {
+        result = entry + strlen(FILL_ENTRY);
+    }
+    else if (strncmp(entry, GOLD_FILL_ENTRY, strlen(GOLD_FILL_ENTRY)) == 0)
+    {
+        result = entry + strlen(GOLD_FILL_ENTRY);
+    }
+    else if (strncmp(entry, GOLD_ZERO_FILL_ENTRY, strlen(GOLD_ZERO_FILL_ENTRY)) == 0)
+    {
+        result = entry + strlen(GOLD_ZERO_FILL_ENTRY);
+    }
+    else
+    {
+        result = NULL;
+    }
+    return result;
+}
+
+// gold lists what it generates itself, the GOT, PLT or merged strings, without an input file
+static int add_generated_section(MAP_PARSER* parser, const char* numbers)
+{
+    int result;
+    unsigned long long address;
+    unsigned long long size;
+    if (parser->object_name != NULL || sscanf(numbers, " 0x%llx 0x%llx", &address, &size) != 2 || size == 0)
+    {
+        result = 0;
+    }
+    else
+    {
+        result = add_contribution(parser, LINKER_LIBRARY, (uint64_t)address, (uint64_t)size);
+    }
+    return result;
+}
+
+static int parse_line(MAP_PARSER* parser, const char* line)
+{
+    int result = 0;
+    const char* fill_numbers;
+    bool pending_input = parser->pending_input;
+    bool pending_generated = parser->pending_generated;
+    parser->pending_input = false;
+    parser->pending_generated = false;
+    if (line[0] != ' ' && line[0] != '\r' && line[0] != '\n')
+    {
+        // Output sections start in the first column
+        size_t name_len = strcspn(line, " \t\r\n");
+        copy_name(parser->section, line, name_len, LINKER_MAP_NAME_LEN);
+        parser->section_end = 0;
+    }
+    else
+    {
+        char first[MAP_LINE_LEN];
+        int name_end = 0;
+        if (sscanf(line, " %4095s%n", first, &name_end) != 1)
+        {
+            // Empty line
+        }
+        else if ((fill_numbers = get_fill_numbers(line)) != NULL)
+        {
+            unsigned long long address;
+            unsigned long long size;
+            if (parser->object_name == NULL && sscanf(fill_numbers, " 0x%llx 0x%llx", &address, &size) == 2 && size > 0 && strcmp(parser->section, DISCARD_SECTION) != 0)
+            {
+                result = add_contribution(parser, PADDING_LIBRARY, (uint64_t)address, (uint64_t)size);
+            }
+        }
+        else if (strcmp(first, GOLD_GENERATED_ENTRY) == 0)
+        {
+            // The name is more than one word, ** merge strings, the numbers follow it or the next line
+            const char* numbers = strstr(line, " 0x");
+            if (numbers == NULL)
+            {
+                parser->pending_generated = true;
+            }
+            else
+            {
+                result = add_generated_section(parser, numbers);
+            }
+        }
+        else if (first[0] != '*' && first[0] != '[' && strncmp(first, "0x", 2) != 0)
+        {
+            // .text.foo, COMMON or a section without the dot like __libc_freeres_fn
+            // The numbers are on the next line when the name is too long
+            if (sscanf(line + name_end, " %4095s", first) != 1)
+            {
+                parser->pending_input = true;
+            }
+            else
+            {
+                result = add_input_section(parser, line + name_end);
+            }
+        }
+        else if (pending_input && strncmp(first, "0x", 2) == 0)
+        {
+            result = add_input_section(parser, line);
+        }
+        else if (pending_generated && strncmp(first, "0x", 2) == 0)
+        {
+            result = add_generated_section(parser, line);
+        }
+        else
+        {
+            // Patterns of the linker script, symbols and assignments
+        }
+    }
+    return result;
+}
+
+static int parse_map(const char* map_path, MAP_PARSER* parser)
+{
+    int result;
+    FILE* map_file;
+    if ((map_file = fopen(map_path, "r")) == NULL)
+    {
+        (void)printf("Failure opening linker map %s\r\n", map_path);
+        result = __LINE__;
+    }
+    else
+    {
+        char line[MAP_LINE_LEN];
+        bool in_memory_map = false;
+        bool line_complete = true;
+
+        result = 0;
+        while (result == 0 && fgets(line, sizeof(line), map_file) != NULL)
+        {
+            // Skip the rest of a line longer than the buffer, no section is that long
+            bool skip = !line_complete;
+            line_complete = strchr(line, '\n') != NULL;
+            if (skip || !line_complete)
+            {
+                continue;
+            }
+            else if (!in_memory_map)
+            {
+                // gold has no linker script part, its map simply ends after the last section
+                in_memory_map = strncmp(line, MEMORY_MAP_START, strlen(MEMORY_MAP_START)) == 0 ||
+                    strncmp(line, GOLD_MEMORY_MAP_START, strlen(GOLD_MEMORY_MAP_START)) == 0;
+            }
+            else if (strncmp(line, MEMORY_MAP_END, strlen(MEMORY_MAP_END)) == 0)
+            {
+                break;
+            }
+            else
+            {
+                result = parse_line(parser, line);
+            }
+        }
+        (void)fclose(map_file);
+
+        if (result == 0 && !in_memory_map)
+        {
+            (void)printf("Failure %s is not a GNU ld or gold map\r\n", map_path);
+            result = __LINE__;
+        }
+    }
+    return result;
+}
+
+int linker_map_read(const char* map_path, LINKER_MAP_CONTRIBUTION** contributions, size_t* contribution_count)
+{
+    int result;
+    if (map_path == NULL || contributions == NULL || contribution_count == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        MAP_PARSER parser;
+        memset(&parser, 0, sizeof(parser));
+        if ((result = parse_map(map_path, &parser)) != 0)
+        {
+            free(parser.contributions);
+        }
+        else
+        {
+            *contributions = parser.contributions;
+            *contribution_count = parser.count;
+        }
+    }
+    return result;
+}
+
+int linker_map_find_object(const char* map_path, const char* object_name, LINKER_MAP_RANGE** ranges, size_t* range_count)
+{
+    int result;
+    if (map_path == NULL || object_name == NULL || ranges == NULL || range_count == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        MAP_PARSER parser;
+        memset(&parser, 0, sizeof(parser));
+        parser.object_name = object_name;
+        if ((result = parse_map(map_path, &parser)) != 0)
+        {
+            free(parser.ranges);
+        }
+        else
+        {
+            *ranges = parser.ranges;
+            *range_count = parser.range_count;
+        }
+    }
+    return result;
+}
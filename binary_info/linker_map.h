@@ -0,0 +1,50 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef LINKER_MAP_H
+#define LINKER_MAP_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#define LINKER_MAP_NAME_LEN     64
+
+typedef struct LINKER_MAP_CONTRIBUTION_TAG
+{
+    // Output section in the final image, .text, .rodata ...
+    char section[LINKER_MAP_NAME_LEN];
+    // Library the input sections came from, see linker_map_get_library
+    char library[LINKER_MAP_NAME_LEN];
+    uint64_t size;
+} LINKER_MAP_CONTRIBUTION;
+
+typedef struct LINKER_MAP_RANGE_TAG
+{
+    uint64_t address;
+    uint64_t size;
+} LINKER_MAP_RANGE;
+
+// Reads a GNU ld or gold map written with -Wl,-Map and sums the input sections per output
+// section and library. The list is freed with free().
+extern int linker_map_read(const char* map_path, LINKER_MAP_CONTRIBUTION** contributions, size_t* contribution_count);
+
+// The address ranges an object file was placed at. The name is matched against the end of
+// the input file, mqtt_client.c.o finds libumqtt.a(mqtt_client.c.o). The list is freed with free().
+extern int linker_map_find_object(const char* map_path, const char* object_name, LINKER_MAP_RANGE** ranges, size_t* range_count);
+
+// Names the library an input file of the map belongs to. Archives are named after the
+// archive without the lib prefix, the tls libraries and the c runtime are grouped as
+// tls and libc and objects linked directly are the application's own.
+extern void linker_map_get_library(const char* input_file, char* library, size_t library_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LINKER_MAP_H
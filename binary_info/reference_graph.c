@@ -0,0 +1,263 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reference_graph.h"
+
+#define NO_SYMBOL               ((size_t)-1)
+
+static const char* const MAIN_SYMBOL = "main";
+
+typedef struct REFERENCE_GRAPH_TAG
+{
+    const ELF_SYMBOL* symbols;
+    size_t symbol_count;
+    // Compressed rows, the references of symbol n are targets[first[n]] up to targets[first[n + 1]]
+    size_t* first;
+    size_t* targets;
+    size_t* roots;
+    size_t root_count;
+    size_t main_symbol;
+    // Scratch space for the walks
+    size_t* queue;
+    size_t* parent;
+    bool* visited;
+} REFERENCE_GRAPH;
+
+static void free_graph(REFERENCE_GRAPH* graph)
+{
+    free(graph->first);
+    free(graph->targets);
+    free(graph->roots);
+    free(graph->queue);
+    free(graph->parent);
+    free(graph->visited);
+    free(graph);
+}
+
+// Walks from the roots, never entering a blocked symbol or following the cut reference
+static uint64_t get_reachable_bytes(REFERENCE_GRAPH* graph, size_t cut_from, size_t cut_to, const bool* blocked)
+{
+    uint64_t result = 0;
+    size_t head = 0;
+    size_t tail = 0;
+    memset(graph->visited, 0, graph->symbol_count * sizeof(bool));
+    for (size_t index = 0; index < graph->root_count; index++)
+    {
+        size_t root = graph->roots[index];
+        if (!graph->visited[root] && (blocked == NULL || !blocked[root]))
+        {
+            graph->visited[root] = true;
+            graph->queue[tail++] = root;
+        }
+    }
+    while (head < tail)
+    {
+        size_t current = graph->queue[head++];
+        result += graph->symbols[current].size;
+        for (size_t index = graph->first[current]; index < graph->first[current + 1]; index++)
+        {
+            size_t next = graph->targets[index];
+            if (!graph->visited[next] && (blocked == NULL || !blocked[next]) && !(current == cut_from && next == cut_to))
+            {
+                graph->visited[next] = true;
+                graph->queue[tail++] = next;
+            }
+        }
+    }
+    return result;
+}
+
+static size_t search_chain(REFERENCE_GRAPH* graph, const size_t* starts, size_t start_count, const bool* is_target)
+{
+    size_t result = NO_SYMBOL;
+    size_t head = 0;
+    size_t tail = 0;
+    memset(graph->visited, 0, graph->symbol_count * sizeof(bool));
+    for (size_t index = 0; index < start_count; index++)
+    {
+        if (!graph->visited[starts[index]])
+        {
+            graph->visited[starts[index]] = true;
+            graph->parent[starts[index]] = NO_SYMBOL;
+            graph->queue[tail++] = starts[index];
+        }
+    }
+    // Breadth first, the first target found is one of the closest
+    while (head < tail && result == NO_SYMBOL)
+    {
+        size_t current = graph->queue[head++];
+        if (is_target[current])
+        {
+            result = current;
+        }
+        else
+        {
+            for (size_t index = graph->first[current]; index < graph->first[current + 1]; index++)
+            {
+                size_t next = graph->targets[index];
+                if (!graph->visited[next])
+                {
+                    graph->visited[next] = true;
+                    graph->parent[next] = current;
+                    graph->queue[tail++] = next;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+REFERENCE_GRAPH_HANDLE reference_graph_create(const ELF_SYMBOL* symbols, size_t symbol_count, const ELF_REFERENCE* references, size_t reference_count)
+{
+    REFERENCE_GRAPH* result;
+    if (symbols == NULL || (references == NULL && reference_count > 0))
+    {
+        result = NULL;
+    }
+    else if ((result = (REFERENCE_GRAPH*)calloc(1, sizeof(REFERENCE_GRAPH))) == NULL)
+    {
+        (void)printf("Failure allocating reference graph\r\n");
+    }
+    else if ((result->first = (size_t*)calloc(symbol_count + 1, sizeof(size_t))) == NULL ||
+        (result->targets = (size_t*)malloc((reference_count + 1) * sizeof(size_t))) == NULL ||
+        (result->roots = (size_t*)malloc((reference_count + 2) * sizeof(size_t))) == NULL ||
+        (result->queue = (size_t*)malloc((symbol_count + 1) * sizeof(size_t))) == NULL ||
+        (result->parent = (size_t*)malloc((symbol_count + 1) * sizeof(size_t))) == NULL ||
+        (result->visited = (bool*)malloc((symbol_count + 1) * sizeof(bool))) == NULL)
+    {
+        (void)printf("Failure allocating reference graph for %zu symbols\r\n", symbol_count);
+        free_graph(result);
+        result = NULL;
+    }
+    else
+    {
+        size_t reference_index = 0;
+        result->symbols = symbols;
+        result->symbol_count = symbol_count;
+        result->main_symbol = NO_SYMBOL;
+        for (size_t index = 0; index < symbol_count; index++)
+        {
+            if (symbols[index].type == ELF_SYMBOL_FUNCTION && strcmp(symbols[index].name, MAIN_SYMBOL) == 0)
+            {
+                result->main_symbol = index;
+            }
+        }
+        // main is a root as well in case the entry point has no symbol
+        if (result->main_symbol != NO_SYMBOL)
+        {
+            result->roots[result->root_count++] = result->main_symbol;
+        }
+
+        // The references come sorted by source with the roots last
+        for (size_t index = 0; index < symbol_count; index++)
+        {
+            result->first[index] = reference_index;
+            while (reference_index < reference_count && references[reference_index].from == index)
+            {
+                result->targets[reference_index] = references[reference_index].to;
+                reference_index++;
+            }
+        }
+        result->first[symbol_count] = reference_index;
+        for (; reference_index < reference_count; reference_index++)
+        {
+            if (references[reference_index].from == ELF_REFERENCE_ROOT)
+            {
+                result->roots[result->root_count++] = references[reference_index].to;
+            }
+        }
+    }
+    return result;
+}
+
+void reference_graph_destroy(REFERENCE_GRAPH_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        free_graph(handle);
+    }
+}
+
+int reference_graph_find_chain(REFERENCE_GRAPH_HANDLE handle, const bool* is_target, size_t** chain, size_t* chain_len)
+{
+    int result;
+    if (handle == NULL || is_target == NULL || chain == NULL || chain_len == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        size_t found = NO_SYMBOL;
+        if (handle->main_symbol != NO_SYMBOL)
+        {
+            found = search_chain(handle, &handle->main_symbol, 1, is_target);
+        }
+        if (found == NO_SYMBOL)
+        {
+            found = search_chain(handle, handle->roots, handle->root_count, is_target);
+        }
+
+        if (found == NO_SYMBOL)
+        {
+            // Nothing references it, the linker kept it anyway
+            result = __LINE__;
+        }
+        else
+        {
+            size_t length = 0;
+            for (size_t current = found; current != NO_SYMBOL; current = handle->parent[current])
+            {
+                length++;
+            }
+            if ((*chain = (size_t*)malloc(length * sizeof(size_t))) == NULL)
+            {
+                (void)printf("Failure allocating reference chain\r\n");
+                result = __LINE__;
+            }
+            else
+            {
+                size_t position = length;
+                for (size_t current = found; current != NO_SYMBOL; current = handle->parent[current])
+                {
+                    (*chain)[--position] = current;
+                }
+                *chain_len = length;
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
+
+uint64_t reference_graph_get_cut_bytes(REFERENCE_GRAPH_HANDLE handle, size_t from, size_t to)
+{
+    uint64_t result;
+    if (handle == NULL || from >= handle->symbol_count || to >= handle->symbol_count)
+    {
+        result = 0;
+    }
+    else
+    {
+        uint64_t all_bytes = get_reachable_bytes(handle, NO_SYMBOL, NO_SYMBOL, NULL);
+        result = all_bytes - get_reachable_bytes(handle, from, to, NULL);
+    }
+    return result;
+}
+
+uint64_t reference_graph_get_retained_bytes(REFERENCE_GRAPH_HANDLE handle, const bool* is_target)
+{
+    uint64_t result;
+    if (handle == NULL || is_target == NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        uint64_t all_bytes = get_reachable_bytes(handle, NO_SYMBOL, NO_SYMBOL, NULL);
+        result = all_bytes - get_reachable_bytes(handle, NO_SYMBOL, NO_SYMBOL, is_target);
+    }
+    return result;
+}
@@ -0,0 +1,40 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef REFERENCE_GRAPH_H
+#define REFERENCE_GRAPH_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#include "elf_file.h"
+
+typedef struct REFERENCE_GRAPH_TAG* REFERENCE_GRAPH_HANDLE;
+
+// The lists come from elf_file_get_references and have to outlive the graph
+extern REFERENCE_GRAPH_HANDLE reference_graph_create(const ELF_SYMBOL* symbols, size_t symbol_count, const ELF_REFERENCE* references, size_t reference_count);
+extern void reference_graph_destroy(REFERENCE_GRAPH_HANDLE handle);
+
+// Shortest chain of references from main to any symbol flagged in is_target, or from the
+// entry point and init arrays when main does not reach it. The chain holds symbol indexes
+// starting with the first symbol and is freed with free().
+extern int reference_graph_find_chain(REFERENCE_GRAPH_HANDLE handle, const bool* is_target, size_t** chain, size_t* chain_len);
+
+// Bytes that are no longer reachable once the reference from -> to is gone
+extern uint64_t reference_graph_get_cut_bytes(REFERENCE_GRAPH_HANDLE handle, size_t from, size_t to);
+
+// Bytes that are only reachable through the flagged symbols, themselves included
+extern uint64_t reference_graph_get_retained_bytes(REFERENCE_GRAPH_HANDLE handle, const bool* is_target);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REFERENCE_GRAPH_H
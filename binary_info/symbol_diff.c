@@ -0,0 +1,140 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbol_diff.h"
+
+static int compare_symbol_name(const void* left, const void* right)
+{
+    return strcmp(((const ELF_SYMBOL*)left)->name, ((const ELF_SYMBOL*)right)->name);
+}
+
+static int compare_delta(const void* left, const void* right)
+{
+    int result;
+    const SYMBOL_DELTA* left_delta = (const SYMBOL_DELTA*)left;
+    const SYMBOL_DELTA* right_delta = (const SYMBOL_DELTA*)right;
+    int64_t left_bytes = left_delta->delta < 0 ? -left_delta->delta : left_delta->delta;
+    int64_t right_bytes = right_delta->delta < 0 ? -right_delta->delta : right_delta->delta;
+    if (left_bytes != right_bytes)
+    {
+        result = left_bytes > right_bytes ? -1 : 1;
+    }
+    else
+    {
+        result = strcmp(left_delta->name, right_delta->name);
+    }
+    return result;
+}
+
+static void add_delta(SYMBOL_DELTA* deltas, size_t* delta_count, SYMBOL_DIFF_SUMMARY* summary, const char* name, SYMBOL_CHANGE change, int64_t delta)
+{
+    deltas[*delta_count].name = name;
+    deltas[*delta_count].change = change;
+    deltas[*delta_count].delta = delta;
+    (*delta_count)++;
+    summary->count[change]++;
+    summary->bytes[change] += delta;
+}
+
+static ELF_SYMBOL* copy_by_name(const ELF_SYMBOL* symbols, size_t count)
+{
+    // Always allocate something, an empty build is still a valid baseline
+    ELF_SYMBOL* result = (ELF_SYMBOL*)malloc((count + 1) * sizeof(ELF_SYMBOL));
+    if (result == NULL)
+    {
+        (void)printf("Failure allocating %zu symbols\r\n", count);
+    }
+    else if (count > 0)
+    {
+        memcpy(result, symbols, count * sizeof(ELF_SYMBOL));
+        qsort(result, count, sizeof(ELF_SYMBOL), compare_symbol_name);
+    }
+    return result;
+}
+
+int symbol_diff_compare(const ELF_SYMBOL* baseline, size_t baseline_count, const ELF_SYMBOL* current, size_t current_count,
+    SYMBOL_DELTA** deltas, size_t* delta_count, SYMBOL_DIFF_SUMMARY* summary)
+{
+    int result;
+    if ((baseline == NULL && baseline_count > 0) || (current == NULL && current_count > 0) || deltas == NULL || delta_count == NULL || summary == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        ELF_SYMBOL* baseline_names;
+        ELF_SYMBOL* current_names;
+        memset(summary, 0, sizeof(SYMBOL_DIFF_SUMMARY));
+        *delta_count = 0;
+        if ((baseline_names = copy_by_name(baseline, baseline_count)) == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            if ((current_names = copy_by_name(current, current_count)) == NULL)
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                if ((*deltas = (SYMBOL_DELTA*)malloc((baseline_count + current_count + 1) * sizeof(SYMBOL_DELTA))) == NULL)
+                {
+                    (void)printf("Failure allocating symbol deltas\r\n");
+                    result = __LINE__;
+                }
+                else
+                {
+                    size_t baseline_index = 0;
+                    size_t current_index = 0;
+                    // Both lists are sorted by name, walk them side by side
+                    while (baseline_index < baseline_count || current_index < current_count)
+                    {
+                        int order;
+                        if (baseline_index == baseline_count)
+                        {
+                            order = 1;
+                        }
+                        else if (current_index == current_count)
+                        {
+                            order = -1;
+                        }
+                        else
+                        {
+                            order = strcmp(baseline_names[baseline_index].name, current_names[current_index].name);
+                        }
+
+                        if (order < 0)
+                        {
+                            add_delta(*deltas, delta_count, summary, baseline_names[baseline_index].name, SYMBOL_CHANGE_REMOVED, -(int64_t)baseline_names[baseline_index].size);
+                            baseline_index++;
+                        }
+                        else if (order > 0)
+                        {
+                            add_delta(*deltas, delta_count, summary, current_names[current_index].name, SYMBOL_CHANGE_ADDED, (int64_t)current_names[current_index].size);
+                            current_index++;
+                        }
+                        else
+                        {
+                            int64_t delta = (int64_t)current_names[current_index].size - (int64_t)baseline_names[baseline_index].size;
+                            if (delta != 0)
+                            {
+                                add_delta(*deltas, delta_count, summary, current_names[current_index].name, delta > 0 ? SYMBOL_CHANGE_GROWN : SYMBOL_CHANGE_SHRUNK, delta);
+                            }
+                            baseline_index++;
+                            current_index++;
+                        }
+                    }
+                    qsort(*deltas, *delta_count, sizeof(SYMBOL_DELTA), compare_delta);
+                    result = 0;
+                }
+                free(current_names);
+            }
+            free(baseline_names);
+        }
+    }
+    return result;
+}
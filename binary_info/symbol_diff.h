@@ -0,0 +1,51 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef SYMBOL_DIFF_H
+#define SYMBOL_DIFF_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#include "elf_file.h"
+
+typedef enum SYMBOL_CHANGE_TAG
+{
+    SYMBOL_CHANGE_ADDED,
+    SYMBOL_CHANGE_REMOVED,
+    SYMBOL_CHANGE_GROWN,
+    SYMBOL_CHANGE_SHRUNK,
+    SYMBOL_CHANGE_COUNT
+} SYMBOL_CHANGE;
+
+typedef struct SYMBOL_DELTA_TAG
+{
+    // Points into whichever build still has the symbol
+    const char* name;
+    SYMBOL_CHANGE change;
+    // Bytes the current build has over the baseline, negative when it got smaller
+    int64_t delta;
+} SYMBOL_DELTA;
+
+typedef struct SYMBOL_DIFF_SUMMARY_TAG
+{
+    size_t count[SYMBOL_CHANGE_COUNT];
+    int64_t bytes[SYMBOL_CHANGE_COUNT];
+} SYMBOL_DIFF_SUMMARY;
+
+// Compares two symbol lists from elf_file_get_symbols by name. The deltas come back with
+// the largest change first and are freed with free().
+extern int symbol_diff_compare(const ELF_SYMBOL* baseline, size_t baseline_count, const ELF_SYMBOL* current, size_t current_count,
+    SYMBOL_DELTA** deltas, size_t* delta_count, SYMBOL_DIFF_SUMMARY* summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SYMBOL_DIFF_H
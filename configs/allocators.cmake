@@ -0,0 +1,87 @@
+#Copyright (c) Microsoft. All rights reserved.
+#Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Selects the malloc implementation the analysis executables are linked against.
+# The allocator sources are cloned into deps/ the same way as the c-sdk.
+set(analysis_allocator "glibc" CACHE STRING "malloc implementation to link the analysis apps with (glibc, jemalloc, mimalloc, tlsf)")
+set_property(CACHE analysis_allocator PROPERTY STRINGS glibc jemalloc mimalloc tlsf)
+
+set(jemalloc_repo_uri "https://github.com/jemalloc/jemalloc.git" CACHE STRING "The jemalloc repo")
+set(jemalloc_branch "5.3.0" CACHE STRING "The jemalloc tag to build")
+set(mimalloc_repo_uri "https://github.com/microsoft/mimalloc.git" CACHE STRING "The mimalloc repo")
+set(mimalloc_branch "v2.1.7" CACHE STRING "The mimalloc tag to build")
+set(tlsf_repo_uri "https://github.com/mattconte/tlsf.git" CACHE STRING "The tlsf repo")
+# tlsf has no release tags, build a fixed commit of master
+set(tlsf_branch "deff9ab509341f264addbd3c8ada533678591905" CACHE STRING "The tlsf commit to build")
+
+if (NOT ${analysis_allocator} STREQUAL "glibc")
+    if (WIN32 OR APPLE)
+        message(FATAL_ERROR "analysis_allocator ${analysis_allocator} is only supported on linux")
+    endif()
+
+    set(ALLOCATOR_WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}/deps/${analysis_allocator}")
+    set(ALLOCATOR_REPO_URI ${${analysis_allocator}_repo_uri})
+    set(ALLOCATOR_BRANCH ${${analysis_allocator}_branch})
+    if (NOT ALLOCATOR_REPO_URI)
+        message(FATAL_ERROR "Unknown analysis_allocator ${analysis_allocator}")
+    endif()
+
+    if (NOT EXISTS "${ALLOCATOR_WORKING_DIRECTORY}/.git")
+        message("running git clone of ${analysis_allocator} into ${ALLOCATOR_WORKING_DIRECTORY}")
+        # Cloned without a branch so ALLOCATOR_BRANCH can be a tag or a commit
+        execute_process (COMMAND git clone ${ALLOCATOR_REPO_URI} -q --no-checkout ${ALLOCATOR_WORKING_DIRECTORY})
+        execute_process (COMMAND git -C ${ALLOCATOR_WORKING_DIRECTORY} checkout -q ${ALLOCATOR_BRANCH} RESULT_VARIABLE ALLOCATOR_CHECKOUT_RESULT)
+        if (NOT ${ALLOCATOR_CHECKOUT_RESULT} EQUAL 0)
+            message(FATAL_ERROR "Failed checking out ${ALLOCATOR_BRANCH} of ${analysis_allocator}")
+        endif()
+    endif()
+endif()
+
+if (${analysis_allocator} STREQUAL "jemalloc")
+    set(JEMALLOC_BUILD_DIR ${CMAKE_CURRENT_BINARY_DIR}/jemalloc)
+    ExternalProject_Add(jemalloc_build
+        SOURCE_DIR ${ALLOCATOR_WORKING_DIRECTORY}
+        BINARY_DIR ${JEMALLOC_BUILD_DIR}
+        # autogen.sh would run configure in the source dir, generate the script
+        # there and configure out of tree so the build stays in the binary dir
+        CONFIGURE_COMMAND ${CMAKE_COMMAND} -E chdir <SOURCE_DIR> autoconf
+            COMMAND <SOURCE_DIR>/configure --disable-shared --disable-doc --disable-stats --prefix=${JEMALLOC_BUILD_DIR}/install
+        BUILD_COMMAND make -j build_lib_static
+        INSTALL_COMMAND ""
+        BUILD_BYPRODUCTS ${JEMALLOC_BUILD_DIR}/lib/libjemalloc.a
+    )
+    set(ALLOCATOR_TARGET jemalloc_build)
+    set(ALLOCATOR_LIBRARY ${JEMALLOC_BUILD_DIR}/lib/libjemalloc.a)
+    set(ALLOCATOR_SYSTEM_LIBS pthread dl m)
+elseif (${analysis_allocator} STREQUAL "mimalloc")
+    set(MI_OVERRIDE ON CACHE BOOL "" FORCE)
+    set(MI_BUILD_SHARED OFF CACHE BOOL "" FORCE)
+    set(MI_BUILD_OBJECT OFF CACHE BOOL "" FORCE)
+    set(MI_BUILD_TESTS OFF CACHE BOOL "" FORCE)
+    add_subdirectory(${ALLOCATOR_WORKING_DIRECTORY} ${CMAKE_CURRENT_BINARY_DIR}/mimalloc)
+    set(ALLOCATOR_TARGET mimalloc-static)
+    set(ALLOCATOR_LIBRARY $<TARGET_FILE:mimalloc-static>)
+    set(ALLOCATOR_SYSTEM_LIBS pthread)
+elseif (${analysis_allocator} STREQUAL "tlsf")
+    add_library(analysis_allocator_lib STATIC
+        ${ALLOCATOR_WORKING_DIRECTORY}/tlsf.c
+        ${CMAKE_CURRENT_SOURCE_DIR}/memory/allocators/tlsf_malloc.c
+    )
+    target_include_directories(analysis_allocator_lib PRIVATE ${ALLOCATOR_WORKING_DIRECTORY})
+    set(ALLOCATOR_TARGET analysis_allocator_lib)
+    set(ALLOCATOR_LIBRARY $<TARGET_FILE:analysis_allocator_lib>)
+    set(ALLOCATOR_SYSTEM_LIBS pthread)
+elseif (NOT ${analysis_allocator} STREQUAL "glibc")
+    message(FATAL_ERROR "Unknown analysis_allocator ${analysis_allocator}")
+endif()
+
+add_definitions(-DANALYSIS_ALLOCATOR="${analysis_allocator}")
+
+# Links the selected allocator into an executable, whole-archive so the malloc
+# family is resolved from it instead of libc
+function(link_analysis_allocator whatIsBuilding)
+    if (NOT ${analysis_allocator} STREQUAL "glibc")
+        target_link_libraries(${whatIsBuilding} -Wl,--whole-archive ${ALLOCATOR_LIBRARY} -Wl,--no-whole-archive ${ALLOCATOR_SYSTEM_LIBS})
+        add_dependencies(${whatIsBuilding} ${ALLOCATOR_TARGET})
+    endif()
+endfunction(link_analysis_allocator)
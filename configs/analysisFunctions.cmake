@@ -5,3 +5,47 @@ function(add_analytic_directory whatIsBuilding folder_name)
     add_subdirectory(${whatIsBuilding})
     set_target_properties(${whatIsBuilding} PROPERTIES FOLDER ${folder_name})
 endfunction(add_analytic_directory)
+
+# Route the sdk's gballoc calls through memory/alloc_tracker.c so the usable
+# size of every allocation can be recorded, and the malloc family so the
+# allocator latency excludes gballoc itself. Requires a linker with --wrap.
+function(add_alloc_tracker whatIsBuilding)
+    if (NOT WIN32 AND NOT APPLE)
+        target_compile_definitions(${whatIsBuilding} PRIVATE USE_ALLOC_TRACKER)
+        target_link_libraries(${whatIsBuilding} "-Wl,--wrap=gballoc_malloc,--wrap=gballoc_calloc,--wrap=gballoc_realloc,--wrap=gballoc_free,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free" pthread)
+    endif()
+endfunction(add_alloc_tracker)
+
+# Route the sdk's gbnetwork send and recv calls through network/net_tracker.c so
+# every packet can be recorded on a timeline, and decorate the default tlsio with
+# network/net_overhead.c to see the plaintext protocol. Requires a linker with --wrap.
+function(add_net_tracker whatIsBuilding)
+    if (NOT WIN32 AND NOT APPLE)
+        target_compile_definitions(${whatIsBuilding} PRIVATE USE_NET_TRACKER)
+        target_link_libraries(${whatIsBuilding} "-Wl,--wrap=gbnetwork_send,--wrap=gbnetwork_recv,--wrap=platform_get_default_tlsio")
+    endif()
+endfunction(add_net_tracker)
+
+# Route the sdk's tickcounter_get_current_ms and get_time calls through sim_clock.c
+# so idle periods can be simulated faster than real time. Requires a linker with --wrap.
+function(add_sim_clock whatIsBuilding)
+    if (NOT WIN32 AND NOT APPLE)
+        target_compile_definitions(${whatIsBuilding} PRIVATE USE_SIM_CLOCK)
+        target_link_libraries(${whatIsBuilding} "-Wl,--wrap=tickcounter_get_current_ms,--wrap=get_time")
+    endif()
+endfunction(add_sim_clock)
+
+# Have the linker write <target>.map next to the executable so binary_info can
+# attribute the image to the libraries it was linked from. With use_why_linked the
+# relocations are kept too so binary_info -w can tell which reference pulled a symbol
+# in, they are not loaded and do not add to the flash size. Requires GNU ld or gold.
+function(add_linker_map whatIsBuilding)
+    if (NOT WIN32 AND NOT APPLE)
+        if (${use_why_linked} AND NOT ${use_gold} AND NOT ${use_icf})
+            target_link_libraries(${whatIsBuilding} "-Wl,-Map=${CMAKE_CURRENT_BINARY_DIR}/${whatIsBuilding}.map,--emit-relocs")
+        else()
+            # gold cannot lay out the image with --emit-relocs, binary_info -w needs ld
+            target_link_libraries(${whatIsBuilding} "-Wl,-Map=${CMAKE_CURRENT_BINARY_DIR}/${whatIsBuilding}.map")
+        endif()
+    endif()
+endfunction(add_linker_map)
@@ -0,0 +1,123 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef PROXY_SERVER_H
+#define PROXY_SERVER_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#define PROXY_DEFAULT_CONNECT_PORT  8888
+#define PROXY_DEFAULT_CONTROL_PORT  8891
+#define PROXY_MAX_FORWARDS          4
+#define PROXY_MAX_PORT_MAPS         4
+#define PROXY_HOST_LEN              256
+#define PROXY_DEFAULT_BIND_ADDRESS  "127.0.0.1"
+
+typedef struct PROXY_SERVER_TAG* PROXY_SERVER_HANDLE;
+
+// What happens to a tunnel once the fault triggers
+typedef enum PROXY_FAULT_TAG
+{
+    PROXY_FAULT_NONE,
+    // Both sides are closed, the device sees an orderly tcp close
+    PROXY_FAULT_DROP,
+    // The device side is reset, the device sees ECONNRESET
+    PROXY_FAULT_RESET,
+    // Nothing is forwarded anymore but the sockets stay open, only timeouts notice
+    PROXY_FAULT_BLACKHOLE,
+    // A fatal tls alert is written to the device before both sides are closed
+    PROXY_FAULT_TLS_ALERT,
+    PROXY_FAULT_COUNT
+} PROXY_FAULT;
+
+// Shaping applied to every tunnel, modeled on the links the devices are deployed on.
+// Every byte is held for half the rtt plus jitter and serialized at the bandwidth of
+// its direction. A tcp stream can not lose bytes, so a lost segment is delayed by a
+// retransmission timeout instead and holds back everything behind it.
+typedef struct PROXY_LINK_TAG
+{
+    const char* name;
+    uint32_t rtt_ms;
+    uint32_t jitter_ms;
+    // kbit/s towards the hub and towards the device, 0 is not limited
+    uint32_t up_kbps;
+    uint32_t down_kbps;
+    // Segments in 10000 that need a retransmission
+    uint32_t loss_per_10k;
+} PROXY_LINK;
+
+// Raw tcp forward, used for the transports that can not go through an http proxy
+typedef struct PROXY_FORWARD_TAG
+{
+    uint16_t listen_port;
+    char target_host[PROXY_HOST_LEN];
+    uint16_t target_port;
+} PROXY_FORWARD;
+
+// CONNECT requests for requested_port go to target_port on the same host. The sdk's
+// websocket and http transports always ask for 443, a local hub without root listens
+// on another port.
+typedef struct PROXY_PORT_MAP_TAG
+{
+    uint16_t requested_port;
+    uint16_t target_port;
+} PROXY_PORT_MAP;
+
+typedef struct PROXY_CONFIG_TAG
+{
+    // IPv4 address every listener binds to, the CONNECT port forwards anywhere so it
+    // stays on loopback unless another address is given
+    const char* bind_address;
+    // HTTP CONNECT listener for the sdk's OPTION_HTTP_PROXY, 0 disables it
+    uint16_t connect_port;
+    uint16_t control_port;
+    PROXY_FORWARD forwards[PROXY_MAX_FORWARDS];
+    size_t forward_count;
+    PROXY_PORT_MAP port_maps[PROXY_MAX_PORT_MAPS];
+    size_t port_map_count;
+    // NULL starts without shaping
+    const PROXY_LINK* link;
+} PROXY_CONFIG;
+
+typedef struct PROXY_STATS_TAG
+{
+    uint64_t tunnels;
+    uint64_t connect_failures;
+    uint64_t bytes_up;
+    uint64_t bytes_down;
+    uint64_t faults;
+    uint64_t blackholed_bytes;
+    uint64_t shaped_bytes;
+    uint64_t retransmits;
+} PROXY_STATS;
+
+extern PROXY_SERVER_HANDLE proxy_server_create(const PROXY_CONFIG* config);
+extern void proxy_server_destroy(PROXY_SERVER_HANDLE handle);
+extern int proxy_server_run(PROXY_SERVER_HANDLE handle, volatile int* stop_running);
+
+// Arms the fault on every open tunnel and on the next new_tunnels tunnels. It triggers
+// once a tunnel carried after_bytes more bytes in either direction, the bytes that
+// would cross the limit are not forwarded. PROXY_FAULT_NONE disarms everything.
+extern void proxy_server_set_fault(PROXY_SERVER_HANDLE handle, PROXY_FAULT fault, uint64_t after_bytes, size_t new_tunnels);
+extern const char* proxy_server_get_fault_name(PROXY_FAULT fault);
+// Returns the built in profile with this name, NULL when there is none
+extern const PROXY_LINK* proxy_server_find_link(const char* name);
+extern const PROXY_LINK* proxy_server_get_links(size_t* count);
+// Applies to the bytes read from now on, what is already queued keeps its timing
+extern void proxy_server_set_link(PROXY_SERVER_HANDLE handle, const PROXY_LINK* link);
+extern void proxy_server_get_stats(PROXY_SERVER_HANDLE handle, PROXY_STATS* stats, size_t* open_tunnels);
+extern void proxy_server_reset_stats(PROXY_SERVER_HANDLE handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROXY_SERVER_H
@@ -0,0 +1,229 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "proxy_server.h"
+
+static volatile int g_stop_running = 0;
+
+typedef enum ARGUEMENT_TYPE_TAG
+{
+    ARGUEMENT_TYPE_UNKNOWN,
+    ARGUEMENT_TYPE_BIND_ADDRESS,
+    ARGUEMENT_TYPE_CONNECT_PORT,
+    ARGUEMENT_TYPE_CONTROL_PORT,
+    ARGUEMENT_TYPE_FORWARD,
+    ARGUEMENT_TYPE_PORT_MAP,
+    ARGUEMENT_TYPE_LINK
+} ARGUEMENT_TYPE;
+
+static void on_signal(int signal_number)
+{
+    (void)signal_number;
+    g_stop_running = 1;
+}
+
+static int parse_port(const char* value, uint16_t* port, bool allow_disable)
+{
+    int result;
+    char* end;
+    unsigned long parsed = strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || (parsed == 0 && !allow_disable) || parsed > 65535)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        *port = (uint16_t)parsed;
+        result = 0;
+    }
+    return result;
+}
+
+// <listen port>:<target host>:<target port>
+static int parse_forward(const char* value, PROXY_CONFIG* config)
+{
+    int result;
+    char listen_port[8];
+    const char* host = strchr(value, ':');
+    const char* target_port = strrchr(value, ':');
+    size_t listen_len = host == NULL ? 0 : (size_t)(host - value);
+    size_t host_len = host == NULL ? 0 : (size_t)(target_port - host - 1);
+
+    if (config->forward_count == PROXY_MAX_FORWARDS || listen_len == 0 || listen_len >= sizeof(listen_port) || host_len == 0 || host_len >= PROXY_HOST_LEN)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        PROXY_FORWARD* forward = &config->forwards[config->forward_count];
+        memcpy(listen_port, value, listen_len);
+        listen_port[listen_len] = '\0';
+        memcpy(forward->target_host, host + 1, host_len);
+        forward->target_host[host_len] = '\0';
+        if ((result = parse_port(listen_port, &forward->listen_port, false)) == 0 &&
+            (result = parse_port(target_port + 1, &forward->target_port, false)) == 0)
+        {
+            config->forward_count++;
+        }
+    }
+    return result;
+}
+
+// <requested port>:<target port>
+static int parse_port_map(const char* value, PROXY_CONFIG* config)
+{
+    int result;
+    char requested_port[8];
+    const char* target_port = strchr(value, ':');
+    size_t requested_len = target_port == NULL ? 0 : (size_t)(target_port - value);
+
+    if (config->port_map_count == PROXY_MAX_PORT_MAPS || requested_len == 0 || requested_len >= sizeof(requested_port))
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        PROXY_PORT_MAP* port_map = &config->port_maps[config->port_map_count];
+        memcpy(requested_port, value, requested_len);
+        requested_port[requested_len] = '\0';
+        if ((result = parse_port(requested_port, &port_map->requested_port, false)) == 0 &&
+            (result = parse_port(target_port + 1, &port_map->target_port, false)) == 0)
+        {
+            config->port_map_count++;
+        }
+    }
+    return result;
+}
+
+// -b [bind address] -p [http proxy port] -l [control port] -f [listen port:target host:target port] -m [requested port:target port] -e [link profile]
+static int parse_command_line(int argc, char* argv[], PROXY_CONFIG* config)
+{
+    int result = 0;
+    ARGUEMENT_TYPE argument_type = ARGUEMENT_TYPE_UNKNOWN;
+
+    for (int index = 1; index < argc && result == 0; index++)
+    {
+        if (argument_type == ARGUEMENT_TYPE_UNKNOWN)
+        {
+            if (argv[index][0] == '-' && (argv[index][1] == 'b' || argv[index][1] == 'B'))
+            {
+                argument_type = ARGUEMENT_TYPE_BIND_ADDRESS;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'p' || argv[index][1] == 'P'))
+            {
+                argument_type = ARGUEMENT_TYPE_CONNECT_PORT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'l' || argv[index][1] == 'L'))
+            {
+                argument_type = ARGUEMENT_TYPE_CONTROL_PORT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'f' || argv[index][1] == 'F'))
+            {
+                argument_type = ARGUEMENT_TYPE_FORWARD;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'm' || argv[index][1] == 'M'))
+            {
+                argument_type = ARGUEMENT_TYPE_PORT_MAP;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'e' || argv[index][1] == 'E'))
+            {
+                argument_type = ARGUEMENT_TYPE_LINK;
+            }
+            else
+            {
+                result = __LINE__;
+            }
+        }
+        else
+        {
+            switch (argument_type)
+            {
+                case ARGUEMENT_TYPE_BIND_ADDRESS:
+                    config->bind_address = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_CONNECT_PORT:
+                    result = parse_port(argv[index], &config->connect_port, true);
+                    break;
+                case ARGUEMENT_TYPE_CONTROL_PORT:
+                    result = parse_port(argv[index], &config->control_port, false);
+                    break;
+                case ARGUEMENT_TYPE_FORWARD:
+                    result = parse_forward(argv[index], config);
+                    break;
+                case ARGUEMENT_TYPE_PORT_MAP:
+                    result = parse_port_map(argv[index], config);
+                    break;
+                case ARGUEMENT_TYPE_LINK:
+                    result = (config->link = proxy_server_find_link(argv[index])) == NULL ? __LINE__ : 0;
+                    break;
+                case ARGUEMENT_TYPE_UNKNOWN:
+                default:
+                    result = __LINE__;
+                    break;
+            }
+            argument_type = ARGUEMENT_TYPE_UNKNOWN;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    int result;
+    PROXY_CONFIG config;
+    PROXY_SERVER_HANDLE server;
+
+    memset(&config, 0, sizeof(config));
+    config.bind_address = PROXY_DEFAULT_BIND_ADDRESS;
+    config.connect_port = PROXY_DEFAULT_CONNECT_PORT;
+    config.control_port = PROXY_DEFAULT_CONTROL_PORT;
+
+    if (parse_command_line(argc, argv, &config) != 0)
+    {
+        size_t link_count;
+        const PROXY_LINK* links = proxy_server_get_links(&link_count);
+        (void)printf("Failure parsing command line\r\n");
+        (void)printf("usage: fault_proxy -b [bind address] -p [http proxy port] -l [control port] -f [listen port:target host:target port] -m [requested port:target port] -e [link profile]\r\n");
+        (void)printf("       the listeners bind to %s unless -b gives another address\r\n", PROXY_DEFAULT_BIND_ADDRESS);
+        (void)printf("       -f can be repeated, the mqtt and amqp transports reach the hub through a forward on 8883 and 5671\r\n");
+        (void)printf("       -m can be repeated, -m 443:8443 sends the websocket and http transports to a hub without root\r\n");
+        (void)printf("       link profiles:");
+        for (size_t index = 0; index < link_count; index++)
+        {
+            (void)printf(" %s", links[index].name);
+        }
+        (void)printf("\r\n");
+        result = __LINE__;
+    }
+    else if ((server = proxy_server_create(&config)) == NULL)
+    {
+        (void)printf("Failure creating fault proxy\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        (void)signal(SIGINT, on_signal);
+        (void)signal(SIGTERM, on_signal);
+        (void)signal(SIGPIPE, SIG_IGN);
+
+        (void)printf("fault proxy listening on %s http proxy:%u control:%u", config.bind_address, config.connect_port, config.control_port);
+        for (size_t index = 0; index < config.forward_count; index++)
+        {
+            (void)printf(" %u->%s:%u", config.forwards[index].listen_port, config.forwards[index].target_host, config.forwards[index].target_port);
+        }
+        for (size_t index = 0; index < config.port_map_count; index++)
+        {
+            (void)printf(" connect %u->%u", config.port_maps[index].requested_port, config.port_maps[index].target_port);
+        }
+        (void)printf(" link:%s\r\n", config.link != NULL ? config.link->name : "none");
+        (void)fflush(stdout);
+
+        result = proxy_server_run(server, &g_stop_running);
+        proxy_server_destroy(server);
+    }
+    return result;
+}
@@ -0,0 +1,1107 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "proxy_server.h"
+
+#define LISTEN_BACKLOG          64
+#define PIPE_CHUNK_SIZE         16384
+#define POLL_TIMEOUT_MS         50
+#define MAX_REQUEST_LEN         1024
+#define MAX_COMMAND_LEN         256
+#define MAX_RESPONSE_LEN        512
+#define MAX_COMMAND_ARGS        8
+#define CONTROL_TIMEOUT_SEC     1
+#define MAX_LISTENERS           (2 + PROXY_MAX_FORWARDS)
+// Roughly a tcp segment on an ethernet or cellular mtu
+#define LINK_SEGMENT_SIZE       1400
+// Bytes held per direction before the source is not read anymore, the link's buffer
+#define LINK_QUEUE_LIMIT        (64 * 1024)
+#define LINK_MIN_RTO_MS         200
+
+static const char* const FAULT_NAMES[PROXY_FAULT_COUNT] = { "none", "drop", "reset", "blackhole", "tls" };
+static const char* const CONNECT_METHOD = "CONNECT ";
+static const char* const CONNECT_ESTABLISHED = "HTTP/1.1 200 Connection established\r\n\r\n";
+static const char* const CONNECT_FAILED = "HTTP/1.1 502 Bad Gateway\r\n\r\n";
+static const char* const HEADER_END = "\r\n\r\n";
+// A plaintext fatal internal_error alert, a session past its handshake can not decrypt it either
+static const unsigned char TLS_FATAL_ALERT[] = { 0x15, 0x03, 0x03, 0x00, 0x02, 0x02, 0x50 };
+static const char* const CUSTOM_LINK_NAME = "custom";
+
+// Typical figures for each link, the cellular ones from the operators' published ranges
+static const PROXY_LINK LINK_PROFILES[] = {
+    // name, rtt_ms, jitter_ms, up_kbps, down_kbps, loss_per_10k
+    { "none", 0, 0, 0, 0, 0 },
+    { "wifi", 20, 5, 20000, 50000, 10 },
+    { "lte-m", 150, 40, 375, 300, 50 },
+    { "nb-iot", 1600, 400, 60, 25, 100 },
+    { "gprs", 700, 150, 40, 80, 200 },
+    // Geostationary, most of the rtt is the distance
+    { "satellite", 650, 50, 1000, 5000, 50 }
+};
+
+typedef enum LISTENER_TYPE_TAG
+{
+    LISTENER_TYPE_CONNECT,
+    LISTENER_TYPE_CONTROL,
+    LISTENER_TYPE_FORWARD
+} LISTENER_TYPE;
+
+typedef struct PROXY_LISTENER_TAG
+{
+    int sock;
+    LISTENER_TYPE type;
+    const PROXY_FORWARD* forward;
+} PROXY_LISTENER;
+
+typedef enum TUNNEL_STATE_TAG
+{
+    // Waiting for the CONNECT request of the http proxy
+    TUNNEL_STATE_REQUEST,
+    TUNNEL_STATE_CONNECTING,
+    TUNNEL_STATE_OPEN,
+    TUNNEL_STATE_BLACKHOLE,
+    TUNNEL_STATE_CLOSED
+} TUNNEL_STATE;
+
+typedef struct LINK_SEGMENT_TAG
+{
+    uint64_t release_us;
+    size_t length;
+    size_t offset;
+    struct LINK_SEGMENT_TAG* next;
+    unsigned char data[];
+} LINK_SEGMENT;
+
+// Bytes read from one side that the other side did not take yet, the
+// source is not read again until they are gone. While the link is shaped
+// they wait in the segment queue until their release time.
+typedef struct PIPE_BUFFER_TAG
+{
+    unsigned char data[PIPE_CHUNK_SIZE];
+    size_t length;
+    LINK_SEGMENT* head;
+    LINK_SEGMENT* tail;
+    size_t queued;
+    // When the last queued bit leaves the bandwidth limit
+    uint64_t link_free_us;
+    uint64_t last_release_us;
+    // The source closed, the queue is still delivered before the tunnel goes
+    bool source_closed;
+} PIPE_BUFFER;
+
+typedef struct PROXY_TUNNEL_TAG
+{
+    int client_sock;
+    int server_sock;
+    TUNNEL_STATE state;
+    bool is_connect_proxy;
+    bool reset_client;
+    char request[MAX_REQUEST_LEN];
+    size_t request_len;
+    PIPE_BUFFER to_server;
+    PIPE_BUFFER to_client;
+    PROXY_FAULT fault;
+    uint64_t fault_after_bytes;
+    uint64_t bytes_carried;
+    struct PROXY_TUNNEL_TAG* next;
+} PROXY_TUNNEL;
+
+typedef struct PROXY_SERVER_TAG
+{
+    PROXY_CONFIG config;
+    PROXY_LISTENER listeners[MAX_LISTENERS];
+    size_t listener_count;
+    PROXY_TUNNEL* tunnels;
+    size_t tunnel_count;
+    PROXY_FAULT pending_fault;
+    uint64_t pending_after_bytes;
+    size_t pending_tunnels;
+    PROXY_LINK link;
+    PROXY_STATS stats;
+} PROXY_SERVER;
+
+static uint64_t get_time_us(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000) + ((uint64_t)now.tv_nsec / 1000);
+}
+
+static bool is_link_shaped(const PROXY_LINK* link)
+{
+    return link->rtt_ms != 0 || link->jitter_ms != 0 || link->up_kbps != 0 || link->down_kbps != 0 || link->loss_per_10k != 0;
+}
+
+static void clear_link_queue(PIPE_BUFFER* pipe)
+{
+    while (pipe->head != NULL)
+    {
+        LINK_SEGMENT* segment = pipe->head;
+        pipe->head = segment->next;
+        free(segment);
+    }
+    pipe->tail = NULL;
+    pipe->queued = 0;
+}
+
+static int set_nonblocking(int sock)
+{
+    int flags = fcntl(sock, F_GETFL, 0);
+    return (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) ? __LINE__ : 0;
+}
+
+static int open_listener(PROXY_LISTENER* listener, const char* bind_address, uint16_t port, LISTENER_TYPE type, const PROXY_FORWARD* forward)
+{
+    int result;
+    struct sockaddr_in addr;
+    int reuse = 1;
+
+    listener->sock = -1;
+    listener->type = type;
+    listener->forward = forward;
+    if (port == 0)
+    {
+        // Disabled, poll skips the negative descriptor
+        result = 0;
+    }
+    else if ((listener->sock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        (void)printf("Failure creating socket for port %u\r\n", port);
+        result = __LINE__;
+    }
+    else
+    {
+        (void)setsockopt(listener->sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, bind_address, &addr.sin_addr) != 1)
+        {
+            (void)printf("Invalid bind address %s\r\n", bind_address);
+            result = __LINE__;
+        }
+        else if (bind(listener->sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            (void)printf("Failure binding %s:%u: %s\r\n", bind_address, port, strerror(errno));
+            result = __LINE__;
+        }
+        else if (listen(listener->sock, LISTEN_BACKLOG) != 0 || set_nonblocking(listener->sock) != 0)
+        {
+            (void)printf("Failure listening on port %u\r\n", port);
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+
+        if (result != 0)
+        {
+            (void)close(listener->sock);
+            listener->sock = -1;
+        }
+    }
+    return result;
+}
+
+static void close_tunnel(PROXY_TUNNEL* tunnel)
+{
+    if (tunnel->client_sock >= 0)
+    {
+        if (tunnel->reset_client)
+        {
+            // A zero linger time turns the close into a RST
+            struct linger no_linger;
+            no_linger.l_onoff = 1;
+            no_linger.l_linger = 0;
+            (void)setsockopt(tunnel->client_sock, SOL_SOCKET, SO_LINGER, &no_linger, sizeof(no_linger));
+        }
+        (void)close(tunnel->client_sock);
+    }
+    if (tunnel->server_sock >= 0)
+    {
+        (void)close(tunnel->server_sock);
+    }
+    clear_link_queue(&tunnel->to_server);
+    clear_link_queue(&tunnel->to_client);
+    free(tunnel);
+}
+
+static void send_all(int sock, const void* data, size_t length)
+{
+    // Only used for the short proxy answers, a full socket buffer loses them
+    (void)send(sock, data, length, MSG_NOSIGNAL);
+}
+
+static int connect_target(PROXY_SERVER* server, PROXY_TUNNEL* tunnel, const char* host, uint16_t port)
+{
+    int result;
+    char port_text[8];
+    struct addrinfo hints;
+    struct addrinfo* addr_list;
+
+    (void)snprintf(port_text, sizeof(port_text), "%u", port);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port_text, &hints, &addr_list) != 0)
+    {
+        (void)printf("Failure resolving %s\r\n", host);
+        result = __LINE__;
+    }
+    else
+    {
+        int no_delay = 1;
+        if ((tunnel->server_sock = socket(addr_list->ai_family, addr_list->ai_socktype, addr_list->ai_protocol)) < 0 || set_nonblocking(tunnel->server_sock) != 0)
+        {
+            (void)printf("Failure creating socket for %s:%u\r\n", host, port);
+            result = __LINE__;
+        }
+        else if (connect(tunnel->server_sock, addr_list->ai_addr, addr_list->ai_addrlen) != 0 && errno != EINPROGRESS)
+        {
+            (void)printf("Failure connecting to %s:%u: %s\r\n", host, port, strerror(errno));
+            result = __LINE__;
+        }
+        else
+        {
+            (void)setsockopt(tunnel->server_sock, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+            tunnel->state = TUNNEL_STATE_CONNECTING;
+            result = 0;
+        }
+        freeaddrinfo(addr_list);
+    }
+
+    if (result != 0)
+    {
+        server->stats.connect_failures++;
+        tunnel->state = TUNNEL_STATE_CLOSED;
+    }
+    return result;
+}
+
+static void accept_tunnel(PROXY_SERVER* server, const PROXY_LISTENER* listener)
+{
+    int sock;
+    while ((sock = accept(listener->sock, NULL, NULL)) >= 0)
+    {
+        PROXY_TUNNEL* tunnel;
+        int no_delay = 1;
+        (void)setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        if (set_nonblocking(sock) != 0 || (tunnel = (PROXY_TUNNEL*)calloc(1, sizeof(PROXY_TUNNEL))) == NULL)
+        {
+            (void)printf("Failure accepting connection\r\n");
+            (void)close(sock);
+        }
+        else
+        {
+            tunnel->client_sock = sock;
+            tunnel->server_sock = -1;
+            tunnel->is_connect_proxy = listener->type == LISTENER_TYPE_CONNECT;
+            tunnel->state = TUNNEL_STATE_REQUEST;
+            if (server->pending_tunnels > 0)
+            {
+                tunnel->fault = server->pending_fault;
+                tunnel->fault_after_bytes = server->pending_after_bytes;
+                server->pending_tunnels--;
+            }
+            if (!tunnel->is_connect_proxy)
+            {
+                (void)connect_target(server, tunnel, listener->forward->target_host, listener->forward->target_port);
+            }
+            tunnel->next = server->tunnels;
+            server->tunnels = tunnel;
+            server->tunnel_count++;
+            server->stats.tunnels++;
+        }
+    }
+}
+
+// CONNECT <host>:<port> HTTP/1.1, the headers that follow are not needed
+static void read_request(PROXY_SERVER* server, PROXY_TUNNEL* tunnel)
+{
+    int received = (int)recv(tunnel->client_sock, tunnel->request + tunnel->request_len, sizeof(tunnel->request) - 1 - tunnel->request_len, 0);
+    if (received <= 0)
+    {
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            tunnel->state = TUNNEL_STATE_CLOSED;
+        }
+    }
+    else
+    {
+        tunnel->request_len += (size_t)received;
+        tunnel->request[tunnel->request_len] = '\0';
+        if (strstr(tunnel->request, HEADER_END) != NULL)
+        {
+            char* host = tunnel->request + strlen(CONNECT_METHOD);
+            char* host_end = strchr(host, ' ');
+            char* port = NULL;
+            if (strncmp(tunnel->request, CONNECT_METHOD, strlen(CONNECT_METHOD)) == 0 && host_end != NULL)
+            {
+                *host_end = '\0';
+                port = strrchr(host, ':');
+            }
+
+            if (port == NULL || port == host)
+            {
+                (void)printf("Failure parsing proxy request\r\n");
+                send_all(tunnel->client_sock, CONNECT_FAILED, strlen(CONNECT_FAILED));
+                tunnel->state = TUNNEL_STATE_CLOSED;
+            }
+            else
+            {
+                uint16_t target_port = (uint16_t)atoi(port + 1);
+                *port = '\0';
+                for (size_t index = 0; index < server->config.port_map_count; index++)
+                {
+                    if (server->config.port_maps[index].requested_port == target_port)
+                    {
+                        target_port = server->config.port_maps[index].target_port;
+                        break;
+                    }
+                }
+                if (connect_target(server, tunnel, host, target_port) != 0)
+                {
+                    send_all(tunnel->client_sock, CONNECT_FAILED, strlen(CONNECT_FAILED));
+                }
+            }
+        }
+        else if (tunnel->request_len == sizeof(tunnel->request) - 1)
+        {
+            (void)printf("Failure proxy request is too long\r\n");
+            tunnel->state = TUNNEL_STATE_CLOSED;
+        }
+    }
+}
+
+static void complete_connect(PROXY_SERVER* server, PROXY_TUNNEL* tunnel)
+{
+    int connect_error = 0;
+    socklen_t error_len = sizeof(connect_error);
+    if (getsockopt(tunnel->server_sock, SOL_SOCKET, SO_ERROR, &connect_error, &error_len) != 0 || connect_error != 0)
+    {
+        (void)printf("Failure connecting tunnel: %s\r\n", strerror(connect_error));
+        server->stats.connect_failures++;
+        if (tunnel->is_connect_proxy)
+        {
+            send_all(tunnel->client_sock, CONNECT_FAILED, strlen(CONNECT_FAILED));
+        }
+        tunnel->state = TUNNEL_STATE_CLOSED;
+    }
+    else
+    {
+        if (tunnel->is_connect_proxy)
+        {
+            send_all(tunnel->client_sock, CONNECT_ESTABLISHED, strlen(CONNECT_ESTABLISHED));
+        }
+        tunnel->state = TUNNEL_STATE_OPEN;
+    }
+}
+
+static void apply_fault(PROXY_SERVER* server, PROXY_TUNNEL* tunnel)
+{
+    server->stats.faults++;
+    switch (tunnel->fault)
+    {
+        case PROXY_FAULT_DROP:
+            tunnel->state = TUNNEL_STATE_CLOSED;
+            break;
+        case PROXY_FAULT_RESET:
+            tunnel->reset_client = true;
+            tunnel->state = TUNNEL_STATE_CLOSED;
+            break;
+        case PROXY_FAULT_BLACKHOLE:
+            tunnel->to_server.length = 0;
+            tunnel->to_client.length = 0;
+            clear_link_queue(&tunnel->to_server);
+            clear_link_queue(&tunnel->to_client);
+            tunnel->state = TUNNEL_STATE_BLACKHOLE;
+            break;
+        case PROXY_FAULT_TLS_ALERT:
+            send_all(tunnel->client_sock, TLS_FATAL_ALERT, sizeof(TLS_FATAL_ALERT));
+            tunnel->state = TUNNEL_STATE_CLOSED;
+            break;
+        case PROXY_FAULT_NONE:
+        default:
+            break;
+    }
+    tunnel->fault = PROXY_FAULT_NONE;
+}
+
+// Cuts what was read into segments and gives each the time the link would deliver it.
+// The release times never go backwards, the tcp stream has to stay in order.
+static int enqueue_segments(PROXY_SERVER* server, PIPE_BUFFER* pipe, bool is_up)
+{
+    int result = 0;
+    const PROXY_LINK* link = &server->link;
+    uint32_t kbps = is_up ? link->up_kbps : link->down_kbps;
+    uint64_t now = get_time_us();
+    uint64_t rto_us = (uint64_t)(link->rtt_ms + (4 * link->jitter_ms)) * 1000;
+    size_t offset = 0;
+
+    if (rto_us < (uint64_t)LINK_MIN_RTO_MS * 1000)
+    {
+        rto_us = (uint64_t)LINK_MIN_RTO_MS * 1000;
+    }
+    if (pipe->link_free_us < now)
+    {
+        pipe->link_free_us = now;
+    }
+    while (offset < pipe->length && result == 0)
+    {
+        size_t length = pipe->length - offset > LINK_SEGMENT_SIZE ? LINK_SEGMENT_SIZE : pipe->length - offset;
+        LINK_SEGMENT* segment = (LINK_SEGMENT*)malloc(sizeof(LINK_SEGMENT) + length);
+        if (segment == NULL)
+        {
+            (void)printf("Failure allocating link segment\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            // Half the rtt each way, the jitter spreads around it
+            int64_t delay_us = (int64_t)link->rtt_ms * 500;
+            if (link->jitter_ms > 0)
+            {
+                delay_us += ((int64_t)(rand() % ((2 * (int)link->jitter_ms) + 1)) - (int64_t)link->jitter_ms) * 1000;
+            }
+            if (kbps > 0)
+            {
+                pipe->link_free_us += ((uint64_t)length * 8000) / kbps;
+            }
+            segment->release_us = pipe->link_free_us + (delay_us > 0 ? (uint64_t)delay_us : 0);
+            if (link->loss_per_10k > 0 && (uint32_t)(rand() % 10000) < link->loss_per_10k)
+            {
+                segment->release_us += rto_us;
+                server->stats.retransmits++;
+            }
+            if (segment->release_us < pipe->last_release_us)
+            {
+                segment->release_us = pipe->last_release_us;
+            }
+            pipe->last_release_us = segment->release_us;
+
+            memcpy(segment->data, pipe->data + offset, length);
+            segment->length = length;
+            segment->offset = 0;
+            segment->next = NULL;
+            if (pipe->tail == NULL)
+            {
+                pipe->head = segment;
+            }
+            else
+            {
+                pipe->tail->next = segment;
+            }
+            pipe->tail = segment;
+            pipe->queued += length;
+            server->stats.shaped_bytes += length;
+            offset += length;
+        }
+    }
+    pipe->length = 0;
+    return result;
+}
+
+// Writes the segments that are due, returns false once the target went away
+static bool send_released(PIPE_BUFFER* pipe, int to_sock)
+{
+    bool result = true;
+    uint64_t now = get_time_us();
+
+    while (pipe->head != NULL && pipe->head->release_us <= now)
+    {
+        LINK_SEGMENT* segment = pipe->head;
+        int written = (int)send(to_sock, segment->data + segment->offset, segment->length - segment->offset, MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            result = errno == EAGAIN || errno == EWOULDBLOCK;
+            break;
+        }
+        segment->offset += (size_t)written;
+        pipe->queued -= (size_t)written;
+        if (segment->offset < segment->length)
+        {
+            // The socket is full
+            break;
+        }
+        pipe->head = segment->next;
+        if (pipe->head == NULL)
+        {
+            pipe->tail = NULL;
+        }
+        free(segment);
+    }
+    return result;
+}
+
+// Moves what from_sock has to to_sock, returns false once a side went away
+static bool pump(PROXY_SERVER* server, PROXY_TUNNEL* tunnel, int from_sock, int to_sock, PIPE_BUFFER* pipe, bool is_up)
+{
+    bool result = true;
+    bool trigger = false;
+
+    if (pipe->length == 0 && pipe->queued < LINK_QUEUE_LIMIT && !pipe->source_closed)
+    {
+        int received = (int)recv(from_sock, pipe->data, sizeof(pipe->data), 0);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            pipe->source_closed = true;
+        }
+        else if (received > 0)
+        {
+            size_t length = (size_t)received;
+            if (tunnel->fault != PROXY_FAULT_NONE && tunnel->bytes_carried + length > tunnel->fault_after_bytes)
+            {
+                length = (size_t)(tunnel->fault_after_bytes - tunnel->bytes_carried);
+                if (tunnel->fault == PROXY_FAULT_BLACKHOLE)
+                {
+                    server->stats.blackholed_bytes += (size_t)received - length;
+                }
+                trigger = true;
+            }
+            tunnel->bytes_carried += length;
+            if (is_up)
+            {
+                server->stats.bytes_up += length;
+            }
+            else
+            {
+                server->stats.bytes_down += length;
+            }
+            pipe->length = length;
+        }
+    }
+
+    // Bytes queued while the link was shaped go first even after it stopped being shaped
+    if (pipe->length > 0 && (pipe->head != NULL || is_link_shaped(&server->link)) && enqueue_segments(server, pipe, is_up) != 0)
+    {
+        result = false;
+    }
+    else if (pipe->head != NULL)
+    {
+        result = send_released(pipe, to_sock);
+    }
+    else if (pipe->length > 0)
+    {
+        int written = (int)send(to_sock, pipe->data, pipe->length, MSG_NOSIGNAL);
+        if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            result = false;
+        }
+        else if (written > 0)
+        {
+            memmove(pipe->data, pipe->data + written, pipe->length - (size_t)written);
+            pipe->length -= (size_t)written;
+        }
+    }
+
+    if (result && pipe->source_closed && pipe->length == 0 && pipe->head == NULL)
+    {
+        result = false;
+    }
+    if (result && trigger)
+    {
+        apply_fault(server, tunnel);
+    }
+    return result;
+}
+
+// A blackholed tunnel swallows everything until the device gives up on it
+static void drain_blackhole(PROXY_SERVER* server, PROXY_TUNNEL* tunnel)
+{
+    unsigned char discard[PIPE_CHUNK_SIZE];
+    int received;
+
+    while ((received = (int)recv(tunnel->client_sock, discard, sizeof(discard), 0)) > 0)
+    {
+        server->stats.blackholed_bytes += (size_t)received;
+    }
+    if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        tunnel->state = TUNNEL_STATE_CLOSED;
+    }
+    else if (tunnel->server_sock >= 0)
+    {
+        while ((received = (int)recv(tunnel->server_sock, discard, sizeof(discard), 0)) > 0)
+        {
+            server->stats.blackholed_bytes += (size_t)received;
+        }
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            // The device still has to notice on its own
+            (void)close(tunnel->server_sock);
+            tunnel->server_sock = -1;
+        }
+    }
+}
+
+static void service_tunnel(PROXY_SERVER* server, PROXY_TUNNEL* tunnel, short client_events, short server_events)
+{
+    if (tunnel->state == TUNNEL_STATE_REQUEST && client_events != 0)
+    {
+        read_request(server, tunnel);
+    }
+    else if (tunnel->state == TUNNEL_STATE_CONNECTING && server_events != 0)
+    {
+        complete_connect(server, tunnel);
+    }
+    else if (tunnel->state == TUNNEL_STATE_OPEN && (client_events != 0 || server_events != 0))
+    {
+        if (!pump(server, tunnel, tunnel->client_sock, tunnel->server_sock, &tunnel->to_server, true) ||
+            (tunnel->state == TUNNEL_STATE_OPEN && !pump(server, tunnel, tunnel->server_sock, tunnel->client_sock, &tunnel->to_client, false)))
+        {
+            tunnel->state = TUNNEL_STATE_CLOSED;
+        }
+    }
+    else if (tunnel->state == TUNNEL_STATE_BLACKHOLE && (client_events != 0 || server_events != 0))
+    {
+        drain_blackhole(server, tunnel);
+    }
+}
+
+static bool can_read(const PIPE_BUFFER* pipe)
+{
+    return pipe->length == 0 && pipe->queued < LINK_QUEUE_LIMIT && !pipe->source_closed;
+}
+
+// Queued segments only need the socket once they are due
+static bool can_write(const PIPE_BUFFER* pipe, uint64_t now)
+{
+    return pipe->head != NULL ? pipe->head->release_us <= now : pipe->length > 0;
+}
+
+static short get_client_events(const PROXY_TUNNEL* tunnel, uint64_t now)
+{
+    short result;
+    if (tunnel->state == TUNNEL_STATE_OPEN)
+    {
+        result = (short)((can_read(&tunnel->to_server) ? POLLIN : 0) | (can_write(&tunnel->to_client, now) ? POLLOUT : 0));
+    }
+    else if (tunnel->state == TUNNEL_STATE_REQUEST || tunnel->state == TUNNEL_STATE_BLACKHOLE)
+    {
+        result = POLLIN;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static short get_server_events(const PROXY_TUNNEL* tunnel, uint64_t now)
+{
+    short result;
+    if (tunnel->state == TUNNEL_STATE_OPEN)
+    {
+        result = (short)((can_read(&tunnel->to_client) ? POLLIN : 0) | (can_write(&tunnel->to_server, now) ? POLLOUT : 0));
+    }
+    else if (tunnel->state == TUNNEL_STATE_CONNECTING)
+    {
+        result = POLLOUT;
+    }
+    else if (tunnel->state == TUNNEL_STATE_BLACKHOLE)
+    {
+        result = POLLIN;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+// FAULT <none|drop|reset|blackhole|tls> <after_bytes> [new_tunnels]
+static void command_fault(PROXY_SERVER* server, size_t argc, char* argv[], char* response, size_t response_len)
+{
+    size_t fault_index;
+    char* end = NULL;
+    uint64_t after_bytes = argc > 2 ? strtoull(argv[2], &end, 10) : 0;
+    size_t new_tunnels = argc > 3 ? (size_t)strtoull(argv[3], NULL, 10) : 0;
+
+    for (fault_index = 0; fault_index < PROXY_FAULT_COUNT; fault_index++)
+    {
+        if (strcmp(argv[1], FAULT_NAMES[fault_index]) == 0)
+        {
+            break;
+        }
+    }
+
+    if (fault_index == PROXY_FAULT_COUNT || (argc > 2 && (end == argv[2] || *end != '\0')))
+    {
+        (void)snprintf(response, response_len, "ERROR unknown fault or byte count");
+    }
+    else
+    {
+        proxy_server_set_fault(server, (PROXY_FAULT)fault_index, after_bytes, new_tunnels);
+        (void)snprintf(response, response_len, "OK fault=%s after_bytes=%" PRIu64 " new_tunnels=%zu", FAULT_NAMES[fault_index], after_bytes, new_tunnels);
+    }
+}
+
+// Wakes up for the next segment that is due, a shaped link can't wait the whole poll interval
+static int get_poll_timeout(const PROXY_SERVER* server, uint64_t now)
+{
+    int result = POLL_TIMEOUT_MS;
+    for (const PROXY_TUNNEL* tunnel = server->tunnels; tunnel != NULL; tunnel = tunnel->next)
+    {
+        const PIPE_BUFFER* pipes[2] = { &tunnel->to_server, &tunnel->to_client };
+        for (size_t index = 0; index < 2; index++)
+        {
+            if (tunnel->state == TUNNEL_STATE_OPEN && pipes[index]->head != NULL && pipes[index]->head->release_us > now)
+            {
+                uint64_t wait_ms = ((pipes[index]->head->release_us - now) + 999) / 1000;
+                if (wait_ms < (uint64_t)result)
+                {
+                    result = (int)wait_ms;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+// LINK <profile> or LINK custom <rtt_ms> <jitter_ms> <up_kbps> <down_kbps> <loss_per_10k>
+static void command_link(PROXY_SERVER* server, size_t argc, char* argv[], char* response, size_t response_len)
+{
+    const PROXY_LINK* link = proxy_server_find_link(argv[1]);
+    PROXY_LINK custom;
+    bool valid = link != NULL;
+
+    if (!valid && argc == 7 && strcmp(argv[1], CUSTOM_LINK_NAME) == 0)
+    {
+        uint32_t* values[5] = { &custom.rtt_ms, &custom.jitter_ms, &custom.up_kbps, &custom.down_kbps, &custom.loss_per_10k };
+        valid = true;
+        for (size_t index = 0; index < 5 && valid; index++)
+        {
+            char* end;
+            unsigned long value = strtoul(argv[index + 2], &end, 10);
+            valid = end != argv[index + 2] && *end == '\0' && value <= UINT32_MAX;
+            *values[index] = (uint32_t)value;
+        }
+        custom.name = CUSTOM_LINK_NAME;
+        link = &custom;
+    }
+
+    if (!valid || link->loss_per_10k > 10000)
+    {
+        (void)snprintf(response, response_len, "ERROR unknown link profile or value");
+    }
+    else
+    {
+        proxy_server_set_link(server, link);
+        (void)snprintf(response, response_len, "OK link=%s rtt_ms=%" PRIu32 " jitter_ms=%" PRIu32 " up_kbps=%" PRIu32 " down_kbps=%" PRIu32 " loss_per_10k=%" PRIu32,
+            link->name, link->rtt_ms, link->jitter_ms, link->up_kbps, link->down_kbps, link->loss_per_10k);
+    }
+}
+
+static void execute_command(PROXY_SERVER* server, char* line, char* response, size_t response_len)
+{
+    char* argv[MAX_COMMAND_ARGS];
+    size_t argc = 0;
+    char* token = strtok(line, " \t\r\n");
+    while (token != NULL && argc < MAX_COMMAND_ARGS)
+    {
+        argv[argc++] = token;
+        token = strtok(NULL, " \t\r\n");
+    }
+
+    if (argc >= 2 && strcmp(argv[0], "FAULT") == 0)
+    {
+        command_fault(server, argc, argv, response, response_len);
+    }
+    else if (argc >= 2 && strcmp(argv[0], "LINK") == 0)
+    {
+        command_link(server, argc, argv, response, response_len);
+    }
+    else if (argc >= 1 && strcmp(argv[0], "STATS") == 0)
+    {
+        PROXY_STATS stats;
+        size_t open_tunnels;
+        proxy_server_get_stats(server, &stats, &open_tunnels);
+        (void)snprintf(response, response_len, "OK tunnels=%" PRIu64 " open=%zu connect_failures=%" PRIu64 " bytes_up=%" PRIu64 " bytes_down=%" PRIu64
+            " faults=%" PRIu64 " blackholed_bytes=%" PRIu64 " link=%s shaped_bytes=%" PRIu64 " retransmits=%" PRIu64,
+            stats.tunnels, open_tunnels, stats.connect_failures, stats.bytes_up, stats.bytes_down, stats.faults, stats.blackholed_bytes,
+            server->link.name, stats.shaped_bytes, stats.retransmits);
+    }
+    else if (argc >= 1 && strcmp(argv[0], "RESET") == 0)
+    {
+        proxy_server_set_fault(server, PROXY_FAULT_NONE, 0, 0);
+        proxy_server_reset_stats(server);
+        (void)snprintf(response, response_len, "OK");
+    }
+    else
+    {
+        (void)snprintf(response, response_len, "ERROR unknown command");
+    }
+}
+
+// The analytics send one command per connection and wait for the answer, so
+// the control channel is served in place with a short timeout
+static void serve_control(PROXY_SERVER* server, const PROXY_LISTENER* listener)
+{
+    int sock;
+    while ((sock = accept(listener->sock, NULL, NULL)) >= 0)
+    {
+        char line[MAX_COMMAND_LEN];
+        char response[MAX_RESPONSE_LEN];
+        size_t line_len = 0;
+        struct timeval timeout;
+        int flags = fcntl(sock, F_GETFL, 0);
+
+        timeout.tv_sec = CONTROL_TIMEOUT_SEC;
+        timeout.tv_usec = 0;
+        (void)fcntl(sock, F_SETFL, flags & ~O_NONBLOCK);
+        (void)setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        while (line_len < sizeof(line) - 1)
+        {
+            int received = (int)recv(sock, line + line_len, sizeof(line) - 1 - line_len, 0);
+            if (received <= 0)
+            {
+                break;
+            }
+            line_len += (size_t)received;
+            line[line_len] = '\0';
+            if (strchr(line, '\n') != NULL)
+            {
+                break;
+            }
+        }
+        line[line_len] = '\0';
+
+        if (strchr(line, '\n') == NULL)
+        {
+            (void)snprintf(response, sizeof(response), "ERROR incomplete command");
+        }
+        else
+        {
+            execute_command(server, line, response, sizeof(response));
+        }
+        (void)strcat(response, "\n");
+        send_all(sock, response, strlen(response));
+        (void)close(sock);
+    }
+}
+
+const char* proxy_server_get_fault_name(PROXY_FAULT fault)
+{
+    return fault < PROXY_FAULT_COUNT ? FAULT_NAMES[fault] : "unknown";
+}
+
+void proxy_server_set_fault(PROXY_SERVER_HANDLE handle, PROXY_FAULT fault, uint64_t after_bytes, size_t new_tunnels)
+{
+    for (PROXY_TUNNEL* tunnel = handle->tunnels; tunnel != NULL; tunnel = tunnel->next)
+    {
+        if (tunnel->state == TUNNEL_STATE_OPEN)
+        {
+            tunnel->fault = fault;
+            tunnel->fault_after_bytes = tunnel->bytes_carried + after_bytes;
+        }
+    }
+    handle->pending_fault = fault;
+    handle->pending_after_bytes = after_bytes;
+    handle->pending_tunnels = fault == PROXY_FAULT_NONE ? 0 : new_tunnels;
+}
+
+const PROXY_LINK* proxy_server_find_link(const char* name)
+{
+    const PROXY_LINK* result = NULL;
+    for (size_t index = 0; index < sizeof(LINK_PROFILES) / sizeof(LINK_PROFILES[0]) && result == NULL; index++)
+    {
+        if (strcmp(name, LINK_PROFILES[index].name) == 0)
+        {
+            result = &LINK_PROFILES[index];
+        }
+    }
+    return result;
+}
+
+const PROXY_LINK* proxy_server_get_links(size_t* count)
+{
+    *count = sizeof(LINK_PROFILES) / sizeof(LINK_PROFILES[0]);
+    return LINK_PROFILES;
+}
+
+void proxy_server_set_link(PROXY_SERVER_HANDLE handle, const PROXY_LINK* link)
+{
+    handle->link = *link;
+    // Only the built in names outlive the command that set them
+    if (proxy_server_find_link(link->name) != link)
+    {
+        handle->link.name = CUSTOM_LINK_NAME;
+    }
+}
+
+void proxy_server_get_stats(PROXY_SERVER_HANDLE handle, PROXY_STATS* stats, size_t* open_tunnels)
+{
+    *stats = handle->stats;
+    *open_tunnels = handle->tunnel_count;
+}
+
+void proxy_server_reset_stats(PROXY_SERVER_HANDLE handle)
+{
+    memset(&handle->stats, 0, sizeof(PROXY_STATS));
+}
+
+PROXY_SERVER_HANDLE proxy_server_create(const PROXY_CONFIG* config)
+{
+    PROXY_SERVER* result;
+    if ((result = (PROXY_SERVER*)calloc(1, sizeof(PROXY_SERVER))) == NULL)
+    {
+        (void)printf("Failure allocating proxy server\r\n");
+    }
+    else
+    {
+        int open_result;
+        result->config = *config;
+        result->link = config->link != NULL ? *config->link : LINK_PROFILES[0];
+        for (size_t index = 0; index < MAX_LISTENERS; index++)
+        {
+            result->listeners[index].sock = -1;
+        }
+
+        open_result = open_listener(&result->listeners[result->listener_count++], config->bind_address, config->connect_port, LISTENER_TYPE_CONNECT, NULL);
+        if (open_result == 0)
+        {
+            open_result = open_listener(&result->listeners[result->listener_count++], config->bind_address, config->control_port, LISTENER_TYPE_CONTROL, NULL);
+        }
+        for (size_t index = 0; index < config->forward_count && index < PROXY_MAX_FORWARDS && open_result == 0; index++)
+        {
+            // The forward points into the copied config so it lives as long as the server
+            open_result = open_listener(&result->listeners[result->listener_count++], config->bind_address, config->forwards[index].listen_port, LISTENER_TYPE_FORWARD, &result->config.forwards[index]);
+        }
+
+        if (open_result != 0)
+        {
+            proxy_server_destroy(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+void proxy_server_destroy(PROXY_SERVER_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        while (handle->tunnels != NULL)
+        {
+            PROXY_TUNNEL* tunnel = handle->tunnels;
+            handle->tunnels = tunnel->next;
+            close_tunnel(tunnel);
+        }
+        for (size_t index = 0; index < handle->listener_count; index++)
+        {
+            if (handle->listeners[index].sock >= 0)
+            {
+                (void)close(handle->listeners[index].sock);
+            }
+        }
+        free(handle);
+    }
+}
+
+int proxy_server_run(PROXY_SERVER_HANDLE handle, volatile int* stop_running)
+{
+    int result = 0;
+    struct pollfd* poll_list = NULL;
+    size_t poll_capacity = 0;
+
+    while (*stop_running == 0 && result == 0)
+    {
+        size_t poll_count = 0;
+        uint64_t now = get_time_us();
+        // Every tunnel polls its device and its hub side
+        size_t needed = handle->listener_count + (handle->tunnel_count * 2);
+        if (needed > poll_capacity)
+        {
+            struct pollfd* new_list = (struct pollfd*)realloc(poll_list, needed * sizeof(struct pollfd));
+            if (new_list == NULL)
+            {
+                (void)printf("Failure allocating poll list\r\n");
+                result = __LINE__;
+                break;
+            }
+            poll_list = new_list;
+            poll_capacity = needed;
+        }
+
+        for (size_t index = 0; index < handle->listener_count; index++)
+        {
+            poll_list[poll_count].fd = handle->listeners[index].sock;
+            poll_list[poll_count].events = POLLIN;
+            poll_list[poll_count++].revents = 0;
+        }
+        for (PROXY_TUNNEL* tunnel = handle->tunnels; tunnel != NULL; tunnel = tunnel->next)
+        {
+            poll_list[poll_count].fd = tunnel->client_sock;
+            poll_list[poll_count].events = get_client_events(tunnel, now);
+            poll_list[poll_count++].revents = 0;
+            poll_list[poll_count].fd = tunnel->server_sock;
+            poll_list[poll_count].events = get_server_events(tunnel, now);
+            poll_list[poll_count++].revents = 0;
+        }
+
+        if (poll(poll_list, poll_count, get_poll_timeout(handle, now)) < 0 && errno != EINTR)
+        {
+            (void)printf("Failure polling sockets\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            size_t poll_index = handle->listener_count;
+            for (PROXY_TUNNEL* tunnel = handle->tunnels; tunnel != NULL && poll_index < poll_count; tunnel = tunnel->next, poll_index += 2)
+            {
+                service_tunnel(handle, tunnel, poll_list[poll_index].revents, poll_list[poll_index + 1].revents);
+            }
+
+            for (size_t index = 0; index < handle->listener_count; index++)
+            {
+                if (poll_list[index].revents & POLLIN)
+                {
+                    if (handle->listeners[index].type == LISTENER_TYPE_CONTROL)
+                    {
+                        serve_control(handle, &handle->listeners[index]);
+                    }
+                    else
+                    {
+                        accept_tunnel(handle, &handle->listeners[index]);
+                    }
+                }
+            }
+
+            // Remove the closed tunnels
+            PROXY_TUNNEL** link = &handle->tunnels;
+            while (*link != NULL)
+            {
+                PROXY_TUNNEL* tunnel = *link;
+                if (tunnel->state == TUNNEL_STATE_CLOSED)
+                {
+                    *link = tunnel->next;
+                    handle->tunnel_count--;
+                    close_tunnel(tunnel);
+                }
+                else
+                {
+                    link = &tunnel->next;
+                }
+            }
+        }
+    }
+    free(poll_list);
+    return result;
+}
@@ -0,0 +1,184 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+// Do not include gballoc.h here, the samples must not be part of the measurements
+#include "latency_stats.h"
+
+#define DEFAULT_CAPACITY        256
+#define NS_PER_US               1000.0
+
+typedef struct LATENCY_STATS_TAG
+{
+    uint64_t* samples;
+    size_t count;
+    size_t capacity;
+    uint64_t total_ns;
+} LATENCY_STATS;
+
+static int compare_samples(const void* left, const void* right)
+{
+    uint64_t left_value = *(const uint64_t*)left;
+    uint64_t right_value = *(const uint64_t*)right;
+    return left_value < right_value ? -1 : (left_value > right_value ? 1 : 0);
+}
+
+// Nearest rank on the sorted samples
+static uint64_t get_percentile(const uint64_t* sorted, size_t count, size_t percentile)
+{
+    size_t rank = (count * percentile + 99) / 100;
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+uint64_t latency_stats_get_time_ns(void)
+{
+#ifdef WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    (void)QueryPerformanceFrequency(&frequency);
+    (void)QueryPerformanceCounter(&counter);
+    return (uint64_t)((counter.QuadPart / frequency.QuadPart) * 1000000000) + (uint64_t)(((counter.QuadPart % frequency.QuadPart) * 1000000000) / frequency.QuadPart);
+#else
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000) + (uint64_t)now.tv_nsec;
+#endif
+}
+
+uint64_t latency_stats_get_thread_cpu_ns(void)
+{
+#ifdef WIN32
+    FILETIME creation_time;
+    FILETIME exit_time;
+    FILETIME kernel_time;
+    FILETIME user_time;
+    uint64_t result = 0;
+    if (GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time))
+    {
+        // FILETIME is in 100ns units
+        result = ((((uint64_t)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime) +
+            (((uint64_t)user_time.dwHighDateTime << 32) | user_time.dwLowDateTime)) * 100;
+    }
+    return result;
+#else
+    struct timespec now;
+    (void)clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return ((uint64_t)now.tv_sec * 1000000000) + (uint64_t)now.tv_nsec;
+#endif
+}
+
+uint64_t latency_stats_get_process_cpu_ns(void)
+{
+#ifdef WIN32
+    FILETIME creation_time;
+    FILETIME exit_time;
+    FILETIME kernel_time;
+    FILETIME user_time;
+    uint64_t result = 0;
+    if (GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+    {
+        // FILETIME is in 100ns units
+        result = ((((uint64_t)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime) +
+            (((uint64_t)user_time.dwHighDateTime << 32) | user_time.dwLowDateTime)) * 100;
+    }
+    return result;
+#else
+    struct timespec now;
+    (void)clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return ((uint64_t)now.tv_sec * 1000000000) + (uint64_t)now.tv_nsec;
+#endif
+}
+
+LATENCY_STATS_HANDLE latency_stats_create(size_t initial_capacity)
+{
+    LATENCY_STATS* result;
+    if ((result = (LATENCY_STATS*)calloc(1, sizeof(LATENCY_STATS))) == NULL)
+    {
+        (void)printf("Failure allocating latency stats\r\n");
+    }
+    else
+    {
+        result->capacity = initial_capacity == 0 ? DEFAULT_CAPACITY : initial_capacity;
+        if ((result->samples = (uint64_t*)malloc(result->capacity * sizeof(uint64_t))) == NULL)
+        {
+            (void)printf("Failure allocating latency samples\r\n");
+            free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+void latency_stats_destroy(LATENCY_STATS_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        free(handle->samples);
+        free(handle);
+    }
+}
+
+void latency_stats_add(LATENCY_STATS_HANDLE handle, uint64_t latency_ns)
+{
+    if (handle != NULL)
+    {
+        if (handle->count == handle->capacity)
+        {
+            uint64_t* samples = (uint64_t*)realloc(handle->samples, handle->capacity * 2 * sizeof(uint64_t));
+            if (samples == NULL)
+            {
+                (void)printf("Failure growing latency samples\r\n");
+                return;
+            }
+            handle->samples = samples;
+            handle->capacity *= 2;
+        }
+        handle->samples[handle->count++] = latency_ns;
+        handle->total_ns += latency_ns;
+    }
+}
+
+void latency_stats_get_summary(LATENCY_STATS_HANDLE handle, LATENCY_SUMMARY* summary)
+{
+    memset(summary, 0, sizeof(LATENCY_SUMMARY));
+    if (handle != NULL && handle->count > 0)
+    {
+        qsort(handle->samples, handle->count, sizeof(uint64_t), compare_samples);
+
+        summary->count = handle->count;
+        summary->min_ns = handle->samples[0];
+        summary->max_ns = handle->samples[handle->count - 1];
+        summary->avg_ns = handle->total_ns / handle->count;
+        summary->p50_ns = get_percentile(handle->samples, handle->count, 50);
+        summary->p90_ns = get_percentile(handle->samples, handle->count, 90);
+        summary->p99_ns = get_percentile(handle->samples, handle->count, 99);
+    }
+}
+
+size_t latency_stats_fill_metrics(const LATENCY_SUMMARY* summary, REPORT_METRIC* metrics)
+{
+    size_t count = 0;
+    metrics[count].name = "latencyCount";
+    metrics[count++].value = (double)summary->count;
+    metrics[count].name = "latencyMinUs";
+    metrics[count++].value = summary->min_ns / NS_PER_US;
+    metrics[count].name = "latencyAvgUs";
+    metrics[count++].value = summary->avg_ns / NS_PER_US;
+    metrics[count].name = "latencyP50Us";
+    metrics[count++].value = summary->p50_ns / NS_PER_US;
+    metrics[count].name = "latencyP90Us";
+    metrics[count++].value = summary->p90_ns / NS_PER_US;
+    metrics[count].name = "latencyP99Us";
+    metrics[count++].value = summary->p99_ns / NS_PER_US;
+    metrics[count].name = "latencyMaxUs";
+    metrics[count++].value = summary->max_ns / NS_PER_US;
+    return count;
+}
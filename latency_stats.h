@@ -0,0 +1,57 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#include "mem_reporter.h"
+
+#define LATENCY_METRIC_COUNT    7
+
+typedef struct LATENCY_STATS_TAG* LATENCY_STATS_HANDLE;
+
+typedef struct LATENCY_SUMMARY_TAG
+{
+    size_t count;
+    uint64_t min_ns;
+    uint64_t avg_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+} LATENCY_SUMMARY;
+
+// Monotonic clock shared by every process on the machine, so a timestamp taken
+// by the local hub can be compared with one taken in the analytics app
+extern uint64_t latency_stats_get_time_ns(void);
+
+// CPU time consumed by the calling thread
+extern uint64_t latency_stats_get_thread_cpu_ns(void);
+
+// CPU time consumed by every thread of the process, includes the sdk worker threads
+extern uint64_t latency_stats_get_process_cpu_ns(void);
+
+// The samples are kept outside of gballoc so they don't show up in the heap
+// measurements. The handle is not thread safe, add samples from one thread.
+extern LATENCY_STATS_HANDLE latency_stats_create(size_t initial_capacity);
+extern void latency_stats_destroy(LATENCY_STATS_HANDLE handle);
+extern void latency_stats_add(LATENCY_STATS_HANDLE handle, uint64_t latency_ns);
+extern void latency_stats_get_summary(LATENCY_STATS_HANDLE handle, LATENCY_SUMMARY* summary);
+
+// Writes LATENCY_METRIC_COUNT entries (in microseconds) into metrics
+extern size_t latency_stats_fill_metrics(const LATENCY_SUMMARY* summary, REPORT_METRIC* metrics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* LATENCY_STATS_H */
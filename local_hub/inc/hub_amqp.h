@@ -0,0 +1,20 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HUB_AMQP_H
+#define HUB_AMQP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "hub_server.h"
+
+// AMQP 1.0 with the IoT Hub link addresses and CBS token exchange
+extern const HUB_PROTOCOL* hub_amqp_get_protocol(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HUB_AMQP_H
@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HUB_AMQP_CODEC_H
+#define HUB_AMQP_CODEC_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#define AMQP_DECODER_MAX_NODES  512
+#define AMQP_WRITER_MAX_DEPTH   8
+#define AMQP_NO_DESCRIPTOR      UINT64_MAX
+
+typedef enum AMQP_TYPE_TAG
+{
+    AMQP_TYPE_NULL,
+    AMQP_TYPE_BOOL,
+    AMQP_TYPE_UINT,
+    AMQP_TYPE_INT,
+    AMQP_TYPE_TIMESTAMP,
+    AMQP_TYPE_UUID,
+    AMQP_TYPE_BINARY,
+    AMQP_TYPE_STRING,
+    AMQP_TYPE_SYMBOL,
+    AMQP_TYPE_LIST,
+    AMQP_TYPE_MAP,
+    AMQP_TYPE_ARRAY,
+    AMQP_TYPE_DESCRIBED,
+    AMQP_TYPE_OTHER
+} AMQP_TYPE;
+
+// A decoded value points into the buffer it was decoded from, raw spans the
+// whole encoding so a value can be echoed back unchanged. Compound values
+// chain their items through first/next, a described value holds the
+// descriptor followed by the value.
+typedef struct AMQP_VALUE_TAG
+{
+    AMQP_TYPE type;
+    uint64_t uint_value;
+    int64_t int_value;
+    const unsigned char* data;
+    size_t length;
+    const unsigned char* raw;
+    size_t raw_length;
+    size_t count;
+    struct AMQP_VALUE_TAG* first;
+    struct AMQP_VALUE_TAG* next;
+} AMQP_VALUE;
+
+typedef struct AMQP_DECODER_TAG
+{
+    AMQP_VALUE nodes[AMQP_DECODER_MAX_NODES];
+    size_t used;
+} AMQP_DECODER;
+
+typedef struct AMQP_WRITER_TAG
+{
+    unsigned char* buffer;
+    size_t length;
+    size_t capacity;
+    bool failed;
+    // The next value completes a described value and is not counted again
+    bool described;
+    size_t depth;
+    size_t compound_offset[AMQP_WRITER_MAX_DEPTH];
+    uint32_t compound_count[AMQP_WRITER_MAX_DEPTH];
+} AMQP_WRITER;
+
+// Decoding, values live until the decoder is reset
+extern void amqp_decoder_reset(AMQP_DECODER* decoder);
+// Returns the number of bytes used or -1
+extern int amqp_decode(AMQP_DECODER* decoder, const unsigned char* data, size_t length, const AMQP_VALUE** value);
+extern uint64_t amqp_get_descriptor(const AMQP_VALUE* value);
+extern const AMQP_VALUE* amqp_get_described(const AMQP_VALUE* value);
+// NULL when the list is shorter or the item is null
+extern const AMQP_VALUE* amqp_get_item(const AMQP_VALUE* list, size_t index);
+extern const AMQP_VALUE* amqp_get_map_value(const AMQP_VALUE* map, const char* key);
+extern bool amqp_value_equals(const AMQP_VALUE* value, const char* text);
+extern uint64_t amqp_get_uint(const AMQP_VALUE* value, uint64_t default_value);
+extern bool amqp_get_bool(const AMQP_VALUE* value, bool default_value);
+
+// Encoding, compounds always use the 32 bit forms so they can be patched when closed
+extern void amqp_writer_init(AMQP_WRITER* writer);
+extern void amqp_writer_deinit(AMQP_WRITER* writer);
+extern void amqp_writer_reset(AMQP_WRITER* writer);
+extern void amqp_write_bytes(AMQP_WRITER* writer, const void* data, size_t length);
+extern void amqp_write_raw(AMQP_WRITER* writer, const unsigned char* raw, size_t length);
+extern void amqp_write_null(AMQP_WRITER* writer);
+extern void amqp_write_bool(AMQP_WRITER* writer, bool value);
+extern void amqp_write_ubyte(AMQP_WRITER* writer, uint8_t value);
+extern void amqp_write_ushort(AMQP_WRITER* writer, uint16_t value);
+extern void amqp_write_uint(AMQP_WRITER* writer, uint32_t value);
+extern void amqp_write_ulong(AMQP_WRITER* writer, uint64_t value);
+extern void amqp_write_int(AMQP_WRITER* writer, int32_t value);
+extern void amqp_write_long(AMQP_WRITER* writer, int64_t value);
+extern void amqp_write_uuid(AMQP_WRITER* writer, const unsigned char uuid[16]);
+extern void amqp_write_binary(AMQP_WRITER* writer, const void* data, size_t length);
+extern void amqp_write_string(AMQP_WRITER* writer, const char* value, size_t length);
+extern void amqp_write_symbol(AMQP_WRITER* writer, const char* value);
+// Symbols must be shorter than 256 bytes
+extern void amqp_write_symbol_array(AMQP_WRITER* writer, const char* const* symbols, size_t count);
+extern void amqp_write_descriptor(AMQP_WRITER* writer, uint64_t code);
+extern void amqp_begin_list(AMQP_WRITER* writer);
+extern void amqp_begin_map(AMQP_WRITER* writer);
+extern void amqp_end_compound(AMQP_WRITER* writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HUB_AMQP_CODEC_H
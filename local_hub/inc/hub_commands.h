@@ -0,0 +1,21 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HUB_COMMANDS_H
+#define HUB_COMMANDS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "hub_server.h"
+
+// Plain text control channel, one command per line and one "OK ..." or
+// "ERROR ..." line in response
+extern const HUB_PROTOCOL* hub_commands_get_protocol(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HUB_COMMANDS_H
@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HUB_CONTROL_H
+#define HUB_CONTROL_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#define HUB_CONTROL_RESPONSE_LEN    2048
+
+// Client side of the local hub control channel used by the analytics apps.
+// hub_control is "<host>:<port>" of the local_hub control listener.
+extern int hub_control_execute(const char* hub_control, const char* command, char* response, size_t response_len);
+
+// Reads key=value out of an "OK key=value ..." response
+extern int hub_control_get_value(const char* response, const char* key, uint64_t* value);
+extern int hub_control_get_string(const char* response, const char* key, char* value, size_t value_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HUB_CONTROL_H
@@ -0,0 +1,20 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HUB_HTTP_H
+#define HUB_HTTP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "hub_server.h"
+
+// The IoT Hub device REST api, upgrades to MQTT or AMQP over websockets
+extern const HUB_PROTOCOL* hub_http_get_protocol(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HUB_HTTP_H
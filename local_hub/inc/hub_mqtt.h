@@ -0,0 +1,20 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HUB_MQTT_H
+#define HUB_MQTT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "hub_server.h"
+
+// MQTT 3.1.1 with the IoT Hub topic layout
+extern const HUB_PROTOCOL* hub_mqtt_get_protocol(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HUB_MQTT_H
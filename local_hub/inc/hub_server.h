@@ -0,0 +1,187 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HUB_SERVER_H
+#define HUB_SERVER_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#include <openssl/ssl.h>
+
+#include "latency_stats.h"
+
+#define HUB_DEVICE_ID_LEN       128
+#define HUB_DEFAULT_MQTT_PORT   8883
+#define HUB_DEFAULT_AMQP_PORT   5671
+#define HUB_DEFAULT_HTTPS_PORT  443
+#define HUB_DEFAULT_CONTROL_PORT 8890
+#define HUB_DEFAULT_BIND_ADDRESS "127.0.0.1"
+#define HUB_METHOD_INFLIGHT_MAX 4096
+#define HUB_DEFAULT_DPS_POLLS   1
+#define HUB_DEFAULT_DPS_RETRY_AFTER 1
+
+typedef struct HUB_SERVER_TAG* HUB_SERVER_HANDLE;
+typedef struct HUB_CONNECTION_TAG HUB_CONNECTION;
+typedef struct HUB_DEVICE_TAG HUB_DEVICE;
+
+typedef enum HUB_MESSAGE_TYPE_TAG
+{
+    HUB_MESSAGE_C2D,
+    HUB_MESSAGE_METHOD,
+    HUB_MESSAGE_TWIN_PATCH,
+    HUB_MESSAGE_TYPE_COUNT
+} HUB_MESSAGE_TYPE;
+
+// A message waiting to be delivered to a device, properties are in the
+// url query form (key=value&key=value). Method invocations carry the
+// method name and use the sequence as the request id, desired property
+// patches use it as the twin version.
+typedef struct HUB_MESSAGE_TAG
+{
+    struct HUB_MESSAGE_TAG* next;
+    HUB_MESSAGE_TYPE msg_type;
+    uint32_t sequence;
+    char* name;
+    char* properties;
+    unsigned char* payload;
+    size_t payload_len;
+} HUB_MESSAGE;
+
+// Entry points a wire protocol implements for the connections it accepted
+typedef struct HUB_PROTOCOL_TAG
+{
+    const char* name;
+    void* (*create)(HUB_CONNECTION* conn);
+    void (*destroy)(void* protocol_state);
+    // Consumes complete frames from data, returns the number of bytes used or -1 to close
+    int (*on_bytes)(void* protocol_state, const unsigned char* data, size_t length);
+    // Returns 0 when the message was written to the connection
+    int (*deliver)(void* protocol_state, const HUB_MESSAGE* message);
+} HUB_PROTOCOL;
+
+typedef struct HUB_STATS_TAG
+{
+    uint64_t connections;
+    uint64_t bytes_recv;
+    uint64_t bytes_sent;
+    uint64_t telemetry_recv;
+    uint64_t telemetry_bytes;
+    uint64_t c2d_queued;
+    uint64_t c2d_sent;
+    uint64_t c2d_completed;
+    uint64_t method_queued;
+    uint64_t method_sent;
+    uint64_t method_completed;
+    uint64_t method_failed;
+    uint64_t method_inflight_max;
+    uint64_t twin_get;
+    uint64_t twin_reported;
+    uint64_t twin_reported_bytes;
+    uint64_t twin_patch_queued;
+    uint64_t twin_patch_sent;
+    uint64_t dps_registrations;
+    uint64_t dps_polls;
+    uint64_t dps_assigned;
+} HUB_STATS;
+
+typedef struct HUB_CONFIG_TAG
+{
+    const char* hostname;
+    const char* ca_cert_file;
+    // IPv4 address every listener binds to, the control port is not authenticated
+    const char* bind_address;
+    uint16_t mqtt_port;
+    // 0 disables the listener
+    uint16_t amqp_port;
+    uint16_t https_port;
+    uint16_t control_port;
+} HUB_CONFIG;
+
+struct HUB_CONNECTION_TAG
+{
+    HUB_SERVER_HANDLE server;
+    int sock;
+    SSL* ssl;
+    bool tls_established;
+    bool track_stats;
+    bool closing;
+    const HUB_PROTOCOL* protocol;
+    void* protocol_state;
+    // Set while the protocol runs inside websocket frames, every send goes through it
+    int (*frame_send)(void* frame_state, const void* data, size_t length);
+    void* frame_state;
+    HUB_DEVICE* device;
+    bool c2d_ready;
+    bool method_ready;
+    bool twin_ready;
+    // Operation status polls answered since the last DPS registration request
+    size_t dps_polls;
+
+    unsigned char* recv_buffer;
+    size_t recv_length;
+    size_t recv_capacity;
+    unsigned char* send_buffer;
+    size_t send_length;
+    size_t send_capacity;
+
+    HUB_CONNECTION* next;
+};
+
+extern HUB_SERVER_HANDLE hub_server_create(const HUB_CONFIG* config);
+extern void hub_server_destroy(HUB_SERVER_HANDLE handle);
+extern int hub_server_run(HUB_SERVER_HANDLE handle, volatile int* stop_running);
+
+extern uint64_t hub_get_time_ns(void);
+
+// Used by the control channel, device_id "*" addresses every connected device
+extern int hub_server_queue_c2d(HUB_SERVER_HANDLE handle, const char* device_id, size_t msg_count, size_t payload_size, size_t* queued);
+// Invokes a method msg_count times at rate calls per second, 0 sends them all at once
+extern int hub_server_queue_methods(HUB_SERVER_HANDLE handle, const char* device_id, size_t msg_count, size_t payload_size, size_t rate, size_t* queued);
+// Pushes desired property patches, the twin document size applies to every twin GET
+extern int hub_server_queue_twin_patches(HUB_SERVER_HANDLE handle, const char* device_id, size_t msg_count, size_t payload_size, size_t rate, size_t* queued);
+extern void hub_server_set_twin_size(HUB_SERVER_HANDLE handle, size_t document_size);
+// A registration is assigned on the poll_count'th operation status poll, 0 assigns it
+// in the registration response. retry_after (seconds) is handed to the device with every 202.
+extern void hub_server_set_dps(HUB_SERVER_HANDLE handle, size_t poll_count, size_t retry_after);
+// Registers a device without a connection, the hub does not check the key
+extern int hub_server_create_device(HUB_SERVER_HANDLE handle, const char* device_id);
+extern void hub_server_get_stats(HUB_SERVER_HANDLE handle, HUB_STATS* stats);
+// Round trip from the hub writing the request to reading the response
+extern void hub_server_get_latency(HUB_SERVER_HANDLE handle, HUB_MESSAGE_TYPE msg_type, LATENCY_SUMMARY* summary);
+extern void hub_server_reset_stats(HUB_SERVER_HANDLE handle);
+
+// Called by the protocol implementations
+extern int hub_connection_send(HUB_CONNECTION* conn, const void* data, size_t length);
+// Bypasses frame_send, used by the framing itself
+extern int hub_connection_send_raw(HUB_CONNECTION* conn, const void* data, size_t length);
+extern int hub_connection_attach_device(HUB_CONNECTION* conn, const char* device_id);
+extern void hub_connection_set_ready(HUB_CONNECTION* conn, HUB_MESSAGE_TYPE msg_type);
+extern const char* hub_connection_get_device_id(const HUB_CONNECTION* conn);
+extern void hub_connection_on_telemetry(HUB_CONNECTION* conn, size_t payload_len);
+// Removes the next C2D message for protocols where the device polls for it,
+// NULL when there is none. The caller frees it with hub_message_destroy.
+extern HUB_MESSAGE* hub_connection_take_c2d(HUB_CONNECTION* conn);
+extern void hub_message_destroy(HUB_MESSAGE* message);
+extern void hub_connection_on_completed(HUB_CONNECTION* conn, HUB_MESSAGE_TYPE msg_type);
+extern void hub_connection_on_method_response(HUB_CONNECTION* conn, uint32_t request_id, int status);
+// Returns the full twin document, the caller frees it
+extern unsigned char* hub_connection_get_twin(HUB_CONNECTION* conn, size_t* length);
+// Returns the new reported properties version
+extern uint32_t hub_connection_on_twin_reported(HUB_CONNECTION* conn, size_t payload_len);
+// Answers a DPS registration request or operation status poll, returns the json body
+// to send with status and retry_after, the caller frees it
+extern unsigned char* hub_connection_on_dps_request(HUB_CONNECTION* conn, bool is_poll, int* status, size_t* retry_after, size_t* length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HUB_SERVER_H
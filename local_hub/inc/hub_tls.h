@@ -0,0 +1,23 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HUB_TLS_H
+#define HUB_TLS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <openssl/ssl.h>
+
+// Creates a server context with a certificate for hostname signed by a test CA
+// that is generated on every start. The CA is written to ca_cert_file so the
+// analytics apps can trust it.
+extern SSL_CTX* hub_tls_create_context(const char* hostname, const char* ca_cert_file);
+extern void hub_tls_destroy_context(SSL_CTX* ssl_ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HUB_TLS_H
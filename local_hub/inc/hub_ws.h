@@ -0,0 +1,30 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef HUB_WS_H
+#define HUB_WS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "hub_server.h"
+
+#define HUB_WS_ACCEPT_KEY_LEN   32
+
+typedef struct HUB_WS_TAG* HUB_WS_HANDLE;
+
+// Runs inner inside websocket binary frames on a connection that completed the upgrade
+extern HUB_WS_HANDLE hub_ws_create(HUB_CONNECTION* conn, const HUB_PROTOCOL* inner);
+extern void hub_ws_destroy(HUB_WS_HANDLE handle);
+extern int hub_ws_on_bytes(HUB_WS_HANDLE handle, const unsigned char* data, size_t length);
+extern int hub_ws_deliver(HUB_WS_HANDLE handle, const HUB_MESSAGE* message);
+
+// Sec-WebSocket-Accept for the Sec-WebSocket-Key of the upgrade request
+extern int hub_ws_get_accept_key(const char* key, size_t key_len, char accept[HUB_WS_ACCEPT_KEY_LEN]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HUB_WS_H
@@ -0,0 +1,1239 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hub_amqp.h"
+#include "hub_amqp_codec.h"
+
+#define AMQP_HEADER_LEN         8
+#define AMQP_FRAME_HEADER_LEN   8
+#define AMQP_FRAME_TYPE_AMQP    0
+#define AMQP_FRAME_TYPE_SASL    1
+#define AMQP_MAX_FRAME_SIZE     65536
+#define AMQP_MIN_FRAME_SIZE     512
+// Room for the frame header and transfer performative in front of a message chunk
+#define AMQP_TRANSFER_OVERHEAD  64
+#define AMQP_MAX_SESSIONS       4
+#define AMQP_MAX_LINKS          16
+#define AMQP_LINK_CREDIT        1000
+#define AMQP_WINDOW             0x7FFFFFFF
+#define AMQP_BATCH_FORMAT       0x80013700
+#define AMQP_MAX_PROPERTY_LEN   128
+#define AMQP_MAX_ADDRESS_LEN    512
+
+#define AMQP_OPEN               0x10
+#define AMQP_BEGIN              0x11
+#define AMQP_ATTACH             0x12
+#define AMQP_FLOW               0x13
+#define AMQP_TRANSFER           0x14
+#define AMQP_DISPOSITION        0x15
+#define AMQP_DETACH             0x16
+#define AMQP_END                0x17
+#define AMQP_CLOSE              0x18
+#define AMQP_ACCEPTED           0x24
+#define AMQP_SOURCE             0x28
+#define AMQP_TARGET             0x29
+#define AMQP_SASL_MECHANISMS    0x40
+#define AMQP_SASL_INIT          0x41
+#define AMQP_SASL_OUTCOME       0x44
+
+#define AMQP_MESSAGE_ANNOTATIONS 0x72
+#define AMQP_PROPERTIES         0x73
+#define AMQP_APPLICATION_PROPERTIES 0x74
+#define AMQP_DATA               0x75
+#define AMQP_VALUE_SECTION      0x77
+
+#define AMQP_PROPERTY_MESSAGE_ID        0
+#define AMQP_PROPERTY_CORRELATION_ID    5
+
+static const unsigned char SASL_PROTOCOL_HEADER[AMQP_HEADER_LEN] = { 'A', 'M', 'Q', 'P', 3, 1, 0, 0 };
+static const unsigned char AMQP_PROTOCOL_HEADER[AMQP_HEADER_LEN] = { 'A', 'M', 'Q', 'P', 0, 1, 0, 0 };
+static const unsigned char EMPTY_FRAME[AMQP_FRAME_HEADER_LEN] = { 0, 0, 0, AMQP_FRAME_HEADER_LEN, 2, AMQP_FRAME_TYPE_AMQP, 0, 0 };
+static const char* const SASL_MECHANISMS[] = { "MSSBCBS", "ANONYMOUS", "PLAIN" };
+static const char* const CONTAINER_ID = "local_hub";
+static const char* const CBS_ADDRESS = "$cbs";
+static const char* const DEVICE_ADDRESS_SEGMENT = "/devices/";
+static const char* const TELEMETRY_ADDRESS_SEGMENT = "/messages/events";
+static const char* const C2D_ADDRESS_SEGMENT = "/messages/devicebound";
+static const char* const METHODS_ADDRESS_SEGMENT = "/methods/devicebound";
+static const char* const TWIN_ADDRESS_SEGMENT = "/twin";
+static const char* const DPS_ADDRESS_SEGMENT = "/registrations/";
+static const char* const METHOD_NAME_PROPERTY = "IoThub-methodname";
+static const char* const METHOD_STATUS_PROPERTY = "IoThub-status";
+static const char* const TWIN_OPERATION_ANNOTATION = "operation";
+static const char* const TWIN_RESOURCE_ANNOTATION = "resource";
+static const char* const TWIN_STATUS_ANNOTATION = "status";
+static const char* const TWIN_VERSION_ANNOTATION = "version";
+static const char* const TWIN_DESIRED_RESOURCE = "/notifications/twin/properties/desired";
+static const char* const DPS_OPERATION_TYPE_PROPERTY = "iotdps-operation-type";
+static const char* const DPS_STATUS_OPERATION = "iotdps-get-operationstatus";
+static const char* const DPS_RETRY_AFTER_PROPERTY = "retry-after";
+
+typedef enum AMQP_STATE_TAG
+{
+    AMQP_STATE_HEADER,
+    AMQP_STATE_SASL,
+    AMQP_STATE_OPEN
+} AMQP_STATE;
+
+typedef enum AMQP_LINK_TYPE_TAG
+{
+    AMQP_LINK_OTHER,
+    AMQP_LINK_CBS,
+    AMQP_LINK_TELEMETRY,
+    AMQP_LINK_C2D,
+    AMQP_LINK_METHODS,
+    AMQP_LINK_TWIN,
+    AMQP_LINK_DPS
+} AMQP_LINK_TYPE;
+
+// Links use the handle the device picked, the hub answers with the same one
+typedef struct AMQP_LINK_TAG
+{
+    bool attached;
+    AMQP_LINK_TYPE link_type;
+    // The device is the sender, the hub grants it credit
+    bool device_sends;
+    uint32_t delivery_count;
+    uint32_t credit;
+
+    // Delivery from the device that spans several transfer frames
+    bool in_delivery;
+    bool delivery_settled;
+    uint32_t delivery_id;
+    uint32_t message_format;
+    unsigned char* delivery;
+    size_t delivery_length;
+    size_t delivery_capacity;
+} AMQP_LINK;
+
+typedef struct AMQP_SESSION_TAG
+{
+    bool begun;
+    uint32_t next_outgoing_id;
+    uint32_t next_incoming_id;
+    uint32_t next_delivery_id;
+    // C2D deliveries waiting for the device disposition
+    uint32_t c2d_unsettled;
+    AMQP_LINK links[AMQP_MAX_LINKS];
+} AMQP_SESSION;
+
+typedef struct AMQP_MESSAGE_TAG
+{
+    const AMQP_VALUE* annotations;
+    const AMQP_VALUE* properties;
+    const AMQP_VALUE* application_properties;
+    const unsigned char* body;
+    size_t body_length;
+    size_t data_count;
+} AMQP_MESSAGE;
+
+typedef struct AMQP_CONTEXT_TAG
+{
+    HUB_CONNECTION* conn;
+    AMQP_STATE state;
+    bool sasl_done;
+    uint32_t remote_max_frame_size;
+    AMQP_SESSION sessions[AMQP_MAX_SESSIONS];
+    AMQP_DECODER decoder;
+    AMQP_WRITER frame;
+    AMQP_WRITER message;
+} AMQP_CONTEXT;
+
+static void begin_performative(AMQP_CONTEXT* context, uint64_t code)
+{
+    amqp_writer_reset(&context->frame);
+    amqp_write_bytes(&context->frame, EMPTY_FRAME, AMQP_FRAME_HEADER_LEN);
+    amqp_write_descriptor(&context->frame, code);
+    amqp_begin_list(&context->frame);
+}
+
+// Closes the performative list started by begin_performative and sends the frame
+static int send_performative(AMQP_CONTEXT* context, uint16_t channel, uint8_t frame_type, const unsigned char* payload, size_t payload_len)
+{
+    int result;
+    AMQP_WRITER* frame = &context->frame;
+
+    amqp_end_compound(frame);
+    amqp_write_bytes(frame, payload, payload_len);
+    if (frame->failed)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        frame->buffer[0] = (unsigned char)(frame->length >> 24);
+        frame->buffer[1] = (unsigned char)((frame->length >> 16) & 0xFF);
+        frame->buffer[2] = (unsigned char)((frame->length >> 8) & 0xFF);
+        frame->buffer[3] = (unsigned char)(frame->length & 0xFF);
+        frame->buffer[5] = frame_type;
+        frame->buffer[6] = (unsigned char)(channel >> 8);
+        frame->buffer[7] = (unsigned char)(channel & 0xFF);
+        result = hub_connection_send(context->conn, frame->buffer, frame->length);
+    }
+    return result;
+}
+
+static AMQP_LINK* find_link(AMQP_CONTEXT* context, AMQP_LINK_TYPE link_type, bool device_sends, uint16_t* channel, uint32_t* handle)
+{
+    AMQP_LINK* result = NULL;
+    for (uint16_t session_index = 0; session_index < AMQP_MAX_SESSIONS && result == NULL; session_index++)
+    {
+        AMQP_SESSION* session = &context->sessions[session_index];
+        for (uint32_t link_index = 0; session->begun && link_index < AMQP_MAX_LINKS; link_index++)
+        {
+            AMQP_LINK* link = &session->links[link_index];
+            if (link->attached && link->link_type == link_type && link->device_sends == device_sends)
+            {
+                *channel = session_index;
+                *handle = link_index;
+                result = link;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+// Sends the message built in context->message, split to the frame size of the device
+static int send_message(AMQP_CONTEXT* context, uint16_t channel, uint32_t handle, bool settled)
+{
+    int result = 0;
+    AMQP_SESSION* session = &context->sessions[channel];
+    AMQP_LINK* link = &session->links[handle];
+    size_t chunk_size = context->remote_max_frame_size - AMQP_TRANSFER_OVERHEAD;
+    size_t pos = 0;
+
+    if (context->message.failed)
+    {
+        result = __LINE__;
+    }
+    else if (link->credit == 0)
+    {
+        // Wait for the device to issue credit
+        result = __LINE__;
+    }
+    else
+    {
+        do
+        {
+            size_t length = context->message.length - pos < chunk_size ? context->message.length - pos : chunk_size;
+            bool more = pos + length < context->message.length;
+            begin_performative(context, AMQP_TRANSFER);
+            amqp_write_uint(&context->frame, handle);
+            if (pos == 0)
+            {
+                unsigned char tag[4];
+                tag[0] = (unsigned char)(session->next_delivery_id >> 24);
+                tag[1] = (unsigned char)((session->next_delivery_id >> 16) & 0xFF);
+                tag[2] = (unsigned char)((session->next_delivery_id >> 8) & 0xFF);
+                tag[3] = (unsigned char)(session->next_delivery_id & 0xFF);
+                amqp_write_uint(&context->frame, session->next_delivery_id);
+                amqp_write_binary(&context->frame, tag, sizeof(tag));
+                amqp_write_uint(&context->frame, 0);
+                amqp_write_bool(&context->frame, settled);
+            }
+            else
+            {
+                amqp_write_null(&context->frame);
+                amqp_write_null(&context->frame);
+                amqp_write_null(&context->frame);
+                amqp_write_null(&context->frame);
+            }
+            amqp_write_bool(&context->frame, more);
+            result = send_performative(context, channel, AMQP_FRAME_TYPE_AMQP, context->message.buffer + pos, length);
+            session->next_outgoing_id++;
+            pos += length;
+        } while (result == 0 && pos < context->message.length);
+
+        if (result == 0)
+        {
+            session->next_delivery_id++;
+            link->delivery_count++;
+            link->credit--;
+        }
+    }
+    return result;
+}
+
+// Application properties from the url query form the server uses
+static void write_query_properties(AMQP_WRITER* writer, const char* properties)
+{
+    amqp_write_descriptor(writer, AMQP_APPLICATION_PROPERTIES);
+    amqp_begin_map(writer);
+    while (properties != NULL && *properties != '\0')
+    {
+        size_t property_len = strcspn(properties, "&");
+        const char* separator = memchr(properties, '=', property_len);
+        if (separator != NULL)
+        {
+            amqp_write_string(writer, properties, (size_t)(separator - properties));
+            amqp_write_string(writer, separator + 1, property_len - (size_t)(separator - properties) - 1);
+        }
+        properties += property_len;
+        if (*properties == '&')
+        {
+            properties++;
+        }
+    }
+    amqp_end_compound(writer);
+}
+
+static void write_correlation_properties(AMQP_WRITER* writer, const AMQP_VALUE* correlation_id)
+{
+    amqp_write_descriptor(writer, AMQP_PROPERTIES);
+    amqp_begin_list(writer);
+    for (size_t index = 0; index < AMQP_PROPERTY_CORRELATION_ID; index++)
+    {
+        amqp_write_null(writer);
+    }
+    amqp_write_raw(writer, correlation_id->raw, correlation_id->raw_length);
+    amqp_end_compound(writer);
+}
+
+static void write_data(AMQP_WRITER* writer, const unsigned char* data, size_t length)
+{
+    amqp_write_descriptor(writer, AMQP_DATA);
+    amqp_write_binary(writer, data, length);
+}
+
+static int send_sasl_mechanisms(AMQP_CONTEXT* context)
+{
+    begin_performative(context, AMQP_SASL_MECHANISMS);
+    amqp_write_symbol_array(&context->frame, SASL_MECHANISMS, sizeof(SASL_MECHANISMS) / sizeof(SASL_MECHANISMS[0]));
+    return send_performative(context, 0, AMQP_FRAME_TYPE_SASL, NULL, 0);
+}
+
+static int on_sasl_frame(AMQP_CONTEXT* context, uint64_t code)
+{
+    int result;
+    if (code != AMQP_SASL_INIT)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        // Any mechanism and credentials are accepted
+        begin_performative(context, AMQP_SASL_OUTCOME);
+        amqp_write_ubyte(&context->frame, 0);
+        result = send_performative(context, 0, AMQP_FRAME_TYPE_SASL, NULL, 0);
+        context->state = AMQP_STATE_HEADER;
+        context->sasl_done = true;
+    }
+    return result;
+}
+
+static int on_open(AMQP_CONTEXT* context, const AMQP_VALUE* fields)
+{
+    uint64_t max_frame_size = amqp_get_uint(amqp_get_item(fields, 2), UINT32_MAX);
+    const AMQP_VALUE* idle_timeout = amqp_get_item(fields, 4);
+
+    context->remote_max_frame_size = max_frame_size > AMQP_MAX_FRAME_SIZE ? AMQP_MAX_FRAME_SIZE : (max_frame_size < AMQP_MIN_FRAME_SIZE ? AMQP_MIN_FRAME_SIZE : (uint32_t)max_frame_size);
+    begin_performative(context, AMQP_OPEN);
+    amqp_write_string(&context->frame, CONTAINER_ID, strlen(CONTAINER_ID));
+    amqp_write_null(&context->frame);
+    amqp_write_uint(&context->frame, AMQP_MAX_FRAME_SIZE);
+    amqp_write_ushort(&context->frame, AMQP_MAX_SESSIONS - 1);
+    if (idle_timeout != NULL)
+    {
+        // The device then sends empty frames often enough for the echo to keep its own timeout satisfied
+        amqp_write_uint(&context->frame, (uint32_t)(amqp_get_uint(idle_timeout, 0) / 2));
+    }
+    return send_performative(context, 0, AMQP_FRAME_TYPE_AMQP, NULL, 0);
+}
+
+static int on_begin(AMQP_CONTEXT* context, uint16_t channel, const AMQP_VALUE* fields)
+{
+    int result;
+    if (channel >= AMQP_MAX_SESSIONS || context->sessions[channel].begun)
+    {
+        (void)printf("Unsupported amqp session on channel %u\r\n", channel);
+        result = __LINE__;
+    }
+    else
+    {
+        AMQP_SESSION* session = &context->sessions[channel];
+        memset(session, 0, sizeof(AMQP_SESSION));
+        session->begun = true;
+        session->next_incoming_id = (uint32_t)amqp_get_uint(amqp_get_item(fields, 1), 0);
+
+        begin_performative(context, AMQP_BEGIN);
+        amqp_write_ushort(&context->frame, channel);
+        amqp_write_uint(&context->frame, session->next_outgoing_id);
+        amqp_write_uint(&context->frame, AMQP_WINDOW);
+        amqp_write_uint(&context->frame, AMQP_WINDOW);
+        amqp_write_uint(&context->frame, AMQP_MAX_LINKS - 1);
+        result = send_performative(context, channel, AMQP_FRAME_TYPE_AMQP, NULL, 0);
+    }
+    return result;
+}
+
+static int send_link_flow(AMQP_CONTEXT* context, uint16_t channel, uint32_t handle)
+{
+    AMQP_SESSION* session = &context->sessions[channel];
+    AMQP_LINK* link = &session->links[handle];
+
+    begin_performative(context, AMQP_FLOW);
+    amqp_write_uint(&context->frame, session->next_incoming_id);
+    amqp_write_uint(&context->frame, AMQP_WINDOW);
+    amqp_write_uint(&context->frame, session->next_outgoing_id);
+    amqp_write_uint(&context->frame, AMQP_WINDOW);
+    amqp_write_uint(&context->frame, handle);
+    amqp_write_uint(&context->frame, link->delivery_count);
+    amqp_write_uint(&context->frame, link->device_sends ? link->credit : 0);
+    return send_performative(context, channel, AMQP_FRAME_TYPE_AMQP, NULL, 0);
+}
+
+static bool copy_address(const AMQP_VALUE* address, char* text, size_t length)
+{
+    bool result = address != NULL && address->type == AMQP_TYPE_STRING && address->length < length;
+    if (result)
+    {
+        memcpy(text, address->data, address->length);
+        text[address->length] = '\0';
+    }
+    return result;
+}
+
+static AMQP_LINK_TYPE get_link_type(const char* address)
+{
+    AMQP_LINK_TYPE result;
+    if (strcmp(address, CBS_ADDRESS) == 0)
+    {
+        result = AMQP_LINK_CBS;
+    }
+    else if (strstr(address, TELEMETRY_ADDRESS_SEGMENT) != NULL)
+    {
+        result = AMQP_LINK_TELEMETRY;
+    }
+    else if (strstr(address, C2D_ADDRESS_SEGMENT) != NULL)
+    {
+        result = AMQP_LINK_C2D;
+    }
+    else if (strstr(address, METHODS_ADDRESS_SEGMENT) != NULL)
+    {
+        result = AMQP_LINK_METHODS;
+    }
+    else if (strstr(address, TWIN_ADDRESS_SEGMENT) != NULL)
+    {
+        result = AMQP_LINK_TWIN;
+    }
+    else if (strstr(address, DPS_ADDRESS_SEGMENT) != NULL)
+    {
+        result = AMQP_LINK_DPS;
+    }
+    else
+    {
+        result = AMQP_LINK_OTHER;
+    }
+    return result;
+}
+
+// amqps://{host}/devices/{id}/... or amqps://{host}/{scope}/registrations/{id} for DPS,
+// the first device link attaches the connection
+static int attach_device(AMQP_CONTEXT* context, const char* address)
+{
+    int result = 0;
+    const char* segment = strstr(address, DEVICE_ADDRESS_SEGMENT);
+    const char* segment_end = segment == NULL ? NULL : segment + strlen(DEVICE_ADDRESS_SEGMENT);
+    if (segment == NULL && (segment = strstr(address, DPS_ADDRESS_SEGMENT)) != NULL)
+    {
+        segment_end = segment + strlen(DPS_ADDRESS_SEGMENT);
+    }
+    if (segment != NULL)
+    {
+        char device_id[HUB_DEVICE_ID_LEN];
+        const char* id_start = segment_end;
+        size_t id_len = strcspn(id_start, "/");
+
+        if (id_len == 0 || id_len >= sizeof(device_id))
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            memcpy(device_id, id_start, id_len);
+            device_id[id_len] = '\0';
+            if (strcmp(hub_connection_get_device_id(context->conn), device_id) != 0)
+            {
+                result = hub_connection_attach_device(context->conn, device_id);
+            }
+        }
+    }
+    return result;
+}
+
+static int on_attach(AMQP_CONTEXT* context, uint16_t channel, const AMQP_VALUE* fields)
+{
+    int result;
+    AMQP_SESSION* session = &context->sessions[channel];
+    uint64_t handle = amqp_get_uint(amqp_get_item(fields, 1), UINT64_MAX);
+    // role false is the sender
+    bool device_sends = !amqp_get_bool(amqp_get_item(fields, 2), false);
+    const AMQP_VALUE* source = amqp_get_item(fields, 5);
+    const AMQP_VALUE* target = amqp_get_item(fields, 6);
+    char address[AMQP_MAX_ADDRESS_LEN];
+
+    if (!copy_address(amqp_get_item(amqp_get_described(device_sends ? target : source), 0), address, sizeof(address)))
+    {
+        address[0] = '\0';
+    }
+
+    if (handle >= AMQP_MAX_LINKS || session->links[handle].attached)
+    {
+        (void)printf("Unsupported amqp link handle %llu\r\n", (unsigned long long)handle);
+        result = __LINE__;
+    }
+    else if (attach_device(context, address) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        AMQP_LINK* link = &session->links[handle];
+        const unsigned char* name = amqp_get_item(fields, 0) == NULL ? NULL : amqp_get_item(fields, 0)->raw;
+        size_t name_len = name == NULL ? 0 : amqp_get_item(fields, 0)->raw_length;
+
+        memset(link, 0, sizeof(AMQP_LINK));
+        link->attached = true;
+        link->device_sends = device_sends;
+        link->link_type = get_link_type(address);
+        link->delivery_count = device_sends ? (uint32_t)amqp_get_uint(amqp_get_item(fields, 9), 0) : 0;
+
+        // The hub mirrors the terminus and settle modes of the device
+        begin_performative(context, AMQP_ATTACH);
+        if (name == NULL)
+        {
+            amqp_write_string(&context->frame, "", 0);
+        }
+        else
+        {
+            amqp_write_raw(&context->frame, name, name_len);
+        }
+        amqp_write_uint(&context->frame, (uint32_t)handle);
+        amqp_write_bool(&context->frame, device_sends);
+        for (size_t index = 3; index <= 6; index++)
+        {
+            const AMQP_VALUE* item = amqp_get_item(fields, index);
+            if (item == NULL)
+            {
+                amqp_write_null(&context->frame);
+            }
+            else
+            {
+                amqp_write_raw(&context->frame, item->raw, item->raw_length);
+            }
+        }
+        amqp_write_null(&context->frame);
+        amqp_write_bool(&context->frame, false);
+        if (device_sends)
+        {
+            amqp_write_null(&context->frame);
+        }
+        else
+        {
+            amqp_write_uint(&context->frame, link->delivery_count);
+        }
+
+        if ((result = send_performative(context, channel, AMQP_FRAME_TYPE_AMQP, NULL, 0)) == 0 && device_sends)
+        {
+            link->credit = AMQP_LINK_CREDIT;
+            result = send_link_flow(context, channel, (uint32_t)handle);
+        }
+    }
+    return result;
+}
+
+static int on_flow(AMQP_CONTEXT* context, uint16_t channel, const AMQP_VALUE* fields)
+{
+    int result = 0;
+    AMQP_SESSION* session = &context->sessions[channel];
+    uint64_t handle = amqp_get_uint(amqp_get_item(fields, 4), UINT64_MAX);
+
+    if (handle < AMQP_MAX_LINKS && session->links[handle].attached)
+    {
+        AMQP_LINK* link = &session->links[handle];
+        if (!link->device_sends)
+        {
+            // Credit counts from the delivery count the device has seen
+            uint32_t remote_delivery_count = (uint32_t)amqp_get_uint(amqp_get_item(fields, 5), link->delivery_count);
+            uint32_t link_credit = (uint32_t)amqp_get_uint(amqp_get_item(fields, 6), 0);
+            link->credit = remote_delivery_count + link_credit - link->delivery_count;
+            if (link->credit > 0 && link->link_type == AMQP_LINK_C2D)
+            {
+                hub_connection_set_ready(context->conn, HUB_MESSAGE_C2D);
+            }
+            else if (link->credit > 0 && link->link_type == AMQP_LINK_METHODS)
+            {
+                hub_connection_set_ready(context->conn, HUB_MESSAGE_METHOD);
+            }
+        }
+        if (amqp_get_bool(amqp_get_item(fields, 9), false))
+        {
+            result = send_link_flow(context, channel, (uint32_t)handle);
+        }
+    }
+    return result;
+}
+
+static int parse_message(AMQP_CONTEXT* context, const unsigned char* data, size_t length, AMQP_MESSAGE* message)
+{
+    int result = 0;
+    size_t pos = 0;
+
+    memset(message, 0, sizeof(AMQP_MESSAGE));
+    while (pos < length && result == 0)
+    {
+        const AMQP_VALUE* section;
+        int used = amqp_decode(&context->decoder, data + pos, length - pos, &section);
+        if (used < 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            const AMQP_VALUE* value = amqp_get_described(section);
+            switch (amqp_get_descriptor(section))
+            {
+                case AMQP_MESSAGE_ANNOTATIONS:
+                    message->annotations = value;
+                    break;
+                case AMQP_PROPERTIES:
+                    message->properties = value;
+                    break;
+                case AMQP_APPLICATION_PROPERTIES:
+                    message->application_properties = value;
+                    break;
+                case AMQP_DATA:
+                    if (message->body == NULL)
+                    {
+                        message->body = value->data;
+                    }
+                    message->body_length += value->length;
+                    message->data_count++;
+                    break;
+                default:
+                    break;
+            }
+            pos += (size_t)used;
+        }
+    }
+    return result;
+}
+
+static int send_cbs_response(AMQP_CONTEXT* context, const AMQP_MESSAGE* request)
+{
+    int result;
+    uint16_t channel;
+    uint32_t handle;
+    const AMQP_VALUE* message_id = amqp_get_item(request->properties, AMQP_PROPERTY_MESSAGE_ID);
+
+    if (message_id == NULL || find_link(context, AMQP_LINK_CBS, false, &channel, &handle) == NULL)
+    {
+        (void)printf("Cbs request without a message id or reply link\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        // Every put-token succeeds, the hub does not validate the SAS token
+        amqp_writer_reset(&context->message);
+        write_correlation_properties(&context->message, message_id);
+        amqp_write_descriptor(&context->message, AMQP_APPLICATION_PROPERTIES);
+        amqp_begin_map(&context->message);
+        amqp_write_string(&context->message, "status-code", strlen("status-code"));
+        amqp_write_int(&context->message, 200);
+        amqp_write_string(&context->message, "status-description", strlen("status-description"));
+        amqp_write_string(&context->message, "OK", 2);
+        amqp_end_compound(&context->message);
+        amqp_write_descriptor(&context->message, AMQP_VALUE_SECTION);
+        amqp_write_null(&context->message);
+        result = send_message(context, channel, handle, true);
+    }
+    return result;
+}
+
+// The method request id travels in the last four bytes of the message id uuid
+static int on_method_response(AMQP_CONTEXT* context, const AMQP_MESSAGE* response)
+{
+    int result;
+    const AMQP_VALUE* correlation_id = amqp_get_item(response->properties, AMQP_PROPERTY_CORRELATION_ID);
+    const AMQP_VALUE* status = amqp_get_map_value(response->application_properties, METHOD_STATUS_PROPERTY);
+
+    if (correlation_id == NULL || correlation_id->type != AMQP_TYPE_UUID || status == NULL)
+    {
+        (void)printf("Invalid method response\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        const unsigned char* uuid = correlation_id->data;
+        uint32_t request_id = ((uint32_t)uuid[12] << 24) | ((uint32_t)uuid[13] << 16) | ((uint32_t)uuid[14] << 8) | uuid[15];
+        hub_connection_on_method_response(context->conn, request_id, (int)amqp_get_uint(status, 0));
+        result = 0;
+    }
+    return result;
+}
+
+static int on_twin_request(AMQP_CONTEXT* context, const AMQP_MESSAGE* request)
+{
+    int result;
+    uint16_t channel;
+    uint32_t handle;
+    const AMQP_VALUE* correlation_id = amqp_get_item(request->properties, AMQP_PROPERTY_CORRELATION_ID);
+    const AMQP_VALUE* operation = amqp_get_map_value(request->annotations, TWIN_OPERATION_ANNOTATION);
+    const AMQP_VALUE* resource = amqp_get_map_value(request->annotations, TWIN_RESOURCE_ANNOTATION);
+
+    if (correlation_id == NULL || operation == NULL || find_link(context, AMQP_LINK_TWIN, false, &channel, &handle) == NULL)
+    {
+        (void)printf("Invalid twin request\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        unsigned char* twin = NULL;
+        size_t twin_len = 0;
+        int status = 200;
+        uint32_t version = 0;
+
+        if (amqp_value_equals(operation, "GET"))
+        {
+            if ((twin = hub_connection_get_twin(context->conn, &twin_len)) == NULL)
+            {
+                status = 500;
+            }
+        }
+        else if (amqp_value_equals(operation, "PATCH"))
+        {
+            version = hub_connection_on_twin_reported(context->conn, request->body_length);
+            status = 204;
+        }
+        else if (amqp_value_equals(operation, "PUT") && amqp_value_equals(resource, TWIN_DESIRED_RESOURCE))
+        {
+            hub_connection_set_ready(context->conn, HUB_MESSAGE_TWIN_PATCH);
+        }
+        else if (amqp_value_equals(operation, "DELETE"))
+        {
+            context->conn->twin_ready = false;
+        }
+
+        amqp_writer_reset(&context->message);
+        amqp_write_descriptor(&context->message, AMQP_MESSAGE_ANNOTATIONS);
+        amqp_begin_map(&context->message);
+        amqp_write_symbol(&context->message, TWIN_STATUS_ANNOTATION);
+        amqp_write_int(&context->message, status);
+        if (version > 0)
+        {
+            amqp_write_symbol(&context->message, TWIN_VERSION_ANNOTATION);
+            amqp_write_long(&context->message, version);
+        }
+        amqp_end_compound(&context->message);
+        write_correlation_properties(&context->message, correlation_id);
+        write_data(&context->message, twin, twin_len);
+        result = send_message(context, channel, handle, true);
+        free(twin);
+    }
+    return result;
+}
+
+// The registration id is the one of the link address, the body is not inspected
+static int on_dps_request(AMQP_CONTEXT* context, const AMQP_MESSAGE* request)
+{
+    int result;
+    uint16_t channel;
+    uint32_t handle;
+    const AMQP_VALUE* message_id = amqp_get_item(request->properties, AMQP_PROPERTY_MESSAGE_ID);
+    const AMQP_VALUE* operation = amqp_get_map_value(request->application_properties, DPS_OPERATION_TYPE_PROPERTY);
+    unsigned char* response;
+    int status;
+    size_t retry_after;
+    size_t response_len;
+
+    if (operation == NULL || find_link(context, AMQP_LINK_DPS, false, &channel, &handle) == NULL)
+    {
+        (void)printf("Invalid dps request\r\n");
+        result = __LINE__;
+    }
+    else if ((response = hub_connection_on_dps_request(context->conn, amqp_value_equals(operation, DPS_STATUS_OPERATION), &status, &retry_after, &response_len)) == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        amqp_writer_reset(&context->message);
+        if (message_id != NULL)
+        {
+            write_correlation_properties(&context->message, message_id);
+        }
+        if (status == 202)
+        {
+            char retry_text[AMQP_MAX_PROPERTY_LEN];
+            int retry_len = snprintf(retry_text, sizeof(retry_text), "%zu", retry_after);
+            amqp_write_descriptor(&context->message, AMQP_APPLICATION_PROPERTIES);
+            amqp_begin_map(&context->message);
+            amqp_write_string(&context->message, DPS_RETRY_AFTER_PROPERTY, strlen(DPS_RETRY_AFTER_PROPERTY));
+            amqp_write_string(&context->message, retry_text, (size_t)retry_len);
+            amqp_end_compound(&context->message);
+        }
+        write_data(&context->message, response, response_len);
+        result = send_message(context, channel, handle, true);
+        free(response);
+    }
+    return result;
+}
+
+static int on_message(AMQP_CONTEXT* context, AMQP_LINK* link)
+{
+    int result;
+    AMQP_MESSAGE message;
+
+    if (parse_message(context, link->delivery, link->delivery_length, &message) != 0)
+    {
+        (void)printf("Invalid amqp message\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        switch (link->link_type)
+        {
+            case AMQP_LINK_CBS:
+                result = send_cbs_response(context, &message);
+                break;
+            case AMQP_LINK_TELEMETRY:
+                if (link->message_format == AMQP_BATCH_FORMAT && message.data_count > 0)
+                {
+                    // Every data section of a batch is an encoded message
+                    for (size_t index = 0; index < message.data_count; index++)
+                    {
+                        hub_connection_on_telemetry(context->conn, message.body_length / message.data_count);
+                    }
+                }
+                else
+                {
+                    hub_connection_on_telemetry(context->conn, message.body_length);
+                }
+                result = 0;
+                break;
+            case AMQP_LINK_METHODS:
+                result = on_method_response(context, &message);
+                break;
+            case AMQP_LINK_TWIN:
+                result = on_twin_request(context, &message);
+                break;
+            case AMQP_LINK_DPS:
+                result = on_dps_request(context, &message);
+                break;
+            default:
+                result = 0;
+                break;
+        }
+    }
+    return result;
+}
+
+static int append_delivery(AMQP_LINK* link, const unsigned char* payload, size_t payload_len)
+{
+    int result = 0;
+    if (link->delivery_length + payload_len > link->delivery_capacity)
+    {
+        size_t new_capacity = link->delivery_capacity == 0 ? AMQP_MAX_FRAME_SIZE : link->delivery_capacity;
+        unsigned char* new_delivery;
+        while (new_capacity < link->delivery_length + payload_len)
+        {
+            new_capacity *= 2;
+        }
+        if ((new_delivery = (unsigned char*)realloc(link->delivery, new_capacity)) == NULL)
+        {
+            (void)printf("Failure allocating amqp delivery\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            link->delivery = new_delivery;
+            link->delivery_capacity = new_capacity;
+        }
+    }
+    if (result == 0 && payload_len > 0)
+    {
+        memcpy(link->delivery + link->delivery_length, payload, payload_len);
+        link->delivery_length += payload_len;
+    }
+    return result;
+}
+
+static int on_transfer(AMQP_CONTEXT* context, uint16_t channel, const AMQP_VALUE* fields, const unsigned char* payload, size_t payload_len)
+{
+    int result;
+    AMQP_SESSION* session = &context->sessions[channel];
+    uint64_t handle = amqp_get_uint(amqp_get_item(fields, 0), UINT64_MAX);
+
+    session->next_incoming_id++;
+    if (handle >= AMQP_MAX_LINKS || !session->links[handle].attached || !session->links[handle].device_sends)
+    {
+        (void)printf("Amqp transfer on unknown link %llu\r\n", (unsigned long long)handle);
+        result = __LINE__;
+    }
+    else
+    {
+        AMQP_LINK* link = &session->links[handle];
+        if (!link->in_delivery)
+        {
+            link->in_delivery = true;
+            link->delivery_length = 0;
+            link->delivery_id = (uint32_t)amqp_get_uint(amqp_get_item(fields, 1), 0);
+            link->message_format = (uint32_t)amqp_get_uint(amqp_get_item(fields, 3), 0);
+            link->delivery_settled = amqp_get_bool(amqp_get_item(fields, 4), false);
+            link->delivery_count++;
+            link->credit = link->credit == 0 ? 0 : link->credit - 1;
+        }
+
+        if ((result = append_delivery(link, payload, payload_len)) == 0 && !amqp_get_bool(amqp_get_item(fields, 5), false))
+        {
+            link->in_delivery = false;
+            if (amqp_get_bool(amqp_get_item(fields, 9), false))
+            {
+                // Aborted by the device
+                result = 0;
+            }
+            else if ((result = on_message(context, link)) == 0 && !link->delivery_settled)
+            {
+                begin_performative(context, AMQP_DISPOSITION);
+                amqp_write_bool(&context->frame, true);
+                amqp_write_uint(&context->frame, link->delivery_id);
+                amqp_write_null(&context->frame);
+                amqp_write_bool(&context->frame, true);
+                amqp_write_descriptor(&context->frame, AMQP_ACCEPTED);
+                amqp_begin_list(&context->frame);
+                amqp_end_compound(&context->frame);
+                result = send_performative(context, channel, AMQP_FRAME_TYPE_AMQP, NULL, 0);
+            }
+
+            if (result == 0 && link->credit < AMQP_LINK_CREDIT / 2)
+            {
+                link->credit = AMQP_LINK_CREDIT;
+                result = send_link_flow(context, channel, (uint32_t)handle);
+            }
+        }
+    }
+    return result;
+}
+
+static void on_disposition(AMQP_CONTEXT* context, uint16_t channel, const AMQP_VALUE* fields)
+{
+    AMQP_SESSION* session = &context->sessions[channel];
+    // Only C2D deliveries go out unsettled, the device settles them as the receiver
+    if (amqp_get_bool(amqp_get_item(fields, 0), false) && amqp_get_descriptor(amqp_get_item(fields, 4)) == AMQP_ACCEPTED)
+    {
+        uint32_t first = (uint32_t)amqp_get_uint(amqp_get_item(fields, 1), 0);
+        uint32_t last = (uint32_t)amqp_get_uint(amqp_get_item(fields, 2), first);
+        for (uint32_t count = last - first + 1; count > 0 && session->c2d_unsettled > 0; count--)
+        {
+            session->c2d_unsettled--;
+            hub_connection_on_completed(context->conn, HUB_MESSAGE_C2D);
+        }
+    }
+}
+
+static void clear_link(AMQP_CONTEXT* context, AMQP_LINK* link)
+{
+    if (link->attached && link->link_type == AMQP_LINK_C2D && !link->device_sends)
+    {
+        context->conn->c2d_ready = false;
+    }
+    else if (link->attached && link->link_type == AMQP_LINK_METHODS && !link->device_sends)
+    {
+        context->conn->method_ready = false;
+    }
+    else if (link->attached && link->link_type == AMQP_LINK_TWIN && !link->device_sends)
+    {
+        context->conn->twin_ready = false;
+    }
+    free(link->delivery);
+    memset(link, 0, sizeof(AMQP_LINK));
+}
+
+static int on_detach(AMQP_CONTEXT* context, uint16_t channel, const AMQP_VALUE* fields)
+{
+    int result;
+    AMQP_SESSION* session = &context->sessions[channel];
+    uint64_t handle = amqp_get_uint(amqp_get_item(fields, 0), UINT64_MAX);
+
+    if (handle >= AMQP_MAX_LINKS)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        clear_link(context, &session->links[handle]);
+        begin_performative(context, AMQP_DETACH);
+        amqp_write_uint(&context->frame, (uint32_t)handle);
+        amqp_write_bool(&context->frame, true);
+        result = send_performative(context, channel, AMQP_FRAME_TYPE_AMQP, NULL, 0);
+    }
+    return result;
+}
+
+static void clear_session(AMQP_CONTEXT* context, AMQP_SESSION* session)
+{
+    for (size_t index = 0; index < AMQP_MAX_LINKS; index++)
+    {
+        clear_link(context, &session->links[index]);
+    }
+    session->begun = false;
+}
+
+static int process_frame(AMQP_CONTEXT* context, uint8_t frame_type, uint16_t channel, const unsigned char* body, size_t body_len)
+{
+    int result;
+    const AMQP_VALUE* performative;
+    int used;
+
+    amqp_decoder_reset(&context->decoder);
+    if (body_len == 0)
+    {
+        // Echo heartbeats, see on_open
+        result = hub_connection_send(context->conn, EMPTY_FRAME, sizeof(EMPTY_FRAME));
+    }
+    else if ((used = amqp_decode(&context->decoder, body, body_len, &performative)) < 0)
+    {
+        (void)printf("Invalid amqp performative\r\n");
+        result = __LINE__;
+    }
+    else if (context->state == AMQP_STATE_SASL)
+    {
+        result = frame_type == AMQP_FRAME_TYPE_SASL ? on_sasl_frame(context, amqp_get_descriptor(performative)) : __LINE__;
+    }
+    else if (frame_type != AMQP_FRAME_TYPE_AMQP)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        uint64_t code = amqp_get_descriptor(performative);
+        const AMQP_VALUE* fields = amqp_get_described(performative);
+
+        if (code != AMQP_OPEN && code != AMQP_BEGIN && code != AMQP_CLOSE && (channel >= AMQP_MAX_SESSIONS || !context->sessions[channel].begun))
+        {
+            (void)printf("Amqp frame on channel %u without a session\r\n", channel);
+            result = __LINE__;
+        }
+        else
+        {
+            switch (code)
+            {
+                case AMQP_OPEN:
+                    result = on_open(context, fields);
+                    break;
+                case AMQP_BEGIN:
+                    result = on_begin(context, channel, fields);
+                    break;
+                case AMQP_ATTACH:
+                    result = on_attach(context, channel, fields);
+                    break;
+                case AMQP_FLOW:
+                    result = on_flow(context, channel, fields);
+                    break;
+                case AMQP_TRANSFER:
+                    result = on_transfer(context, channel, fields, body + used, body_len - (size_t)used);
+                    break;
+                case AMQP_DISPOSITION:
+                    on_disposition(context, channel, fields);
+                    result = 0;
+                    break;
+                case AMQP_DETACH:
+                    result = on_detach(context, channel, fields);
+                    break;
+                case AMQP_END:
+                    clear_session(context, &context->sessions[channel]);
+                    begin_performative(context, AMQP_END);
+                    result = send_performative(context, channel, AMQP_FRAME_TYPE_AMQP, NULL, 0);
+                    break;
+                case AMQP_CLOSE:
+                    // Answer and let the connection close
+                    begin_performative(context, AMQP_CLOSE);
+                    (void)send_performative(context, 0, AMQP_FRAME_TYPE_AMQP, NULL, 0);
+                    result = __LINE__;
+                    break;
+                default:
+                    (void)printf("Unsupported amqp performative 0x%llx\r\n", (unsigned long long)code);
+                    result = __LINE__;
+                    break;
+            }
+        }
+    }
+    return result;
+}
+
+static void* amqp_create(HUB_CONNECTION* conn)
+{
+    AMQP_CONTEXT* result;
+    if ((result = (AMQP_CONTEXT*)calloc(1, sizeof(AMQP_CONTEXT))) == NULL)
+    {
+        (void)printf("Failure allocating amqp session\r\n");
+    }
+    else
+    {
+        result->conn = conn;
+        result->state = AMQP_STATE_HEADER;
+        result->remote_max_frame_size = AMQP_MIN_FRAME_SIZE;
+        amqp_writer_init(&result->frame);
+        amqp_writer_init(&result->message);
+    }
+    return result;
+}
+
+static void amqp_destroy(void* protocol_state)
+{
+    AMQP_CONTEXT* context = (AMQP_CONTEXT*)protocol_state;
+    for (size_t index = 0; index < AMQP_MAX_SESSIONS; index++)
+    {
+        for (size_t link_index = 0; link_index < AMQP_MAX_LINKS; link_index++)
+        {
+            free(context->sessions[index].links[link_index].delivery);
+        }
+    }
+    amqp_writer_deinit(&context->frame);
+    amqp_writer_deinit(&context->message);
+    free(context);
+}
+
+static int amqp_on_bytes(void* protocol_state, const unsigned char* data, size_t length)
+{
+    int result = 0;
+    AMQP_CONTEXT* context = (AMQP_CONTEXT*)protocol_state;
+    size_t pos = 0;
+
+    while (length - pos >= AMQP_HEADER_LEN)
+    {
+        if (context->state == AMQP_STATE_HEADER)
+        {
+            // SASL first, then the AMQP header again on the same connection
+            if (!context->sasl_done && memcmp(data + pos, SASL_PROTOCOL_HEADER, AMQP_HEADER_LEN) == 0)
+            {
+                context->state = AMQP_STATE_SASL;
+                if (hub_connection_send(context->conn, SASL_PROTOCOL_HEADER, AMQP_HEADER_LEN) != 0 || send_sasl_mechanisms(context) != 0)
+                {
+                    result = -1;
+                }
+            }
+            else if (memcmp(data + pos, AMQP_PROTOCOL_HEADER, AMQP_HEADER_LEN) == 0)
+            {
+                context->state = AMQP_STATE_OPEN;
+                result = hub_connection_send(context->conn, AMQP_PROTOCOL_HEADER, AMQP_HEADER_LEN) == 0 ? 0 : -1;
+            }
+            else
+            {
+                // Answer with the supported header before closing
+                (void)hub_connection_send(context->conn, AMQP_PROTOCOL_HEADER, AMQP_HEADER_LEN);
+                result = -1;
+            }
+            if (result != 0)
+            {
+                break;
+            }
+            pos += AMQP_HEADER_LEN;
+        }
+        else
+        {
+            size_t frame_size = ((size_t)data[pos] << 24) | ((size_t)data[pos + 1] << 16) | ((size_t)data[pos + 2] << 8) | data[pos + 3];
+            size_t data_offset = (size_t)data[pos + 4] * 4;
+
+            if (frame_size < AMQP_FRAME_HEADER_LEN || frame_size > AMQP_MAX_FRAME_SIZE || data_offset < AMQP_FRAME_HEADER_LEN || data_offset > frame_size)
+            {
+                (void)printf("Invalid amqp frame of %zu bytes\r\n", frame_size);
+                result = -1;
+                break;
+            }
+            else if (length - pos < frame_size)
+            {
+                break;
+            }
+            else if (process_frame(context, data[pos + 5], (uint16_t)((data[pos + 6] << 8) | data[pos + 7]), data + pos + data_offset, frame_size - data_offset) != 0)
+            {
+                result = -1;
+                break;
+            }
+            pos += frame_size;
+        }
+    }
+    return result < 0 ? result : (int)pos;
+}
+
+static int amqp_deliver(void* protocol_state, const HUB_MESSAGE* message)
+{
+    int result;
+    AMQP_CONTEXT* context = (AMQP_CONTEXT*)protocol_state;
+    AMQP_WRITER* writer = &context->message;
+    AMQP_LINK_TYPE link_type = message->msg_type == HUB_MESSAGE_C2D ? AMQP_LINK_C2D : (message->msg_type == HUB_MESSAGE_METHOD ? AMQP_LINK_METHODS : AMQP_LINK_TWIN);
+    uint16_t channel;
+    uint32_t handle;
+
+    if (find_link(context, link_type, false, &channel, &handle) == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        amqp_writer_reset(writer);
+        if (message->msg_type == HUB_MESSAGE_C2D)
+        {
+            char message_id[AMQP_MAX_PROPERTY_LEN];
+            int id_len = snprintf(message_id, sizeof(message_id), "%u", message->sequence);
+            amqp_write_descriptor(writer, AMQP_PROPERTIES);
+            amqp_begin_list(writer);
+            amqp_write_string(writer, message_id, (size_t)id_len);
+            amqp_end_compound(writer);
+            write_query_properties(writer, message->properties);
+        }
+        else if (message->msg_type == HUB_MESSAGE_METHOD)
+        {
+            unsigned char uuid[16];
+            memset(uuid, 0, sizeof(uuid));
+            uuid[12] = (unsigned char)(message->sequence >> 24);
+            uuid[13] = (unsigned char)((message->sequence >> 16) & 0xFF);
+            uuid[14] = (unsigned char)((message->sequence >> 8) & 0xFF);
+            uuid[15] = (unsigned char)(message->sequence & 0xFF);
+            amqp_write_descriptor(writer, AMQP_PROPERTIES);
+            amqp_begin_list(writer);
+            amqp_write_uuid(writer, uuid);
+            amqp_end_compound(writer);
+            amqp_write_descriptor(writer, AMQP_APPLICATION_PROPERTIES);
+            amqp_begin_map(writer);
+            amqp_write_string(writer, METHOD_NAME_PROPERTY, strlen(METHOD_NAME_PROPERTY));
+            amqp_write_string(writer, message->name, strlen(message->name));
+            amqp_end_compound(writer);
+        }
+        else
+        {
+            // Desired property patches carry no correlation id
+            amqp_write_descriptor(writer, AMQP_MESSAGE_ANNOTATIONS);
+            amqp_begin_map(writer);
+            amqp_write_symbol(writer, TWIN_VERSION_ANNOTATION);
+            amqp_write_long(writer, message->sequence);
+            amqp_end_compound(writer);
+        }
+        write_data(writer, message->payload, message->payload_len);
+
+        // C2D waits for the device to accept it, the rest goes out settled
+        if ((result = send_message(context, channel, handle, message->msg_type != HUB_MESSAGE_C2D)) == 0 && message->msg_type == HUB_MESSAGE_C2D)
+        {
+            context->sessions[channel].c2d_unsettled++;
+        }
+    }
+    return result;
+}
+
+static const HUB_PROTOCOL AMQP_PROTOCOL =
+{
+    "amqp",
+    amqp_create,
+    amqp_destroy,
+    amqp_on_bytes,
+    amqp_deliver
+};
+
+const HUB_PROTOCOL* hub_amqp_get_protocol(void)
+{
+    return &AMQP_PROTOCOL;
+}
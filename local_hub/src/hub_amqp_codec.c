@@ -0,0 +1,614 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hub_amqp_codec.h"
+
+#define AMQP_WRITER_CHUNK_SIZE  1024
+
+static uint64_t read_big_endian(const unsigned char* data, size_t width)
+{
+    uint64_t result = 0;
+    for (size_t index = 0; index < width; index++)
+    {
+        result = (result << 8) | data[index];
+    }
+    return result;
+}
+
+// The encoded width of the fixed size types follows from the subcategory nibble
+static size_t get_fixed_width(uint8_t constructor)
+{
+    size_t result;
+    switch (constructor >> 4)
+    {
+        case 0x4:
+            result = 0;
+            break;
+        case 0x5:
+            result = 1;
+            break;
+        case 0x6:
+            result = 2;
+            break;
+        case 0x7:
+            result = 4;
+            break;
+        case 0x8:
+            result = 8;
+            break;
+        case 0x9:
+            result = 16;
+            break;
+        default:
+            result = SIZE_MAX;
+            break;
+    }
+    return result;
+}
+
+static AMQP_VALUE* new_node(AMQP_DECODER* decoder)
+{
+    AMQP_VALUE* result;
+    if (decoder->used == AMQP_DECODER_MAX_NODES)
+    {
+        (void)printf("Amqp value has more than %d nodes\r\n", AMQP_DECODER_MAX_NODES);
+        result = NULL;
+    }
+    else
+    {
+        result = &decoder->nodes[decoder->used++];
+        memset(result, 0, sizeof(AMQP_VALUE));
+    }
+    return result;
+}
+
+static int decode_value(AMQP_DECODER* decoder, const unsigned char* data, size_t length, size_t* pos, AMQP_VALUE** value);
+
+static int decode_fixed(uint8_t constructor, const unsigned char* data, size_t width, AMQP_VALUE* node)
+{
+    int result = 0;
+    uint64_t raw_value = read_big_endian(data, width);
+    switch (constructor)
+    {
+        case 0x40:
+            node->type = AMQP_TYPE_NULL;
+            break;
+        case 0x41:
+        case 0x42:
+            node->type = AMQP_TYPE_BOOL;
+            node->uint_value = constructor == 0x41 ? 1 : 0;
+            break;
+        case 0x56:
+            node->type = AMQP_TYPE_BOOL;
+            node->uint_value = raw_value != 0 ? 1 : 0;
+            break;
+        case 0x43:
+        case 0x44:
+        case 0x50:
+        case 0x52:
+        case 0x53:
+        case 0x60:
+        case 0x70:
+        case 0x80:
+            node->type = AMQP_TYPE_UINT;
+            node->uint_value = raw_value;
+            node->int_value = (int64_t)raw_value;
+            break;
+        case 0x51:
+        case 0x54:
+        case 0x55:
+        case 0x61:
+        case 0x71:
+        case 0x81:
+        case 0x83:
+            // Sign extend from the encoded width
+            node->type = constructor == 0x83 ? AMQP_TYPE_TIMESTAMP : AMQP_TYPE_INT;
+            node->int_value = width == 8 ? (int64_t)raw_value : (int64_t)(raw_value << (64 - width * 8)) >> (64 - width * 8);
+            node->uint_value = (uint64_t)node->int_value;
+            break;
+        case 0x98:
+            node->type = AMQP_TYPE_UUID;
+            node->data = data;
+            node->length = width;
+            break;
+        default:
+            if (get_fixed_width(constructor) == SIZE_MAX)
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                node->type = AMQP_TYPE_OTHER;
+                node->data = data;
+                node->length = width;
+            }
+            break;
+    }
+    return result;
+}
+
+static int decode_payload(AMQP_DECODER* decoder, uint8_t constructor, const unsigned char* data, size_t length, size_t* pos, AMQP_VALUE* node)
+{
+    int result;
+    size_t width = get_fixed_width(constructor);
+    uint8_t category = constructor >> 4;
+
+    if (constructor == 0x45)
+    {
+        node->type = AMQP_TYPE_LIST;
+        result = 0;
+    }
+    else if (width != SIZE_MAX)
+    {
+        if (length - *pos < width)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            result = decode_fixed(constructor, data + *pos, width, node);
+            *pos += width;
+        }
+    }
+    else if (category == 0xa || category == 0xb)
+    {
+        size_t size_width = category == 0xa ? 1 : 4;
+        size_t size;
+        if (length - *pos < size_width || length - *pos - size_width < (size = (size_t)read_big_endian(data + *pos, size_width)))
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            uint8_t type_code = constructor & 0x0F;
+            node->type = type_code == 0x0 ? AMQP_TYPE_BINARY : (type_code == 0x1 ? AMQP_TYPE_STRING : (type_code == 0x3 ? AMQP_TYPE_SYMBOL : AMQP_TYPE_OTHER));
+            node->data = data + *pos + size_width;
+            node->length = size;
+            *pos += size_width + size;
+            result = 0;
+        }
+    }
+    else if (category == 0xc || category == 0xd || category == 0xe || category == 0xf)
+    {
+        size_t size_width = (category == 0xc || category == 0xe) ? 1 : 4;
+        size_t size;
+        if (length - *pos < size_width * 2 || length - *pos - size_width < (size = (size_t)read_big_endian(data + *pos, size_width)) || size < size_width)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            size_t end = *pos + size_width + size;
+            AMQP_VALUE** link = &node->first;
+            node->count = (size_t)read_big_endian(data + *pos + size_width, size_width);
+            *pos += size_width * 2;
+            result = 0;
+
+            if (category == 0xc || category == 0xd)
+            {
+                node->type = (constructor & 0x0F) == 0x1 ? AMQP_TYPE_MAP : AMQP_TYPE_LIST;
+                for (size_t index = 0; index < node->count && result == 0; index++)
+                {
+                    if ((result = decode_value(decoder, data, end, pos, link)) == 0)
+                    {
+                        link = &(*link)->next;
+                    }
+                }
+            }
+            else
+            {
+                // Arrays share one constructor, a descriptor on it is not kept
+                uint8_t element_constructor = 0;
+                node->type = AMQP_TYPE_ARRAY;
+                if (*pos < end && data[*pos] == 0x00)
+                {
+                    AMQP_VALUE* descriptor;
+                    (*pos)++;
+                    result = decode_value(decoder, data, end, pos, &descriptor);
+                }
+                if (result == 0 && *pos >= end && node->count > 0)
+                {
+                    result = __LINE__;
+                }
+                else if (result == 0 && node->count > 0)
+                {
+                    element_constructor = data[(*pos)++];
+                }
+                for (size_t index = 0; index < node->count && result == 0; index++)
+                {
+                    AMQP_VALUE* element = new_node(decoder);
+                    size_t start = *pos;
+                    if (element == NULL || (result = decode_payload(decoder, element_constructor, data, end, pos, element)) != 0)
+                    {
+                        result = result == 0 ? __LINE__ : result;
+                    }
+                    else
+                    {
+                        element->raw = data + start;
+                        element->raw_length = *pos - start;
+                        *link = element;
+                        link = &element->next;
+                    }
+                }
+            }
+            if (result == 0)
+            {
+                *pos = end;
+            }
+        }
+    }
+    else
+    {
+        result = __LINE__;
+    }
+    return result;
+}
+
+static int decode_value(AMQP_DECODER* decoder, const unsigned char* data, size_t length, size_t* pos, AMQP_VALUE** value)
+{
+    int result;
+    size_t start = *pos;
+    AMQP_VALUE* node;
+
+    if (*pos >= length || (node = new_node(decoder)) == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        uint8_t constructor = data[(*pos)++];
+        if (constructor == 0x00)
+        {
+            AMQP_VALUE* descriptor;
+            node->type = AMQP_TYPE_DESCRIBED;
+            node->count = 2;
+            if ((result = decode_value(decoder, data, length, pos, &descriptor)) == 0 &&
+                (result = decode_value(decoder, data, length, pos, &descriptor->next)) == 0)
+            {
+                node->first = descriptor;
+            }
+        }
+        else
+        {
+            result = decode_payload(decoder, constructor, data, length, pos, node);
+        }
+
+        if (result == 0)
+        {
+            node->raw = data + start;
+            node->raw_length = *pos - start;
+            *value = node;
+        }
+    }
+    return result;
+}
+
+void amqp_decoder_reset(AMQP_DECODER* decoder)
+{
+    decoder->used = 0;
+}
+
+int amqp_decode(AMQP_DECODER* decoder, const unsigned char* data, size_t length, const AMQP_VALUE** value)
+{
+    size_t pos = 0;
+    AMQP_VALUE* node;
+    int result = decode_value(decoder, data, length, &pos, &node) == 0 ? (int)pos : -1;
+    if (result >= 0)
+    {
+        *value = node;
+    }
+    return result;
+}
+
+uint64_t amqp_get_descriptor(const AMQP_VALUE* value)
+{
+    return (value != NULL && value->type == AMQP_TYPE_DESCRIBED && value->first->type == AMQP_TYPE_UINT) ? value->first->uint_value : AMQP_NO_DESCRIPTOR;
+}
+
+const AMQP_VALUE* amqp_get_described(const AMQP_VALUE* value)
+{
+    return (value != NULL && value->type == AMQP_TYPE_DESCRIBED) ? value->first->next : NULL;
+}
+
+const AMQP_VALUE* amqp_get_item(const AMQP_VALUE* list, size_t index)
+{
+    const AMQP_VALUE* result = (list != NULL && list->type == AMQP_TYPE_LIST) ? list->first : NULL;
+    for (size_t item = 0; item < index && result != NULL; item++)
+    {
+        result = result->next;
+    }
+    return (result != NULL && result->type == AMQP_TYPE_NULL) ? NULL : result;
+}
+
+const AMQP_VALUE* amqp_get_map_value(const AMQP_VALUE* map, const char* key)
+{
+    const AMQP_VALUE* result = NULL;
+    if (map != NULL && map->type == AMQP_TYPE_MAP)
+    {
+        for (const AMQP_VALUE* item = map->first; item != NULL && item->next != NULL; item = item->next->next)
+        {
+            if (amqp_value_equals(item, key))
+            {
+                result = item->next;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+bool amqp_value_equals(const AMQP_VALUE* value, const char* text)
+{
+    return value != NULL && (value->type == AMQP_TYPE_STRING || value->type == AMQP_TYPE_SYMBOL) &&
+        value->length == strlen(text) && memcmp(value->data, text, value->length) == 0;
+}
+
+uint64_t amqp_get_uint(const AMQP_VALUE* value, uint64_t default_value)
+{
+    return (value != NULL && (value->type == AMQP_TYPE_UINT || value->type == AMQP_TYPE_INT)) ? value->uint_value : default_value;
+}
+
+bool amqp_get_bool(const AMQP_VALUE* value, bool default_value)
+{
+    return (value != NULL && value->type == AMQP_TYPE_BOOL) ? value->uint_value != 0 : default_value;
+}
+
+void amqp_writer_init(AMQP_WRITER* writer)
+{
+    memset(writer, 0, sizeof(AMQP_WRITER));
+}
+
+void amqp_writer_deinit(AMQP_WRITER* writer)
+{
+    free(writer->buffer);
+    memset(writer, 0, sizeof(AMQP_WRITER));
+}
+
+void amqp_writer_reset(AMQP_WRITER* writer)
+{
+    writer->length = 0;
+    writer->failed = false;
+    writer->described = false;
+    writer->depth = 0;
+}
+
+void amqp_write_bytes(AMQP_WRITER* writer, const void* data, size_t length)
+{
+    if (!writer->failed && writer->length + length > writer->capacity)
+    {
+        size_t new_capacity = writer->capacity == 0 ? AMQP_WRITER_CHUNK_SIZE : writer->capacity;
+        unsigned char* new_buffer;
+        while (new_capacity < writer->length + length)
+        {
+            new_capacity *= 2;
+        }
+        if ((new_buffer = (unsigned char*)realloc(writer->buffer, new_capacity)) == NULL)
+        {
+            (void)printf("Failure growing amqp writer\r\n");
+            writer->failed = true;
+        }
+        else
+        {
+            writer->buffer = new_buffer;
+            writer->capacity = new_capacity;
+        }
+    }
+    if (!writer->failed && length > 0)
+    {
+        memcpy(writer->buffer + writer->length, data, length);
+        writer->length += length;
+    }
+}
+
+static void write_big_endian(AMQP_WRITER* writer, uint64_t value, size_t width)
+{
+    unsigned char encoded[8];
+    for (size_t index = 0; index < width; index++)
+    {
+        encoded[index] = (unsigned char)((value >> ((width - 1 - index) * 8)) & 0xFF);
+    }
+    amqp_write_bytes(writer, encoded, width);
+}
+
+// Every value written counts as one item of the enclosing compound
+static void begin_value(AMQP_WRITER* writer, uint8_t constructor)
+{
+    if (writer->described)
+    {
+        writer->described = false;
+    }
+    else if (writer->depth > 0)
+    {
+        writer->compound_count[writer->depth - 1]++;
+    }
+    amqp_write_bytes(writer, &constructor, 1);
+}
+
+static void write_variable(AMQP_WRITER* writer, uint8_t short_constructor, const void* data, size_t length)
+{
+    if (length < 256)
+    {
+        begin_value(writer, short_constructor);
+        write_big_endian(writer, length, 1);
+    }
+    else
+    {
+        begin_value(writer, (uint8_t)(short_constructor + 0x10));
+        write_big_endian(writer, length, 4);
+    }
+    amqp_write_bytes(writer, data, length);
+}
+
+void amqp_write_raw(AMQP_WRITER* writer, const unsigned char* raw, size_t length)
+{
+    if (length > 0)
+    {
+        begin_value(writer, raw[0]);
+        amqp_write_bytes(writer, raw + 1, length - 1);
+    }
+}
+
+void amqp_write_null(AMQP_WRITER* writer)
+{
+    begin_value(writer, 0x40);
+}
+
+void amqp_write_bool(AMQP_WRITER* writer, bool value)
+{
+    begin_value(writer, value ? 0x41 : 0x42);
+}
+
+void amqp_write_ubyte(AMQP_WRITER* writer, uint8_t value)
+{
+    begin_value(writer, 0x50);
+    write_big_endian(writer, value, 1);
+}
+
+void amqp_write_ushort(AMQP_WRITER* writer, uint16_t value)
+{
+    begin_value(writer, 0x60);
+    write_big_endian(writer, value, 2);
+}
+
+void amqp_write_uint(AMQP_WRITER* writer, uint32_t value)
+{
+    if (value == 0)
+    {
+        begin_value(writer, 0x43);
+    }
+    else if (value < 256)
+    {
+        begin_value(writer, 0x52);
+        write_big_endian(writer, value, 1);
+    }
+    else
+    {
+        begin_value(writer, 0x70);
+        write_big_endian(writer, value, 4);
+    }
+}
+
+void amqp_write_ulong(AMQP_WRITER* writer, uint64_t value)
+{
+    if (value == 0)
+    {
+        begin_value(writer, 0x44);
+    }
+    else if (value < 256)
+    {
+        begin_value(writer, 0x53);
+        write_big_endian(writer, value, 1);
+    }
+    else
+    {
+        begin_value(writer, 0x80);
+        write_big_endian(writer, value, 8);
+    }
+}
+
+void amqp_write_int(AMQP_WRITER* writer, int32_t value)
+{
+    begin_value(writer, 0x71);
+    write_big_endian(writer, (uint32_t)value, 4);
+}
+
+void amqp_write_long(AMQP_WRITER* writer, int64_t value)
+{
+    begin_value(writer, 0x81);
+    write_big_endian(writer, (uint64_t)value, 8);
+}
+
+void amqp_write_uuid(AMQP_WRITER* writer, const unsigned char uuid[16])
+{
+    begin_value(writer, 0x98);
+    amqp_write_bytes(writer, uuid, 16);
+}
+
+void amqp_write_binary(AMQP_WRITER* writer, const void* data, size_t length)
+{
+    write_variable(writer, 0xa0, data, length);
+}
+
+void amqp_write_string(AMQP_WRITER* writer, const char* value, size_t length)
+{
+    write_variable(writer, 0xa1, value, length);
+}
+
+void amqp_write_symbol(AMQP_WRITER* writer, const char* value)
+{
+    write_variable(writer, 0xa3, value, strlen(value));
+}
+
+void amqp_write_symbol_array(AMQP_WRITER* writer, const char* const* symbols, size_t count)
+{
+    size_t size = 4 + 1;
+    for (size_t index = 0; index < count; index++)
+    {
+        size += 1 + strlen(symbols[index]);
+    }
+    begin_value(writer, 0xf0);
+    write_big_endian(writer, size, 4);
+    write_big_endian(writer, count, 4);
+    write_big_endian(writer, 0xa3, 1);
+    for (size_t index = 0; index < count; index++)
+    {
+        size_t length = strlen(symbols[index]);
+        write_big_endian(writer, length, 1);
+        amqp_write_bytes(writer, symbols[index], length);
+    }
+}
+
+void amqp_write_descriptor(AMQP_WRITER* writer, uint64_t code)
+{
+    begin_value(writer, 0x00);
+    // The descriptor itself is part of the described value
+    writer->described = true;
+    amqp_write_ulong(writer, code);
+    writer->described = true;
+}
+
+static void begin_compound(AMQP_WRITER* writer, uint8_t constructor)
+{
+    begin_value(writer, constructor);
+    if (writer->depth == AMQP_WRITER_MAX_DEPTH)
+    {
+        (void)printf("Amqp value nests deeper than %d\r\n", AMQP_WRITER_MAX_DEPTH);
+        writer->failed = true;
+    }
+    else
+    {
+        // Size and count are patched in when the compound is closed
+        writer->compound_offset[writer->depth] = writer->length;
+        writer->compound_count[writer->depth] = 0;
+        writer->depth++;
+        write_big_endian(writer, 0, 8);
+    }
+}
+
+void amqp_begin_list(AMQP_WRITER* writer)
+{
+    begin_compound(writer, 0xd0);
+}
+
+void amqp_begin_map(AMQP_WRITER* writer)
+{
+    begin_compound(writer, 0xd1);
+}
+
+void amqp_end_compound(AMQP_WRITER* writer)
+{
+    if (writer->depth > 0 && !writer->failed)
+    {
+        size_t offset = writer->compound_offset[--writer->depth];
+        uint32_t size = (uint32_t)(writer->length - offset - 4);
+        uint32_t count = writer->compound_count[writer->depth];
+        for (size_t index = 0; index < 4; index++)
+        {
+            writer->buffer[offset + index] = (unsigned char)((size >> ((3 - index) * 8)) & 0xFF);
+            writer->buffer[offset + 4 + index] = (unsigned char)((count >> ((3 - index) * 8)) & 0xFF);
+        }
+    }
+}
@@ -0,0 +1,381 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "hub_commands.h"
+
+#define MAX_COMMAND_LEN         1024
+#define MAX_RESPONSE_LEN        2048
+#define MAX_COMMAND_ARGS        8
+
+// Any valid base64 works, the hub does not verify SAS tokens
+static const char* const DEVICE_KEY = "bG9jYWxfaHViX2RldmljZV9rZXk=";
+
+typedef struct CONTROL_SESSION_TAG
+{
+    HUB_CONNECTION* conn;
+} CONTROL_SESSION;
+
+typedef int (*COMMAND_HANDLER)(HUB_SERVER_HANDLE server, size_t argc, char* argv[], char* response, size_t response_len);
+
+typedef struct HUB_COMMAND_TAG
+{
+    const char* name;
+    size_t min_args;
+    COMMAND_HANDLER handler;
+} HUB_COMMAND;
+
+static int parse_size(const char* value, size_t* result)
+{
+    char* end;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    *result = (size_t)parsed;
+    return (end == value || *end != '\0') ? __LINE__ : 0;
+}
+
+// C2D <device_id|*> <msg_count> <payload_size>
+static int command_c2d(HUB_SERVER_HANDLE server, size_t argc, char* argv[], char* response, size_t response_len)
+{
+    int result;
+    size_t msg_count;
+    size_t payload_size;
+    size_t queued;
+    (void)argc;
+
+    if (parse_size(argv[2], &msg_count) != 0 || parse_size(argv[3], &payload_size) != 0)
+    {
+        (void)snprintf(response, response_len, "ERROR invalid count or size");
+        result = __LINE__;
+    }
+    else if (hub_server_queue_c2d(server, argv[1], msg_count, payload_size, &queued) != 0)
+    {
+        (void)snprintf(response, response_len, "ERROR failed queuing messages");
+        result = __LINE__;
+    }
+    else if (queued == 0)
+    {
+        (void)snprintf(response, response_len, "ERROR device %s is not connected", argv[1]);
+        result = __LINE__;
+    }
+    else
+    {
+        (void)snprintf(response, response_len, "OK queued=%zu", queued);
+        result = 0;
+    }
+    return result;
+}
+
+// METHOD <device_id|*> <msg_count> <payload_size> <calls_per_sec>
+static int command_method(HUB_SERVER_HANDLE server, size_t argc, char* argv[], char* response, size_t response_len)
+{
+    int result;
+    size_t msg_count;
+    size_t payload_size;
+    size_t rate;
+    size_t queued;
+    (void)argc;
+
+    if (parse_size(argv[2], &msg_count) != 0 || parse_size(argv[3], &payload_size) != 0 || parse_size(argv[4], &rate) != 0)
+    {
+        (void)snprintf(response, response_len, "ERROR invalid count, size or rate");
+        result = __LINE__;
+    }
+    else if (hub_server_queue_methods(server, argv[1], msg_count, payload_size, rate, &queued) != 0)
+    {
+        (void)snprintf(response, response_len, "ERROR failed queuing method calls");
+        result = __LINE__;
+    }
+    else if (queued == 0)
+    {
+        (void)snprintf(response, response_len, "ERROR device %s is not connected", argv[1]);
+        result = __LINE__;
+    }
+    else
+    {
+        (void)snprintf(response, response_len, "OK queued=%zu", queued);
+        result = 0;
+    }
+    return result;
+}
+
+// TWIN <document_size>
+static int command_twin(HUB_SERVER_HANDLE server, size_t argc, char* argv[], char* response, size_t response_len)
+{
+    int result;
+    size_t document_size;
+    (void)argc;
+
+    if (parse_size(argv[1], &document_size) != 0)
+    {
+        (void)snprintf(response, response_len, "ERROR invalid document size");
+        result = __LINE__;
+    }
+    else
+    {
+        hub_server_set_twin_size(server, document_size);
+        (void)snprintf(response, response_len, "OK document_size=%zu", document_size);
+        result = 0;
+    }
+    return result;
+}
+
+// TWIN_PATCH <device_id|*> <patch_count> <payload_size> <patches_per_sec>
+static int command_twin_patch(HUB_SERVER_HANDLE server, size_t argc, char* argv[], char* response, size_t response_len)
+{
+    int result;
+    size_t msg_count;
+    size_t payload_size;
+    size_t rate;
+    size_t queued;
+    (void)argc;
+
+    if (parse_size(argv[2], &msg_count) != 0 || parse_size(argv[3], &payload_size) != 0 || parse_size(argv[4], &rate) != 0)
+    {
+        (void)snprintf(response, response_len, "ERROR invalid count, size or rate");
+        result = __LINE__;
+    }
+    else if (hub_server_queue_twin_patches(server, argv[1], msg_count, payload_size, rate, &queued) != 0)
+    {
+        (void)snprintf(response, response_len, "ERROR failed queuing twin patches");
+        result = __LINE__;
+    }
+    else if (queued == 0)
+    {
+        (void)snprintf(response, response_len, "ERROR device %s is not connected", argv[1]);
+        result = __LINE__;
+    }
+    else
+    {
+        (void)snprintf(response, response_len, "OK queued=%zu", queued);
+        result = 0;
+    }
+    return result;
+}
+
+// DPS <polls_to_assign> <retry_after_sec>
+static int command_dps(HUB_SERVER_HANDLE server, size_t argc, char* argv[], char* response, size_t response_len)
+{
+    int result;
+    size_t poll_count;
+    size_t retry_after;
+    (void)argc;
+
+    if (parse_size(argv[1], &poll_count) != 0 || parse_size(argv[2], &retry_after) != 0)
+    {
+        (void)snprintf(response, response_len, "ERROR invalid poll count or retry after");
+        result = __LINE__;
+    }
+    else
+    {
+        hub_server_set_dps(server, poll_count, retry_after);
+        (void)snprintf(response, response_len, "OK polls=%zu retry_after=%zu", poll_count, retry_after);
+        result = 0;
+    }
+    return result;
+}
+
+// DEVICE <device_id>
+static int command_device(HUB_SERVER_HANDLE server, size_t argc, char* argv[], char* response, size_t response_len)
+{
+    int result;
+    (void)argc;
+
+    if (hub_server_create_device(server, argv[1]) != 0)
+    {
+        (void)snprintf(response, response_len, "ERROR failed creating device %s", argv[1]);
+        result = __LINE__;
+    }
+    else
+    {
+        (void)snprintf(response, response_len, "OK device_id=%s key=%s", argv[1], DEVICE_KEY);
+        result = 0;
+    }
+    return result;
+}
+
+// LATENCY <METHOD>
+static int command_latency(HUB_SERVER_HANDLE server, size_t argc, char* argv[], char* response, size_t response_len)
+{
+    int result;
+    LATENCY_SUMMARY summary;
+    (void)argc;
+
+    if (strcmp(argv[1], "METHOD") != 0)
+    {
+        (void)snprintf(response, response_len, "ERROR no latency recorded for %s", argv[1]);
+        result = __LINE__;
+    }
+    else
+    {
+        hub_server_get_latency(server, HUB_MESSAGE_METHOD, &summary);
+        (void)snprintf(response, response_len, "OK count=%zu min_ns=%" PRIu64 " avg_ns=%" PRIu64 " p50_ns=%" PRIu64 " p90_ns=%" PRIu64 " p99_ns=%" PRIu64 " max_ns=%" PRIu64,
+            summary.count, summary.min_ns, summary.avg_ns, summary.p50_ns, summary.p90_ns, summary.p99_ns, summary.max_ns);
+        result = 0;
+    }
+    return result;
+}
+
+// STATS
+static int command_stats(HUB_SERVER_HANDLE server, size_t argc, char* argv[], char* response, size_t response_len)
+{
+    HUB_STATS stats;
+    (void)argc;
+    (void)argv;
+
+    hub_server_get_stats(server, &stats);
+    (void)snprintf(response, response_len, "OK connections=%" PRIu64 " bytes_recv=%" PRIu64 " bytes_sent=%" PRIu64
+        " telemetry=%" PRIu64 " telemetry_bytes=%" PRIu64 " c2d_queued=%" PRIu64 " c2d_sent=%" PRIu64 " c2d_completed=%" PRIu64
+        " method_queued=%" PRIu64 " method_sent=%" PRIu64 " method_completed=%" PRIu64 " method_failed=%" PRIu64 " method_inflight_max=%" PRIu64
+        " twin_get=%" PRIu64 " twin_reported=%" PRIu64 " twin_reported_bytes=%" PRIu64 " twin_patch_queued=%" PRIu64 " twin_patch_sent=%" PRIu64
+        " dps_registrations=%" PRIu64 " dps_polls=%" PRIu64 " dps_assigned=%" PRIu64,
+        stats.connections, stats.bytes_recv, stats.bytes_sent, stats.telemetry_recv, stats.telemetry_bytes,
+        stats.c2d_queued, stats.c2d_sent, stats.c2d_completed,
+        stats.method_queued, stats.method_sent, stats.method_completed, stats.method_failed, stats.method_inflight_max,
+        stats.twin_get, stats.twin_reported, stats.twin_reported_bytes, stats.twin_patch_queued, stats.twin_patch_sent,
+        stats.dps_registrations, stats.dps_polls, stats.dps_assigned);
+    return 0;
+}
+
+// RESET
+static int command_reset(HUB_SERVER_HANDLE server, size_t argc, char* argv[], char* response, size_t response_len)
+{
+    (void)argc;
+    (void)argv;
+    hub_server_reset_stats(server);
+    (void)snprintf(response, response_len, "OK");
+    return 0;
+}
+
+static const HUB_COMMAND HUB_COMMAND_LIST[] =
+{
+    { "DEVICE", 2, command_device },
+    { "C2D", 4, command_c2d },
+    { "METHOD", 5, command_method },
+    { "TWIN", 2, command_twin },
+    { "TWIN_PATCH", 5, command_twin_patch },
+    { "DPS", 3, command_dps },
+    { "LATENCY", 2, command_latency },
+    { "STATS", 1, command_stats },
+    { "RESET", 1, command_reset }
+};
+
+static void execute_command(CONTROL_SESSION* session, char* line)
+{
+    char response[MAX_RESPONSE_LEN];
+    char* argv[MAX_COMMAND_ARGS];
+    size_t argc = 0;
+    char* token = strtok(line, " \t");
+    const HUB_COMMAND* command = NULL;
+
+    while (token != NULL && argc < MAX_COMMAND_ARGS)
+    {
+        argv[argc++] = token;
+        token = strtok(NULL, " \t");
+    }
+
+    for (size_t index = 0; argc > 0 && index < sizeof(HUB_COMMAND_LIST) / sizeof(HUB_COMMAND_LIST[0]); index++)
+    {
+        if (strcmp(argv[0], HUB_COMMAND_LIST[index].name) == 0)
+        {
+            command = &HUB_COMMAND_LIST[index];
+            break;
+        }
+    }
+
+    if (command == NULL)
+    {
+        (void)snprintf(response, sizeof(response), "ERROR unknown command");
+    }
+    else if (argc < command->min_args)
+    {
+        (void)snprintf(response, sizeof(response), "ERROR %s expects %zu arguments", command->name, command->min_args - 1);
+    }
+    else
+    {
+        (void)command->handler(session->conn->server, argc, argv, response, sizeof(response));
+    }
+    (void)strcat(response, "\n");
+    (void)hub_connection_send(session->conn, response, strlen(response));
+}
+
+static void* commands_create(HUB_CONNECTION* conn)
+{
+    CONTROL_SESSION* result;
+    if ((result = (CONTROL_SESSION*)calloc(1, sizeof(CONTROL_SESSION))) == NULL)
+    {
+        (void)printf("Failure allocating control session\r\n");
+    }
+    else
+    {
+        result->conn = conn;
+    }
+    return result;
+}
+
+static void commands_destroy(void* protocol_state)
+{
+    free(protocol_state);
+}
+
+static int commands_on_bytes(void* protocol_state, const unsigned char* data, size_t length)
+{
+    int result = 0;
+    CONTROL_SESSION* session = (CONTROL_SESSION*)protocol_state;
+    size_t pos = 0;
+
+    while (pos < length)
+    {
+        const unsigned char* line_end = (const unsigned char*)memchr(data + pos, '\n', length - pos);
+        if (line_end == NULL)
+        {
+            if (length - pos >= MAX_COMMAND_LEN)
+            {
+                result = -1;
+            }
+            break;
+        }
+        else
+        {
+            char line[MAX_COMMAND_LEN];
+            size_t line_len = (size_t)(line_end - (data + pos));
+            if (line_len >= sizeof(line))
+            {
+                result = -1;
+                break;
+            }
+            memcpy(line, data + pos, line_len);
+            if (line_len > 0 && line[line_len - 1] == '\r')
+            {
+                line_len--;
+            }
+            line[line_len] = '\0';
+            execute_command(session, line);
+            pos += (size_t)(line_end - (data + pos)) + 1;
+        }
+    }
+    return result < 0 ? result : (int)pos;
+}
+
+static int commands_deliver(void* protocol_state, const HUB_MESSAGE* message)
+{
+    (void)protocol_state;
+    (void)message;
+    return __LINE__;
+}
+
+static const HUB_PROTOCOL CONTROL_PROTOCOL =
+{
+    "control",
+    commands_create,
+    commands_destroy,
+    commands_on_bytes,
+    commands_deliver
+};
+
+const HUB_PROTOCOL* hub_commands_get_protocol(void)
+{
+    return &CONTROL_PROTOCOL;
+}
@@ -0,0 +1,184 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    typedef SOCKET CONTROL_SOCKET;
+    #define INVALID_CONTROL_SOCKET      INVALID_SOCKET
+    #define close_control_socket(s)     closesocket(s)
+#else
+    #include <unistd.h>
+    #include <netdb.h>
+    #include <sys/socket.h>
+    typedef int CONTROL_SOCKET;
+    #define INVALID_CONTROL_SOCKET      -1
+    #define close_control_socket(s)     close(s)
+#endif
+
+// Do not include gballoc.h, the control traffic is not part of the measurements
+#include "hub_control.h"
+
+#define MAX_HOST_LEN        256
+
+static CONTROL_SOCKET connect_control(const char* hub_control)
+{
+    CONTROL_SOCKET result = INVALID_CONTROL_SOCKET;
+    char host[MAX_HOST_LEN];
+    const char* port = strrchr(hub_control, ':');
+    size_t host_len = port == NULL ? 0 : (size_t)(port - hub_control);
+
+    if (host_len == 0 || host_len >= sizeof(host))
+    {
+        (void)printf("Invalid hub control address %s, expected <host>:<port>\r\n", hub_control);
+    }
+    else
+    {
+        struct addrinfo hints;
+        struct addrinfo* addr_list;
+
+        memcpy(host, hub_control, host_len);
+        host[host_len] = '\0';
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, port + 1, &hints, &addr_list) != 0)
+        {
+            (void)printf("Failure resolving hub control address %s\r\n", hub_control);
+        }
+        else
+        {
+            for (struct addrinfo* addr = addr_list; addr != NULL; addr = addr->ai_next)
+            {
+                if ((result = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) != INVALID_CONTROL_SOCKET)
+                {
+                    if (connect(result, addr->ai_addr, (int)addr->ai_addrlen) == 0)
+                    {
+                        break;
+                    }
+                    close_control_socket(result);
+                    result = INVALID_CONTROL_SOCKET;
+                }
+            }
+            freeaddrinfo(addr_list);
+        }
+    }
+    return result;
+}
+
+int hub_control_execute(const char* hub_control, const char* command, char* response, size_t response_len)
+{
+    int result;
+    CONTROL_SOCKET control_socket;
+
+    if (hub_control == NULL || command == NULL || response == NULL || response_len == 0)
+    {
+        result = __LINE__;
+    }
+    else if ((control_socket = connect_control(hub_control)) == INVALID_CONTROL_SOCKET)
+    {
+        (void)printf("Failure connecting to the hub control channel %s\r\n", hub_control);
+        result = __LINE__;
+    }
+    else
+    {
+        size_t command_len = strlen(command);
+        if (send(control_socket, command, (int)command_len, 0) != (int)command_len || send(control_socket, "\n", 1, 0) != 1)
+        {
+            (void)printf("Failure sending hub control command\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            size_t received = 0;
+            char* line_end = NULL;
+
+            // The response is a single line
+            response[0] = '\0';
+            while (line_end == NULL && received < response_len - 1)
+            {
+                int recv_len = (int)recv(control_socket, response + received, (int)(response_len - 1 - received), 0);
+                if (recv_len <= 0)
+                {
+                    break;
+                }
+                received += (size_t)recv_len;
+                response[received] = '\0';
+                line_end = strchr(response, '\n');
+            }
+
+            if (line_end == NULL)
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                *line_end = '\0';
+                result = strncmp(response, "OK", 2) == 0 ? 0 : __LINE__;
+            }
+
+            if (result != 0)
+            {
+                (void)printf("Hub control command '%s' failed: %s\r\n", command, received > 0 ? response : "no response");
+            }
+        }
+        close_control_socket(control_socket);
+    }
+    return result;
+}
+
+static const char* find_value(const char* response, const char* key)
+{
+    const char* result = NULL;
+    size_t key_len = strlen(key);
+    const char* pos = response;
+
+    while ((pos = strstr(pos, key)) != NULL)
+    {
+        // Match whole keys only
+        if ((pos == response || pos[-1] == ' ') && pos[key_len] == '=')
+        {
+            result = pos + key_len + 1;
+            break;
+        }
+        pos += key_len;
+    }
+    return result;
+}
+
+int hub_control_get_value(const char* response, const char* key, uint64_t* value)
+{
+    int result;
+    const char* found = find_value(response, key);
+    if (found == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        *value = strtoull(found, NULL, 10);
+        result = 0;
+    }
+    return result;
+}
+
+int hub_control_get_string(const char* response, const char* key, char* value, size_t value_len)
+{
+    int result;
+    const char* found = find_value(response, key);
+    size_t found_len = found == NULL ? 0 : strcspn(found, " ");
+    if (found == NULL || found_len >= value_len)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        memcpy(value, found, found_len);
+        value[found_len] = '\0';
+        result = 0;
+    }
+    return result;
+}
@@ -0,0 +1,537 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "hub_http.h"
+#include "hub_ws.h"
+#include "hub_mqtt.h"
+#include "hub_amqp.h"
+
+#define HTTP_MAX_HEADER_LEN     8192
+#define HTTP_MAX_METHOD_LEN     16
+#define HTTP_MAX_PATH_LEN       512
+#define HTTP_MAX_PROTOCOL_LEN   32
+#define HTTP_MAX_RESPONSE_HEADER_LEN 1024
+#define HTTP_MAX_BODY_LEN       (64 * 1024 * 1024)
+
+static const char* const DEVICE_PATH_PREFIX = "/devices/";
+static const char* const TELEMETRY_PATH = "/messages/events";
+static const char* const C2D_PATH = "/messages/devicebound";
+static const char* const ABANDON_PATH_SUFFIX = "/abandon";
+static const char* const WEBSOCKET_PATH = "/$iothub/websocket";
+static const char* const WEBSOCKET_MQTT_PROTOCOL = "mqtt";
+static const char* const WEBSOCKET_AMQP_PROTOCOL = "AMQPWSB10";
+static const char* const BATCH_CONTENT_TYPE = "application/vnd.microsoft.iothub.json";
+static const char* const BATCH_BODY_KEY = "\"body\"";
+static const char* const APP_PROPERTY_HEADER_PREFIX = "iothub-app-";
+static const char* const DPS_PATH_SEGMENT = "/registrations/";
+static const char* const DPS_REGISTER_SUFFIX = "/register";
+static const char* const DPS_OPERATIONS_SEGMENT = "/operations/";
+
+typedef struct HTTP_SESSION_TAG
+{
+    HUB_CONNECTION* conn;
+    // Set once the connection upgraded to websockets
+    HUB_WS_HANDLE ws;
+} HTTP_SESSION;
+
+typedef struct HTTP_REQUEST_TAG
+{
+    char method[HTTP_MAX_METHOD_LEN];
+    char path[HTTP_MAX_PATH_LEN];
+    size_t content_length;
+    bool is_batch;
+    bool is_upgrade;
+    const char* ws_key;
+    size_t ws_key_len;
+    char ws_protocol[HTTP_MAX_PROTOCOL_LEN];
+    const unsigned char* body;
+} HTTP_REQUEST;
+
+static const char* find_header_end(const unsigned char* data, size_t length)
+{
+    const char* result = NULL;
+    for (size_t pos = 0; pos + 4 <= length && pos < HTTP_MAX_HEADER_LEN; pos++)
+    {
+        if (memcmp(data + pos, "\r\n\r\n", 4) == 0)
+        {
+            result = (const char*)data + pos;
+            break;
+        }
+    }
+    return result;
+}
+
+static void copy_token(char* target, size_t target_len, const char* source, size_t source_len)
+{
+    size_t copy_len = source_len < target_len - 1 ? source_len : target_len - 1;
+    memcpy(target, source, copy_len);
+    target[copy_len] = '\0';
+}
+
+static int parse_request(const char* header, size_t header_len, HTTP_REQUEST* request)
+{
+    int result;
+    const char* end = header + header_len;
+    const char* line_end = strstr(header, "\r\n");
+    const char* path;
+    const char* version;
+
+    memset(request, 0, sizeof(HTTP_REQUEST));
+    if (line_end == NULL)
+    {
+        line_end = end;
+    }
+    path = memchr(header, ' ', (size_t)(line_end - header));
+    version = path == NULL ? NULL : memchr(path + 1, ' ', (size_t)(line_end - path - 1));
+    if (version == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        // The query (api-version) does not change the behavior
+        size_t path_len = strcspn(path + 1, " ?");
+        copy_token(request->method, sizeof(request->method), header, (size_t)(path - header));
+        copy_token(request->path, sizeof(request->path), path + 1, path_len);
+
+        for (const char* line = line_end + 2; line < end; line = line_end + 2)
+        {
+            const char* colon;
+            const char* value;
+            size_t name_len;
+            size_t value_len;
+
+            line_end = strstr(line, "\r\n");
+            if (line_end == NULL || line_end > end)
+            {
+                line_end = end;
+            }
+            if ((colon = memchr(line, ':', (size_t)(line_end - line))) == NULL)
+            {
+                continue;
+            }
+            name_len = (size_t)(colon - line);
+            value = colon + 1;
+            while (value < line_end && *value == ' ')
+            {
+                value++;
+            }
+            value_len = (size_t)(line_end - value);
+
+            if (name_len == strlen("Content-Length") && strncasecmp(line, "Content-Length", name_len) == 0)
+            {
+                request->content_length = (size_t)strtoull(value, NULL, 10);
+            }
+            else if (name_len == strlen("Content-Type") && strncasecmp(line, "Content-Type", name_len) == 0)
+            {
+                request->is_batch = value_len >= strlen(BATCH_CONTENT_TYPE) && strncasecmp(value, BATCH_CONTENT_TYPE, strlen(BATCH_CONTENT_TYPE)) == 0;
+            }
+            else if (name_len == strlen("Upgrade") && strncasecmp(line, "Upgrade", name_len) == 0)
+            {
+                request->is_upgrade = value_len == strlen("websocket") && strncasecmp(value, "websocket", value_len) == 0;
+            }
+            else if (name_len == strlen("Sec-WebSocket-Key") && strncasecmp(line, "Sec-WebSocket-Key", name_len) == 0)
+            {
+                request->ws_key = value;
+                request->ws_key_len = value_len;
+            }
+            else if (name_len == strlen("Sec-WebSocket-Protocol") && strncasecmp(line, "Sec-WebSocket-Protocol", name_len) == 0)
+            {
+                copy_token(request->ws_protocol, sizeof(request->ws_protocol), value, value_len);
+            }
+        }
+        result = request->content_length > HTTP_MAX_BODY_LEN ? __LINE__ : 0;
+    }
+    return result;
+}
+
+static int send_response(HTTP_SESSION* session, int status, const char* reason, const char* headers, const unsigned char* body, size_t body_len)
+{
+    int result;
+    char header[HTTP_MAX_RESPONSE_HEADER_LEN];
+    int header_len = snprintf(header, sizeof(header), "HTTP/1.1 %d %s\r\nContent-Length: %zu\r\n%s\r\n", status, reason, body_len, headers == NULL ? "" : headers);
+    if (header_len < 0 || header_len >= (int)sizeof(header))
+    {
+        result = __LINE__;
+    }
+    else if (body_len == 0)
+    {
+        result = hub_connection_send(session->conn, header, (size_t)header_len);
+    }
+    else
+    {
+        // One write so the response goes out in a single tls record where it fits
+        unsigned char* response = (unsigned char*)malloc((size_t)header_len + body_len);
+        if (response == NULL)
+        {
+            (void)printf("Failure allocating http response\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            memcpy(response, header, (size_t)header_len);
+            memcpy(response + header_len, body, body_len);
+            result = hub_connection_send(session->conn, response, (size_t)header_len + body_len);
+            free(response);
+        }
+    }
+    return result;
+}
+
+static int on_upgrade(HTTP_SESSION* session, const HTTP_REQUEST* request)
+{
+    int result;
+    const HUB_PROTOCOL* inner;
+    char accept[HUB_WS_ACCEPT_KEY_LEN];
+    char headers[HTTP_MAX_RESPONSE_HEADER_LEN];
+
+    if (strcasecmp(request->ws_protocol, WEBSOCKET_MQTT_PROTOCOL) == 0)
+    {
+        inner = hub_mqtt_get_protocol();
+    }
+    else if (strcasecmp(request->ws_protocol, WEBSOCKET_AMQP_PROTOCOL) == 0)
+    {
+        inner = hub_amqp_get_protocol();
+    }
+    else
+    {
+        inner = NULL;
+    }
+
+    if (inner == NULL || hub_ws_get_accept_key(request->ws_key, request->ws_key_len, accept) != 0)
+    {
+        (void)printf("Unsupported websocket upgrade for protocol '%s'\r\n", request->ws_protocol);
+        result = send_response(session, 400, "Bad Request", NULL, NULL, 0);
+    }
+    else
+    {
+        (void)snprintf(headers, sizeof(headers), "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\nSec-WebSocket-Protocol: %s\r\n", accept, request->ws_protocol);
+        // The 101 goes out before the framing is installed
+        if (send_response(session, 101, "Switching Protocols", headers, NULL, 0) != 0)
+        {
+            result = __LINE__;
+        }
+        else if ((session->ws = hub_ws_create(session->conn, inner)) == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static size_t count_batch_messages(const unsigned char* body, size_t body_len)
+{
+    size_t result = 0;
+    size_t key_len = strlen(BATCH_BODY_KEY);
+    for (size_t pos = 0; pos + key_len <= body_len; pos++)
+    {
+        if (memcmp(body + pos, BATCH_BODY_KEY, key_len) == 0)
+        {
+            result++;
+            pos += key_len - 1;
+        }
+    }
+    return result;
+}
+
+static int on_telemetry(HTTP_SESSION* session, const HTTP_REQUEST* request)
+{
+    if (request->is_batch)
+    {
+        // Batches are a json array with a base64 body per message
+        size_t msg_count = count_batch_messages(request->body, request->content_length);
+        for (size_t index = 0; index < msg_count; index++)
+        {
+            hub_connection_on_telemetry(session->conn, request->content_length / msg_count);
+        }
+    }
+    else
+    {
+        hub_connection_on_telemetry(session->conn, request->content_length);
+    }
+    return send_response(session, 204, "No Content", NULL, NULL, 0);
+}
+
+static int send_c2d(HTTP_SESSION* session)
+{
+    int result;
+    HUB_MESSAGE* message = hub_connection_take_c2d(session->conn);
+    if (message == NULL)
+    {
+        result = send_response(session, 204, "No Content", NULL, NULL, 0);
+    }
+    else
+    {
+        char headers[HTTP_MAX_RESPONSE_HEADER_LEN];
+        int header_len = snprintf(headers, sizeof(headers), "ETag: \"%u\"\r\niothub-messageid: %u\r\n", message->sequence, message->sequence);
+
+        // Every message property becomes an iothub-app- header
+        for (const char* property = message->properties; header_len > 0 && header_len < (int)sizeof(headers) && *property != '\0'; )
+        {
+            size_t property_len = strcspn(property, "&");
+            const char* separator = memchr(property, '=', property_len);
+            if (separator != NULL)
+            {
+                header_len += snprintf(headers + header_len, sizeof(headers) - (size_t)header_len, "%s%.*s: %.*s\r\n", APP_PROPERTY_HEADER_PREFIX,
+                    (int)(separator - property), property, (int)(property_len - (size_t)(separator - property) - 1), separator + 1);
+            }
+            property += property_len;
+            if (*property == '&')
+            {
+                property++;
+            }
+        }
+
+        if (header_len < 0 || header_len >= (int)sizeof(headers))
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            result = send_response(session, 200, "OK", headers, message->payload, message->payload_len);
+        }
+        hub_message_destroy(message);
+    }
+    return result;
+}
+
+// PUT /{scope}/registrations/{id}/register, GET /{scope}/registrations/{id}/operations/{operation}
+static int on_dps_request(HTTP_SESSION* session, const HTTP_REQUEST* request, const char* registration)
+{
+    int result;
+    const char* registration_id = registration + strlen(DPS_PATH_SEGMENT);
+    const char* resource = strchr(registration_id, '/');
+    bool is_poll = resource != NULL && strncmp(resource, DPS_OPERATIONS_SEGMENT, strlen(DPS_OPERATIONS_SEGMENT)) == 0 && strcmp(request->method, "GET") == 0;
+    bool is_register = resource != NULL && strcmp(resource, DPS_REGISTER_SUFFIX) == 0 && strcmp(request->method, "PUT") == 0;
+
+    if (resource == NULL || resource == registration_id || (!is_poll && !is_register))
+    {
+        result = send_response(session, 404, "Not Found", NULL, NULL, 0);
+    }
+    else
+    {
+        char id[HUB_DEVICE_ID_LEN];
+        unsigned char* response;
+        int status;
+        size_t retry_after;
+        size_t response_len;
+        copy_token(id, sizeof(id), registration_id, (size_t)(resource - registration_id));
+
+        // The registration id attaches the connection like the device id of the hub paths
+        if (strcmp(hub_connection_get_device_id(session->conn), id) != 0 && hub_connection_attach_device(session->conn, id) != 0)
+        {
+            result = send_response(session, 500, "Internal Server Error", NULL, NULL, 0);
+        }
+        else if ((response = hub_connection_on_dps_request(session->conn, is_poll, &status, &retry_after, &response_len)) == NULL)
+        {
+            result = send_response(session, 500, "Internal Server Error", NULL, NULL, 0);
+        }
+        else
+        {
+            char headers[HTTP_MAX_RESPONSE_HEADER_LEN];
+            if (status == 202)
+            {
+                (void)snprintf(headers, sizeof(headers), "Content-Type: application/json\r\nRetry-After: %zu\r\n", retry_after);
+            }
+            else
+            {
+                (void)snprintf(headers, sizeof(headers), "Content-Type: application/json\r\n");
+            }
+            result = send_response(session, status, status == 202 ? "Accepted" : "OK", headers, response, response_len);
+            free(response);
+        }
+    }
+    return result;
+}
+
+// /devices/{id}/messages/events, /devices/{id}/messages/devicebound[/{etag}[/abandon]]
+static int process_request(HTTP_SESSION* session, const HTTP_REQUEST* request)
+{
+    int result;
+    const char* device_id = request->path + strlen(DEVICE_PATH_PREFIX);
+    const char* resource = strncmp(request->path, DEVICE_PATH_PREFIX, strlen(DEVICE_PATH_PREFIX)) == 0 ? strchr(device_id, '/') : NULL;
+    const char* registration = resource == NULL ? strstr(request->path, DPS_PATH_SEGMENT) : NULL;
+
+    if (request->is_upgrade && strcmp(request->path, WEBSOCKET_PATH) == 0)
+    {
+        result = on_upgrade(session, request);
+    }
+    else if (registration != NULL)
+    {
+        result = on_dps_request(session, request, registration);
+    }
+    else if (resource == NULL || resource == device_id)
+    {
+        result = send_response(session, 404, "Not Found", NULL, NULL, 0);
+    }
+    else
+    {
+        char id[HUB_DEVICE_ID_LEN];
+        copy_token(id, sizeof(id), device_id, (size_t)(resource - device_id));
+
+        // Requests carry the device in the path, the connection follows the last one
+        if (strcmp(hub_connection_get_device_id(session->conn), id) != 0 && hub_connection_attach_device(session->conn, id) != 0)
+        {
+            result = send_response(session, 500, "Internal Server Error", NULL, NULL, 0);
+        }
+        else if (strcasecmp(resource, TELEMETRY_PATH) == 0 && strcmp(request->method, "POST") == 0)
+        {
+            result = on_telemetry(session, request);
+        }
+        else if (strcasecmp(resource, C2D_PATH) == 0 && strcmp(request->method, "GET") == 0)
+        {
+            result = send_c2d(session);
+        }
+        else if (strncasecmp(resource, C2D_PATH, strlen(C2D_PATH)) == 0 && resource[strlen(C2D_PATH)] == '/')
+        {
+            size_t resource_len = strlen(resource);
+            size_t suffix_len = strlen(ABANDON_PATH_SUFFIX);
+            if (strcmp(request->method, "DELETE") == 0)
+            {
+                hub_connection_on_completed(session->conn, HUB_MESSAGE_C2D);
+                result = send_response(session, 204, "No Content", NULL, NULL, 0);
+            }
+            else if (strcmp(request->method, "POST") == 0 && resource_len > suffix_len && strcasecmp(resource + resource_len - suffix_len, ABANDON_PATH_SUFFIX) == 0)
+            {
+                result = send_response(session, 204, "No Content", NULL, NULL, 0);
+            }
+            else
+            {
+                result = send_response(session, 405, "Method Not Allowed", NULL, NULL, 0);
+            }
+        }
+        else
+        {
+            result = send_response(session, 404, "Not Found", NULL, NULL, 0);
+        }
+    }
+    return result;
+}
+
+static void* http_create(HUB_CONNECTION* conn)
+{
+    HTTP_SESSION* result;
+    if ((result = (HTTP_SESSION*)calloc(1, sizeof(HTTP_SESSION))) == NULL)
+    {
+        (void)printf("Failure allocating http session\r\n");
+    }
+    else
+    {
+        result->conn = conn;
+    }
+    return result;
+}
+
+static void http_destroy(void* protocol_state)
+{
+    HTTP_SESSION* session = (HTTP_SESSION*)protocol_state;
+    hub_ws_destroy(session->ws);
+    free(session);
+}
+
+static int http_on_bytes(void* protocol_state, const unsigned char* data, size_t length)
+{
+    int result = 0;
+    HTTP_SESSION* session = (HTTP_SESSION*)protocol_state;
+    size_t pos = 0;
+
+    while (session->ws == NULL && pos < length)
+    {
+        HTTP_REQUEST request;
+        char* header;
+        const char* header_end = find_header_end(data + pos, length - pos);
+        size_t header_len;
+        bool complete = false;
+
+        if (header_end == NULL)
+        {
+            if (length - pos >= HTTP_MAX_HEADER_LEN)
+            {
+                result = -1;
+            }
+            break;
+        }
+
+        header_len = (size_t)(header_end - (const char*)data - pos);
+        if ((header = (char*)malloc(header_len + 1)) == NULL)
+        {
+            result = -1;
+            break;
+        }
+        memcpy(header, data + pos, header_len);
+        header[header_len] = '\0';
+
+        if (parse_request(header, header_len, &request) != 0)
+        {
+            (void)printf("Invalid http request\r\n");
+            result = -1;
+        }
+        else if (length - pos - header_len - 4 >= request.content_length)
+        {
+            request.body = data + pos + header_len + 4;
+            if (process_request(session, &request) != 0)
+            {
+                result = -1;
+            }
+            else
+            {
+                pos += header_len + 4 + request.content_length;
+                complete = true;
+            }
+        }
+        free(header);
+
+        // Otherwise wait for the rest of the body
+        if (!complete)
+        {
+            break;
+        }
+    }
+
+    // Anything after the upgrade request already belongs to the websocket
+    if (result == 0 && session->ws != NULL && pos < length)
+    {
+        int used = hub_ws_on_bytes(session->ws, data + pos, length - pos);
+        result = used < 0 ? used : 0;
+        pos += used < 0 ? 0 : (size_t)used;
+    }
+    return result < 0 ? result : (int)pos;
+}
+
+static int http_deliver(void* protocol_state, const HUB_MESSAGE* message)
+{
+    int result;
+    HTTP_SESSION* session = (HTTP_SESSION*)protocol_state;
+    if (session->ws != NULL)
+    {
+        result = hub_ws_deliver(session->ws, message);
+    }
+    else
+    {
+        // The device polls for C2D messages, there is nothing to push
+        result = __LINE__;
+    }
+    return result;
+}
+
+static const HUB_PROTOCOL HTTP_PROTOCOL =
+{
+    "https",
+    http_create,
+    http_destroy,
+    http_on_bytes,
+    http_deliver
+};
+
+const HUB_PROTOCOL* hub_http_get_protocol(void)
+{
+    return &HTTP_PROTOCOL;
+}
@@ -0,0 +1,652 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hub_mqtt.h"
+
+#define MQTT_CONNECT            1
+#define MQTT_CONNACK            2
+#define MQTT_PUBLISH            3
+#define MQTT_PUBACK             4
+#define MQTT_SUBSCRIBE          8
+#define MQTT_SUBACK             9
+#define MQTT_UNSUBSCRIBE        10
+#define MQTT_UNSUBACK           11
+#define MQTT_PINGREQ            12
+#define MQTT_PINGRESP           13
+#define MQTT_DISCONNECT         14
+
+#define MQTT_MAX_HEADER_LEN     5
+#define MQTT_PACKET_ID_COUNT    65536
+#define MQTT_TOPIC_MAX_LEN      512
+#define MQTT_REQUEST_ID_LEN     64
+
+static const char* const DEVICE_TOPIC_PREFIX = "devices/";
+static const char* const TELEMETRY_TOPIC_SEGMENT = "/messages/events/";
+static const char* const C2D_TOPIC_SEGMENT = "/messages/devicebound/";
+static const char* const C2D_TOPIC_FMT = "devices/%s/messages/devicebound/%s";
+static const char* const METHOD_SUBSCRIBE_TOPIC = "$iothub/methods/POST/";
+static const char* const METHOD_RESPONSE_PREFIX = "$iothub/methods/res/";
+static const char* const METHOD_TOPIC_FMT = "$iothub/methods/POST/%s/?$rid=%u";
+static const char* const REQUEST_ID_KEY = "$rid=";
+static const char* const TWIN_GET_PREFIX = "$iothub/twin/GET/";
+static const char* const TWIN_REPORTED_PREFIX = "$iothub/twin/PATCH/properties/reported/";
+static const char* const TWIN_DESIRED_SUBSCRIBE_TOPIC = "$iothub/twin/PATCH/properties/desired/";
+static const char* const TWIN_GET_RESPONSE_FMT = "$iothub/twin/res/200/?$rid=%s";
+static const char* const TWIN_REPORTED_RESPONSE_FMT = "$iothub/twin/res/204/?$rid=%s&$version=%u";
+static const char* const TWIN_DESIRED_TOPIC_FMT = "$iothub/twin/PATCH/properties/desired/?$version=%u";
+static const char* const DPS_REGISTER_PREFIX = "$dps/registrations/PUT/iotdps-register/";
+static const char* const DPS_STATUS_PREFIX = "$dps/registrations/GET/iotdps-get-operationstatus/";
+static const char* const DPS_RESPONSE_FMT = "$dps/registrations/res/%d/?$rid=%s";
+static const char* const DPS_RETRY_RESPONSE_FMT = "$dps/registrations/res/%d/?$rid=%s&retry-after=%zu";
+
+typedef struct MQTT_SESSION_TAG
+{
+    HUB_CONNECTION* conn;
+    bool connected;
+    uint16_t next_packet_id;
+    // Message type + 1 of every QoS 1 publish the device has not acknowledged
+    uint8_t* inflight;
+} MQTT_SESSION;
+
+typedef struct MQTT_READER_TAG
+{
+    const unsigned char* data;
+    size_t length;
+    size_t pos;
+    bool failed;
+} MQTT_READER;
+
+static uint8_t read_byte(MQTT_READER* reader)
+{
+    uint8_t result = 0;
+    if (reader->pos + 1 > reader->length)
+    {
+        reader->failed = true;
+    }
+    else
+    {
+        result = reader->data[reader->pos++];
+    }
+    return result;
+}
+
+static uint16_t read_uint16(MQTT_READER* reader)
+{
+    uint16_t result = (uint16_t)(read_byte(reader) << 8);
+    result |= read_byte(reader);
+    return result;
+}
+
+// Returns a pointer into the packet, the string is not null terminated
+static const char* read_string(MQTT_READER* reader, size_t* str_len)
+{
+    const char* result = NULL;
+    *str_len = read_uint16(reader);
+    if (reader->failed || reader->pos + *str_len > reader->length)
+    {
+        reader->failed = true;
+        *str_len = 0;
+    }
+    else
+    {
+        result = (const char*)reader->data + reader->pos;
+        reader->pos += *str_len;
+    }
+    return result;
+}
+
+static size_t encode_remaining_length(unsigned char* buffer, size_t length)
+{
+    size_t result = 0;
+    do
+    {
+        unsigned char encoded = (unsigned char)(length % 128);
+        length /= 128;
+        if (length > 0)
+        {
+            encoded |= 0x80;
+        }
+        buffer[result++] = encoded;
+    } while (length > 0);
+    return result;
+}
+
+static int send_ack(MQTT_SESSION* session, uint8_t packet_type, uint16_t packet_id)
+{
+    unsigned char packet[4];
+    packet[0] = (unsigned char)(packet_type << 4);
+    packet[1] = 2;
+    packet[2] = (unsigned char)(packet_id >> 8);
+    packet[3] = (unsigned char)(packet_id & 0xFF);
+    return hub_connection_send(session->conn, packet, sizeof(packet));
+}
+
+static int send_publish(MQTT_SESSION* session, const char* topic, const unsigned char* payload, size_t payload_len, uint8_t qos, HUB_MESSAGE_TYPE msg_type)
+{
+    int result;
+    size_t topic_len = strlen(topic);
+    size_t remaining = 2 + topic_len + (qos > 0 ? 2 : 0) + payload_len;
+    unsigned char* packet = (unsigned char*)malloc(MQTT_MAX_HEADER_LEN + remaining);
+    if (packet == NULL)
+    {
+        (void)printf("Failure allocating publish packet\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t pos = 0;
+        packet[pos++] = (unsigned char)((MQTT_PUBLISH << 4) | (qos << 1));
+        pos += encode_remaining_length(packet + pos, remaining);
+        packet[pos++] = (unsigned char)(topic_len >> 8);
+        packet[pos++] = (unsigned char)(topic_len & 0xFF);
+        memcpy(packet + pos, topic, topic_len);
+        pos += topic_len;
+        if (qos > 0)
+        {
+            uint16_t packet_id = session->next_packet_id;
+            session->next_packet_id = (uint16_t)(packet_id == 0xFFFF ? 1 : packet_id + 1);
+            session->inflight[packet_id] = (uint8_t)(msg_type + 1);
+            packet[pos++] = (unsigned char)(packet_id >> 8);
+            packet[pos++] = (unsigned char)(packet_id & 0xFF);
+        }
+        if (payload_len > 0)
+        {
+            memcpy(packet + pos, payload, payload_len);
+            pos += payload_len;
+        }
+        result = hub_connection_send(session->conn, packet, pos);
+        free(packet);
+    }
+    return result;
+}
+
+// $iothub/methods/res/{status}/?$rid={request id}
+static int parse_method_response(const char* topic, int* status, uint32_t* request_id)
+{
+    int result;
+    const char* rid = strstr(topic, REQUEST_ID_KEY);
+    char* end;
+
+    *status = (int)strtol(topic + strlen(METHOD_RESPONSE_PREFIX), &end, 10);
+    if (end == topic + strlen(METHOD_RESPONSE_PREFIX) || rid == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        *request_id = (uint32_t)strtoul(rid + strlen(REQUEST_ID_KEY), &end, 10);
+        result = end == rid + strlen(REQUEST_ID_KEY) ? __LINE__ : 0;
+    }
+    return result;
+}
+
+// The request id is echoed back as the device sent it
+static int copy_request_id(const char* topic, char* request_id, size_t length)
+{
+    int result;
+    const char* rid = strstr(topic, REQUEST_ID_KEY);
+    if (rid == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        size_t rid_len;
+        rid += strlen(REQUEST_ID_KEY);
+        rid_len = strcspn(rid, "&");
+        if (rid_len == 0 || rid_len >= length)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            memcpy(request_id, rid, rid_len);
+            request_id[rid_len] = '\0';
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static int on_twin_request(MQTT_SESSION* session, const char* topic, size_t payload_len)
+{
+    int result;
+    char request_id[MQTT_REQUEST_ID_LEN];
+    char response_topic[MQTT_TOPIC_MAX_LEN];
+
+    if (copy_request_id(topic, request_id, sizeof(request_id)) != 0)
+    {
+        (void)printf("Invalid twin request topic %s\r\n", topic);
+        result = __LINE__;
+    }
+    else if (strncmp(topic, TWIN_GET_PREFIX, strlen(TWIN_GET_PREFIX)) == 0)
+    {
+        size_t twin_len;
+        unsigned char* twin = hub_connection_get_twin(session->conn, &twin_len);
+        if (twin == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            (void)snprintf(response_topic, sizeof(response_topic), TWIN_GET_RESPONSE_FMT, request_id);
+            result = send_publish(session, response_topic, twin, twin_len, 0, HUB_MESSAGE_TWIN_PATCH);
+            free(twin);
+        }
+    }
+    else
+    {
+        uint32_t version = hub_connection_on_twin_reported(session->conn, payload_len);
+        (void)snprintf(response_topic, sizeof(response_topic), TWIN_REPORTED_RESPONSE_FMT, request_id, version);
+        result = send_publish(session, response_topic, NULL, 0, 0, HUB_MESSAGE_TWIN_PATCH);
+    }
+    return result;
+}
+
+// The registration id is the client id of the connection, the body is not inspected
+static int on_dps_request(MQTT_SESSION* session, const char* topic)
+{
+    int result;
+    char request_id[MQTT_REQUEST_ID_LEN];
+    char response_topic[MQTT_TOPIC_MAX_LEN];
+    unsigned char* response;
+    int status;
+    size_t retry_after;
+    size_t response_len;
+
+    if (copy_request_id(topic, request_id, sizeof(request_id)) != 0)
+    {
+        (void)printf("Invalid dps request topic %s\r\n", topic);
+        result = __LINE__;
+    }
+    else if ((response = hub_connection_on_dps_request(session->conn, strncmp(topic, DPS_STATUS_PREFIX, strlen(DPS_STATUS_PREFIX)) == 0, &status, &retry_after, &response_len)) == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        if (status == 202)
+        {
+            (void)snprintf(response_topic, sizeof(response_topic), DPS_RETRY_RESPONSE_FMT, status, request_id, retry_after);
+        }
+        else
+        {
+            (void)snprintf(response_topic, sizeof(response_topic), DPS_RESPONSE_FMT, status, request_id);
+        }
+        result = send_publish(session, response_topic, response, response_len, 0, HUB_MESSAGE_C2D);
+        free(response);
+    }
+    return result;
+}
+
+static int on_connect(MQTT_SESSION* session, MQTT_READER* reader)
+{
+    int result;
+    size_t name_len;
+    size_t client_id_len;
+    const char* client_id;
+    uint8_t connect_flags;
+    char device_id[HUB_DEVICE_ID_LEN];
+
+    (void)read_string(reader, &name_len);
+    (void)read_byte(reader);
+    connect_flags = read_byte(reader);
+    (void)read_uint16(reader);
+    client_id = read_string(reader, &client_id_len);
+    // The will, username and password are accepted without checking the sas token. DPS
+    // connections use the registration id as client id so they attach like a device.
+
+    if (reader->failed || session->connected || client_id_len == 0 || client_id_len >= sizeof(device_id))
+    {
+        (void)printf("Invalid MQTT CONNECT packet\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        unsigned char connack[4] = { MQTT_CONNACK << 4, 2, 0, 0 };
+        (void)connect_flags;
+        memcpy(device_id, client_id, client_id_len);
+        device_id[client_id_len] = '\0';
+
+        if (hub_connection_attach_device(session->conn, device_id) != 0)
+        {
+            connack[3] = 3;
+            (void)hub_connection_send(session->conn, connack, sizeof(connack));
+            result = __LINE__;
+        }
+        else
+        {
+            session->connected = true;
+            result = hub_connection_send(session->conn, connack, sizeof(connack));
+        }
+    }
+    return result;
+}
+
+static int on_publish(MQTT_SESSION* session, uint8_t flags, MQTT_READER* reader)
+{
+    int result;
+    uint8_t qos = (flags >> 1) & 0x03;
+    uint16_t packet_id = 0;
+    size_t topic_len;
+    const char* topic = read_string(reader, &topic_len);
+    char topic_text[MQTT_TOPIC_MAX_LEN];
+
+    if (qos > 0)
+    {
+        packet_id = read_uint16(reader);
+    }
+
+    if (reader->failed || qos > 1 || !session->connected)
+    {
+        (void)printf("Invalid MQTT PUBLISH packet\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t payload_len = reader->length - reader->pos;
+        size_t copy_len = topic_len < sizeof(topic_text) - 1 ? topic_len : sizeof(topic_text) - 1;
+        memcpy(topic_text, topic, copy_len);
+        topic_text[copy_len] = '\0';
+
+        // Acknowledge first so a twin response never overtakes the PUBACK
+        result = qos == 1 ? send_ack(session, MQTT_PUBACK, packet_id) : 0;
+        if (result != 0)
+        {
+            (void)printf("Failure acknowledging MQTT PUBLISH packet\r\n");
+        }
+        else if (strncmp(topic_text, DEVICE_TOPIC_PREFIX, strlen(DEVICE_TOPIC_PREFIX)) == 0 && strstr(topic_text, TELEMETRY_TOPIC_SEGMENT) != NULL)
+        {
+            hub_connection_on_telemetry(session->conn, payload_len);
+        }
+        else if (strncmp(topic_text, METHOD_RESPONSE_PREFIX, strlen(METHOD_RESPONSE_PREFIX)) == 0)
+        {
+            int status;
+            uint32_t request_id;
+            if (parse_method_response(topic_text, &status, &request_id) != 0)
+            {
+                (void)printf("Invalid method response topic %s\r\n", topic_text);
+            }
+            else
+            {
+                hub_connection_on_method_response(session->conn, request_id, status);
+            }
+        }
+        else if (strncmp(topic_text, TWIN_GET_PREFIX, strlen(TWIN_GET_PREFIX)) == 0 || strncmp(topic_text, TWIN_REPORTED_PREFIX, strlen(TWIN_REPORTED_PREFIX)) == 0)
+        {
+            result = on_twin_request(session, topic_text, payload_len);
+        }
+        else if (strncmp(topic_text, DPS_REGISTER_PREFIX, strlen(DPS_REGISTER_PREFIX)) == 0 || strncmp(topic_text, DPS_STATUS_PREFIX, strlen(DPS_STATUS_PREFIX)) == 0)
+        {
+            result = on_dps_request(session, topic_text);
+        }
+    }
+    return result;
+}
+
+static int on_puback(MQTT_SESSION* session, MQTT_READER* reader)
+{
+    int result;
+    uint16_t packet_id = read_uint16(reader);
+    if (reader->failed)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        if (session->inflight[packet_id] != 0)
+        {
+            hub_connection_on_completed(session->conn, (HUB_MESSAGE_TYPE)(session->inflight[packet_id] - 1));
+            session->inflight[packet_id] = 0;
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static int on_subscribe(MQTT_SESSION* session, MQTT_READER* reader)
+{
+    int result;
+    uint16_t packet_id = read_uint16(reader);
+    unsigned char suback[MQTT_MAX_HEADER_LEN + 2 + 64];
+    size_t topic_count = 0;
+    uint8_t granted[64];
+    bool c2d_ready = false;
+    bool method_ready = false;
+    bool twin_ready = false;
+
+    while (!reader->failed && reader->pos < reader->length && topic_count < sizeof(granted))
+    {
+        size_t topic_len;
+        const char* topic = read_string(reader, &topic_len);
+        uint8_t qos = read_byte(reader);
+        if (!reader->failed)
+        {
+            if (topic_len > strlen(C2D_TOPIC_SEGMENT) && strncmp(topic, DEVICE_TOPIC_PREFIX, strlen(DEVICE_TOPIC_PREFIX)) == 0)
+            {
+                const char* segment = topic + topic_len - strlen(C2D_TOPIC_SEGMENT) - 1;
+                if (strncmp(segment, C2D_TOPIC_SEGMENT, strlen(C2D_TOPIC_SEGMENT)) == 0)
+                {
+                    c2d_ready = true;
+                }
+            }
+            else if (topic_len > strlen(METHOD_SUBSCRIBE_TOPIC) && strncmp(topic, METHOD_SUBSCRIBE_TOPIC, strlen(METHOD_SUBSCRIBE_TOPIC)) == 0)
+            {
+                method_ready = true;
+            }
+            else if (topic_len > strlen(TWIN_DESIRED_SUBSCRIBE_TOPIC) && strncmp(topic, TWIN_DESIRED_SUBSCRIBE_TOPIC, strlen(TWIN_DESIRED_SUBSCRIBE_TOPIC)) == 0)
+            {
+                twin_ready = true;
+            }
+            granted[topic_count++] = qos > 1 ? 1 : qos;
+        }
+    }
+
+    if (reader->failed || topic_count == 0 || !session->connected)
+    {
+        (void)printf("Invalid MQTT SUBSCRIBE packet\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t pos = 0;
+        suback[pos++] = MQTT_SUBACK << 4;
+        pos += encode_remaining_length(suback + pos, 2 + topic_count);
+        suback[pos++] = (unsigned char)(packet_id >> 8);
+        suback[pos++] = (unsigned char)(packet_id & 0xFF);
+        memcpy(suback + pos, granted, topic_count);
+        pos += topic_count;
+        result = hub_connection_send(session->conn, suback, pos);
+
+        // Queued messages go out after the SUBACK
+        if (result == 0 && c2d_ready)
+        {
+            hub_connection_set_ready(session->conn, HUB_MESSAGE_C2D);
+        }
+        if (result == 0 && method_ready)
+        {
+            hub_connection_set_ready(session->conn, HUB_MESSAGE_METHOD);
+        }
+        if (result == 0 && twin_ready)
+        {
+            hub_connection_set_ready(session->conn, HUB_MESSAGE_TWIN_PATCH);
+        }
+    }
+    return result;
+}
+
+static int process_packet(MQTT_SESSION* session, uint8_t packet_type, uint8_t flags, const unsigned char* body, size_t body_len)
+{
+    int result;
+    MQTT_READER reader;
+    reader.data = body;
+    reader.length = body_len;
+    reader.pos = 0;
+    reader.failed = false;
+
+    switch (packet_type)
+    {
+        case MQTT_CONNECT:
+            result = on_connect(session, &reader);
+            break;
+        case MQTT_PUBLISH:
+            result = on_publish(session, flags, &reader);
+            break;
+        case MQTT_PUBACK:
+            result = on_puback(session, &reader);
+            break;
+        case MQTT_SUBSCRIBE:
+            result = on_subscribe(session, &reader);
+            break;
+        case MQTT_UNSUBSCRIBE:
+        {
+            uint16_t packet_id = read_uint16(&reader);
+            result = reader.failed ? __LINE__ : send_ack(session, MQTT_UNSUBACK, packet_id);
+            break;
+        }
+        case MQTT_PINGREQ:
+        {
+            unsigned char pingresp[2] = { MQTT_PINGRESP << 4, 0 };
+            result = hub_connection_send(session->conn, pingresp, sizeof(pingresp));
+            break;
+        }
+        case MQTT_DISCONNECT:
+        default:
+            result = __LINE__;
+            break;
+    }
+    return result;
+}
+
+static void* mqtt_create(HUB_CONNECTION* conn)
+{
+    MQTT_SESSION* result;
+    if ((result = (MQTT_SESSION*)calloc(1, sizeof(MQTT_SESSION))) == NULL)
+    {
+        (void)printf("Failure allocating mqtt session\r\n");
+    }
+    else if ((result->inflight = (uint8_t*)calloc(MQTT_PACKET_ID_COUNT, sizeof(uint8_t))) == NULL)
+    {
+        (void)printf("Failure allocating mqtt inflight table\r\n");
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        result->conn = conn;
+        result->next_packet_id = 1;
+    }
+    return result;
+}
+
+static void mqtt_destroy(void* protocol_state)
+{
+    MQTT_SESSION* session = (MQTT_SESSION*)protocol_state;
+    free(session->inflight);
+    free(session);
+}
+
+static int mqtt_on_bytes(void* protocol_state, const unsigned char* data, size_t length)
+{
+    int result = 0;
+    MQTT_SESSION* session = (MQTT_SESSION*)protocol_state;
+    size_t pos = 0;
+
+    while (length - pos >= 2)
+    {
+        size_t remaining = 0;
+        size_t multiplier = 1;
+        size_t header_len = 1;
+        bool complete = false;
+
+        while (header_len < MQTT_MAX_HEADER_LEN && pos + header_len < length)
+        {
+            unsigned char encoded = data[pos + header_len++];
+            remaining += (encoded & 0x7F) * multiplier;
+            multiplier *= 128;
+            if ((encoded & 0x80) == 0)
+            {
+                complete = true;
+                break;
+            }
+        }
+
+        if (!complete)
+        {
+            if (header_len >= MQTT_MAX_HEADER_LEN)
+            {
+                result = -1;
+            }
+            break;
+        }
+        else if (length - pos - header_len < remaining)
+        {
+            break;
+        }
+        else if (process_packet(session, data[pos] >> 4, data[pos] & 0x0F, data + pos + header_len, remaining) != 0)
+        {
+            result = -1;
+            break;
+        }
+        pos += header_len + remaining;
+    }
+    return result < 0 ? result : (int)pos;
+}
+
+static int mqtt_deliver(void* protocol_state, const HUB_MESSAGE* message)
+{
+    int result;
+    MQTT_SESSION* session = (MQTT_SESSION*)protocol_state;
+    char topic[MQTT_TOPIC_MAX_LEN];
+
+    if (message->msg_type == HUB_MESSAGE_C2D)
+    {
+        if (snprintf(topic, sizeof(topic), C2D_TOPIC_FMT, hub_connection_get_device_id(session->conn), message->properties) >= (int)sizeof(topic))
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            result = send_publish(session, topic, message->payload, message->payload_len, 1, message->msg_type);
+        }
+    }
+    else if (message->msg_type == HUB_MESSAGE_METHOD)
+    {
+        // Method requests go out at QoS 0, the response publish completes them
+        if (snprintf(topic, sizeof(topic), METHOD_TOPIC_FMT, message->name, message->sequence) >= (int)sizeof(topic))
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            result = send_publish(session, topic, message->payload, message->payload_len, 0, message->msg_type);
+        }
+    }
+    else if (message->msg_type == HUB_MESSAGE_TWIN_PATCH)
+    {
+        (void)snprintf(topic, sizeof(topic), TWIN_DESIRED_TOPIC_FMT, message->sequence);
+        result = send_publish(session, topic, message->payload, message->payload_len, 0, message->msg_type);
+    }
+    else
+    {
+        result = __LINE__;
+    }
+    return result;
+}
+
+static const HUB_PROTOCOL MQTT_PROTOCOL =
+{
+    "mqtt",
+    mqtt_create,
+    mqtt_destroy,
+    mqtt_on_bytes,
+    mqtt_deliver
+};
+
+const HUB_PROTOCOL* hub_mqtt_get_protocol(void)
+{
+    return &MQTT_PROTOCOL;
+}
@@ -0,0 +1,1197 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "hub_server.h"
+#include "hub_tls.h"
+#include "hub_mqtt.h"
+#include "hub_amqp.h"
+#include "hub_http.h"
+#include "hub_commands.h"
+
+#define LISTEN_BACKLOG          64
+#define RECV_CHUNK_SIZE         16384
+#define POLL_TIMEOUT_MS         50
+#define MAX_PROPERTY_LEN        128
+#define MAX_DPS_RESPONSE_LEN    1024
+#define NS_PER_SEC              1000000000ULL
+#define NS_PER_MS               1000000ULL
+
+static const char* const METHOD_NAME = "analytics_method";
+static const char* const TWIN_DOCUMENT_HEAD_FMT = "{\"desired\":{\"$version\":%u,\"data\":\"";
+static const char* const TWIN_DOCUMENT_TAIL_FMT = "\"},\"reported\":{\"$version\":%u}}";
+static const char* const TWIN_PATCH_HEAD_FMT = "{\"$version\":%u,\"data\":\"";
+static const char* const DPS_ASSIGNING_FMT = "{\"operationId\":\"local.%s\",\"status\":\"assigning\"}";
+static const char* const DPS_ASSIGNED_FMT = "{\"operationId\":\"local.%s\",\"status\":\"assigned\",\"registrationState\":{\"registrationId\":\"%s\","
+    "\"assignedHub\":\"%s\",\"deviceId\":\"%s\",\"status\":\"assigned\",\"substatus\":\"initialAssignment\",\"etag\":\"IjEi\"}}";
+
+typedef struct HUB_LISTENER_TAG
+{
+    int sock;
+    bool use_tls;
+    bool track_stats;
+    const HUB_PROTOCOL* protocol;
+} HUB_LISTENER;
+
+typedef enum HUB_LISTENER_INDEX_TAG
+{
+    HUB_LISTENER_MQTT,
+    HUB_LISTENER_AMQP,
+    HUB_LISTENER_HTTPS,
+    HUB_LISTENER_CONTROL,
+    HUB_LISTENER_COUNT
+} HUB_LISTENER_INDEX;
+
+typedef struct HUB_METHOD_INFLIGHT_TAG
+{
+    bool active;
+    uint32_t request_id;
+    uint64_t sent_ns;
+} HUB_METHOD_INFLIGHT;
+
+// Messages the hub generates at a fixed rate instead of queueing them
+typedef struct HUB_SCHEDULE_TAG
+{
+    size_t remaining;
+    size_t payload_size;
+    uint64_t interval_ns;
+    uint64_t next_ns;
+} HUB_SCHEDULE;
+
+struct HUB_DEVICE_TAG
+{
+    char device_id[HUB_DEVICE_ID_LEN];
+    HUB_CONNECTION* connection;
+    HUB_MESSAGE* pending_head;
+    HUB_MESSAGE* pending_tail;
+    uint32_t next_sequence;
+
+    HUB_SCHEDULE schedule[HUB_MESSAGE_TYPE_COUNT];
+    HUB_METHOD_INFLIGHT* method_inflight;
+    size_t method_inflight_count;
+    uint32_t twin_desired_version;
+    uint32_t twin_reported_version;
+
+    HUB_DEVICE* next;
+};
+
+typedef struct HUB_SERVER_TAG
+{
+    HUB_CONFIG config;
+    SSL_CTX* ssl_ctx;
+    HUB_LISTENER listeners[HUB_LISTENER_COUNT];
+    HUB_CONNECTION* connections;
+    size_t connection_count;
+    HUB_DEVICE* devices;
+    HUB_STATS stats;
+    size_t method_inflight_count;
+    size_t twin_document_size;
+    size_t dps_poll_count;
+    size_t dps_retry_after;
+    LATENCY_STATS_HANDLE latency[HUB_MESSAGE_TYPE_COUNT];
+} HUB_SERVER;
+
+uint64_t hub_get_time_ns(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000) + (uint64_t)now.tv_nsec;
+}
+
+static int set_nonblocking(int sock)
+{
+    int flags = fcntl(sock, F_GETFL, 0);
+    return (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) ? __LINE__ : 0;
+}
+
+static int open_listener(HUB_LISTENER* listener, const char* bind_address, uint16_t port, bool use_tls, const HUB_PROTOCOL* protocol)
+{
+    int result;
+    struct sockaddr_in addr;
+    int reuse = 1;
+
+    listener->sock = -1;
+    listener->use_tls = use_tls;
+    // The control channel is not part of the device traffic
+    listener->track_stats = use_tls;
+    listener->protocol = protocol;
+    if (port == 0)
+    {
+        // Disabled, poll skips the negative descriptor
+        result = 0;
+    }
+    else if ((listener->sock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        (void)printf("Failure creating socket for port %u\r\n", port);
+        result = __LINE__;
+    }
+    else
+    {
+        (void)setsockopt(listener->sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, bind_address, &addr.sin_addr) != 1)
+        {
+            (void)printf("Invalid bind address %s\r\n", bind_address);
+            result = __LINE__;
+        }
+        else if (bind(listener->sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            (void)printf("Failure binding %s:%u: %s\r\n", bind_address, port, strerror(errno));
+            result = __LINE__;
+        }
+        else if (listen(listener->sock, LISTEN_BACKLOG) != 0 || set_nonblocking(listener->sock) != 0)
+        {
+            (void)printf("Failure listening on port %u\r\n", port);
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+
+        if (result != 0)
+        {
+            (void)close(listener->sock);
+            listener->sock = -1;
+        }
+    }
+    return result;
+}
+
+// Builds head + "abc..." + tail, padded out to size when it is larger than the frame
+static unsigned char* create_padded_json(const char* head, const char* tail, size_t size, size_t* length)
+{
+    unsigned char* result;
+    size_t head_len = strlen(head);
+    size_t tail_len = strlen(tail);
+    size_t fill_len = size > head_len + tail_len ? size - head_len - tail_len : 0;
+
+    *length = head_len + fill_len + tail_len;
+    if ((result = (unsigned char*)malloc(*length + 1)) == NULL)
+    {
+        (void)printf("Failure allocating json payload\r\n");
+    }
+    else
+    {
+        memcpy(result, head, head_len);
+        for (size_t pos = 0; pos < fill_len; pos++)
+        {
+            result[head_len + pos] = (unsigned char)('a' + (pos % 26));
+        }
+        memcpy(result + head_len + fill_len, tail, tail_len);
+        result[*length] = '\0';
+    }
+    return result;
+}
+
+void hub_message_destroy(HUB_MESSAGE* message)
+{
+    free(message->name);
+    free(message->properties);
+    free(message->payload);
+    free(message);
+}
+
+static HUB_DEVICE* find_device(HUB_SERVER* server, const char* device_id)
+{
+    HUB_DEVICE* result = server->devices;
+    while (result != NULL && strcmp(result->device_id, device_id) != 0)
+    {
+        result = result->next;
+    }
+    return result;
+}
+
+static HUB_DEVICE* create_device(HUB_SERVER* server, const char* device_id)
+{
+    HUB_DEVICE* result = find_device(server, device_id);
+    if (result == NULL)
+    {
+        if (strlen(device_id) == 0 || strlen(device_id) >= HUB_DEVICE_ID_LEN || (result = (HUB_DEVICE*)calloc(1, sizeof(HUB_DEVICE))) == NULL)
+        {
+            (void)printf("Failure creating device %s\r\n", device_id);
+        }
+        else
+        {
+            (void)strcpy(result->device_id, device_id);
+            result->next = server->devices;
+            server->devices = result;
+        }
+    }
+    return result;
+}
+
+// The time is stamped on delivery so the device can measure the dispatch latency
+static int stamp_message(HUB_MESSAGE* message)
+{
+    char properties[MAX_PROPERTY_LEN];
+    (void)snprintf(properties, sizeof(properties), "seq=%u&sent_ns=%llu", message->sequence, (unsigned long long)hub_get_time_ns());
+    free(message->properties);
+    message->properties = strdup(properties);
+    return message->properties == NULL ? __LINE__ : 0;
+}
+
+static void remove_pending(HUB_DEVICE* device)
+{
+    device->pending_head = device->pending_head->next;
+    if (device->pending_head == NULL)
+    {
+        device->pending_tail = NULL;
+    }
+}
+
+static void flush_device(HUB_DEVICE* device)
+{
+    HUB_CONNECTION* conn = device->connection;
+    while (device->pending_head != NULL && conn != NULL && !conn->closing && conn->c2d_ready)
+    {
+        HUB_MESSAGE* message = device->pending_head;
+        if (stamp_message(message) != 0 || conn->protocol->deliver(conn->protocol_state, message) != 0)
+        {
+            break;
+        }
+
+        remove_pending(device);
+        conn->server->stats.c2d_sent++;
+        hub_message_destroy(message);
+    }
+}
+
+static void clear_method_inflight(HUB_SERVER* server, HUB_DEVICE* device)
+{
+    // Invocations without a response when the device goes away are failures
+    if (device->method_inflight != NULL && device->method_inflight_count > 0)
+    {
+        for (size_t index = 0; index < HUB_METHOD_INFLIGHT_MAX; index++)
+        {
+            device->method_inflight[index].active = false;
+        }
+        server->stats.method_failed += device->method_inflight_count;
+        server->method_inflight_count -= device->method_inflight_count;
+        device->method_inflight_count = 0;
+    }
+}
+
+static void close_connection(HUB_CONNECTION* conn)
+{
+    if (conn->device != NULL && conn->device->connection == conn)
+    {
+        clear_method_inflight(conn->server, conn->device);
+        conn->device->connection = NULL;
+    }
+    if (conn->protocol_state != NULL)
+    {
+        conn->protocol->destroy(conn->protocol_state);
+    }
+    if (conn->ssl != NULL)
+    {
+        if (conn->tls_established)
+        {
+            (void)SSL_shutdown(conn->ssl);
+        }
+        SSL_free(conn->ssl);
+    }
+    (void)close(conn->sock);
+    free(conn->recv_buffer);
+    free(conn->send_buffer);
+    free(conn);
+}
+
+static void accept_connection(HUB_SERVER* server, HUB_LISTENER* listener)
+{
+    int sock;
+    while ((sock = accept(listener->sock, NULL, NULL)) >= 0)
+    {
+        HUB_CONNECTION* conn;
+        int no_delay = 1;
+        (void)setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        if (set_nonblocking(sock) != 0 || (conn = (HUB_CONNECTION*)calloc(1, sizeof(HUB_CONNECTION))) == NULL)
+        {
+            (void)printf("Failure accepting connection\r\n");
+            (void)close(sock);
+        }
+        else
+        {
+            conn->server = server;
+            conn->sock = sock;
+            conn->protocol = listener->protocol;
+            conn->track_stats = listener->track_stats;
+            if (listener->use_tls && ((conn->ssl = SSL_new(server->ssl_ctx)) == NULL || SSL_set_fd(conn->ssl, sock) != 1))
+            {
+                (void)printf("Failure creating tls session\r\n");
+                close_connection(conn);
+            }
+            else if ((conn->protocol_state = conn->protocol->create(conn)) == NULL)
+            {
+                (void)printf("Failure creating %s session\r\n", conn->protocol->name);
+                close_connection(conn);
+            }
+            else
+            {
+                if (conn->ssl != NULL)
+                {
+                    SSL_set_accept_state(conn->ssl);
+                }
+                else
+                {
+                    conn->tls_established = true;
+                }
+                conn->next = server->connections;
+                server->connections = conn;
+                server->connection_count++;
+                if (conn->track_stats)
+                {
+                    server->stats.connections++;
+                }
+            }
+        }
+    }
+}
+
+static int flush_send_buffer(HUB_CONNECTION* conn)
+{
+    int result = 0;
+    size_t sent = 0;
+    while (sent < conn->send_length && result == 0)
+    {
+        int written;
+        if (conn->ssl != NULL)
+        {
+            written = SSL_write(conn->ssl, conn->send_buffer + sent, (int)(conn->send_length - sent));
+            if (written <= 0)
+            {
+                int ssl_error = SSL_get_error(conn->ssl, written);
+                if (ssl_error != SSL_ERROR_WANT_WRITE && ssl_error != SSL_ERROR_WANT_READ)
+                {
+                    result = __LINE__;
+                }
+                break;
+            }
+        }
+        else
+        {
+            written = (int)send(conn->sock, conn->send_buffer + sent, conn->send_length - sent, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    result = __LINE__;
+                }
+                break;
+            }
+        }
+        sent += (size_t)written;
+    }
+
+    if (sent > 0)
+    {
+        memmove(conn->send_buffer, conn->send_buffer + sent, conn->send_length - sent);
+        conn->send_length -= sent;
+        if (conn->track_stats)
+        {
+            conn->server->stats.bytes_sent += sent;
+        }
+    }
+    return result;
+}
+
+static int ensure_capacity(unsigned char** buffer, size_t* capacity, size_t needed)
+{
+    int result = 0;
+    if (needed > *capacity)
+    {
+        size_t new_capacity = *capacity == 0 ? RECV_CHUNK_SIZE : *capacity;
+        unsigned char* new_buffer;
+        while (new_capacity < needed)
+        {
+            new_capacity *= 2;
+        }
+        if ((new_buffer = (unsigned char*)realloc(*buffer, new_capacity)) == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            *buffer = new_buffer;
+            *capacity = new_capacity;
+        }
+    }
+    return result;
+}
+
+int hub_connection_send_raw(HUB_CONNECTION* conn, const void* data, size_t length)
+{
+    int result;
+    if (conn->closing)
+    {
+        result = __LINE__;
+    }
+    else if (ensure_capacity(&conn->send_buffer, &conn->send_capacity, conn->send_length + length) != 0)
+    {
+        (void)printf("Failure allocating send buffer\r\n");
+        conn->closing = true;
+        result = __LINE__;
+    }
+    else
+    {
+        memcpy(conn->send_buffer + conn->send_length, data, length);
+        conn->send_length += length;
+        if (conn->tls_established && flush_send_buffer(conn) != 0)
+        {
+            conn->closing = true;
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int hub_connection_send(HUB_CONNECTION* conn, const void* data, size_t length)
+{
+    return conn->frame_send != NULL ? conn->frame_send(conn->frame_state, data, length) : hub_connection_send_raw(conn, data, length);
+}
+
+static void read_connection(HUB_CONNECTION* conn)
+{
+    if (conn->ssl != NULL && !conn->tls_established)
+    {
+        int handshake = SSL_do_handshake(conn->ssl);
+        if (handshake == 1)
+        {
+            conn->tls_established = true;
+        }
+        else
+        {
+            int ssl_error = SSL_get_error(conn->ssl, handshake);
+            if (ssl_error != SSL_ERROR_WANT_READ && ssl_error != SSL_ERROR_WANT_WRITE)
+            {
+                conn->closing = true;
+            }
+        }
+    }
+
+    while (conn->tls_established && !conn->closing)
+    {
+        int received;
+        if (ensure_capacity(&conn->recv_buffer, &conn->recv_capacity, conn->recv_length + RECV_CHUNK_SIZE) != 0)
+        {
+            conn->closing = true;
+            break;
+        }
+
+        if (conn->ssl != NULL)
+        {
+            received = SSL_read(conn->ssl, conn->recv_buffer + conn->recv_length, RECV_CHUNK_SIZE);
+            if (received <= 0)
+            {
+                int ssl_error = SSL_get_error(conn->ssl, received);
+                if (ssl_error != SSL_ERROR_WANT_READ && ssl_error != SSL_ERROR_WANT_WRITE)
+                {
+                    conn->closing = true;
+                }
+                break;
+            }
+        }
+        else
+        {
+            received = (int)recv(conn->sock, conn->recv_buffer + conn->recv_length, RECV_CHUNK_SIZE, 0);
+            if (received <= 0)
+            {
+                if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                {
+                    conn->closing = true;
+                }
+                break;
+            }
+        }
+        conn->recv_length += (size_t)received;
+        if (conn->track_stats)
+        {
+            conn->server->stats.bytes_recv += (size_t)received;
+        }
+    }
+
+    if (conn->recv_length > 0 && !conn->closing)
+    {
+        int used = conn->protocol->on_bytes(conn->protocol_state, conn->recv_buffer, conn->recv_length);
+        if (used < 0)
+        {
+            conn->closing = true;
+        }
+        else if (used > 0)
+        {
+            memmove(conn->recv_buffer, conn->recv_buffer + used, conn->recv_length - (size_t)used);
+            conn->recv_length -= (size_t)used;
+        }
+    }
+}
+
+int hub_connection_attach_device(HUB_CONNECTION* conn, const char* device_id)
+{
+    int result;
+    HUB_DEVICE* device = create_device(conn->server, device_id);
+    if (device == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        // A reconnecting device replaces its previous connection
+        if (device->connection != NULL && device->connection != conn)
+        {
+            device->connection->device = NULL;
+            device->connection->closing = true;
+        }
+        device->connection = conn;
+        conn->device = device;
+        result = 0;
+    }
+    return result;
+}
+
+void hub_connection_set_ready(HUB_CONNECTION* conn, HUB_MESSAGE_TYPE msg_type)
+{
+    if (msg_type == HUB_MESSAGE_C2D)
+    {
+        conn->c2d_ready = true;
+    }
+    else if (msg_type == HUB_MESSAGE_METHOD)
+    {
+        conn->method_ready = true;
+    }
+    else if (msg_type == HUB_MESSAGE_TWIN_PATCH)
+    {
+        conn->twin_ready = true;
+    }
+    if (conn->device != NULL)
+    {
+        flush_device(conn->device);
+    }
+}
+
+const char* hub_connection_get_device_id(const HUB_CONNECTION* conn)
+{
+    return conn->device == NULL ? "" : conn->device->device_id;
+}
+
+void hub_connection_on_telemetry(HUB_CONNECTION* conn, size_t payload_len)
+{
+    conn->server->stats.telemetry_recv++;
+    conn->server->stats.telemetry_bytes += payload_len;
+}
+
+HUB_MESSAGE* hub_connection_take_c2d(HUB_CONNECTION* conn)
+{
+    HUB_MESSAGE* result = NULL;
+    HUB_DEVICE* device = conn->device;
+    if (device != NULL && device->pending_head != NULL && stamp_message(device->pending_head) == 0)
+    {
+        result = device->pending_head;
+        remove_pending(device);
+        result->next = NULL;
+        conn->server->stats.c2d_sent++;
+    }
+    return result;
+}
+
+void hub_connection_on_completed(HUB_CONNECTION* conn, HUB_MESSAGE_TYPE msg_type)
+{
+    if (msg_type == HUB_MESSAGE_C2D)
+    {
+        conn->server->stats.c2d_completed++;
+    }
+}
+
+void hub_connection_on_method_response(HUB_CONNECTION* conn, uint32_t request_id, int status)
+{
+    HUB_SERVER* server = conn->server;
+    HUB_DEVICE* device = conn->device;
+    uint64_t now = hub_get_time_ns();
+
+    if (device != NULL && device->method_inflight != NULL)
+    {
+        HUB_METHOD_INFLIGHT* inflight = &device->method_inflight[request_id % HUB_METHOD_INFLIGHT_MAX];
+        if (inflight->active && inflight->request_id == request_id)
+        {
+            inflight->active = false;
+            device->method_inflight_count--;
+            server->method_inflight_count--;
+            if (status >= 200 && status < 300)
+            {
+                server->stats.method_completed++;
+                latency_stats_add(server->latency[HUB_MESSAGE_METHOD], now - inflight->sent_ns);
+            }
+            else
+            {
+                server->stats.method_failed++;
+            }
+        }
+    }
+}
+
+unsigned char* hub_connection_get_twin(HUB_CONNECTION* conn, size_t* length)
+{
+    unsigned char* result;
+    HUB_SERVER* server = conn->server;
+    char head[MAX_PROPERTY_LEN];
+    char tail[MAX_PROPERTY_LEN];
+    uint32_t desired_version = conn->device == NULL ? 0 : conn->device->twin_desired_version;
+    uint32_t reported_version = conn->device == NULL ? 0 : conn->device->twin_reported_version;
+
+    (void)snprintf(head, sizeof(head), TWIN_DOCUMENT_HEAD_FMT, desired_version);
+    (void)snprintf(tail, sizeof(tail), TWIN_DOCUMENT_TAIL_FMT, reported_version);
+    if ((result = create_padded_json(head, tail, server->twin_document_size, length)) != NULL)
+    {
+        server->stats.twin_get++;
+    }
+    return result;
+}
+
+uint32_t hub_connection_on_twin_reported(HUB_CONNECTION* conn, size_t payload_len)
+{
+    uint32_t result = 0;
+    conn->server->stats.twin_reported++;
+    conn->server->stats.twin_reported_bytes += payload_len;
+    if (conn->device != NULL)
+    {
+        result = ++conn->device->twin_reported_version;
+    }
+    return result;
+}
+
+unsigned char* hub_connection_on_dps_request(HUB_CONNECTION* conn, bool is_poll, int* status, size_t* retry_after, size_t* length)
+{
+    unsigned char* result;
+    HUB_SERVER* server = conn->server;
+    const char* registration_id = hub_connection_get_device_id(conn);
+    bool assigned;
+
+    if (is_poll)
+    {
+        server->stats.dps_polls++;
+        conn->dps_polls++;
+        assigned = conn->dps_polls >= server->dps_poll_count;
+    }
+    else
+    {
+        server->stats.dps_registrations++;
+        conn->dps_polls = 0;
+        assigned = server->dps_poll_count == 0;
+    }
+
+    if ((result = (unsigned char*)malloc(MAX_DPS_RESPONSE_LEN)) == NULL)
+    {
+        (void)printf("Failure allocating dps response\r\n");
+    }
+    else
+    {
+        int body_len;
+        if (assigned)
+        {
+            body_len = snprintf((char*)result, MAX_DPS_RESPONSE_LEN, DPS_ASSIGNED_FMT, registration_id, registration_id, server->config.hostname, registration_id);
+            *status = 200;
+            server->stats.dps_assigned++;
+        }
+        else
+        {
+            body_len = snprintf((char*)result, MAX_DPS_RESPONSE_LEN, DPS_ASSIGNING_FMT, registration_id);
+            *status = 202;
+        }
+
+        if (body_len < 0 || body_len >= MAX_DPS_RESPONSE_LEN)
+        {
+            (void)printf("Failure constructing dps response for %s\r\n", registration_id);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            *retry_after = server->dps_retry_after;
+            *length = (size_t)body_len;
+        }
+    }
+    return result;
+}
+
+static int send_method(HUB_SERVER* server, HUB_DEVICE* device)
+{
+    int result;
+    HUB_CONNECTION* conn = device->connection;
+    HUB_MESSAGE message;
+    HUB_METHOD_INFLIGHT* inflight = &device->method_inflight[device->next_sequence % HUB_METHOD_INFLIGHT_MAX];
+
+    memset(&message, 0, sizeof(message));
+    message.msg_type = HUB_MESSAGE_METHOD;
+    message.sequence = device->next_sequence;
+    message.name = (char*)METHOD_NAME;
+
+    if (inflight->active)
+    {
+        // Wait for the slot to be answered
+        result = __LINE__;
+    }
+    // The payload is a json string of the requested size
+    else if ((message.payload = create_padded_json("\"", "\"", device->schedule[HUB_MESSAGE_METHOD].payload_size, &message.payload_len)) == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        inflight->sent_ns = hub_get_time_ns();
+        if (conn->protocol->deliver(conn->protocol_state, &message) != 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            inflight->active = true;
+            inflight->request_id = device->next_sequence++;
+            device->method_inflight_count++;
+            server->stats.method_sent++;
+            if (++server->method_inflight_count > server->stats.method_inflight_max)
+            {
+                server->stats.method_inflight_max = server->method_inflight_count;
+            }
+            result = 0;
+        }
+        free(message.payload);
+    }
+    return result;
+}
+
+static int send_twin_patch(HUB_SERVER* server, HUB_DEVICE* device)
+{
+    int result;
+    HUB_CONNECTION* conn = device->connection;
+    HUB_MESSAGE message;
+    char head[MAX_PROPERTY_LEN];
+
+    memset(&message, 0, sizeof(message));
+    message.msg_type = HUB_MESSAGE_TWIN_PATCH;
+    message.sequence = device->twin_desired_version + 1;
+
+    (void)snprintf(head, sizeof(head), TWIN_PATCH_HEAD_FMT, message.sequence);
+    if ((message.payload = create_padded_json(head, "\"}", device->schedule[HUB_MESSAGE_TWIN_PATCH].payload_size, &message.payload_len)) == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        if (conn->protocol->deliver(conn->protocol_state, &message) != 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            device->twin_desired_version = message.sequence;
+            server->stats.twin_patch_sent++;
+            result = 0;
+        }
+        free(message.payload);
+    }
+    return result;
+}
+
+static bool is_schedule_ready(const HUB_CONNECTION* conn, HUB_MESSAGE_TYPE msg_type)
+{
+    bool result;
+    if (conn == NULL || conn->closing)
+    {
+        result = false;
+    }
+    else if (msg_type == HUB_MESSAGE_METHOD)
+    {
+        result = conn->method_ready;
+    }
+    else if (msg_type == HUB_MESSAGE_TWIN_PATCH)
+    {
+        result = conn->twin_ready;
+    }
+    else
+    {
+        result = false;
+    }
+    return result;
+}
+
+// Returns the time in ns until the next scheduled message is due
+static uint64_t dispatch_scheduled(HUB_SERVER* server)
+{
+    uint64_t result = UINT64_MAX;
+    uint64_t now = hub_get_time_ns();
+    for (HUB_DEVICE* device = server->devices; device != NULL; device = device->next)
+    {
+        for (size_t index = 0; index < HUB_MESSAGE_TYPE_COUNT; index++)
+        {
+            HUB_SCHEDULE* schedule = &device->schedule[index];
+            if (schedule->remaining > 0 && is_schedule_ready(device->connection, (HUB_MESSAGE_TYPE)index))
+            {
+                while (schedule->remaining > 0 && schedule->next_ns <= now)
+                {
+                    int send_result = index == HUB_MESSAGE_METHOD ? send_method(server, device) : send_twin_patch(server, device);
+                    if (send_result != 0)
+                    {
+                        break;
+                    }
+                    schedule->remaining--;
+                    schedule->next_ns += schedule->interval_ns;
+                }
+                if (schedule->remaining > 0)
+                {
+                    uint64_t wait_ns = schedule->next_ns > now ? schedule->next_ns - now : NS_PER_MS;
+                    result = wait_ns < result ? wait_ns : result;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+static int queue_c2d_messages(HUB_DEVICE* device, size_t msg_count, size_t payload_size)
+{
+    int result = 0;
+    for (size_t index = 0; index < msg_count && result == 0; index++)
+    {
+        HUB_MESSAGE* message = (HUB_MESSAGE*)calloc(1, sizeof(HUB_MESSAGE));
+        if (message == NULL || (message->payload = (unsigned char*)malloc(payload_size == 0 ? 1 : payload_size)) == NULL)
+        {
+            (void)printf("Failure allocating c2d message\r\n");
+            free(message);
+            result = __LINE__;
+        }
+        else
+        {
+            for (size_t pos = 0; pos < payload_size; pos++)
+            {
+                message->payload[pos] = (unsigned char)('a' + (pos % 26));
+            }
+            message->payload_len = payload_size;
+            message->msg_type = HUB_MESSAGE_C2D;
+            message->sequence = device->next_sequence++;
+            if (device->pending_tail == NULL)
+            {
+                device->pending_head = message;
+            }
+            else
+            {
+                device->pending_tail->next = message;
+            }
+            device->pending_tail = message;
+        }
+    }
+    return result;
+}
+
+int hub_server_queue_c2d(HUB_SERVER_HANDLE handle, const char* device_id, size_t msg_count, size_t payload_size, size_t* queued)
+{
+    int result = 0;
+    *queued = 0;
+    for (HUB_DEVICE* device = handle->devices; device != NULL && result == 0; device = device->next)
+    {
+        bool send_all = strcmp(device_id, "*") == 0;
+        if ((send_all && device->connection != NULL) || strcmp(device_id, device->device_id) == 0)
+        {
+            if ((result = queue_c2d_messages(device, msg_count, payload_size)) == 0)
+            {
+                *queued += msg_count;
+                handle->stats.c2d_queued += msg_count;
+                flush_device(device);
+            }
+        }
+    }
+    return result;
+}
+
+static size_t schedule_messages(HUB_SERVER* server, const char* device_id, HUB_MESSAGE_TYPE msg_type, size_t msg_count, size_t payload_size, size_t rate)
+{
+    size_t result = 0;
+    for (HUB_DEVICE* device = server->devices; device != NULL; device = device->next)
+    {
+        bool send_all = strcmp(device_id, "*") == 0;
+        if ((send_all && device->connection != NULL) || strcmp(device_id, device->device_id) == 0)
+        {
+            HUB_SCHEDULE* schedule = &device->schedule[msg_type];
+            schedule->remaining += msg_count;
+            schedule->payload_size = payload_size;
+            schedule->interval_ns = rate == 0 ? 0 : NS_PER_SEC / rate;
+            schedule->next_ns = hub_get_time_ns();
+            result += msg_count;
+        }
+    }
+    (void)dispatch_scheduled(server);
+    return result;
+}
+
+int hub_server_queue_methods(HUB_SERVER_HANDLE handle, const char* device_id, size_t msg_count, size_t payload_size, size_t rate, size_t* queued)
+{
+    int result = 0;
+    for (HUB_DEVICE* device = handle->devices; device != NULL && result == 0; device = device->next)
+    {
+        if (device->method_inflight == NULL && (device->method_inflight = (HUB_METHOD_INFLIGHT*)calloc(HUB_METHOD_INFLIGHT_MAX, sizeof(HUB_METHOD_INFLIGHT))) == NULL)
+        {
+            (void)printf("Failure allocating method inflight table\r\n");
+            result = __LINE__;
+        }
+    }
+    if (result == 0)
+    {
+        *queued = schedule_messages(handle, device_id, HUB_MESSAGE_METHOD, msg_count, payload_size, rate);
+        handle->stats.method_queued += *queued;
+    }
+    return result;
+}
+
+int hub_server_queue_twin_patches(HUB_SERVER_HANDLE handle, const char* device_id, size_t msg_count, size_t payload_size, size_t rate, size_t* queued)
+{
+    *queued = schedule_messages(handle, device_id, HUB_MESSAGE_TWIN_PATCH, msg_count, payload_size, rate);
+    handle->stats.twin_patch_queued += *queued;
+    return 0;
+}
+
+void hub_server_set_twin_size(HUB_SERVER_HANDLE handle, size_t document_size)
+{
+    handle->twin_document_size = document_size;
+}
+
+void hub_server_set_dps(HUB_SERVER_HANDLE handle, size_t poll_count, size_t retry_after)
+{
+    handle->dps_poll_count = poll_count;
+    handle->dps_retry_after = retry_after;
+}
+
+int hub_server_create_device(HUB_SERVER_HANDLE handle, const char* device_id)
+{
+    return create_device(handle, device_id) == NULL ? __LINE__ : 0;
+}
+
+void hub_server_get_stats(HUB_SERVER_HANDLE handle, HUB_STATS* stats)
+{
+    *stats = handle->stats;
+}
+
+void hub_server_get_latency(HUB_SERVER_HANDLE handle, HUB_MESSAGE_TYPE msg_type, LATENCY_SUMMARY* summary)
+{
+    latency_stats_get_summary(handle->latency[msg_type], summary);
+}
+
+void hub_server_reset_stats(HUB_SERVER_HANDLE handle)
+{
+    memset(&handle->stats, 0, sizeof(HUB_STATS));
+    handle->stats.method_inflight_max = handle->method_inflight_count;
+    for (size_t index = 0; index < HUB_MESSAGE_TYPE_COUNT; index++)
+    {
+        LATENCY_STATS_HANDLE latency = latency_stats_create(0);
+        if (latency == NULL)
+        {
+            (void)printf("Failure resetting latency stats\r\n");
+        }
+        else
+        {
+            latency_stats_destroy(handle->latency[index]);
+            handle->latency[index] = latency;
+        }
+    }
+}
+
+HUB_SERVER_HANDLE hub_server_create(const HUB_CONFIG* config)
+{
+    HUB_SERVER* result;
+    if ((result = (HUB_SERVER*)calloc(1, sizeof(HUB_SERVER))) == NULL)
+    {
+        (void)printf("Failure allocating hub server\r\n");
+    }
+    else
+    {
+        bool latency_created = true;
+        result->config = *config;
+        result->dps_poll_count = HUB_DEFAULT_DPS_POLLS;
+        result->dps_retry_after = HUB_DEFAULT_DPS_RETRY_AFTER;
+        for (size_t index = 0; index < HUB_LISTENER_COUNT; index++)
+        {
+            result->listeners[index].sock = -1;
+        }
+        for (size_t index = 0; index < HUB_MESSAGE_TYPE_COUNT; index++)
+        {
+            if ((result->latency[index] = latency_stats_create(0)) == NULL)
+            {
+                latency_created = false;
+            }
+        }
+
+        if (!latency_created)
+        {
+            (void)printf("Failure creating latency stats\r\n");
+            hub_server_destroy(result);
+            result = NULL;
+        }
+        else if ((result->ssl_ctx = hub_tls_create_context(config->hostname, config->ca_cert_file)) == NULL)
+        {
+            (void)printf("Failure creating tls context\r\n");
+            hub_server_destroy(result);
+            result = NULL;
+        }
+        else if (open_listener(&result->listeners[HUB_LISTENER_MQTT], config->bind_address, config->mqtt_port, true, hub_mqtt_get_protocol()) != 0 ||
+            open_listener(&result->listeners[HUB_LISTENER_AMQP], config->bind_address, config->amqp_port, true, hub_amqp_get_protocol()) != 0 ||
+            open_listener(&result->listeners[HUB_LISTENER_HTTPS], config->bind_address, config->https_port, true, hub_http_get_protocol()) != 0 ||
+            open_listener(&result->listeners[HUB_LISTENER_CONTROL], config->bind_address, config->control_port, false, hub_commands_get_protocol()) != 0)
+        {
+            // 443 needs root, without it -w moves https to another port behind the fault_proxy -m map
+            hub_server_destroy(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+void hub_server_destroy(HUB_SERVER_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        while (handle->connections != NULL)
+        {
+            HUB_CONNECTION* conn = handle->connections;
+            handle->connections = conn->next;
+            close_connection(conn);
+        }
+        while (handle->devices != NULL)
+        {
+            HUB_DEVICE* device = handle->devices;
+            handle->devices = device->next;
+            while (device->pending_head != NULL)
+            {
+                HUB_MESSAGE* message = device->pending_head;
+                device->pending_head = message->next;
+                hub_message_destroy(message);
+            }
+            free(device->method_inflight);
+            free(device);
+        }
+        for (size_t index = 0; index < HUB_LISTENER_COUNT; index++)
+        {
+            if (handle->listeners[index].sock >= 0)
+            {
+                (void)close(handle->listeners[index].sock);
+            }
+        }
+        for (size_t index = 0; index < HUB_MESSAGE_TYPE_COUNT; index++)
+        {
+            latency_stats_destroy(handle->latency[index]);
+        }
+        hub_tls_destroy_context(handle->ssl_ctx);
+        free(handle);
+    }
+}
+
+int hub_server_run(HUB_SERVER_HANDLE handle, volatile int* stop_running)
+{
+    int result = 0;
+    struct pollfd* poll_list = NULL;
+    size_t poll_capacity = 0;
+
+    while (*stop_running == 0 && result == 0)
+    {
+        size_t poll_count = 0;
+        int poll_timeout = POLL_TIMEOUT_MS;
+        uint64_t next_scheduled_ns = dispatch_scheduled(handle);
+        size_t needed = HUB_LISTENER_COUNT + handle->connection_count;
+        if (needed > poll_capacity)
+        {
+            struct pollfd* new_list = (struct pollfd*)realloc(poll_list, needed * sizeof(struct pollfd));
+            if (new_list == NULL)
+            {
+                (void)printf("Failure allocating poll list\r\n");
+                result = __LINE__;
+                break;
+            }
+            poll_list = new_list;
+            poll_capacity = needed;
+        }
+
+        for (size_t index = 0; index < HUB_LISTENER_COUNT; index++)
+        {
+            poll_list[poll_count].fd = handle->listeners[index].sock;
+            poll_list[poll_count].events = POLLIN;
+            poll_list[poll_count++].revents = 0;
+        }
+        for (HUB_CONNECTION* conn = handle->connections; conn != NULL; conn = conn->next)
+        {
+            poll_list[poll_count].fd = conn->sock;
+            poll_list[poll_count].events = POLLIN | (conn->send_length > 0 ? POLLOUT : 0);
+            poll_list[poll_count++].revents = 0;
+        }
+
+        if (next_scheduled_ns < (uint64_t)POLL_TIMEOUT_MS * NS_PER_MS)
+        {
+            poll_timeout = (int)(next_scheduled_ns / NS_PER_MS);
+        }
+
+        if (poll(poll_list, poll_count, poll_timeout) < 0 && errno != EINTR)
+        {
+            (void)printf("Failure polling sockets\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            size_t poll_index = HUB_LISTENER_COUNT;
+            for (HUB_CONNECTION* conn = handle->connections; conn != NULL && poll_index < poll_count; conn = conn->next, poll_index++)
+            {
+                short revents = poll_list[poll_index].revents;
+                if (revents & (POLLIN | POLLHUP | POLLERR))
+                {
+                    read_connection(conn);
+                }
+                if ((revents & POLLOUT) && conn->tls_established && !conn->closing && flush_send_buffer(conn) != 0)
+                {
+                    conn->closing = true;
+                }
+            }
+
+            for (size_t index = 0; index < HUB_LISTENER_COUNT; index++)
+            {
+                if (poll_list[index].revents & POLLIN)
+                {
+                    accept_connection(handle, &handle->listeners[index]);
+                }
+            }
+
+            // Remove the closed connections
+            HUB_CONNECTION** link = &handle->connections;
+            while (*link != NULL)
+            {
+                HUB_CONNECTION* conn = *link;
+                if (conn->closing)
+                {
+                    *link = conn->next;
+                    handle->connection_count--;
+                    close_connection(conn);
+                }
+                else
+                {
+                    link = &conn->next;
+                }
+            }
+        }
+    }
+    free(poll_list);
+    return result;
+}
@@ -0,0 +1,200 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509v3.h>
+
+#include "hub_tls.h"
+
+#define HUB_KEY_BITS            2048
+#define HUB_CERT_VALID_DAYS     30
+
+static const char* const HUB_CA_NAME = "Azure IoT Analysis Local Test CA";
+
+static EVP_PKEY* generate_key(void)
+{
+    EVP_PKEY* result = NULL;
+    EVP_PKEY_CTX* key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+    if (key_ctx == NULL)
+    {
+        (void)printf("Failure creating key context\r\n");
+    }
+    else
+    {
+        if (EVP_PKEY_keygen_init(key_ctx) <= 0 ||
+            EVP_PKEY_CTX_set_rsa_keygen_bits(key_ctx, HUB_KEY_BITS) <= 0 ||
+            EVP_PKEY_keygen(key_ctx, &result) <= 0)
+        {
+            (void)printf("Failure generating rsa key\r\n");
+            result = NULL;
+        }
+        EVP_PKEY_CTX_free(key_ctx);
+    }
+    return result;
+}
+
+static int add_extension(X509* cert, X509* issuer, int nid, const char* value)
+{
+    int result;
+    X509V3_CTX ext_ctx;
+    X509_EXTENSION* ext;
+
+    X509V3_set_ctx_nodb(&ext_ctx);
+    X509V3_set_ctx(&ext_ctx, issuer, cert, NULL, NULL, 0);
+    if ((ext = X509V3_EXT_conf_nid(NULL, &ext_ctx, nid, value)) == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result = X509_add_ext(cert, ext, -1) == 1 ? 0 : __LINE__;
+        X509_EXTENSION_free(ext);
+    }
+    return result;
+}
+
+// Creates a certificate for key, self signed when issuer is NULL
+static X509* create_certificate(EVP_PKEY* key, const char* common_name, long serial, X509* issuer, EVP_PKEY* issuer_key)
+{
+    X509* result = X509_new();
+    if (result == NULL)
+    {
+        (void)printf("Failure allocating certificate\r\n");
+    }
+    else
+    {
+        X509_NAME* name = X509_get_subject_name(result);
+        X509* signer = issuer == NULL ? result : issuer;
+        EVP_PKEY* signer_key = issuer_key == NULL ? key : issuer_key;
+        int ext_result;
+
+        (void)X509_set_version(result, 2);
+        (void)ASN1_INTEGER_set(X509_get_serialNumber(result), serial);
+        (void)X509_gmtime_adj(X509_getm_notBefore(result), -60 * 60);
+        (void)X509_gmtime_adj(X509_getm_notAfter(result), 60L * 60 * 24 * HUB_CERT_VALID_DAYS);
+        (void)X509_set_pubkey(result, key);
+        (void)X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)common_name, -1, -1, 0);
+        (void)X509_set_issuer_name(result, X509_get_subject_name(signer));
+
+        ext_result = add_extension(result, signer, NID_subject_key_identifier, "hash");
+        if (issuer == NULL)
+        {
+            ext_result |= add_extension(result, signer, NID_basic_constraints, "critical,CA:TRUE");
+            ext_result |= add_extension(result, signer, NID_key_usage, "critical,keyCertSign,cRLSign");
+        }
+        else
+        {
+            char alt_name[256];
+            (void)snprintf(alt_name, sizeof(alt_name), "DNS:%s,DNS:localhost,IP:127.0.0.1", common_name);
+            ext_result |= add_extension(result, signer, NID_authority_key_identifier, "keyid");
+            ext_result |= add_extension(result, signer, NID_basic_constraints, "CA:FALSE");
+            ext_result |= add_extension(result, signer, NID_key_usage, "critical,digitalSignature,keyEncipherment");
+            ext_result |= add_extension(result, signer, NID_ext_key_usage, "serverAuth");
+            ext_result |= add_extension(result, signer, NID_subject_alt_name, alt_name);
+        }
+
+        if (ext_result != 0)
+        {
+            (void)printf("Failure adding certificate extensions\r\n");
+            X509_free(result);
+            result = NULL;
+        }
+        else if (X509_sign(result, signer_key, EVP_sha256()) == 0)
+        {
+            (void)printf("Failure signing certificate\r\n");
+            X509_free(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+static int write_ca_file(X509* ca_cert, const char* ca_cert_file)
+{
+    int result;
+    FILE* file = fopen(ca_cert_file, "w");
+    if (file == NULL)
+    {
+        (void)printf("Failure opening CA certificate file %s\r\n", ca_cert_file);
+        result = __LINE__;
+    }
+    else
+    {
+        result = PEM_write_X509(file, ca_cert) == 1 ? 0 : __LINE__;
+        fclose(file);
+    }
+    return result;
+}
+
+SSL_CTX* hub_tls_create_context(const char* hostname, const char* ca_cert_file)
+{
+    SSL_CTX* result;
+    EVP_PKEY* ca_key;
+    EVP_PKEY* server_key;
+    X509* ca_cert = NULL;
+    X509* server_cert = NULL;
+
+    if ((ca_key = generate_key()) == NULL)
+    {
+        result = NULL;
+    }
+    else if ((server_key = generate_key()) == NULL)
+    {
+        EVP_PKEY_free(ca_key);
+        result = NULL;
+    }
+    else
+    {
+        if ((ca_cert = create_certificate(ca_key, HUB_CA_NAME, 1, NULL, NULL)) == NULL)
+        {
+            result = NULL;
+        }
+        else if ((server_cert = create_certificate(server_key, hostname, 2, ca_cert, ca_key)) == NULL)
+        {
+            result = NULL;
+        }
+        else if (write_ca_file(ca_cert, ca_cert_file) != 0)
+        {
+            result = NULL;
+        }
+        else if ((result = SSL_CTX_new(TLS_server_method())) == NULL)
+        {
+            (void)printf("Failure creating ssl context\r\n");
+        }
+        else
+        {
+            (void)SSL_CTX_set_min_proto_version(result, TLS1_2_VERSION);
+            SSL_CTX_set_mode(result, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+            if (SSL_CTX_use_certificate(result, server_cert) != 1 ||
+                SSL_CTX_use_PrivateKey(result, server_key) != 1 ||
+                SSL_CTX_add1_chain_cert(result, ca_cert) != 1 ||
+                SSL_CTX_check_private_key(result) != 1)
+            {
+                (void)printf("Failure setting server certificate\r\n");
+                ERR_print_errors_fp(stdout);
+                SSL_CTX_free(result);
+                result = NULL;
+            }
+        }
+        X509_free(server_cert);
+        X509_free(ca_cert);
+        EVP_PKEY_free(server_key);
+        EVP_PKEY_free(ca_key);
+    }
+    return result;
+}
+
+void hub_tls_destroy_context(SSL_CTX* ssl_ctx)
+{
+    if (ssl_ctx != NULL)
+    {
+        SSL_CTX_free(ssl_ctx);
+    }
+}
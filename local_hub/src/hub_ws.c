@@ -0,0 +1,292 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include "hub_ws.h"
+
+#define WS_OPCODE_CONTINUATION  0x0
+#define WS_OPCODE_TEXT          0x1
+#define WS_OPCODE_BINARY        0x2
+#define WS_OPCODE_CLOSE         0x8
+#define WS_OPCODE_PING          0x9
+#define WS_OPCODE_PONG          0xA
+#define WS_FIN                  0x80
+#define WS_MASK                 0x80
+#define WS_MAX_HEADER_LEN       14
+#define WS_MAX_KEY_LEN          64
+#define WS_MAX_PAYLOAD_LEN      (64 * 1024 * 1024)
+
+static const char* const WS_ACCEPT_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+typedef struct HUB_WS_TAG
+{
+    HUB_CONNECTION* conn;
+    const HUB_PROTOCOL* inner;
+    void* inner_state;
+    // Unmasked payload of the data frames, the inner protocol sees a plain stream
+    unsigned char* stream;
+    size_t stream_length;
+    size_t stream_capacity;
+} HUB_WS;
+
+static int send_frame(HUB_WS* ws, uint8_t opcode, const void* data, size_t length)
+{
+    int result;
+    unsigned char* frame = (unsigned char*)malloc(WS_MAX_HEADER_LEN + length);
+    if (frame == NULL)
+    {
+        (void)printf("Failure allocating websocket frame\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t pos = 0;
+        // The server does not mask its frames
+        frame[pos++] = (unsigned char)(WS_FIN | opcode);
+        if (length < 126)
+        {
+            frame[pos++] = (unsigned char)length;
+        }
+        else if (length <= 0xFFFF)
+        {
+            frame[pos++] = 126;
+            frame[pos++] = (unsigned char)(length >> 8);
+            frame[pos++] = (unsigned char)(length & 0xFF);
+        }
+        else
+        {
+            frame[pos++] = 127;
+            for (int shift = 56; shift >= 0; shift -= 8)
+            {
+                frame[pos++] = (unsigned char)(((uint64_t)length >> shift) & 0xFF);
+            }
+        }
+        if (length > 0)
+        {
+            memcpy(frame + pos, data, length);
+            pos += length;
+        }
+        result = hub_connection_send_raw(ws->conn, frame, pos);
+        free(frame);
+    }
+    return result;
+}
+
+static int ws_frame_send(void* frame_state, const void* data, size_t length)
+{
+    return send_frame((HUB_WS*)frame_state, WS_OPCODE_BINARY, data, length);
+}
+
+static int append_stream(HUB_WS* ws, const unsigned char* payload, size_t length, const unsigned char* mask)
+{
+    int result = 0;
+    if (ws->stream_length + length > ws->stream_capacity)
+    {
+        size_t new_capacity = ws->stream_capacity == 0 ? 4096 : ws->stream_capacity;
+        unsigned char* new_stream;
+        while (new_capacity < ws->stream_length + length)
+        {
+            new_capacity *= 2;
+        }
+        if ((new_stream = (unsigned char*)realloc(ws->stream, new_capacity)) == NULL)
+        {
+            (void)printf("Failure allocating websocket stream\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            ws->stream = new_stream;
+            ws->stream_capacity = new_capacity;
+        }
+    }
+
+    if (result == 0)
+    {
+        for (size_t pos = 0; pos < length; pos++)
+        {
+            ws->stream[ws->stream_length + pos] = mask == NULL ? payload[pos] : (unsigned char)(payload[pos] ^ mask[pos % 4]);
+        }
+        ws->stream_length += length;
+    }
+    return result;
+}
+
+static int process_frame(HUB_WS* ws, uint8_t opcode, const unsigned char* payload, size_t length, const unsigned char* mask)
+{
+    int result;
+    if (opcode == WS_OPCODE_CONTINUATION || opcode == WS_OPCODE_TEXT || opcode == WS_OPCODE_BINARY)
+    {
+        // Message boundaries do not matter to the stream protocols on top
+        result = append_stream(ws, payload, length, mask);
+    }
+    else if (opcode == WS_OPCODE_PING)
+    {
+        unsigned char pong[125];
+        for (size_t pos = 0; pos < length && pos < sizeof(pong); pos++)
+        {
+            pong[pos] = mask == NULL ? payload[pos] : (unsigned char)(payload[pos] ^ mask[pos % 4]);
+        }
+        result = send_frame(ws, WS_OPCODE_PONG, pong, length < sizeof(pong) ? length : sizeof(pong));
+    }
+    else if (opcode == WS_OPCODE_CLOSE)
+    {
+        // Answer the close handshake and drop the connection
+        (void)send_frame(ws, WS_OPCODE_CLOSE, NULL, 0);
+        result = __LINE__;
+    }
+    else
+    {
+        result = opcode == WS_OPCODE_PONG ? 0 : __LINE__;
+    }
+    return result;
+}
+
+HUB_WS_HANDLE hub_ws_create(HUB_CONNECTION* conn, const HUB_PROTOCOL* inner)
+{
+    HUB_WS* result;
+    if ((result = (HUB_WS*)calloc(1, sizeof(HUB_WS))) == NULL)
+    {
+        (void)printf("Failure allocating websocket session\r\n");
+    }
+    else
+    {
+        result->conn = conn;
+        result->inner = inner;
+        conn->frame_send = ws_frame_send;
+        conn->frame_state = result;
+        if ((result->inner_state = inner->create(conn)) == NULL)
+        {
+            (void)printf("Failure creating %s session over websocket\r\n", inner->name);
+            hub_ws_destroy(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+void hub_ws_destroy(HUB_WS_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        if (handle->inner_state != NULL)
+        {
+            handle->inner->destroy(handle->inner_state);
+        }
+        if (handle->conn->frame_state == handle)
+        {
+            handle->conn->frame_send = NULL;
+            handle->conn->frame_state = NULL;
+        }
+        free(handle->stream);
+        free(handle);
+    }
+}
+
+int hub_ws_on_bytes(HUB_WS_HANDLE handle, const unsigned char* data, size_t length)
+{
+    int result = 0;
+    size_t pos = 0;
+
+    while (length - pos >= 2)
+    {
+        uint8_t opcode = data[pos] & 0x0F;
+        bool masked = (data[pos + 1] & WS_MASK) != 0;
+        uint64_t payload_len = data[pos + 1] & 0x7F;
+        size_t header_len = 2;
+
+        if (payload_len == 126)
+        {
+            header_len += 2;
+        }
+        else if (payload_len == 127)
+        {
+            header_len += 8;
+        }
+        if (masked)
+        {
+            header_len += 4;
+        }
+        if (length - pos < header_len)
+        {
+            break;
+        }
+
+        if (payload_len == 126)
+        {
+            payload_len = ((uint64_t)data[pos + 2] << 8) | data[pos + 3];
+        }
+        else if (payload_len == 127)
+        {
+            payload_len = 0;
+            for (size_t index = 0; index < 8; index++)
+            {
+                payload_len = (payload_len << 8) | data[pos + 2 + index];
+            }
+        }
+
+        if (payload_len > WS_MAX_PAYLOAD_LEN)
+        {
+            (void)printf("Websocket frame of %llu bytes is too large\r\n", (unsigned long long)payload_len);
+            result = -1;
+            break;
+        }
+        else if (length - pos - header_len < payload_len)
+        {
+            break;
+        }
+        else if (process_frame(handle, opcode, data + pos + header_len, (size_t)payload_len, masked ? data + pos + header_len - 4 : NULL) != 0)
+        {
+            result = -1;
+            break;
+        }
+        pos += header_len + (size_t)payload_len;
+    }
+
+    if (result == 0 && handle->stream_length > 0)
+    {
+        int used = handle->inner->on_bytes(handle->inner_state, handle->stream, handle->stream_length);
+        if (used < 0)
+        {
+            result = -1;
+        }
+        else if (used > 0)
+        {
+            memmove(handle->stream, handle->stream + used, handle->stream_length - (size_t)used);
+            handle->stream_length -= (size_t)used;
+        }
+    }
+    return result < 0 ? result : (int)pos;
+}
+
+int hub_ws_deliver(HUB_WS_HANDLE handle, const HUB_MESSAGE* message)
+{
+    return handle->inner->deliver(handle->inner_state, message);
+}
+
+int hub_ws_get_accept_key(const char* key, size_t key_len, char accept[HUB_WS_ACCEPT_KEY_LEN])
+{
+    int result;
+    char source[WS_MAX_KEY_LEN + 40];
+    size_t guid_len = strlen(WS_ACCEPT_GUID);
+
+    if (key_len == 0 || key_len > WS_MAX_KEY_LEN)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        unsigned char digest[SHA_DIGEST_LENGTH];
+        memcpy(source, key, key_len);
+        memcpy(source + key_len, WS_ACCEPT_GUID, guid_len);
+        (void)SHA1((const unsigned char*)source, key_len + guid_len, digest);
+        // 20 bytes encode to 28 characters plus the terminator
+        (void)EVP_EncodeBlock((unsigned char*)accept, digest, SHA_DIGEST_LENGTH);
+        result = 0;
+    }
+    return result;
+}
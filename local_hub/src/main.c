@@ -0,0 +1,170 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "hub_server.h"
+
+static const char* const DEFAULT_HOSTNAME = "localhost";
+static const char* const DEFAULT_CA_CERT_FILE = "local_hub_ca.pem";
+
+static volatile int g_stop_running = 0;
+
+typedef enum ARGUEMENT_TYPE_TAG
+{
+    ARGUEMENT_TYPE_UNKNOWN,
+    ARGUEMENT_TYPE_HOSTNAME,
+    ARGUEMENT_TYPE_BIND_ADDRESS,
+    ARGUEMENT_TYPE_MQTT_PORT,
+    ARGUEMENT_TYPE_AMQP_PORT,
+    ARGUEMENT_TYPE_HTTPS_PORT,
+    ARGUEMENT_TYPE_CONTROL_PORT,
+    ARGUEMENT_TYPE_CA_CERT_FILE
+} ARGUEMENT_TYPE;
+
+static void on_signal(int signal_number)
+{
+    (void)signal_number;
+    g_stop_running = 1;
+}
+
+static int parse_port(const char* value, uint16_t* port, bool allow_disable)
+{
+    int result;
+    char* end;
+    unsigned long parsed = strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || (parsed == 0 && !allow_disable) || parsed > 65535)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        *port = (uint16_t)parsed;
+        result = 0;
+    }
+    return result;
+}
+
+// -h [hostname] -b [bind address] -m [mqtt port] -a [amqp port] -w [https port] -l [control port] -t [ca cert output file]
+static int parse_command_line(int argc, char* argv[], HUB_CONFIG* config)
+{
+    int result = 0;
+    ARGUEMENT_TYPE argument_type = ARGUEMENT_TYPE_UNKNOWN;
+
+    for (int index = 1; index < argc && result == 0; index++)
+    {
+        if (argument_type == ARGUEMENT_TYPE_UNKNOWN)
+        {
+            if (argv[index][0] == '-' && (argv[index][1] == 'h' || argv[index][1] == 'H'))
+            {
+                argument_type = ARGUEMENT_TYPE_HOSTNAME;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'b' || argv[index][1] == 'B'))
+            {
+                argument_type = ARGUEMENT_TYPE_BIND_ADDRESS;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'm' || argv[index][1] == 'M'))
+            {
+                argument_type = ARGUEMENT_TYPE_MQTT_PORT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'a' || argv[index][1] == 'A'))
+            {
+                argument_type = ARGUEMENT_TYPE_AMQP_PORT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'w' || argv[index][1] == 'W'))
+            {
+                argument_type = ARGUEMENT_TYPE_HTTPS_PORT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'l' || argv[index][1] == 'L'))
+            {
+                argument_type = ARGUEMENT_TYPE_CONTROL_PORT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 't' || argv[index][1] == 'T'))
+            {
+                argument_type = ARGUEMENT_TYPE_CA_CERT_FILE;
+            }
+            else
+            {
+                result = __LINE__;
+            }
+        }
+        else
+        {
+            switch (argument_type)
+            {
+                case ARGUEMENT_TYPE_HOSTNAME:
+                    config->hostname = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_BIND_ADDRESS:
+                    config->bind_address = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_MQTT_PORT:
+                    result = parse_port(argv[index], &config->mqtt_port, false);
+                    break;
+                case ARGUEMENT_TYPE_AMQP_PORT:
+                    result = parse_port(argv[index], &config->amqp_port, true);
+                    break;
+                case ARGUEMENT_TYPE_HTTPS_PORT:
+                    result = parse_port(argv[index], &config->https_port, true);
+                    break;
+                case ARGUEMENT_TYPE_CONTROL_PORT:
+                    result = parse_port(argv[index], &config->control_port, false);
+                    break;
+                case ARGUEMENT_TYPE_CA_CERT_FILE:
+                    config->ca_cert_file = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_UNKNOWN:
+                default:
+                    result = __LINE__;
+                    break;
+            }
+            argument_type = ARGUEMENT_TYPE_UNKNOWN;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    int result;
+    HUB_CONFIG config;
+    HUB_SERVER_HANDLE server;
+
+    memset(&config, 0, sizeof(config));
+    config.hostname = DEFAULT_HOSTNAME;
+    config.ca_cert_file = DEFAULT_CA_CERT_FILE;
+    config.bind_address = HUB_DEFAULT_BIND_ADDRESS;
+    config.mqtt_port = HUB_DEFAULT_MQTT_PORT;
+    config.amqp_port = HUB_DEFAULT_AMQP_PORT;
+    config.https_port = HUB_DEFAULT_HTTPS_PORT;
+    config.control_port = HUB_DEFAULT_CONTROL_PORT;
+
+    if (parse_command_line(argc, argv, &config) != 0)
+    {
+        (void)printf("Failure parsing command line\r\n");
+        (void)printf("usage: local_hub -h [hostname] -b [bind address] -m [mqtt port] -a [amqp port] -w [https port] -l [control port] -t [ca cert output file]\r\n");
+        (void)printf("       a port of 0 disables the amqp or https listener, the SDK websocket and http transports always use 443\r\n");
+        (void)printf("       the listeners bind to %s unless -b gives another address\r\n", HUB_DEFAULT_BIND_ADDRESS);
+        result = __LINE__;
+    }
+    else if ((server = hub_server_create(&config)) == NULL)
+    {
+        (void)printf("Failure creating local hub\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        (void)signal(SIGINT, on_signal);
+        (void)signal(SIGTERM, on_signal);
+        (void)signal(SIGPIPE, SIG_IGN);
+
+        (void)printf("local hub %s listening on %s mqtt:%u amqp:%u https:%u control:%u, test CA written to %s\r\n", config.hostname, config.bind_address, config.mqtt_port, config.amqp_port, config.https_port, config.control_port, config.ca_cert_file);
+        (void)fflush(stdout);
+
+        result = hub_server_run(server, &g_stop_running);
+        hub_server_destroy(server);
+    }
+    return result;
+}
@@ -36,7 +36,7 @@ static REPORTER_TYPE g_report_type = REPORTER_TYPE_JSON;
 static const char* const UNKNOWN_TYPE = "unknown";
 static const char* const NODE_SDK_ANALYSIS = "sdkAnalysis";
 static const char* const NODE_BASE_ARRAY = "analysisItem";
-static const char* const SDK_ANALYSIS_EMPTY_NODE = "{ \"sdkAnalysis\" : { \"osType\": \"%s\", \"sdkType\": \"%s\", \"version\": \"1.0.0\", \"uploadEnabled\": \"%s\", \"logEnabled\": \"%s\", \"analysisItem\" : [] } }";
+static const char* const SDK_ANALYSIS_EMPTY_NODE = "{ \"sdkAnalysis\" : { \"osType\": \"%s\", \"sdkType\": \"%s\", \"version\": \"1.0.0\", \"uploadEnabled\": \"%s\", \"logEnabled\": \"%s\", \"allocator\": \"%s\", \"analysisItem\" : [] } }";
 static const char* const NODE_OPERATING_SYSTEM = "osType";
 
 static const char* const BINARY_SIZE_JSON_FMT = "{ \"rpt_type\": \"ROM\", \"dateTime\": \"%s\", \"feature\": \"%s\", \"layer\": \"%s\", \"version\": \"%s\", \"transport\" : \"%s\", \"binarySize\" : \"%s\" }";
@@ -46,6 +46,8 @@ static const char* const NETWORK_ANALYSIS_JSON_FMT = "{ \"rpt_type\": \"NETWORK\
 static const char* const BINARY_SIZE_CSV_FMT = "%s, %s, %s, %s, %s, %s";
 static const char* const HEAP_ANALYSIS_CSV_FMT = "%s, %s, %s, %s, %s, %s, %s, %d, %zu, %zu, %zu";
 static const char* const NETWORK_ANALYSIS_CSV_FMT = "%s, %s, %s, %s, %s, %s, %d, %" PRIu64 ", %ld, %" PRIu64 ", %ld";
+static const char* const METRICS_CSV_FMT = "%s, %s, %s, %s, %s, %s, %d";
+static const char* const PACKET_CSV_FMT = "%s, %s, %s, %s, %s, %s, %d, %" PRIu64 ", %s, %zu, %s";
 
 #ifdef NO_LOGGING
 static const char* const LOGGING_INCLUDED = "false";
@@ -57,6 +59,11 @@ static const char* const UPLOAD_INCLUDED = "false";
 #else
 static const char* const UPLOAD_INCLUDED = "true";
 #endif
+#ifdef ANALYSIS_ALLOCATOR
+static const char* const ALLOCATOR_IN_USE = ANALYSIS_ALLOCATOR;
+#else
+static const char* const ALLOCATOR_IN_USE = "default";
+#endif
 
 typedef struct JSON_REPORT_INFO_TAG
 {
@@ -141,35 +148,43 @@ static void add_node_to_csv(const char* field_data, const REPORT_INFO* report_in
     }
 }
 
-static void add_node_to_json(const char* node_data, const REPORT_INFO* report_info)
+static void add_value_to_json(JSON_Value* json_value, const REPORT_INFO* report_info)
 {
-    JSON_Value* json_value;
-    if ((json_value = json_parse_string(node_data)) != NULL)
-    {
-        JSON_Object* json_object;
-        JSON_Array* base_array;
-        JSON_Value* json_analysis;
+    JSON_Object* json_object;
+    JSON_Array* base_array;
+    JSON_Value* json_analysis;
 
-        if ((json_analysis = json_object_get_value(report_info->rpt_value.json_info.analysis_node, NODE_SDK_ANALYSIS)) == NULL)
-        {
-            (void)printf("ERROR: Failed getting node object value\r\n");
-        }
-        else if ((json_object = json_value_get_object(json_analysis)) == NULL)
-        {
-            (void)printf("ERROR: Failed getting object value\r\n");
-        }
-        else if ((base_array = json_object_get_array(json_object, NODE_BASE_ARRAY)) == NULL)
+    if ((json_analysis = json_object_get_value(report_info->rpt_value.json_info.analysis_node, NODE_SDK_ANALYSIS)) == NULL)
+    {
+        (void)printf("ERROR: Failed getting node object value\r\n");
+        json_value_free(json_value);
+    }
+    else if ((json_object = json_value_get_object(json_analysis)) == NULL)
+    {
+        (void)printf("ERROR: Failed getting object value\r\n");
+        json_value_free(json_value);
+    }
+    else if ((base_array = json_object_get_array(json_object, NODE_BASE_ARRAY)) == NULL)
+    {
+        (void)printf("ERROR: Failed getting object value\r\n");
+        json_value_free(json_value);
+    }
+    else
+    {
+        if (json_array_append_value(base_array, json_value) != JSONSuccess)
         {
-            (void)printf("ERROR: Failed getting object value\r\n");
+            (void)printf("ERROR: Failed to allocate binary json\r\n");
+            json_value_free(json_value);
         }
-        else
-        {
-            if (json_array_append_value(base_array, json_value) != JSONSuccess)
-            {
-                (void)printf("ERROR: Failed to allocate binary json\r\n");
+    }
+}
 
-            }
-        }
+static void add_node_to_json(const char* node_data, const REPORT_INFO* report_info)
+{
+    JSON_Value* json_value;
+    if ((json_value = json_parse_string(node_data)) != NULL)
+    {
+        add_value_to_json(json_value, report_info);
     }
 }
 
@@ -450,7 +465,7 @@ REPORT_HANDLE report_initialize(REPORTER_TYPE rpt_type, SDK_TYPE sdk_type)
         result->sdk_type = sdk_type;
         if (result->rpt_type == REPORTER_TYPE_JSON)
         {
-            STRING_HANDLE json_node = STRING_construct_sprintf(SDK_ANALYSIS_EMPTY_NODE, OS_NAME, get_sdk_type(result->sdk_type), UPLOAD_INCLUDED, LOGGING_INCLUDED);
+            STRING_HANDLE json_node = STRING_construct_sprintf(SDK_ANALYSIS_EMPTY_NODE, OS_NAME, get_sdk_type(result->sdk_type), UPLOAD_INCLUDED, LOGGING_INCLUDED, ALLOCATOR_IN_USE);
             if (json_node == NULL)
             {
                 (void)printf("Failure creating Analysis node\r\n");
@@ -523,7 +538,15 @@ void report_binary_sizes(REPORT_HANDLE handle, const BINARY_INFO* bin_info)
         char date_time[DATE_TIME_LEN];
         char byte_formatted[FORMAT_MAX_LEN];
         get_report_date(date_time, DATE_TIME_LEN);
-        format_bytes(bin_info->binary_size, byte_formatted);
+        if (bin_info->rpt_type == REPORTER_TYPE_CSV)
+        {
+            // The thousands separator would split the csv field
+            (void)sprintf(byte_formatted, "%ld", bin_info->binary_size);
+        }
+        else
+        {
+            format_bytes(bin_info->binary_size, byte_formatted);
+        }
 
         const char* string_format = get_format_value(handle, bin_info->operation_type);
         STRING_HANDLE binary_data = STRING_construct_sprintf(string_format, date_time, get_feature_type(bin_info->feature_type),
@@ -605,6 +628,146 @@ void report_network_usage(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem
     }
 }
 
+void report_metrics(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info, const char* rpt_name, const REPORT_METRIC* metrics, size_t metric_count)
+{
+    if (handle != NULL && iot_mem_info != NULL && rpt_name != NULL)
+    {
+        char date_time[DATE_TIME_LEN];
+        get_report_date(date_time, DATE_TIME_LEN);
+
+        if (handle->rpt_type == REPORTER_TYPE_CSV)
+        {
+            STRING_HANDLE metric_data = STRING_construct_sprintf(METRICS_CSV_FMT, date_time, rpt_name, get_feature_type(iot_mem_info->feature_type),
+                get_layer_type(iot_mem_info->feature_type), iot_mem_info->iothub_version, get_protocol_name(iot_mem_info->iothub_protocol), (int)iot_mem_info->msg_sent);
+            if (metric_data == NULL)
+            {
+                (void)printf("ERROR: Failed to allocate metrics csv\r\n");
+            }
+            else
+            {
+                for (size_t index = 0; index < metric_count; index++)
+                {
+                    (void)STRING_sprintf(metric_data, ", %s, %.3f", metrics[index].name, metrics[index].value);
+                }
+                add_node_to_csv(STRING_c_str(metric_data), handle);
+                STRING_delete(metric_data);
+            }
+        }
+        else
+        {
+            JSON_Value* metric_value;
+            JSON_Object* metric_object;
+            if ((metric_value = json_value_init_object()) == NULL)
+            {
+                (void)printf("ERROR: Failed to allocate metrics json\r\n");
+            }
+            else if ((metric_object = json_value_get_object(metric_value)) == NULL)
+            {
+                (void)printf("ERROR: Failed getting metrics object\r\n");
+                json_value_free(metric_value);
+            }
+            else
+            {
+                (void)json_object_set_string(metric_object, "rpt_type", rpt_name);
+                (void)json_object_set_string(metric_object, "dateTime", date_time);
+                (void)json_object_set_string(metric_object, "feature", get_feature_type(iot_mem_info->feature_type));
+                (void)json_object_set_string(metric_object, "layer", get_layer_type(iot_mem_info->feature_type));
+                (void)json_object_set_string(metric_object, "version", iot_mem_info->iothub_version);
+                (void)json_object_set_string(metric_object, "transport", get_protocol_name(iot_mem_info->iothub_protocol));
+                (void)json_object_set_number(metric_object, "msgCount", (double)iot_mem_info->msg_sent);
+                for (size_t index = 0; index < metric_count; index++)
+                {
+                    (void)json_object_set_number(metric_object, metrics[index].name, metrics[index].value);
+                }
+                add_value_to_json(metric_value, handle);
+            }
+        }
+    }
+}
+
+void report_packet_timeline(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info, const char* rpt_name, const REPORT_PACKET* packets, size_t packet_count)
+{
+    if (handle != NULL && iot_mem_info != NULL && rpt_name != NULL && (packets != NULL || packet_count == 0))
+    {
+        char date_time[DATE_TIME_LEN];
+        get_report_date(date_time, DATE_TIME_LEN);
+
+        if (handle->rpt_type == REPORTER_TYPE_CSV)
+        {
+            // One row per packet so the timeline can be plotted straight from the file
+            for (size_t index = 0; index < packet_count; index++)
+            {
+                STRING_HANDLE packet_data = STRING_construct_sprintf(PACKET_CSV_FMT, date_time, rpt_name, get_feature_type(iot_mem_info->feature_type),
+                    get_layer_type(iot_mem_info->feature_type), iot_mem_info->iothub_version, get_protocol_name(iot_mem_info->iothub_protocol), (int)iot_mem_info->msg_sent,
+                    packets[index].time_us, packets[index].is_send ? "send" : "recv", packets[index].size, packets[index].phase);
+                if (packet_data == NULL)
+                {
+                    (void)printf("ERROR: Failed to allocate packet csv\r\n");
+                    break;
+                }
+                add_node_to_csv(STRING_c_str(packet_data), handle);
+                STRING_delete(packet_data);
+            }
+        }
+        else
+        {
+            JSON_Value* timeline_value;
+            JSON_Value* packet_array_value = NULL;
+            JSON_Object* timeline_object;
+            JSON_Array* packet_array;
+            if ((timeline_value = json_value_init_object()) == NULL)
+            {
+                (void)printf("ERROR: Failed to allocate timeline json\r\n");
+            }
+            else if ((timeline_object = json_value_get_object(timeline_value)) == NULL ||
+                (packet_array_value = json_value_init_array()) == NULL ||
+                (packet_array = json_value_get_array(packet_array_value)) == NULL)
+            {
+                (void)printf("ERROR: Failed getting timeline object\r\n");
+                json_value_free(packet_array_value);
+                json_value_free(timeline_value);
+            }
+            else
+            {
+                (void)json_object_set_string(timeline_object, "rpt_type", rpt_name);
+                (void)json_object_set_string(timeline_object, "dateTime", date_time);
+                (void)json_object_set_string(timeline_object, "feature", get_feature_type(iot_mem_info->feature_type));
+                (void)json_object_set_string(timeline_object, "layer", get_layer_type(iot_mem_info->feature_type));
+                (void)json_object_set_string(timeline_object, "version", iot_mem_info->iothub_version);
+                (void)json_object_set_string(timeline_object, "transport", get_protocol_name(iot_mem_info->iothub_protocol));
+                (void)json_object_set_number(timeline_object, "msgCount", (double)iot_mem_info->msg_sent);
+                for (size_t index = 0; index < packet_count; index++)
+                {
+                    JSON_Value* packet_value;
+                    JSON_Object* packet_object;
+                    if ((packet_value = json_value_init_object()) == NULL || (packet_object = json_value_get_object(packet_value)) == NULL)
+                    {
+                        (void)printf("ERROR: Failed to allocate packet json\r\n");
+                        json_value_free(packet_value);
+                        break;
+                    }
+                    (void)json_object_set_number(packet_object, "timeUs", (double)packets[index].time_us);
+                    (void)json_object_set_string(packet_object, "dir", packets[index].is_send ? "send" : "recv");
+                    (void)json_object_set_number(packet_object, "size", (double)packets[index].size);
+                    (void)json_object_set_string(packet_object, "phase", packets[index].phase);
+                    if (json_array_append_value(packet_array, packet_value) != JSONSuccess)
+                    {
+                        (void)printf("ERROR: Failed adding packet json\r\n");
+                        json_value_free(packet_value);
+                        break;
+                    }
+                }
+                if (json_object_set_value(timeline_object, "packets", packet_array_value) != JSONSuccess)
+                {
+                    (void)printf("ERROR: Failed adding packet timeline\r\n");
+                    json_value_free(packet_array_value);
+                }
+                add_value_to_json(timeline_value, handle);
+            }
+        }
+    }
+}
+
 bool report_write(REPORT_HANDLE handle, const char* output_file, const char* conn_string)
 {
     bool result;
@@ -6,10 +6,12 @@
 
 #ifdef __cplusplus
 #include <cstddef>
+#include <cstdint>
 extern "C" {
 #else
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #endif
 
 static const char* MQTT_PROTOCOL_NAME = "MQTT PROTOCOL";
@@ -76,8 +78,23 @@ typedef struct REPORT_INFO_TAG* REPORT_HANDLE;
     {
         char* device_conn_string;
         char* scope_id;
+        // PEM of the CA to trust, NULL uses the certificates from certs.c
+        const char* trusted_cert;
+        // <host>:<port> of the local hub control channel, NULL when running against a real hub
+        const char* hub_control;
+        // <host>:<port> of an http proxy for the websocket transports, NULL connects directly
+        const char* http_proxy;
     } CONNECTION_INFO;
 
+    typedef struct SCENARIO_INFO_TAG
+    {
+        size_t msg_count;
+        size_t payload_size;
+        // Operations per second requested from the local hub, 0 sends them all at once
+        size_t msg_rate;
+        bool use_byte_array_msg;
+    } SCENARIO_INFO;
+
     typedef struct MEM_ANALYSIS_INFO_TAG
     {
         const char* iothub_version;
@@ -100,14 +117,36 @@ typedef struct REPORT_INFO_TAG* REPORT_HANDLE;
         const char* azure_conn_string;
         bool skip_ul;
         SDK_TYPE sdk_type;
+        // Functions and objects listed per binary, largest first
+        size_t top_symbols;
+        // cmake directory of another build to diff the symbols with, NULL skips the diff
+        const char* baseline_dir;
+        // Symbol or object file to explain the reference chain for, NULL skips it
+        const char* why_linked;
     } BINARY_INFO;
 
+    typedef struct REPORT_METRIC_TAG
+    {
+        const char* name;
+        double value;
+    } REPORT_METRIC;
+
+    typedef struct REPORT_PACKET_TAG
+    {
+        uint64_t time_us;
+        bool is_send;
+        size_t size;
+        const char* phase;
+    } REPORT_PACKET;
+
     extern REPORT_HANDLE report_initialize(REPORTER_TYPE rpt_type, SDK_TYPE sdk_type);
     extern void report_deinitialize(REPORT_HANDLE handle);
     
     extern void report_memory_usage(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info);
     extern void report_binary_sizes(REPORT_HANDLE handle, const BINARY_INFO* bin_info);
     extern void report_network_usage(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info);
+    extern void report_metrics(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info, const char* rpt_name, const REPORT_METRIC* metrics, size_t metric_count);
+    extern void report_packet_timeline(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info, const char* rpt_name, const REPORT_PACKET* packets, size_t packet_count);
 
     extern bool report_write(REPORT_HANDLE handle, const char* output_file, const char* conn_string);
 
@@ -0,0 +1,630 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "alloc_tracker.h"
+
+// Do not include gballoc.h here, this file must call the real allocator for its
+// own bookkeeping so it does not show up in the measurements
+#ifdef USE_ALLOC_TRACKER
+    #include <malloc.h>
+    #include <pthread.h>
+    #include <time.h>
+    #define ALLOC_USABLE_SIZE(ptr)      malloc_usable_size(ptr)
+#endif
+
+#define INITIAL_TABLE_SIZE          1024
+#define TABLE_LOAD_PERCENT          70
+
+#ifndef ANALYSIS_ALLOCATOR
+    #define ANALYSIS_ALLOCATOR      "glibc"
+#endif
+
+typedef struct ALLOCATOR_HEADER_TAG
+{
+    const char* name;
+    size_t header_size;
+} ALLOCATOR_HEADER;
+
+// Bytes in front of every block. glibc and tlsf store the block size there, the
+// previous size field overlaps with the user data of the previous block. jemalloc
+// and mimalloc keep their metadata per page and carve the blocks out of size classes.
+static const ALLOCATOR_HEADER ALLOCATOR_HEADERS[] = {
+    { "glibc", sizeof(size_t) },
+    { "jemalloc", 0 },
+    { "mimalloc", 0 },
+    { "tlsf", sizeof(size_t) }
+};
+
+static const char* const SIZE_CLASS_ALLOC_NAMES[ALLOC_SIZE_CLASS_COUNT] = {
+    "allocs16", "allocs32", "allocs64", "allocs128", "allocs256", "allocs512", "allocs1K", "allocs2K", "allocs4K", "allocsLarge" };
+static const char* const SIZE_CLASS_REQUESTED_NAMES[ALLOC_SIZE_CLASS_COUNT] = {
+    "requested16", "requested32", "requested64", "requested128", "requested256", "requested512", "requested1K", "requested2K", "requested4K", "requestedLarge" };
+static const char* const SIZE_CLASS_SLACK_NAMES[ALLOC_SIZE_CLASS_COUNT] = {
+    "slack16", "slack32", "slack64", "slack128", "slack256", "slack512", "slack1K", "slack2K", "slack4K", "slackLarge" };
+
+#ifdef USE_ALLOC_TRACKER
+
+typedef struct ALLOC_ENTRY_TAG
+{
+    void* ptr;
+    size_t requested;
+    size_t usable;
+} ALLOC_ENTRY;
+
+static const size_t SIZE_CLASS_LIMITS[ALLOC_SIZE_CLASS_COUNT] = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, SIZE_MAX };
+
+static const char* const PROC_STATUS_FILE = "/proc/self/status";
+static const char* const PROC_CLEAR_REFS_FILE = "/proc/self/clear_refs";
+
+// Marks a slot that held an allocation so probing continues past it
+#define TOMBSTONE_PTR               ((void*)1)
+
+static pthread_mutex_t g_tracker_lock = PTHREAD_MUTEX_INITIALIZER;
+static ALLOC_TRACKER_INFO g_tracker_info;
+static size_t g_header_size;
+static ALLOC_ENTRY* g_alloc_table;
+static size_t g_table_size;
+static size_t g_table_used;
+
+extern void* __real_gballoc_malloc(size_t size);
+extern void* __real_gballoc_calloc(size_t nmemb, size_t size);
+extern void* __real_gballoc_realloc(void* ptr, size_t size);
+extern void __real_gballoc_free(void* ptr);
+extern void* __real_malloc(size_t size);
+extern void* __real_calloc(size_t nmemb, size_t size);
+extern void* __real_realloc(void* ptr, size_t size);
+extern void __real_free(void* ptr);
+
+// The backend call gballoc makes on this thread. gballoc also allocates its own
+// list entry, only the call that returns or frees the caller's block is timed.
+typedef struct BACKEND_CALL_TAG
+{
+    bool in_gballoc;
+    const void* free_ptr;
+    void* result;
+    uint64_t elapsed_ns;
+} BACKEND_CALL;
+
+static __thread BACKEND_CALL t_backend_call;
+
+static size_t get_header_size(void)
+{
+    size_t result = 0;
+    for (size_t index = 0; index < sizeof(ALLOCATOR_HEADERS) / sizeof(ALLOCATOR_HEADERS[0]); index++)
+    {
+        if (strcmp(ALLOCATOR_HEADERS[index].name, ANALYSIS_ALLOCATOR) == 0)
+        {
+            result = ALLOCATOR_HEADERS[index].header_size;
+            break;
+        }
+    }
+    return result;
+}
+
+static size_t get_size_class(size_t size)
+{
+    size_t result = 0;
+    while (result < ALLOC_SIZE_CLASS_COUNT - 1 && size > SIZE_CLASS_LIMITS[result])
+    {
+        result++;
+    }
+    return result;
+}
+
+static uint64_t get_time_ns(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000) + (uint64_t)now.tv_nsec;
+}
+
+static void record_alloc_latency(uint64_t elapsed)
+{
+    size_t bucket = 0;
+    while (bucket < ALLOC_LATENCY_BUCKETS - 1 && elapsed >= ((uint64_t)1 << bucket))
+    {
+        bucket++;
+    }
+
+    (void)pthread_mutex_lock(&g_tracker_lock);
+    g_tracker_info.alloc_latency_total_ns += elapsed;
+    if (elapsed > g_tracker_info.alloc_latency_max_ns)
+    {
+        g_tracker_info.alloc_latency_max_ns = elapsed;
+    }
+    g_tracker_info.alloc_latency_bucket[bucket]++;
+    (void)pthread_mutex_unlock(&g_tracker_lock);
+}
+
+static void record_free_latency(uint64_t elapsed)
+{
+    (void)pthread_mutex_lock(&g_tracker_lock);
+    g_tracker_info.free_latency_total_ns += elapsed;
+    g_tracker_info.free_count++;
+    (void)pthread_mutex_unlock(&g_tracker_lock);
+}
+
+static size_t read_status_kb(const char* field_name)
+{
+    size_t result = 0;
+    FILE* status_file = fopen(PROC_STATUS_FILE, "r");
+    if (status_file != NULL)
+    {
+        char line[128];
+        size_t name_len = strlen(field_name);
+        while (fgets(line, sizeof(line), status_file) != NULL)
+        {
+            if (strncmp(line, field_name, name_len) == 0 && line[name_len] == ':')
+            {
+                result = (size_t)strtoul(line + name_len + 1, NULL, 10);
+                break;
+            }
+        }
+        fclose(status_file);
+    }
+    return result;
+}
+
+static void reset_peak_rss(void)
+{
+    // Writing 5 to clear_refs resets VmHWM to the current rss (Linux 4.0+)
+    FILE* clear_file = fopen(PROC_CLEAR_REFS_FILE, "w");
+    if (clear_file != NULL)
+    {
+        (void)fputs("5", clear_file);
+        fclose(clear_file);
+    }
+}
+
+static size_t hash_pointer(const void* ptr, size_t table_size)
+{
+    uintptr_t value = (uintptr_t)ptr;
+    value ^= value >> 17;
+    value *= (uintptr_t)0x9E3779B97F4A7C15ULL;
+    return (size_t)(value >> 7) & (table_size - 1);
+}
+
+static int insert_entry(ALLOC_ENTRY* table, size_t table_size, void* ptr, size_t requested, size_t usable)
+{
+    int result = __LINE__;
+    size_t index = hash_pointer(ptr, table_size);
+    for (size_t probe = 0; probe < table_size; probe++)
+    {
+        ALLOC_ENTRY* entry = &table[(index + probe) & (table_size - 1)];
+        if (entry->ptr == NULL || entry->ptr == TOMBSTONE_PTR)
+        {
+            entry->ptr = ptr;
+            entry->requested = requested;
+            entry->usable = usable;
+            result = 0;
+            break;
+        }
+    }
+    return result;
+}
+
+static int grow_table(void)
+{
+    int result;
+    size_t new_size = g_table_size == 0 ? INITIAL_TABLE_SIZE : g_table_size * 2;
+    ALLOC_ENTRY* new_table = (ALLOC_ENTRY*)calloc(new_size, sizeof(ALLOC_ENTRY));
+    if (new_table == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        size_t moved = 0;
+        for (size_t index = 0; index < g_table_size; index++)
+        {
+            if (g_alloc_table[index].ptr != NULL && g_alloc_table[index].ptr != TOMBSTONE_PTR)
+            {
+                (void)insert_entry(new_table, new_size, g_alloc_table[index].ptr, g_alloc_table[index].requested, g_alloc_table[index].usable);
+                moved++;
+            }
+        }
+        free(g_alloc_table);
+        g_alloc_table = new_table;
+        g_table_size = new_size;
+        g_table_used = moved;
+        result = 0;
+    }
+    return result;
+}
+
+static ALLOC_ENTRY* find_entry(const void* ptr)
+{
+    ALLOC_ENTRY* result = NULL;
+    if (g_table_size > 0)
+    {
+        size_t index = hash_pointer(ptr, g_table_size);
+        for (size_t probe = 0; probe < g_table_size; probe++)
+        {
+            ALLOC_ENTRY* entry = &g_alloc_table[(index + probe) & (g_table_size - 1)];
+            if (entry->ptr == NULL)
+            {
+                break;
+            }
+            else if (entry->ptr == ptr)
+            {
+                result = entry;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+static void track_allocation(void* ptr, size_t requested)
+{
+    if (ptr != NULL)
+    {
+        size_t usable = ALLOC_USABLE_SIZE(ptr);
+        size_t footprint;
+        ALLOC_SIZE_CLASS* size_class = &g_tracker_info.size_class[get_size_class(requested)];
+
+        (void)pthread_mutex_lock(&g_tracker_lock);
+        if ((g_table_used + 1) * 100 >= g_table_size * TABLE_LOAD_PERCENT)
+        {
+            (void)grow_table();
+        }
+        if (g_table_size > 0 && insert_entry(g_alloc_table, g_table_size, ptr, requested, usable) == 0)
+        {
+            g_table_used++;
+
+            g_tracker_info.total_allocs++;
+            g_tracker_info.total_requested += requested;
+            size_class->alloc_count++;
+            size_class->live_allocs++;
+            size_class->live_requested += requested;
+            size_class->live_usable += usable;
+
+            g_tracker_info.live_allocs++;
+            g_tracker_info.live_requested += requested;
+            g_tracker_info.live_usable += usable;
+            if (g_tracker_info.live_usable > g_tracker_info.peak_usable)
+            {
+                // The slack a pool could win back is the slack of the blocks held at the peak
+                g_tracker_info.peak_allocs = g_tracker_info.live_allocs;
+                g_tracker_info.peak_requested = g_tracker_info.live_requested;
+                g_tracker_info.peak_usable = g_tracker_info.live_usable;
+                for (size_t index = 0; index < ALLOC_SIZE_CLASS_COUNT; index++)
+                {
+                    ALLOC_SIZE_CLASS* peak_class = &g_tracker_info.size_class[index];
+                    peak_class->peak_allocs = peak_class->live_allocs;
+                    peak_class->peak_requested = peak_class->live_requested;
+                    peak_class->peak_usable = peak_class->live_usable;
+                }
+            }
+            footprint = g_tracker_info.live_usable + (g_tracker_info.live_allocs * g_header_size);
+            if (footprint > g_tracker_info.peak_footprint)
+            {
+                g_tracker_info.peak_footprint = footprint;
+            }
+        }
+        (void)pthread_mutex_unlock(&g_tracker_lock);
+    }
+}
+
+static bool untrack_allocation(void* ptr, size_t* requested)
+{
+    bool result = false;
+    if (ptr != NULL)
+    {
+        ALLOC_ENTRY* entry;
+        (void)pthread_mutex_lock(&g_tracker_lock);
+        // Blocks allocated before the last reset are not in the table and are ignored
+        if ((entry = find_entry(ptr)) != NULL)
+        {
+            ALLOC_SIZE_CLASS* size_class = &g_tracker_info.size_class[get_size_class(entry->requested)];
+            size_class->live_allocs--;
+            size_class->live_requested -= entry->requested;
+            size_class->live_usable -= entry->usable;
+            g_tracker_info.live_allocs--;
+            g_tracker_info.live_requested -= entry->requested;
+            g_tracker_info.live_usable -= entry->usable;
+            if (requested != NULL)
+            {
+                *requested = entry->requested;
+            }
+            entry->ptr = TOMBSTONE_PTR;
+            result = true;
+        }
+        (void)pthread_mutex_unlock(&g_tracker_lock);
+    }
+    return result;
+}
+
+static void begin_backend_call(const void* free_ptr)
+{
+    t_backend_call.in_gballoc = true;
+    t_backend_call.free_ptr = free_ptr;
+    t_backend_call.result = NULL;
+    t_backend_call.elapsed_ns = 0;
+}
+
+static void end_backend_alloc(const void* result)
+{
+    t_backend_call.in_gballoc = false;
+    if (result != NULL && t_backend_call.result == result)
+    {
+        record_alloc_latency(t_backend_call.elapsed_ns);
+    }
+}
+
+// The malloc family is wrapped as well so the time gballoc spends on its lock
+// and allocation list is not counted as allocator latency
+void* __wrap_malloc(size_t size)
+{
+    void* result;
+    if (t_backend_call.in_gballoc)
+    {
+        uint64_t start = get_time_ns();
+        result = __real_malloc(size);
+        t_backend_call.elapsed_ns = get_time_ns() - start;
+        t_backend_call.result = result;
+    }
+    else
+    {
+        result = __real_malloc(size);
+    }
+    return result;
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+    void* result;
+    if (t_backend_call.in_gballoc)
+    {
+        uint64_t start = get_time_ns();
+        result = __real_calloc(nmemb, size);
+        t_backend_call.elapsed_ns = get_time_ns() - start;
+        t_backend_call.result = result;
+    }
+    else
+    {
+        result = __real_calloc(nmemb, size);
+    }
+    return result;
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    void* result;
+    if (t_backend_call.in_gballoc)
+    {
+        uint64_t start = get_time_ns();
+        result = __real_realloc(ptr, size);
+        t_backend_call.elapsed_ns = get_time_ns() - start;
+        t_backend_call.result = result;
+    }
+    else
+    {
+        result = __real_realloc(ptr, size);
+    }
+    return result;
+}
+
+void __wrap_free(void* ptr)
+{
+    if (t_backend_call.in_gballoc && ptr != NULL && ptr == t_backend_call.free_ptr)
+    {
+        uint64_t start = get_time_ns();
+        __real_free(ptr);
+        record_free_latency(get_time_ns() - start);
+    }
+    else
+    {
+        __real_free(ptr);
+    }
+}
+
+void* __wrap_gballoc_malloc(size_t size)
+{
+    begin_backend_call(NULL);
+    void* result = __real_gballoc_malloc(size);
+    end_backend_alloc(result);
+    track_allocation(result, size);
+    return result;
+}
+
+void* __wrap_gballoc_calloc(size_t nmemb, size_t size)
+{
+    begin_backend_call(NULL);
+    void* result = __real_gballoc_calloc(nmemb, size);
+    end_backend_alloc(result);
+    track_allocation(result, nmemb * size);
+    return result;
+}
+
+void* __wrap_gballoc_realloc(void* ptr, size_t size)
+{
+    size_t prev_requested = 0;
+    // Untrack first, once realloc releases the block another thread can get the same address
+    bool was_tracked = untrack_allocation(ptr, &prev_requested);
+    begin_backend_call(NULL);
+    void* result = __real_gballoc_realloc(ptr, size);
+    end_backend_alloc(result);
+    if (result != NULL)
+    {
+        track_allocation(result, size);
+    }
+    else if (size != 0 && was_tracked)
+    {
+        // Realloc failed so the original block is still alive
+        track_allocation(ptr, prev_requested);
+    }
+    return result;
+}
+
+void __wrap_gballoc_free(void* ptr)
+{
+    (void)untrack_allocation(ptr, NULL);
+    begin_backend_call(ptr);
+    __real_gballoc_free(ptr);
+    t_backend_call.in_gballoc = false;
+}
+
+bool alloc_tracker_is_enabled(void)
+{
+    return true;
+}
+
+void alloc_tracker_reset(void)
+{
+    (void)pthread_mutex_lock(&g_tracker_lock);
+    memset(&g_tracker_info, 0, sizeof(g_tracker_info));
+    g_header_size = get_header_size();
+    if (g_alloc_table != NULL)
+    {
+        memset(g_alloc_table, 0, g_table_size * sizeof(ALLOC_ENTRY));
+    }
+    g_table_used = 0;
+    (void)pthread_mutex_unlock(&g_tracker_lock);
+
+    reset_peak_rss();
+}
+
+void alloc_tracker_get_info(ALLOC_TRACKER_INFO* info)
+{
+    if (info != NULL)
+    {
+        (void)pthread_mutex_lock(&g_tracker_lock);
+        *info = g_tracker_info;
+        (void)pthread_mutex_unlock(&g_tracker_lock);
+
+        info->header_size = get_header_size();
+        info->rss_kb = read_status_kb("VmRSS");
+        info->rss_peak_kb = read_status_kb("VmHWM");
+        for (size_t index = 0; index < ALLOC_SIZE_CLASS_COUNT; index++)
+        {
+            info->size_class[index].max_size = SIZE_CLASS_LIMITS[index];
+        }
+    }
+}
+#else
+bool alloc_tracker_is_enabled(void)
+{
+    return false;
+}
+
+void alloc_tracker_reset(void)
+{
+}
+
+void alloc_tracker_get_info(ALLOC_TRACKER_INFO* info)
+{
+    if (info != NULL)
+    {
+        memset(info, 0, sizeof(ALLOC_TRACKER_INFO));
+    }
+}
+#endif
+
+static uint64_t get_latency_percentile(const ALLOC_TRACKER_INFO* info, size_t percentile)
+{
+    uint64_t result = 0;
+    size_t total = 0;
+    size_t running = 0;
+    for (size_t index = 0; index < ALLOC_LATENCY_BUCKETS; index++)
+    {
+        total += info->alloc_latency_bucket[index];
+    }
+    for (size_t index = 0; index < ALLOC_LATENCY_BUCKETS && total > 0; index++)
+    {
+        running += info->alloc_latency_bucket[index];
+        if (running * 100 >= total * percentile)
+        {
+            // Upper bound of the bucket
+            result = (uint64_t)1 << index;
+            break;
+        }
+    }
+    return result;
+}
+
+static void report_allocator_usage(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info, const ALLOC_TRACKER_INFO* info)
+{
+    REPORT_METRIC metrics[8];
+    size_t count = 0;
+    size_t alloc_calls = 0;
+
+    for (size_t index = 0; index < ALLOC_LATENCY_BUCKETS; index++)
+    {
+        alloc_calls += info->alloc_latency_bucket[index];
+    }
+
+    metrics[count].name = "rssKb";
+    metrics[count++].value = (double)info->rss_kb;
+    metrics[count].name = "rssPeakKb";
+    metrics[count++].value = (double)info->rss_peak_kb;
+    metrics[count].name = "allocCalls";
+    metrics[count++].value = (double)alloc_calls;
+    metrics[count].name = "allocAvgNs";
+    metrics[count++].value = alloc_calls == 0 ? 0.0 : (double)info->alloc_latency_total_ns / alloc_calls;
+    metrics[count].name = "allocP50Ns";
+    metrics[count++].value = (double)get_latency_percentile(info, 50);
+    metrics[count].name = "allocP99Ns";
+    metrics[count++].value = (double)get_latency_percentile(info, 99);
+    metrics[count].name = "allocMaxNs";
+    metrics[count++].value = (double)info->alloc_latency_max_ns;
+    metrics[count].name = "freeAvgNs";
+    metrics[count++].value = info->free_count == 0 ? 0.0 : (double)info->free_latency_total_ns / info->free_count;
+    report_metrics(handle, iot_mem_info, "ALLOCATOR", metrics, count);
+}
+
+void alloc_tracker_report(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info)
+{
+    if (alloc_tracker_is_enabled())
+    {
+        ALLOC_TRACKER_INFO info;
+        REPORT_METRIC metrics[12 + (ALLOC_SIZE_CLASS_COUNT * 3)];
+        size_t count = 0;
+
+        alloc_tracker_get_info(&info);
+
+        metrics[count].name = "headerPerAlloc";
+        metrics[count++].value = (double)info.header_size;
+        metrics[count].name = "peakUsable";
+        metrics[count++].value = (double)info.peak_usable;
+        metrics[count].name = "peakFootprint";
+        metrics[count++].value = (double)info.peak_footprint;
+        metrics[count].name = "peakAllocs";
+        metrics[count++].value = (double)info.peak_allocs;
+        metrics[count].name = "peakSlack";
+        metrics[count++].value = (double)(info.peak_usable - info.peak_requested);
+        metrics[count].name = "peakHeader";
+        metrics[count++].value = (double)(info.peak_allocs * info.header_size);
+        metrics[count].name = "liveAllocs";
+        metrics[count++].value = (double)info.live_allocs;
+        metrics[count].name = "liveRequested";
+        metrics[count++].value = (double)info.live_requested;
+        metrics[count].name = "liveUsable";
+        metrics[count++].value = (double)info.live_usable;
+        metrics[count].name = "liveHeader";
+        metrics[count++].value = (double)(info.live_allocs * info.header_size);
+        metrics[count].name = "totalAllocs";
+        metrics[count++].value = (double)info.total_allocs;
+        metrics[count].name = "totalRequested";
+        metrics[count++].value = (double)info.total_requested;
+
+        // Per size class, the requested bytes and slack of the blocks held at the peak
+        for (size_t index = 0; index < ALLOC_SIZE_CLASS_COUNT; index++)
+        {
+            const ALLOC_SIZE_CLASS* size_class = &info.size_class[index];
+            metrics[count].name = SIZE_CLASS_ALLOC_NAMES[index];
+            metrics[count++].value = (double)size_class->alloc_count;
+            metrics[count].name = SIZE_CLASS_REQUESTED_NAMES[index];
+            metrics[count++].value = (double)size_class->peak_requested;
+            metrics[count].name = SIZE_CLASS_SLACK_NAMES[index];
+            metrics[count++].value = (double)(size_class->peak_usable - size_class->peak_requested);
+        }
+        report_metrics(handle, iot_mem_info, "RAM_SLACK", metrics, count);
+
+        report_allocator_usage(handle, iot_mem_info, &info);
+    }
+}
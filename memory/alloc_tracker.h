@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdbool>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#include "mem_reporter.h"
+
+#define ALLOC_SIZE_CLASS_COUNT  10
+#define ALLOC_LATENCY_BUCKETS   32
+
+    // The allocations whose requested size is <= max_size (and above the previous class).
+    // The counts are over every allocation, the bytes over the blocks alive at the time
+    // the usable bytes of the whole heap peaked.
+    typedef struct ALLOC_SIZE_CLASS_TAG
+    {
+        size_t max_size;
+        size_t alloc_count;
+        size_t live_allocs;
+        size_t live_requested;
+        size_t live_usable;
+        size_t peak_allocs;
+        size_t peak_requested;
+        size_t peak_usable;
+    } ALLOC_SIZE_CLASS;
+
+    typedef struct ALLOC_TRACKER_INFO_TAG
+    {
+        size_t header_size;
+        size_t total_allocs;
+        size_t total_requested;
+        size_t live_allocs;
+        size_t live_requested;
+        size_t live_usable;
+        size_t peak_allocs;
+        size_t peak_requested;
+        size_t peak_usable;
+        size_t peak_footprint;
+        ALLOC_SIZE_CLASS size_class[ALLOC_SIZE_CLASS_COUNT];
+
+        // Time spent in the malloc and free calls gballoc makes for the caller's block,
+        // without gballoc's own bookkeeping. Bucket n counts calls that took < 2^n ns
+        uint64_t alloc_latency_total_ns;
+        uint64_t alloc_latency_max_ns;
+        uint64_t free_latency_total_ns;
+        size_t free_count;
+        size_t alloc_latency_bucket[ALLOC_LATENCY_BUCKETS];
+
+        // Resident set size of the process in KB, the peak is since the last reset
+        size_t rss_kb;
+        size_t rss_peak_kb;
+    } ALLOC_TRACKER_INFO;
+
+    // The tracker sits between the sdk and gballoc, and between gballoc and malloc, through
+    // the linker's --wrap option, it is only active when the target was linked with add_alloc_tracker()
+    extern bool alloc_tracker_is_enabled(void);
+    extern void alloc_tracker_reset(void);
+    extern void alloc_tracker_get_info(ALLOC_TRACKER_INFO* info);
+    extern void alloc_tracker_report(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* ALLOC_TRACKER_H */
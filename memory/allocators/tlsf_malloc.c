@@ -0,0 +1,187 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Replaces the libc malloc family with the TLSF allocator in deps/tlsf so the
+// analysis executables can be measured against a constant time allocator.
+// The pools are carved out of mmap regions and grown on demand.
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "tlsf.h"
+
+#define TLSF_POOL_SIZE          (4 * 1024 * 1024)
+#define TLSF_DEFAULT_ALIGN      (2 * sizeof(void*))
+
+static pthread_mutex_t g_tlsf_lock = PTHREAD_MUTEX_INITIALIZER;
+static tlsf_t g_tlsf;
+
+static void* map_region(size_t size)
+{
+    void* result = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return result == MAP_FAILED ? NULL : result;
+}
+
+// Must be called with the lock held
+static int add_pool(size_t min_size)
+{
+    int result;
+    size_t pool_size = TLSF_POOL_SIZE;
+    size_t needed = min_size + tlsf_pool_overhead() + tlsf_alloc_overhead() + TLSF_DEFAULT_ALIGN;
+    if (needed < min_size)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        void* region;
+        while (pool_size < needed)
+        {
+            pool_size *= 2;
+        }
+        if (pool_size > tlsf_block_size_max())
+        {
+            result = __LINE__;
+        }
+        else if (g_tlsf == NULL)
+        {
+            size_t control_size = (tlsf_size() + TLSF_DEFAULT_ALIGN - 1) & ~(TLSF_DEFAULT_ALIGN - 1);
+            if ((region = map_region(control_size + pool_size)) == NULL)
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                g_tlsf = tlsf_create_with_pool(region, control_size + pool_size);
+                result = g_tlsf == NULL ? __LINE__ : 0;
+            }
+        }
+        else if ((region = map_region(pool_size)) == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            result = tlsf_add_pool(g_tlsf, region, pool_size) == NULL ? __LINE__ : 0;
+        }
+    }
+    return result;
+}
+
+static void* allocate_aligned(size_t alignment, size_t size)
+{
+    void* result = NULL;
+    (void)pthread_mutex_lock(&g_tlsf_lock);
+    if (g_tlsf != NULL)
+    {
+        result = tlsf_memalign(g_tlsf, alignment, size);
+    }
+    if (result == NULL && add_pool(size + alignment) == 0)
+    {
+        result = tlsf_memalign(g_tlsf, alignment, size);
+    }
+    (void)pthread_mutex_unlock(&g_tlsf_lock);
+    if (result == NULL)
+    {
+        errno = ENOMEM;
+    }
+    return result;
+}
+
+void* malloc(size_t size)
+{
+    return allocate_aligned(TLSF_DEFAULT_ALIGN, size == 0 ? 1 : size);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+    void* result;
+    size_t total = nmemb * size;
+    if (size != 0 && total / size != nmemb)
+    {
+        errno = ENOMEM;
+        result = NULL;
+    }
+    else if ((result = malloc(total)) != NULL)
+    {
+        memset(result, 0, total);
+    }
+    return result;
+}
+
+void free(void* ptr)
+{
+    if (ptr != NULL)
+    {
+        (void)pthread_mutex_lock(&g_tlsf_lock);
+        tlsf_free(g_tlsf, ptr);
+        (void)pthread_mutex_unlock(&g_tlsf_lock);
+    }
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    void* result;
+    if (ptr == NULL)
+    {
+        result = malloc(size);
+    }
+    else if (size == 0)
+    {
+        free(ptr);
+        result = NULL;
+    }
+    else
+    {
+        (void)pthread_mutex_lock(&g_tlsf_lock);
+        result = tlsf_realloc(g_tlsf, ptr, size);
+        (void)pthread_mutex_unlock(&g_tlsf_lock);
+        if (result == NULL)
+        {
+            // The current pools are full, move the block into a new one
+            if ((result = malloc(size)) != NULL)
+            {
+                size_t prev_size = tlsf_block_size(ptr);
+                memcpy(result, ptr, prev_size < size ? prev_size : size);
+                free(ptr);
+            }
+        }
+    }
+    return result;
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    return allocate_aligned(alignment < TLSF_DEFAULT_ALIGN ? TLSF_DEFAULT_ALIGN : alignment, size == 0 ? 1 : size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+    int result;
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || (alignment % sizeof(void*)) != 0)
+    {
+        result = EINVAL;
+    }
+    else if ((*memptr = memalign(alignment, size)) == NULL)
+    {
+        result = ENOMEM;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+size_t malloc_usable_size(void* ptr)
+{
+    return ptr == NULL ? 0 : tlsf_block_size(ptr);
+}
@@ -2,11 +2,15 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "c2d_mem_analytics.h"
+#include "latency_stats.h"
+#include "hub_control.h"
 
 #include "iothub_client.h"
 #include "iothub_message.h"
+#include "iothub_client_options.h"
 
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/tickcounter.h"
@@ -24,15 +28,26 @@
 
 #include "iothub_client_version.h"
 
-#define PROXY_PORT                  8888
-#define TIME_BETWEEN_MESSAGES       1
+#define CONNECT_TIMEOUT_MS          30000
+#define RECEIVE_TIMEOUT_MS          60000
+#define UL_WAIT_SLEEP_MS            10
+#define C2D_COMMAND_LEN             128
+#define MAX_PROXY_HOST_LEN          256
+#define NS_PER_SEC                  1000000000.0
+#define C2D_METRIC_COUNT            (6 + LATENCY_METRIC_COUNT)
+
+static const char* const SENT_TIME_PROPERTY = "sent_ns";
+static const char* const C2D_REPORT_NAME = "C2D";
 
 typedef struct IOTHUB_CLIENT_INFO_TAG
 {
     int connected;
     int stop_running;
     size_t msg_count;
-    bool use_byte_array;
+    size_t baseline_memory;
+    size_t dispatch_memory;
+    uint64_t last_recv_ns;
+    LATENCY_STATS_HANDLE latency_stats;
 } IOTHUB_CLIENT_INFO;
 
 static IOTHUB_CLIENT_TRANSPORT_PROVIDER initialize(MEM_ANALYSIS_INFO* iot_mem_info, PROTOCOL_TYPE protocol, size_t num_msgs_to_send)
@@ -44,21 +59,27 @@ static IOTHUB_CLIENT_TRANSPORT_PROVIDER initialize(MEM_ANALYSIS_INFO* iot_mem_in
     iot_mem_info->iothub_protocol = protocol;
     switch (protocol)
     {
+#ifdef USE_MQTT
         case PROTOCOL_MQTT:
             result = MQTT_Protocol;
             break;
         case PROTOCOL_MQTT_WS:
             result = MQTT_WebSocket_Protocol;
             break;
+#endif
+#ifdef USE_HTTP
         case PROTOCOL_HTTP:
             result = HTTP_Protocol;
             break;
+#endif
+#ifdef USE_AMQP
         case PROTOCOL_AMQP:
             result = AMQP_Protocol;
             break;
         case PROTOCOL_AMQP_WS:
             result = AMQP_Protocol_over_WebSocketsTls;
             break;
+#endif
         default:
             result = NULL;
             break;
@@ -66,9 +87,30 @@ static IOTHUB_CLIENT_TRANSPORT_PROVIDER initialize(MEM_ANALYSIS_INFO* iot_mem_in
     return result;
 }
 
+// The websocket and http transports reach the hub through the http proxy when one is
+// given, a local hub running without root only has its https port behind it
+static bool get_proxy_options(const CONNECTION_INFO* conn_info, PROTOCOL_TYPE protocol, char* proxy_host, size_t host_len, HTTP_PROXY_OPTIONS* proxy_options)
+{
+    bool result = false;
+    const char* port = conn_info->http_proxy == NULL ? NULL : strrchr(conn_info->http_proxy, ':');
+    if ((protocol == PROTOCOL_MQTT_WS || protocol == PROTOCOL_AMQP_WS || protocol == PROTOCOL_HTTP) && port != NULL && port != conn_info->http_proxy && (size_t)(port - conn_info->http_proxy) < host_len)
+    {
+        memcpy(proxy_host, conn_info->http_proxy, (size_t)(port - conn_info->http_proxy));
+        proxy_host[port - conn_info->http_proxy] = '\0';
+        memset(proxy_options, 0, sizeof(HTTP_PROXY_OPTIONS));
+        proxy_options->host_address = proxy_host;
+        proxy_options->port = atoi(port + 1);
+        result = true;
+    }
+    return result;
+}
+
 static IOTHUBMESSAGE_DISPOSITION_RESULT receive_msg_callback(IOTHUB_MESSAGE_HANDLE message, void* user_context)
 {
     IOTHUB_CLIENT_INFO* iot_client_info = (IOTHUB_CLIENT_INFO*)user_context;
+    uint64_t recv_time = latency_stats_get_time_ns();
+    size_t current_memory = gballoc_getCurrentMemoryUsed();
+    const char* sent_time;
 
     IOTHUBMESSAGE_CONTENT_TYPE content_type = IoTHubMessage_GetContentType(message);
     if (content_type == IOTHUBMESSAGE_BYTEARRAY)
@@ -89,6 +131,21 @@ static IOTHUBMESSAGE_DISPOSITION_RESULT receive_msg_callback(IOTHUB_MESSAGE_HAND
             (void)printf("Failure retrieving byte array message\r\n");
         }
     }
+
+    // The local hub stamps every message when it is written to the socket
+    if ((sent_time = IoTHubMessage_GetProperty(message, SENT_TIME_PROPERTY)) != NULL)
+    {
+        uint64_t sent_ns = strtoull(sent_time, NULL, 10);
+        if (sent_ns > 0 && sent_ns <= recv_time)
+        {
+            latency_stats_add(iot_client_info->latency_stats, recv_time - sent_ns);
+        }
+    }
+    if (current_memory > iot_client_info->baseline_memory)
+    {
+        iot_client_info->dispatch_memory += current_memory - iot_client_info->baseline_memory;
+    }
+    iot_client_info->last_recv_ns = recv_time;
     iot_client_info->msg_count++;
 
     return IOTHUBMESSAGE_ACCEPTED;
@@ -116,146 +173,275 @@ static void iothub_connection_status(IOTHUB_CLIENT_CONNECTION_STATUS result, IOT
     }
 }
 
-int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg)
+static int request_c2d_messages(const CONNECTION_INFO* conn_info, const SCENARIO_INFO* scenario)
 {
     int result;
+    if (conn_info->hub_control == NULL)
+    {
+        (void)printf("Send %zu cloud to device messages to the device now\r\n", scenario->msg_count);
+        result = 0;
+    }
+    else
+    {
+        char command[C2D_COMMAND_LEN];
+        char response[HUB_CONTROL_RESPONSE_LEN];
+        (void)snprintf(command, sizeof(command), "C2D * %zu %zu", scenario->msg_count, scenario->payload_size);
+        result = hub_control_execute(conn_info->hub_control, command, response, sizeof(response));
+    }
+    return result;
+}
+
+static void report_c2d_usage(REPORT_HANDLE report_handle, const MEM_ANALYSIS_INFO* iot_mem_info, IOTHUB_CLIENT_INFO* iothub_info, uint64_t request_time)
+{
+    REPORT_METRIC metrics[C2D_METRIC_COUNT];
+    LATENCY_SUMMARY summary;
+    size_t count = 0;
+    // The metrics were reset at the baseline so the maximum is the peak of the receive
+    size_t peak_memory = gballoc_getMaximumMemoryUsed();
+    size_t peak_delta = peak_memory > iothub_info->baseline_memory ? peak_memory - iothub_info->baseline_memory : 0;
+    double receive_secs = iothub_info->msg_count == 0 ? 0.0 : (iothub_info->last_recv_ns - request_time) / NS_PER_SEC;
+
+    latency_stats_get_summary(iothub_info->latency_stats, &summary);
+
+    metrics[count].name = "msgsReceived";
+    metrics[count++].value = (double)iothub_info->msg_count;
+    metrics[count].name = "receiveSeconds";
+    metrics[count++].value = receive_secs;
+    metrics[count].name = "msgsPerSec";
+    metrics[count++].value = receive_secs > 0.0 ? iothub_info->msg_count / receive_secs : 0.0;
+    metrics[count].name = "heapBaseline";
+    metrics[count++].value = (double)iothub_info->baseline_memory;
+    metrics[count].name = "peakHeapDelta";
+    metrics[count++].value = (double)peak_delta;
+    // The sdk dispatches every message as soon as it is read, this is what it holds
+    // above the baseline when the callback runs, message included
+    metrics[count].name = "dispatchHeapDelta";
+    metrics[count++].value = iothub_info->msg_count == 0 ? 0.0 : (double)iothub_info->dispatch_memory / iothub_info->msg_count;
+    count += latency_stats_fill_metrics(&summary, &metrics[count]);
+
+    report_metrics(report_handle, iot_mem_info, C2D_REPORT_NAME, metrics, count);
+}
+
+int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario)
+{
+    int result;
+    HTTP_PROXY_OPTIONS proxy_options;
+    char proxy_host[MAX_PROXY_HOST_LEN];
     IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
 
     MEM_ANALYSIS_INFO iot_mem_info;
     memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
 
-    if ((iothub_transport = initialize(&iot_mem_info, protocol, num_msgs_to_send)) == NULL)
+    if ((iothub_transport = initialize(&iot_mem_info, protocol, scenario->msg_count)) == NULL)
     {
         (void)printf("Failed setting transport failed\r\n");
         result = __LINE__;
     }
     else
     {
-        gballoc_resetMetrics();
-        iot_mem_info.operation_type = OPERATION_MEMORY;
-        iot_mem_info.feature_type = FEATURE_C2D_LL;
+        IOTHUB_CLIENT_INFO iothub_info;
+        memset(&iothub_info, 0, sizeof(IOTHUB_CLIENT_INFO));
 
-        // Sending the iothub messages
-        IOTHUB_CLIENT_LL_HANDLE iothub_client;
-        if ((iothub_client = IoTHubClient_LL_CreateFromConnectionString(conn_info->device_conn_string, iothub_transport) ) == NULL)
+        if ((iothub_info.latency_stats = latency_stats_create(scenario->msg_count)) == NULL)
         {
-            (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_info->device_conn_string);
+            (void)printf("Failed creating latency stats\r\n");
             result = __LINE__;
         }
         else
         {
-            IOTHUB_CLIENT_INFO iothub_info;
-            memset(&iothub_info, 0, sizeof(IOTHUB_CLIENT_INFO));
-
-            if (protocol == PROTOCOL_HTTP)
-            {
-                iothub_info.connected = 1;
-            }
-
-            (void)IoTHubClient_LL_SetConnectionStatusCallback(iothub_client, iothub_connection_status, &iothub_info);
+            gballoc_resetMetrics();
+            iot_mem_info.operation_type = OPERATION_MEMORY;
+            iot_mem_info.feature_type = FEATURE_C2D_LL;
 
-            //IoTHubClient_SetOption(iothub_client, "logtrace", &g_trace_on);
-            // Always set the cert so we can compare apples to apples
-            IoTHubClient_LL_SetOption(iothub_client, OPTION_TRUSTED_CERT, certificates);
-
-            if (IoTHubClient_LL_SetMessageCallback(iothub_client, receive_msg_callback, &iothub_info) != IOTHUB_CLIENT_OK)
+            IOTHUB_CLIENT_LL_HANDLE iothub_client;
+            if ((iothub_client = IoTHubClient_LL_CreateFromConnectionString(conn_info->device_conn_string, iothub_transport) ) == NULL)
             {
-                (void)printf("ERROR: IoTHubClient_LL_SetMessageCallback..........FAILED!\r\n");
+                (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_info->device_conn_string);
                 result = __LINE__;
             }
             else
             {
-                bool send_msg = true;
-                result = 0;
-                do
+                if (protocol == PROTOCOL_HTTP)
+                {
+                    unsigned int min_polling_time = 1;
+                    iothub_info.connected = 1;
+                    (void)IoTHubClient_LL_SetOption(iothub_client, OPTION_MIN_POLLING_TIME, &min_polling_time);
+                }
+
+                (void)IoTHubClient_LL_SetConnectionStatusCallback(iothub_client, iothub_connection_status, &iothub_info);
+
+                // Always set the cert so we can compare apples to apples
+                (void)IoTHubClient_LL_SetOption(iothub_client, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+                if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
                 {
-                    if (iothub_info.connected == 1 && send_msg)
+                    (void)IoTHubClient_LL_SetOption(iothub_client, OPTION_HTTP_PROXY, &proxy_options);
+                }
+
+                if (IoTHubClient_LL_SetMessageCallback(iothub_client, receive_msg_callback, &iothub_info) != IOTHUB_CLIENT_OK)
+                {
+                    (void)printf("ERROR: IoTHubClient_LL_SetMessageCallback..........FAILED!\r\n");
+                    result = __LINE__;
+                }
+                else
+                {
+                    uint64_t start_time = latency_stats_get_time_ns();
+                    do
+                    {
+                        IoTHubClient_LL_DoWork(iothub_client);
+                        ThreadAPI_Sleep(1);
+                    } while (iothub_info.connected == 0 && iothub_info.stop_running == 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < CONNECT_TIMEOUT_MS);
+
+                    if (iothub_info.connected == 0)
                     {
-                        // Send message to the client
-                        (void)printf("Send Message Now\r\n");
-                        send_msg = false;
+                        (void)printf("Failed connecting to the hub\r\n");
+                        result = __LINE__;
                     }
-                    IoTHubClient_LL_DoWork(iothub_client);
-                    ThreadAPI_Sleep(20);
-                } while (iothub_info.stop_running != 0 || iothub_info.msg_count < num_msgs_to_send);
-            }
+                    else
+                    {
+                        // Everything above the baseline is held for the cloud to device messages
+                        uint64_t request_time = latency_stats_get_time_ns();
+                        gballoc_resetMetrics();
+                        iothub_info.baseline_memory = gballoc_getCurrentMemoryUsed();
+
+                        if (request_c2d_messages(conn_info, scenario) != 0)
+                        {
+                            result = __LINE__;
+                        }
+                        else
+                        {
+                            do
+                            {
+                                IoTHubClient_LL_DoWork(iothub_client);
+                                ThreadAPI_Sleep(1);
+                            } while (iothub_info.stop_running == 0 && iothub_info.msg_count < scenario->msg_count && (latency_stats_get_time_ns() - request_time) / 1000000 < RECEIVE_TIMEOUT_MS);
+
+                            // Send the outstanding acknowledgements
+                            for (size_t index = 0; index < 10; index++)
+                            {
+                                IoTHubClient_LL_DoWork(iothub_client);
+                                ThreadAPI_Sleep(1);
+                            }
+                            report_c2d_usage(report_handle, &iot_mem_info, &iothub_info, request_time);
+                            result = 0;
+                        }
+                    }
+                }
 
-            IoTHubClient_LL_Destroy(iothub_client);
+                IoTHubClient_LL_Destroy(iothub_client);
 
-            report_memory_usage(NULL, &iot_mem_info);
+                report_memory_usage(report_handle, &iot_mem_info);
+            }
+            latency_stats_destroy(iothub_info.latency_stats);
         }
     }
     return result;
 }
 
-int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg)
+int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario)
 {
     int result;
+    HTTP_PROXY_OPTIONS proxy_options;
+    char proxy_host[MAX_PROXY_HOST_LEN];
     IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
 
     MEM_ANALYSIS_INFO iot_mem_info;
     memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
 
-    if ((iothub_transport = initialize(&iot_mem_info, protocol, num_msgs_to_send)) == NULL)
+    if ((iothub_transport = initialize(&iot_mem_info, protocol, scenario->msg_count)) == NULL)
     {
         (void)printf("Failed setting transport failed\r\n");
         result = __LINE__;
     }
     else
     {
-        gballoc_resetMetrics();
-
-        iot_mem_info.operation_type = OPERATION_MEMORY;
-        iot_mem_info.feature_type = FEATURE_C2D_UL;
+        IOTHUB_CLIENT_INFO iothub_info;
+        memset(&iothub_info, 0, sizeof(IOTHUB_CLIENT_INFO));
 
-        // Sending the iothub messages
-        IOTHUB_CLIENT_HANDLE iothub_client;
-        if ((iothub_client = IoTHubClient_CreateFromConnectionString(conn_info->device_conn_string, iothub_transport)) == NULL)
+        if ((iothub_info.latency_stats = latency_stats_create(scenario->msg_count)) == NULL)
         {
-            (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_info->device_conn_string);
+            (void)printf("Failed creating latency stats\r\n");
             result = __LINE__;
         }
         else
         {
-            IOTHUB_CLIENT_INFO iothub_info;
-            memset(&iothub_info, 0, sizeof(IOTHUB_CLIENT_INFO));
+            gballoc_resetMetrics();
 
-            // Http doesn't have a connection callback
-            if (protocol == PROTOCOL_HTTP)
-            {
-                iothub_info.connected = 1;
-            }
+            iot_mem_info.operation_type = OPERATION_MEMORY;
+            iot_mem_info.feature_type = FEATURE_C2D_UL;
 
-            (void)IoTHubClient_SetConnectionStatusCallback(iothub_client, iothub_connection_status, &iothub_info);
-
-            //IoTHubClient_SetOption(iothub_client, "logtrace", &g_trace_on);
-            // Always set the cert so we can compare apples to apples
-            IoTHubClient_SetOption(iothub_client, OPTION_TRUSTED_CERT, certificates);
-
-            if (IoTHubClient_SetMessageCallback(iothub_client, receive_msg_callback, &iothub_info) != IOTHUB_CLIENT_OK)
+            IOTHUB_CLIENT_HANDLE iothub_client;
+            if ((iothub_client = IoTHubClient_CreateFromConnectionString(conn_info->device_conn_string, iothub_transport)) == NULL)
             {
-                (void)printf("ERROR: IoTHubClient_LL_SetMessageCallback..........FAILED!\r\n");
+                (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_info->device_conn_string);
                 result = __LINE__;
             }
             else
             {
-                bool send_msg = true;
-                result = 0;
-                do
+                // Http doesn't have a connection callback
+                if (protocol == PROTOCOL_HTTP)
+                {
+                    unsigned int min_polling_time = 1;
+                    iothub_info.connected = 1;
+                    (void)IoTHubClient_SetOption(iothub_client, OPTION_MIN_POLLING_TIME, &min_polling_time);
+                }
+
+                (void)IoTHubClient_SetConnectionStatusCallback(iothub_client, iothub_connection_status, &iothub_info);
+
+                // Always set the cert so we can compare apples to apples
+                (void)IoTHubClient_SetOption(iothub_client, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+                if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
+                {
+                    (void)IoTHubClient_SetOption(iothub_client, OPTION_HTTP_PROXY, &proxy_options);
+                }
+
+                if (IoTHubClient_SetMessageCallback(iothub_client, receive_msg_callback, &iothub_info) != IOTHUB_CLIENT_OK)
+                {
+                    (void)printf("ERROR: IoTHubClient_SetMessageCallback..........FAILED!\r\n");
+                    result = __LINE__;
+                }
+                else
                 {
-                    if (iothub_info.connected == 1 && send_msg)
+                    uint64_t start_time = latency_stats_get_time_ns();
+                    while (iothub_info.connected == 0 && iothub_info.stop_running == 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < CONNECT_TIMEOUT_MS)
                     {
-                        // Send message to the client
-                        (void)printf("Send Message Now\r\n");
-                        send_msg = false;
+                        ThreadAPI_Sleep(UL_WAIT_SLEEP_MS);
                     }
-                    ThreadAPI_Sleep(1000);
-                } while (iothub_info.stop_running != 0 || iothub_info.msg_count < num_msgs_to_send);
-            }
 
-            IoTHubClient_Destroy(iothub_client);
+                    if (iothub_info.connected == 0)
+                    {
+                        (void)printf("Failed connecting to the hub\r\n");
+                        result = __LINE__;
+                    }
+                    else
+                    {
+                        uint64_t request_time = latency_stats_get_time_ns();
+                        gballoc_resetMetrics();
+                        iothub_info.baseline_memory = gballoc_getCurrentMemoryUsed();
+
+                        if (request_c2d_messages(conn_info, scenario) != 0)
+                        {
+                            result = __LINE__;
+                        }
+                        else
+                        {
+                            while (iothub_info.stop_running == 0 && iothub_info.msg_count < scenario->msg_count && (latency_stats_get_time_ns() - request_time) / 1000000 < RECEIVE_TIMEOUT_MS)
+                            {
+                                ThreadAPI_Sleep(UL_WAIT_SLEEP_MS);
+                            }
+
+                            // Give the worker thread time to acknowledge the messages
+                            ThreadAPI_Sleep(100);
+                            report_c2d_usage(report_handle, &iot_mem_info, &iothub_info, request_time);
+                            result = 0;
+                        }
+                    }
+                }
+
+                IoTHubClient_Destroy(iothub_client);
 
-            report_memory_usage(NULL, &iot_mem_info);
+                report_memory_usage(report_handle, &iot_mem_info);
+            }
+            latency_stats_destroy(iothub_info.latency_stats);
         }
     }
     return result;
@@ -1,20 +1,22 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
-#include <vld.h>
-
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "sdk_mem_analytics.h"
+#include "latency_stats.h"
+#include "hub_control.h"
 
 #include "iothub_client.h"
 #include "iothub_message.h"
 
 #include "azure_c_shared_utility/threadapi.h"
-#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/shared_util_options.h"
 #include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/gbnetwork.h"
+#include "azure_c_shared_utility/lock.h"
 
 #ifdef USE_MQTT
     #include "iothubtransportmqtt.h"
@@ -28,92 +30,223 @@
     #include "iothubtransporthttp.h"
 #endif
 
-#include "../../../certs/certs.h"
+#include "../certs/certs.h"
 
 #include "iothub_client_version.h"
 
-#define PROXY_PORT                  8888
-#define MESSAGES_TO_SEND            1
-#define TIME_BETWEEN_MESSAGES       1
+#define CONNECT_TIMEOUT_MS          30000
+#define INVOKE_TIMEOUT_MS           60000
+#define COMPLETE_TIMEOUT_MS         5000
+#define UL_WAIT_SLEEP_MS            10
+#define METHOD_COMMAND_LEN          128
+#define MAX_PROXY_HOST_LEN          256
+#define METHOD_METRIC_COUNT         (8 + LATENCY_METRIC_COUNT)
+
+static const char* const METHOD_REPORT_NAME = "METHODS";
+static const char* const METHOD_RESPONSE = "{ \"Response\": \"This is the response from the device\" }";
 
-typedef struct IOTHUB_CLIENT_SAMPLE_INFO_TAG
+typedef struct IOTHUB_CLIENT_INFO_TAG
 {
     int connected;
     int stop_running;
+    size_t method_count;
+
+    // The invocations the client has handed to the callback and not got a response
+    // for yet. The queue is only written by the callback and read by the loop.
+    LOCK_HANDLE lock;
+    METHOD_HANDLE* pending;
+    size_t pending_capacity;
+    size_t pending_count;
+    size_t pending_next;
+    size_t inflight;
+    size_t inflight_max;
 } IOTHUB_CLIENT_INFO;
 
+typedef struct METHOD_RESULT_TAG
+{
+    size_t baseline_memory;
+    uint64_t baseline_bytes;
+    uint64_t method_completed;
+    uint64_t method_inflight_max;
+    LATENCY_SUMMARY latency;
+} METHOD_RESULT;
+
 static IOTHUB_CLIENT_TRANSPORT_PROVIDER initialize(MEM_ANALYSIS_INFO* iot_mem_info, PROTOCOL_TYPE protocol, size_t num_msgs_to_send)
 {
     IOTHUB_CLIENT_TRANSPORT_PROVIDER result;
     iot_mem_info->msg_sent = num_msgs_to_send;
     iot_mem_info->iothub_version = IoTHubClient_GetVersionString();
 
+    iot_mem_info->iothub_protocol = protocol;
     switch (protocol)
     {
 #ifdef USE_MQTT
-    case PROTOCOL_MQTT:
-        result = MQTT_Protocol;
-        iot_mem_info->iothub_protocol = MQTT_PROTOCOL_NAME;
-        break;
-    case PROTOCOL_MQTT_WS:
-        result = MQTT_WebSocket_Protocol;
-        iot_mem_info->iothub_protocol = MQTT_WS_PROTOCOL_NAME;
-        break;
-#endif
-#ifdef USE_HTTP
-    case PROTOCOL_HTTP:
-        result = HTTP_Protocol;
-        iot_mem_info->iothub_protocol = HTTP_PROTOCOL_NAME;
-        break;
+        case PROTOCOL_MQTT:
+            result = MQTT_Protocol;
+            break;
+        case PROTOCOL_MQTT_WS:
+            result = MQTT_WebSocket_Protocol;
+            break;
 #endif
 #ifdef USE_AMQP
-    case PROTOCOL_AMQP:
-        result = AMQP_Protocol;
-        iot_mem_info->iothub_protocol = AMQP_PROTOCOL_NAME;
-        break;
-    case PROTOCOL_AMQP_WS:
-        result = AMQP_Protocol_over_WebSocketsTls;
-        iot_mem_info->iothub_protocol = AMQP_WS_PROTOCOL_NAME;
-        break;
+        case PROTOCOL_AMQP:
+            result = AMQP_Protocol;
+            break;
+        case PROTOCOL_AMQP_WS:
+            result = AMQP_Protocol_over_WebSocketsTls;
+            break;
 #endif
-    default:
-        result = NULL;
-        break;
+        default:
+            result = NULL;
+            break;
     }
     return result;
 }
 
-static int send_device_method_message()
+// The websocket and http transports reach the hub through the http proxy when one is
+// given, a local hub running without root only has its https port behind it
+static bool get_proxy_options(const CONNECTION_INFO* conn_info, PROTOCOL_TYPE protocol, char* proxy_host, size_t host_len, HTTP_PROXY_OPTIONS* proxy_options)
 {
-    int result;
+    bool result = false;
+    const char* port = conn_info->http_proxy == NULL ? NULL : strrchr(conn_info->http_proxy, ':');
+    if ((protocol == PROTOCOL_MQTT_WS || protocol == PROTOCOL_AMQP_WS || protocol == PROTOCOL_HTTP) && port != NULL && port != conn_info->http_proxy && (size_t)(port - conn_info->http_proxy) < host_len)
+    {
+        memcpy(proxy_host, conn_info->http_proxy, (size_t)(port - conn_info->http_proxy));
+        proxy_host[port - conn_info->http_proxy] = '\0';
+        memset(proxy_options, 0, sizeof(HTTP_PROXY_OPTIONS));
+        proxy_options->host_address = proxy_host;
+        proxy_options->port = atoi(port + 1);
+        result = true;
+    }
     return result;
 }
 
-static int device_method_callback(const char* method_name, const unsigned char* payload, size_t size, unsigned char** response, size_t* resp_size, void* user_context)
+// Only queues the invocation, the loop hands the response back on its next pass
+// so the calls that arrive together are held by the client at the same time
+static int device_method_callback(const char* method_name, const unsigned char* payload, size_t size, METHOD_HANDLE method_id, void* user_context)
 {
-    int status = 200;
-    if (user_context != NULL)
+    int result;
+    IOTHUB_CLIENT_INFO* iothub_info = (IOTHUB_CLIENT_INFO*)user_context;
+    (void)method_name;
+    (void)payload;
+    (void)size;
+
+    if (Lock(iothub_info->lock) != LOCK_OK)
     {
-        IOTHUB_CLIENT_INFO* iothub_info = (IOTHUB_CLIENT_INFO*)user_context;
+        (void)printf("Failure locking the pending methods\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        if (iothub_info->pending_count == iothub_info->pending_capacity)
+        {
+            (void)printf("Failure queueing method %zu, the hub invoked more than requested\r\n", iothub_info->pending_count + 1);
+            result = __LINE__;
+        }
+        else
+        {
+            iothub_info->pending[iothub_info->pending_count++] = method_id;
+            iothub_info->inflight++;
+            if (iothub_info->inflight > iothub_info->inflight_max)
+            {
+                iothub_info->inflight_max = iothub_info->inflight;
+            }
+            iothub_info->method_count++;
+            result = 0;
+        }
+        (void)Unlock(iothub_info->lock);
+    }
+    return result;
+}
 
-        printf("\r\nDevice Method called\r\n");
-        printf("Device Method name:    %s\r\n", method_name);
-        printf("Device Method payload: %.*s\r\n", (int)size, (const char*)payload);
+static bool take_pending_method(IOTHUB_CLIENT_INFO* iothub_info, METHOD_HANDLE* method_id)
+{
+    bool result = false;
+    if (Lock(iothub_info->lock) != LOCK_OK)
+    {
+        (void)printf("Failure locking the pending methods\r\n");
+    }
+    else
+    {
+        if (iothub_info->pending_next < iothub_info->pending_count)
+        {
+            *method_id = iothub_info->pending[iothub_info->pending_next++];
+            result = true;
+        }
+        (void)Unlock(iothub_info->lock);
+    }
+    return result;
+}
 
-        const char* RESPONSE_STRING = "{ \"Response\": \"This is the response from the device\" }";
+static void complete_pending_method(IOTHUB_CLIENT_INFO* iothub_info)
+{
+    if (Lock(iothub_info->lock) != LOCK_OK)
+    {
+        (void)printf("Failure locking the pending methods\r\n");
+    }
+    else
+    {
+        iothub_info->inflight--;
+        (void)Unlock(iothub_info->lock);
+    }
+}
 
-        *resp_size = strlen(RESPONSE_STRING);
-        if ((*response = malloc(*resp_size)) == NULL)
+static void respond_methods_ll(IOTHUB_CLIENT_LL_HANDLE iothub_client, IOTHUB_CLIENT_INFO* iothub_info)
+{
+    METHOD_HANDLE method_id;
+    while (take_pending_method(iothub_info, &method_id))
+    {
+        if (IoTHubClient_LL_DeviceMethodResponse(iothub_client, method_id, (const unsigned char*)METHOD_RESPONSE, strlen(METHOD_RESPONSE), 200) != IOTHUB_CLIENT_OK)
         {
-            status = -1;
+            (void)printf("Failure sending the method response\r\n");
         }
-        else
+        complete_pending_method(iothub_info);
+    }
+}
+
+// The lock is not held while responding, the worker thread holds the client's
+// lock when it calls the callback
+static void respond_methods_ul(IOTHUB_CLIENT_HANDLE iothub_client, IOTHUB_CLIENT_INFO* iothub_info)
+{
+    METHOD_HANDLE method_id;
+    while (take_pending_method(iothub_info, &method_id))
+    {
+        if (IoTHubClient_DeviceMethodResponse(iothub_client, method_id, (const unsigned char*)METHOD_RESPONSE, strlen(METHOD_RESPONSE), 200) != IOTHUB_CLIENT_OK)
         {
-            (void)memcpy(*response, RESPONSE_STRING, *resp_size);
+            (void)printf("Failure sending the method response\r\n");
         }
-        iothub_info->stop_running = 1;
+        complete_pending_method(iothub_info);
+    }
+}
+
+// The queue is allocated before the baseline so it is not part of the measurement
+static int initialize_client_info(IOTHUB_CLIENT_INFO* iothub_info, size_t method_count)
+{
+    int result;
+    memset(iothub_info, 0, sizeof(IOTHUB_CLIENT_INFO));
+    if ((iothub_info->pending = (METHOD_HANDLE*)malloc((method_count == 0 ? 1 : method_count) * sizeof(METHOD_HANDLE))) == NULL)
+    {
+        (void)printf("Failure allocating %zu pending methods\r\n", method_count);
+        result = __LINE__;
+    }
+    else if ((iothub_info->lock = Lock_Init()) == NULL)
+    {
+        (void)printf("Failure creating the pending methods lock\r\n");
+        free(iothub_info->pending);
+        result = __LINE__;
+    }
+    else
+    {
+        iothub_info->pending_capacity = method_count;
+        result = 0;
     }
-    return status;
+    return result;
+}
+
+static void deinitialize_client_info(IOTHUB_CLIENT_INFO* iothub_info)
+{
+    Lock_Deinit(iothub_info->lock);
+    free(iothub_info->pending);
 }
 
 static void iothub_connection_status(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* user_context)
@@ -138,93 +271,332 @@ static void iothub_connection_status(IOTHUB_CLIENT_CONNECTION_STATUS result, IOT
     }
 }
 
-int send_lower_level_operation(const char* conn_string, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg, memory_usage_callback memory_cb)
+static uint64_t get_network_bytes(void)
+{
+    return gbnetwork_getBytesSent() + gbnetwork_getBytesRecv();
+}
+
+static size_t get_invoke_timeout_ms(const SCENARIO_INFO* scenario)
+{
+    return INVOKE_TIMEOUT_MS + (scenario->msg_rate == 0 ? 0 : (scenario->msg_count * 1000) / scenario->msg_rate);
+}
+
+static int request_methods(const CONNECTION_INFO* conn_info, const SCENARIO_INFO* scenario)
 {
     int result;
-    IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
+    if (conn_info->hub_control == NULL)
+    {
+        (void)printf("Invoke the device method %zu times now\r\n", scenario->msg_count);
+        result = 0;
+    }
+    else
+    {
+        char command[METHOD_COMMAND_LEN];
+        char response[HUB_CONTROL_RESPONSE_LEN];
+        (void)snprintf(command, sizeof(command), "METHOD * %zu %zu %zu", scenario->msg_count, scenario->payload_size, scenario->msg_rate);
+        if (hub_control_execute(conn_info->hub_control, "RESET", response, sizeof(response)) != 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            result = hub_control_execute(conn_info->hub_control, command, response, sizeof(response));
+        }
+    }
+    return result;
+}
 
-    TICK_COUNTER_HANDLE g_tick_counter_handle;
-    MEM_ANALYSIS_INFO iot_mem_info;
-    memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
+// Returns 0 once the hub has read every response
+static int get_hub_results(const CONNECTION_INFO* conn_info, const SCENARIO_INFO* scenario, METHOD_RESULT* method_result)
+{
+    int result;
+    char response[HUB_CONTROL_RESPONSE_LEN];
+    uint64_t value;
 
-    if ((iothub_transport = initialize(&iot_mem_info, protocol, num_msgs_to_send)) == NULL)
+    if (conn_info->hub_control == NULL)
+    {
+        result = 0;
+    }
+    else if (hub_control_execute(conn_info->hub_control, "STATS", response, sizeof(response)) != 0 ||
+        hub_control_get_value(response, "method_completed", &method_result->method_completed) != 0 ||
+        hub_control_get_value(response, "method_inflight_max", &method_result->method_inflight_max) != 0)
+    {
+        result = __LINE__;
+    }
+    else if (method_result->method_completed < scenario->msg_count)
     {
-        (void)printf("Failed setting transport failed\r\n");
         result = __LINE__;
     }
-    else if ((g_tick_counter_handle = tickcounter_create()) == NULL)
+    else if (hub_control_execute(conn_info->hub_control, "LATENCY METHOD", response, sizeof(response)) != 0)
     {
-        (void)printf("tickcounter_create failed\r\n");
         result = __LINE__;
     }
     else
     {
-        gballoc_resetMetrics();
-        iot_mem_info.operation_type = OPERATION_METHODS;
+        (void)hub_control_get_value(response, "count", &value);
+        method_result->latency.count = (size_t)value;
+        (void)hub_control_get_value(response, "min_ns", &method_result->latency.min_ns);
+        (void)hub_control_get_value(response, "avg_ns", &method_result->latency.avg_ns);
+        (void)hub_control_get_value(response, "p50_ns", &method_result->latency.p50_ns);
+        (void)hub_control_get_value(response, "p90_ns", &method_result->latency.p90_ns);
+        (void)hub_control_get_value(response, "p99_ns", &method_result->latency.p99_ns);
+        (void)hub_control_get_value(response, "max_ns", &method_result->latency.max_ns);
+        result = 0;
+    }
+    return result;
+}
 
-        IOTHUB_CLIENT_INFO iothub_info;
-        memset(&iothub_info, 0, sizeof(IOTHUB_CLIENT_INFO));
+static void report_method_usage(REPORT_HANDLE report_handle, const MEM_ANALYSIS_INFO* iot_mem_info, const IOTHUB_CLIENT_INFO* iothub_info, const METHOD_RESULT* method_result)
+{
+    REPORT_METRIC metrics[METHOD_METRIC_COUNT];
+    size_t count = 0;
+    // The metrics were reset at the baseline so the maximum is the peak of the invocations
+    size_t peak_memory = gballoc_getMaximumMemoryUsed();
+    size_t peak_delta = peak_memory > method_result->baseline_memory ? peak_memory - method_result->baseline_memory : 0;
+    uint64_t network_bytes = get_network_bytes() - method_result->baseline_bytes;
+    size_t completed = method_result->method_completed > 0 ? (size_t)method_result->method_completed : iothub_info->method_count;
 
-        // Sending the iothub messages
-        IOTHUB_CLIENT_LL_HANDLE iothub_client;
-        if ((iothub_client = IoTHubClient_LL_CreateFromConnectionString(conn_string, iothub_transport) ) == NULL)
-        {
-            (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_string);
-            result = __LINE__;
-        }
-        else if (IoTHubClient_LL_SetDeviceMethodCallback(iothub_client, device_method_callback, &iothub_info) != IOTHUB_CLIENT_OK)
+    metrics[count].name = "methodsInvoked";
+    metrics[count++].value = (double)iothub_info->method_count;
+    metrics[count].name = "methodsCompleted";
+    metrics[count++].value = (double)completed;
+    metrics[count].name = "heapBaseline";
+    metrics[count++].value = (double)method_result->baseline_memory;
+    metrics[count].name = "peakHeapDelta";
+    metrics[count++].value = (double)peak_delta;
+    // The hub knows how many calls were waiting on a response at the same time
+    metrics[count].name = "inflightMax";
+    metrics[count++].value = (double)method_result->method_inflight_max;
+    // The most calls the device held at once, and what each of them costs on the heap
+    // above the baseline, as the dispatch heap of c2d is per message
+    metrics[count].name = "deviceInflightMax";
+    metrics[count++].value = (double)iothub_info->inflight_max;
+    metrics[count].name = "heapPerInflight";
+    metrics[count++].value = iothub_info->inflight_max == 0 ? 0.0 : (double)peak_delta / iothub_info->inflight_max;
+    metrics[count].name = "networkBytesPerCall";
+    metrics[count++].value = completed == 0 ? 0.0 : (double)network_bytes / completed;
+    count += latency_stats_fill_metrics(&method_result->latency, &metrics[count]);
+
+    report_metrics(report_handle, iot_mem_info, METHOD_REPORT_NAME, metrics, count);
+}
+
+int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario)
+{
+    int result;
+    HTTP_PROXY_OPTIONS proxy_options;
+    char proxy_host[MAX_PROXY_HOST_LEN];
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
+
+    MEM_ANALYSIS_INFO iot_mem_info;
+    memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
+
+    if ((iothub_transport = initialize(&iot_mem_info, protocol, scenario->msg_count)) == NULL)
+    {
+        (void)printf("Failed setting transport failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        IOTHUB_CLIENT_INFO iothub_info;
+        if (initialize_client_info(&iothub_info, scenario->msg_count) != 0)
         {
-            (void)printf("failed setting device method callback!\r\n");
             result = __LINE__;
         }
         else
         {
-            result = 0;
-            int sent_device_method_msg = 0;
-
-            (void)IoTHubClient_LL_SetOption(iothub_client, OPTION_TRUSTED_CERT, certificates);
+            gballoc_resetMetrics();
+            iot_mem_info.operation_type = OPERATION_MEMORY;
+            iot_mem_info.feature_type = FEATURE_METHODS_LL;
 
-            
-            do
+            IOTHUB_CLIENT_LL_HANDLE iothub_client;
+            if ((iothub_client = IoTHubClient_LL_CreateFromConnectionString(conn_info->device_conn_string, iothub_transport) ) == NULL)
+            {
+                (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_info->device_conn_string);
+                result = __LINE__;
+            }
+            else
             {
-                if (iothub_info.connected == 1 && sent_device_method_msg == 0)
+                (void)IoTHubClient_LL_SetConnectionStatusCallback(iothub_client, iothub_connection_status, &iothub_info);
+
+                // Always set the cert so we can compare apples to apples
+                (void)IoTHubClient_LL_SetOption(iothub_client, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+                if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
                 {
-                    if (send_device_method_message() == 0)
+                    (void)IoTHubClient_LL_SetOption(iothub_client, OPTION_HTTP_PROXY, &proxy_options);
+                }
+
+                if (IoTHubClient_LL_SetDeviceMethodCallback_Ex(iothub_client, device_method_callback, &iothub_info) != IOTHUB_CLIENT_OK)
+                {
+                    (void)printf("failed setting device method callback!\r\n");
+                    result = __LINE__;
+                }
+                else
+                {
+                    uint64_t start_time = latency_stats_get_time_ns();
+                    do
+                    {
+                        IoTHubClient_LL_DoWork(iothub_client);
+                        ThreadAPI_Sleep(1);
+                    } while (iothub_info.connected == 0 && iothub_info.stop_running == 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < CONNECT_TIMEOUT_MS);
+
+                    if (iothub_info.connected == 0)
+                    {
+                        (void)printf("Failed connecting to the hub\r\n");
+                        result = __LINE__;
+                    }
+                    else
                     {
-                        sent_device_method_msg = 1;
+                        METHOD_RESULT method_result;
+                        memset(&method_result, 0, sizeof(METHOD_RESULT));
+                        gballoc_resetMetrics();
+                        method_result.baseline_memory = gballoc_getCurrentMemoryUsed();
+                        method_result.baseline_bytes = get_network_bytes();
+
+                        if (request_methods(conn_info, scenario) != 0)
+                        {
+                            result = __LINE__;
+                        }
+                        else
+                        {
+                            size_t timeout_ms = get_invoke_timeout_ms(scenario);
+                            start_time = latency_stats_get_time_ns();
+                            do
+                            {
+                                IoTHubClient_LL_DoWork(iothub_client);
+                                respond_methods_ll(iothub_client, &iothub_info);
+                                ThreadAPI_Sleep(1);
+                            } while (iothub_info.stop_running == 0 && iothub_info.method_count < scenario->msg_count && (latency_stats_get_time_ns() - start_time) / 1000000 < timeout_ms);
+
+                            // Keep sending the responses until the hub has seen all of them
+                            start_time = latency_stats_get_time_ns();
+                            do
+                            {
+                                for (size_t index = 0; index < 10; index++)
+                                {
+                                    IoTHubClient_LL_DoWork(iothub_client);
+                                    respond_methods_ll(iothub_client, &iothub_info);
+                                    ThreadAPI_Sleep(1);
+                                }
+                            } while (get_hub_results(conn_info, scenario, &method_result) != 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < COMPLETE_TIMEOUT_MS);
+
+                            report_method_usage(report_handle, &iot_mem_info, &iothub_info, &method_result);
+                            result = 0;
+                        }
                     }
                 }
-                IoTHubClient_LL_DoWork(iothub_client);
-                ThreadAPI_Sleep(1);
-            } while (iothub_info.stop_running == 0);
+                IoTHubClient_LL_Destroy(iothub_client);
 
-            size_t index = 0;
-            for (index = 0; index < 10; index++)
-            {
-                IoTHubClient_LL_DoWork(iothub_client);
-                ThreadAPI_Sleep(1);
+                report_memory_usage(report_handle, &iot_mem_info);
             }
-            IoTHubClient_LL_Destroy(iothub_client);
-
-            memory_cb(&iot_mem_info);
+            deinitialize_client_info(&iothub_info);
         }
-        tickcounter_destroy(g_tick_counter_handle);
     }
     return result;
 }
 
-int send_upper_level_operation(const char* conn_string, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg, memory_usage_callback mem_cb)
+int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario)
 {
     int result;
-    (void)use_byte_array_msg;
-    (void)protocol;
-    if (conn_string == NULL || num_msgs_to_send == 0 || mem_cb == NULL)
+    HTTP_PROXY_OPTIONS proxy_options;
+    char proxy_host[MAX_PROXY_HOST_LEN];
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
+
+    MEM_ANALYSIS_INFO iot_mem_info;
+    memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
+
+    if ((iothub_transport = initialize(&iot_mem_info, protocol, scenario->msg_count)) == NULL)
     {
+        (void)printf("Failed setting transport failed\r\n");
         result = __LINE__;
     }
     else
     {
-        result = 0;
+        IOTHUB_CLIENT_INFO iothub_info;
+        if (initialize_client_info(&iothub_info, scenario->msg_count) != 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            gballoc_resetMetrics();
+            iot_mem_info.operation_type = OPERATION_MEMORY;
+            iot_mem_info.feature_type = FEATURE_METHODS_UL;
+
+            IOTHUB_CLIENT_HANDLE iothub_client;
+            if ((iothub_client = IoTHubClient_CreateFromConnectionString(conn_info->device_conn_string, iothub_transport)) == NULL)
+            {
+                (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_info->device_conn_string);
+                result = __LINE__;
+            }
+            else
+            {
+                (void)IoTHubClient_SetConnectionStatusCallback(iothub_client, iothub_connection_status, &iothub_info);
+
+                // Always set the cert so we can compare apples to apples
+                (void)IoTHubClient_SetOption(iothub_client, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+                if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
+                {
+                    (void)IoTHubClient_SetOption(iothub_client, OPTION_HTTP_PROXY, &proxy_options);
+                }
+
+                if (IoTHubClient_SetDeviceMethodCallback_Ex(iothub_client, device_method_callback, &iothub_info) != IOTHUB_CLIENT_OK)
+                {
+                    (void)printf("failed setting device method callback!\r\n");
+                    result = __LINE__;
+                }
+                else
+                {
+                    uint64_t start_time = latency_stats_get_time_ns();
+                    while (iothub_info.connected == 0 && iothub_info.stop_running == 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < CONNECT_TIMEOUT_MS)
+                    {
+                        ThreadAPI_Sleep(UL_WAIT_SLEEP_MS);
+                    }
+
+                    if (iothub_info.connected == 0)
+                    {
+                        (void)printf("Failed connecting to the hub\r\n");
+                        result = __LINE__;
+                    }
+                    else
+                    {
+                        METHOD_RESULT method_result;
+                        memset(&method_result, 0, sizeof(METHOD_RESULT));
+                        gballoc_resetMetrics();
+                        method_result.baseline_memory = gballoc_getCurrentMemoryUsed();
+                        method_result.baseline_bytes = get_network_bytes();
+
+                        if (request_methods(conn_info, scenario) != 0)
+                        {
+                            result = __LINE__;
+                        }
+                        else
+                        {
+                            size_t timeout_ms = get_invoke_timeout_ms(scenario);
+                            start_time = latency_stats_get_time_ns();
+                            while (iothub_info.stop_running == 0 && iothub_info.method_count < scenario->msg_count && (latency_stats_get_time_ns() - start_time) / 1000000 < timeout_ms)
+                            {
+                                respond_methods_ul(iothub_client, &iothub_info);
+                                ThreadAPI_Sleep(UL_WAIT_SLEEP_MS);
+                            }
+
+                            start_time = latency_stats_get_time_ns();
+                            do
+                            {
+                                respond_methods_ul(iothub_client, &iothub_info);
+                                ThreadAPI_Sleep(UL_WAIT_SLEEP_MS);
+                            } while (get_hub_results(conn_info, scenario, &method_result) != 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < COMPLETE_TIMEOUT_MS);
+
+                            report_method_usage(report_handle, &iot_mem_info, &iothub_info, &method_result);
+                            result = 0;
+                        }
+                    }
+                }
+                IoTHubClient_Destroy(iothub_client);
+
+                report_memory_usage(report_handle, &iot_mem_info);
+            }
+            deinitialize_client_info(&iothub_info);
+        }
     }
-    return 0;
+    return result;
 }
@@ -7,6 +7,12 @@
     #include "sdk_mem_analytics.h"
 #elif USE_C2D
     #include "c2d_mem_analytics.h"
+#elif USE_METHODS
+    #include "sdk_mem_analytics.h"
+#elif USE_TWIN
+    #include "twin_mem_analytics.h"
+#elif USE_THROUGHPUT
+    #include "throughput_mem_analytics.h"
 #elif USE_PROVISIONING
     #include "provisioning_mem.h"
 #elif USE_NETWORKING
@@ -18,6 +24,7 @@
 #endif
 
 #include "azure_c_shared_utility/connection_string_parser.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/platform.h"
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/gbnetwork.h"
@@ -25,10 +32,17 @@
 #include "iothub_service_client_auth.h"
 #include "iothub_registrymanager.h"
 
+#include "hub_control.h"
+
 static const char* DEVICE_CONNECTION_STRING_FMT = "HostName=%s;DeviceId=%s;SharedAccessKey=%s";
+static const char* ANALYTICS_DEVICE_ID = "mem_analytics_device";
 
 #define USE_MSG_BYTE_ARRAY  1
-#define MESSAGES_TO_USE    1
+#define DEVICE_CREATED_REGISTRY 1
+#define DEVICE_CREATED_LOCAL    2
+#define MAX_DEVICE_KEY_LEN      128
+#define MESSAGES_TO_USE     1
+#define DEFAULT_PAYLOAD_SIZE    128
 
 typedef enum ARGUEMENT_TYPE_TAG
 {
@@ -36,13 +50,22 @@ typedef enum ARGUEMENT_TYPE_TAG
     ARGUEMENT_TYPE_CONNECTION_STRING,
     ARGUEMENT_TYPE_SCOPE_ID,
     ARGUEMENT_TYPE_DEVICE_ID,
-    ARGUEMENT_TYPE_DEVICE_KEY
+    ARGUEMENT_TYPE_DEVICE_KEY,
+    ARGUEMENT_TYPE_OUTPUT_FILE,
+    ARGUEMENT_TYPE_TRUSTED_CERT,
+    ARGUEMENT_TYPE_HUB_CONTROL,
+    ARGUEMENT_TYPE_MSG_COUNT,
+    ARGUEMENT_TYPE_PAYLOAD_SIZE,
+    ARGUEMENT_TYPE_MSG_RATE,
+    ARGUEMENT_TYPE_HTTP_PROXY
 } ARGUEMENT_TYPE;
 
 typedef struct MEM_ANALYTIC_INFO_TAG
 {
     int create_device;
     const char* connection_string;
+    const char* output_file;
+    const char* trusted_cert_file;
     IOTHUB_DEVICE device_info;
 } MEM_ANALYTIC_INFO;
 
@@ -95,7 +118,7 @@ static int create_device(MEM_ANALYTIC_INFO* mem_info)
             IOTHUB_REGISTRY_DEVICE_CREATE register_device;
             memset(&register_device, 0, sizeof(register_device));
 
-            register_device.deviceId = "mem_analytics_device";
+            register_device.deviceId = ANALYTICS_DEVICE_ID;
             register_device.primaryKey = "";
             register_device.secondaryKey = "";
             register_device.authMethod = IOTHUB_REGISTRYMANAGER_AUTH_SPK;
@@ -107,7 +130,7 @@ static int create_device(MEM_ANALYTIC_INFO* mem_info)
             }
             else
             {
-                mem_info->create_device = 1;
+                mem_info->create_device = DEVICE_CREATED_REGISTRY;
                 result = 0;
             }
             IoTHubRegistryManager_Destroy(reg_mgr_handle);
@@ -117,6 +140,37 @@ static int create_device(MEM_ANALYTIC_INFO* mem_info)
     return result;
 }
 
+// The local hub keeps its own registry, the device is created over the control channel
+static int create_local_device(MEM_ANALYTIC_INFO* mem_info, const CONNECTION_INFO* conn_info)
+{
+    int result;
+    char command[HUB_CONTROL_RESPONSE_LEN];
+    char response[HUB_CONTROL_RESPONSE_LEN];
+    char device_key[MAX_DEVICE_KEY_LEN];
+
+    (void)snprintf(command, sizeof(command), "DEVICE %s", ANALYTICS_DEVICE_ID);
+    if (hub_control_execute(conn_info->hub_control, command, response, sizeof(response)) != 0 ||
+        hub_control_get_string(response, "key", device_key, sizeof(device_key)) != 0)
+    {
+        (void)printf("Failed creating device on the local hub\r\n");
+        result = __LINE__;
+    }
+    else if (mallocAndStrcpy_s((char**)&mem_info->device_info.deviceId, ANALYTICS_DEVICE_ID) != 0 ||
+        mallocAndStrcpy_s((char**)&mem_info->device_info.primaryKey, device_key) != 0)
+    {
+        (void)printf("Failure allocating local device info\r\n");
+        free((char*)mem_info->device_info.deviceId);
+        mem_info->device_info.deviceId = NULL;
+        result = __LINE__;
+    }
+    else
+    {
+        mem_info->create_device = DEVICE_CREATED_LOCAL;
+        result = 0;
+    }
+    return result;
+}
+
 static void remove_device(MEM_ANALYTIC_INFO* mem_info)
 {
     IOTHUB_SERVICE_CLIENT_AUTH_HANDLE svc_client_handle = IoTHubServiceClientAuth_CreateFromConnectionString(mem_info->connection_string);
@@ -215,9 +269,43 @@ static int construct_dev_conn_string(MEM_ANALYTIC_INFO* mem_info, CONNECTION_INF
     return result;
 }
 
-static int parse_command_line(int argc, char* argv[], MEM_ANALYTIC_INFO* mem_info, CONNECTION_INFO* conn_info)
+static char* load_trusted_cert(const char* cert_file)
 {
-    // -c "[connection_string]" -d [device_name] -k [device_key] 
+    char* result = NULL;
+    FILE* file = fopen(cert_file, "rb");
+    if (file == NULL)
+    {
+        (void)printf("Failure opening certificate file %s\r\n", cert_file);
+    }
+    else
+    {
+        long file_len;
+        if (fseek(file, 0, SEEK_END) != 0 || (file_len = ftell(file)) <= 0 || fseek(file, 0, SEEK_SET) != 0)
+        {
+            (void)printf("Failure reading certificate file %s\r\n", cert_file);
+        }
+        else if ((result = malloc(file_len + 1)) == NULL)
+        {
+            (void)printf("Failure allocating certificate\r\n");
+        }
+        else if (fread(result, 1, file_len, file) != (size_t)file_len)
+        {
+            (void)printf("Failure reading certificate file %s\r\n", cert_file);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result[file_len] = '\0';
+        }
+        fclose(file);
+    }
+    return result;
+}
+
+static int parse_command_line(int argc, char* argv[], MEM_ANALYTIC_INFO* mem_info, CONNECTION_INFO* conn_info, SCENARIO_INFO* scenario)
+{
+    // -c "[connection_string]" -d [device_name] -k [device_key] -o [output_file] -t [trusted_cert_file] -l [hub_control] -n [msg_count] -p [payload_size] -r [msg_rate] -e [http_proxy]
     int result = 0;
     ARGUEMENT_TYPE argument_type = ARGUEMENT_TYPE_UNKNOWN;
 
@@ -241,6 +329,34 @@ static int parse_command_line(int argc, char* argv[], MEM_ANALYTIC_INFO* mem_inf
             {
                 argument_type = ARGUEMENT_TYPE_SCOPE_ID;
             }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'o' || argv[index][1] == 'O'))
+            {
+                argument_type = ARGUEMENT_TYPE_OUTPUT_FILE;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 't' || argv[index][1] == 'T'))
+            {
+                argument_type = ARGUEMENT_TYPE_TRUSTED_CERT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'l' || argv[index][1] == 'L'))
+            {
+                argument_type = ARGUEMENT_TYPE_HUB_CONTROL;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'n' || argv[index][1] == 'N'))
+            {
+                argument_type = ARGUEMENT_TYPE_MSG_COUNT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'p' || argv[index][1] == 'P'))
+            {
+                argument_type = ARGUEMENT_TYPE_PAYLOAD_SIZE;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'r' || argv[index][1] == 'R'))
+            {
+                argument_type = ARGUEMENT_TYPE_MSG_RATE;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'e' || argv[index][1] == 'E'))
+            {
+                argument_type = ARGUEMENT_TYPE_HTTP_PROXY;
+            }
         }
         else
         {
@@ -258,6 +374,27 @@ static int parse_command_line(int argc, char* argv[], MEM_ANALYTIC_INFO* mem_inf
                 case ARGUEMENT_TYPE_SCOPE_ID:
                     conn_info->scope_id = argv[index];
                     break;
+                case ARGUEMENT_TYPE_OUTPUT_FILE:
+                    mem_info->output_file = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_TRUSTED_CERT:
+                    mem_info->trusted_cert_file = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_HUB_CONTROL:
+                    conn_info->hub_control = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_MSG_COUNT:
+                    scenario->msg_count = (size_t)atoi(argv[index]);
+                    break;
+                case ARGUEMENT_TYPE_PAYLOAD_SIZE:
+                    scenario->payload_size = (size_t)atoi(argv[index]);
+                    break;
+                case ARGUEMENT_TYPE_MSG_RATE:
+                    scenario->msg_rate = (size_t)atoi(argv[index]);
+                    break;
+                case ARGUEMENT_TYPE_HTTP_PROXY:
+                    conn_info->http_proxy = argv[index];
+                    break;
                 case ARGUEMENT_TYPE_UNKNOWN:
                 default:
                     result = __LINE__;
@@ -267,7 +404,15 @@ static int parse_command_line(int argc, char* argv[], MEM_ANALYTIC_INFO* mem_inf
         }
     }
 
-    if (mem_info->device_info.deviceId == NULL && conn_info->scope_id == NULL)
+    if (result == 0 && mem_info->trusted_cert_file != NULL && (conn_info->trusted_cert = load_trusted_cert(mem_info->trusted_cert_file)) == NULL)
+    {
+        result = __LINE__;
+    }
+    else if (result == 0 && mem_info->device_info.deviceId == NULL && conn_info->scope_id == NULL && conn_info->hub_control != NULL)
+    {
+        result = create_local_device(mem_info, conn_info);
+    }
+    else if (result == 0 && mem_info->device_info.deviceId == NULL && conn_info->scope_id == NULL)
     {
 #ifdef USE_HTTP
         result = create_device(mem_info);
@@ -278,36 +423,36 @@ static int parse_command_line(int argc, char* argv[], MEM_ANALYTIC_INFO* mem_inf
     return result;
 }
 
-static void send_heap_info(CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle)
+static void send_heap_info(CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, const SCENARIO_INFO* scenario)
 {
     // MQTT Sending
 #ifdef USE_MQTT
-    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_MQTT, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY);
-    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_MQTT_WS, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY);
+    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_MQTT, scenario);
+    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_MQTT_WS, scenario);
 #endif
     // AMQP Sending
 #ifdef USE_AMQP
-    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_AMQP, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY);
-    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_AMQP_WS, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY);
+    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_AMQP, scenario);
+    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_AMQP_WS, scenario);
 #endif
     // HTTP Sending
 #ifdef USE_HTTP
-    //initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_HTTP, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY);
+    //initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_HTTP, scenario);
 #endif
 
     // MQTT Sending
 #ifdef USE_MQTT
-    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_MQTT, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY);
-    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_MQTT_WS, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY);
+    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_MQTT, scenario);
+    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_MQTT_WS, scenario);
 #endif
     // AMQP Sending
 #ifdef USE_AMQP
-    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_AMQP, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY);
-    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_AMQP_WS, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY);
+    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_AMQP, scenario);
+    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_AMQP_WS, scenario);
 #endif
     // HTTP Sending
 #ifdef USE_HTTP
-    //initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_HTTP, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY);
+    //initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_HTTP, scenario);
 #endif
 }
 
@@ -316,12 +461,17 @@ int main(int argc, char* argv[])
     int result;
     MEM_ANALYTIC_INFO mem_info;
     CONNECTION_INFO conn_info;
+    SCENARIO_INFO scenario;
     REPORT_HANDLE report_handle;
 
     memset(&mem_info, 0, sizeof(mem_info));
     memset(&conn_info, 0, sizeof(conn_info));
+    scenario.msg_count = MESSAGES_TO_USE;
+    scenario.payload_size = DEFAULT_PAYLOAD_SIZE;
+    scenario.msg_rate = 0;
+    scenario.use_byte_array_msg = USE_MSG_BYTE_ARRAY;
 
-    if (parse_command_line(argc, argv, &mem_info, &conn_info) != 0)
+    if (parse_command_line(argc, argv, &mem_info, &conn_info, &scenario) != 0)
     {
         (void)printf("Failure parsing command line\r\n");
         result = __LINE__;
@@ -345,11 +495,11 @@ int main(int argc, char* argv[])
     }
     else
     {
-        send_heap_info(&conn_info, report_handle);
+        send_heap_info(&conn_info, report_handle, &scenario);
 
         result = 0;
 
-        if (mem_info.create_device != 0)
+        if (mem_info.create_device == DEVICE_CREATED_REGISTRY)
         {
 #ifdef USE_HTTP
             remove_device(&mem_info);
@@ -360,7 +510,7 @@ int main(int argc, char* argv[])
         platform_deinit();
         gbnetwork_deinit();
 
-        report_write(report_handle, NULL, NULL);
+        report_write(report_handle, mem_info.output_file, NULL);
 
         report_deinitialize(report_handle);
 
@@ -370,6 +520,7 @@ int main(int argc, char* argv[])
             free((char*)mem_info.device_info.primaryKey);
         }
         free(conn_info.device_conn_string);
+        free((char*)conn_info.trusted_cert);
         free((char*)mem_info.device_info.secondaryKey);
         free((char*)mem_info.device_info.generationId);
         free((char*)mem_info.device_info.eTag);
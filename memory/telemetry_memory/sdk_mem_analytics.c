@@ -2,9 +2,13 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "sdk_mem_analytics.h"
 #include "mem_reporter.h"
+#include "alloc_tracker.h"
+#include "msg_latency.h"
+#include "latency_stats.h"
 
 #include "iothub_client.h"
 #include "iothub_message.h"
@@ -14,6 +18,7 @@
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/shared_util_options.h"
 #include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/gbnetwork.h"
 
 #include "iothubtransportmqtt.h"
 #include "iothubtransportmqtt_websockets.h"
@@ -28,6 +33,8 @@
 #define PROXY_PORT                  8888
 #define MESSAGES_TO_USE             1
 #define TIME_BETWEEN_MESSAGES       1
+#define CONFIRM_TIMEOUT_MS          30000
+#define MAX_PROXY_HOST_LEN          256
 
 typedef struct IOTHUB_CLIENT_SAMPLE_INFO_TAG
 {
@@ -72,6 +79,24 @@ static IOTHUB_CLIENT_TRANSPORT_PROVIDER initialize(MEM_ANALYSIS_INFO* iot_mem_in
     return result;
 }
 
+// The websocket and http transports reach the hub through the http proxy when one is
+// given, a local hub running without root only has its https port behind it
+static bool get_proxy_options(const CONNECTION_INFO* conn_info, PROTOCOL_TYPE protocol, char* proxy_host, size_t host_len, HTTP_PROXY_OPTIONS* proxy_options)
+{
+    bool result = false;
+    const char* port = conn_info->http_proxy == NULL ? NULL : strrchr(conn_info->http_proxy, ':');
+    if ((protocol == PROTOCOL_MQTT_WS || protocol == PROTOCOL_AMQP_WS || protocol == PROTOCOL_HTTP) && port != NULL && port != conn_info->http_proxy && (size_t)(port - conn_info->http_proxy) < host_len)
+    {
+        memcpy(proxy_host, conn_info->http_proxy, (size_t)(port - conn_info->http_proxy));
+        proxy_host[port - conn_info->http_proxy] = '\0';
+        memset(proxy_options, 0, sizeof(HTTP_PROXY_OPTIONS));
+        proxy_options->host_address = proxy_host;
+        proxy_options->port = atoi(port + 1);
+        result = true;
+    }
+    return result;
+}
+
 static void iothub_connection_status(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* user_context)
 {
     (void)reason;
@@ -94,16 +119,37 @@ static void iothub_connection_status(IOTHUB_CLIENT_CONNECTION_STATUS result, IOT
     }
 }
 
-int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg)
+// The lower layer only writes to the socket from DoWork. This app has no protocol
+// decoding, a DoWork that sent anything once the connection is authenticated is taken
+// as the moment the queued messages went on the wire
+static void do_work_and_track(IOTHUB_CLIENT_LL_HANDLE iothub_client, const IOTHUB_CLIENT_INFO* iothub_info, MSG_LATENCY_HANDLE msg_latency)
+{
+    uint64_t sends = gbnetwork_getNumSends();
+    IoTHubClient_LL_DoWork(iothub_client);
+    if (iothub_info->connected != 0 && gbnetwork_getNumSends() != sends)
+    {
+        msg_latency_dispatched(msg_latency);
+    }
+}
+
+static void send_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* user_context)
+{
+    msg_latency_confirmed(user_context, result == IOTHUB_CLIENT_CONFIRMATION_OK);
+}
+
+int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario)
 {
     int result;
+    HTTP_PROXY_OPTIONS proxy_options;
+    char proxy_host[MAX_PROXY_HOST_LEN];
     IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
 
     TICK_COUNTER_HANDLE tick_counter_handle;
+    MSG_LATENCY_HANDLE msg_latency;
     MEM_ANALYSIS_INFO iot_mem_info;
     memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
 
-    if ((iothub_transport = initialize(&iot_mem_info, protocol, num_msgs_to_send)) == NULL)
+    if ((iothub_transport = initialize(&iot_mem_info, protocol, scenario->msg_count)) == NULL)
     {
         (void)printf("Failed setting transport failed\r\n");
         result = __LINE__;
@@ -113,9 +159,16 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
         (void)printf("tickcounter_create failed\r\n");
         result = __LINE__;
     }
+    else if ((msg_latency = msg_latency_create(scenario->msg_count)) == NULL)
+    {
+        (void)printf("Failed creating message latency\r\n");
+        tickcounter_destroy(tick_counter_handle);
+        result = __LINE__;
+    }
     else
     {
         gballoc_resetMetrics();
+        alloc_tracker_reset();
         iot_mem_info.operation_type = OPERATION_MEMORY;
         iot_mem_info.feature_type = FEATURE_TELEMETRY_LL;
 
@@ -144,7 +197,11 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
             (void)IoTHubClient_LL_SetConnectionStatusCallback(iothub_client, iothub_connection_status, &iothub_info);
 
             // Set the certificate
-            IoTHubClient_LL_SetOption(iothub_client, OPTION_TRUSTED_CERT, certificates);
+            IoTHubClient_LL_SetOption(iothub_client, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+            if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
+            {
+                (void)IoTHubClient_LL_SetOption(iothub_client, OPTION_HTTP_PROXY, &proxy_options);
+            }
 
             do
             {
@@ -158,7 +215,7 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
                         sprintf_s(msgText, sizeof(msgText), "{ \"message_index\" : \"%zu\" }", msg_count++);
 
                         IOTHUB_MESSAGE_HANDLE msg_handle;
-                        if (use_byte_array_msg)
+                        if (scenario->use_byte_array_msg)
                         {
                             msg_handle = IoTHubMessage_CreateFromByteArray((const unsigned char*)msgText, strlen(msgText));
                         }
@@ -179,9 +236,11 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
 
                             (void)IoTHubMessage_SetProperty(msg_handle, "property_key", "property_value");
 
-                            if (IoTHubClient_LL_SendEventAsync(iothub_client, msg_handle, NULL, NULL) != IOTHUB_CLIENT_OK)
+                            void* msg_context = msg_latency_enqueue(msg_latency);
+                            if (IoTHubClient_LL_SendEventAsync(iothub_client, msg_handle, send_confirm_callback, msg_context) != IOTHUB_CLIENT_OK)
                             {
                                 (void)printf("ERROR: IoTHubClient_LL_SendEventAsync..........FAILED!\r\n");
+                                msg_latency_confirmed(msg_context, false);
                             }
                             else
                             {
@@ -191,9 +250,17 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
                         }
                     }
                 }
-                IoTHubClient_LL_DoWork(iothub_client);
+                do_work_and_track(iothub_client, &iothub_info, msg_latency);
                 ThreadAPI_Sleep(1);
-            } while (iothub_info.stop_running == 0 && msg_count < num_msgs_to_send);
+            } while (iothub_info.stop_running == 0 && msg_count < scenario->msg_count);
+
+            // Wait for the confirmations so every message has a latency
+            uint64_t confirm_start = latency_stats_get_time_ns();
+            while (iothub_info.stop_running == 0 && msg_latency_get_pending(msg_latency) > 0 && (latency_stats_get_time_ns() - confirm_start) / 1000000 < CONFIRM_TIMEOUT_MS)
+            {
+                do_work_and_track(iothub_client, &iothub_info, msg_latency);
+                ThreadAPI_Sleep(1);
+            }
 
             size_t index = 0;
             for (index = 0; index < 10; index++)
@@ -201,25 +268,32 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
                 IoTHubClient_LL_DoWork(iothub_client);
                 ThreadAPI_Sleep(1);
             }
+            // The live blocks are the ones the client holds while it is connected
+            alloc_tracker_report(report_handle, &iot_mem_info);
             IoTHubClient_LL_Destroy(iothub_client);
 
             report_memory_usage(report_handle, &iot_mem_info);
+            msg_latency_report(msg_latency, report_handle, &iot_mem_info);
         }
+        msg_latency_destroy(msg_latency);
         tickcounter_destroy(tick_counter_handle);
     }
     return result;
 }
 
-int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg)
+int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario)
 {
     int result;
+    HTTP_PROXY_OPTIONS proxy_options;
+    char proxy_host[MAX_PROXY_HOST_LEN];
     IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
 
     TICK_COUNTER_HANDLE tick_counter_handle;
+    MSG_LATENCY_HANDLE msg_latency;
     MEM_ANALYSIS_INFO iot_mem_info;
     memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
 
-    if ((iothub_transport = initialize(&iot_mem_info, protocol, num_msgs_to_send)) == NULL)
+    if ((iothub_transport = initialize(&iot_mem_info, protocol, scenario->msg_count)) == NULL)
     {
         (void)printf("Failed setting transport failed\r\n");
         result = __LINE__;
@@ -229,9 +303,16 @@ int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
         (void)printf("tickcounter_create failed\r\n");
         result = __LINE__;
     }
+    else if ((msg_latency = msg_latency_create(scenario->msg_count + 1)) == NULL)
+    {
+        (void)printf("Failed creating message latency\r\n");
+        tickcounter_destroy(tick_counter_handle);
+        result = __LINE__;
+    }
     else
     {
         gballoc_resetMetrics();
+        alloc_tracker_reset();
 
         iot_mem_info.operation_type = OPERATION_MEMORY;
         iot_mem_info.feature_type = FEATURE_TELEMETRY_UL;
@@ -263,7 +344,11 @@ int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
 
             //IoTHubClient_SetOption(iothub_client, "logtrace", &g_trace_on);
             // Always set the cert so we can compare apples to apples
-            IoTHubClient_SetOption(iothub_client, OPTION_TRUSTED_CERT, certificates);
+            IoTHubClient_SetOption(iothub_client, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+            if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
+            {
+                (void)IoTHubClient_SetOption(iothub_client, OPTION_HTTP_PROXY, &proxy_options);
+            }
 
             do
             {
@@ -277,7 +362,7 @@ int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
                         sprintf_s(msgText, sizeof(msgText), "{ \"message_index\" : \"%zu\" }", msg_count);
 
                         IOTHUB_MESSAGE_HANDLE msg_handle;
-                        if (use_byte_array_msg)
+                        if (scenario->use_byte_array_msg)
                         {
                             msg_handle = IoTHubMessage_CreateFromByteArray((const unsigned char*)msgText, strlen(msgText));
                         }
@@ -302,15 +387,17 @@ int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
                                 (void)printf("ERROR: Map_AddOrUpdate Failed!\r\n");
                             }
 
-                            if (IoTHubClient_SendEventAsync(iothub_client, msg_handle, NULL, NULL) != IOTHUB_CLIENT_OK)
+                            void* msg_context = msg_latency_enqueue(msg_latency);
+                            if (IoTHubClient_SendEventAsync(iothub_client, msg_handle, send_confirm_callback, msg_context) != IOTHUB_CLIENT_OK)
                             {
                                 (void)printf("ERROR: IoTHubClient_SendEventAsync..........FAILED!\r\n");
+                                msg_latency_confirmed(msg_context, false);
                             }
                             else
                             {
                                 msg_count++;
                                 (void)tickcounter_get_current_ms(tick_counter_handle, &last_send_time);
-                                if (msg_count > num_msgs_to_send)
+                                if (msg_count > scenario->msg_count)
                                 {
                                     iothub_info.stop_running = 1;
                                 }
@@ -321,13 +408,22 @@ int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
                 }
             } while (iothub_info.stop_running == 0);
 
-            // Give it a few seconds to send the message
+            // Give it a few seconds to send the message, longer if confirmations are still missing
             ThreadAPI_Sleep(5000);
+            uint64_t confirm_start = latency_stats_get_time_ns();
+            while (msg_latency_get_pending(msg_latency) > 0 && (latency_stats_get_time_ns() - confirm_start) / 1000000 < CONFIRM_TIMEOUT_MS)
+            {
+                ThreadAPI_Sleep(10);
+            }
 
+            // The live blocks are the ones the client holds while it is connected
+            alloc_tracker_report(report_handle, &iot_mem_info);
             IoTHubClient_Destroy(iothub_client);
 
             report_memory_usage(report_handle, &iot_mem_info);
+            msg_latency_report(msg_latency, report_handle, &iot_mem_info);
         }
+        msg_latency_destroy(msg_latency);
         tickcounter_destroy(tick_counter_handle);
     }
     return result;
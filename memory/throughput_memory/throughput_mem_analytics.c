@@ -0,0 +1,587 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "throughput_mem_analytics.h"
+#include "latency_stats.h"
+
+#include "iothub_client.h"
+#include "iothub_message.h"
+
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/shared_util_options.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/gbnetwork.h"
+#include "azure_c_shared_utility/lock.h"
+
+#ifdef USE_MQTT
+    #include "iothubtransportmqtt.h"
+    #include "iothubtransportmqtt_websockets.h"
+#endif
+#ifdef USE_AMQP
+    #include "iothubtransportamqp.h"
+    #include "iothubtransportamqp_websockets.h"
+#endif
+
+#include "../certs/certs.h"
+
+#include "iothub_client_version.h"
+
+#define CONNECT_TIMEOUT_MS          30000
+#define DRAIN_TIMEOUT_MS            30000
+#define STEP_DURATION_MS            3000
+// Binary search steps between 0 and the saturation rate, each one halves the uncertainty
+#define SEARCH_STEPS                6
+#define SEARCH_HEADROOM             1.2
+// Outstanding messages while pushing as fast as the client accepts them
+#define SATURATION_QUEUE_LIMIT      5000
+// A rate is sustainable when at least MIN_DELIVERY_RATIO of it is confirmed and the
+// queue holds no more than QUEUE_BOUND_MS worth of it at the end of the step
+#define MIN_DELIVERY_RATIO          0.95
+#define QUEUE_BOUND_MS              500
+#define QUEUE_BOUND_MIN             10
+#define SEND_BURST                  16
+#define MAX_PAYLOAD_SIZE            (256 * 1024)
+#define NS_PER_MS                   1000000
+#define NS_PER_US                   1000.0
+#define NS_PER_SEC                  1000000000.0
+#define THROUGHPUT_METRIC_COUNT     16
+#define MAX_PROXY_HOST_LEN          256
+
+static const char* const THROUGHPUT_REPORT_NAME = "THROUGHPUT";
+
+// Outside of gballoc so the payload is not part of the heap at saturation
+static unsigned char g_payload[MAX_PAYLOAD_SIZE];
+
+typedef struct IOTHUB_CLIENT_INFO_TAG
+{
+    int connected;
+    int stop_running;
+    size_t enqueued;
+    // The upper layer confirms on its worker thread, the lock covers confirmed and failed
+    LOCK_HANDLE lock;
+    size_t confirmed;
+    size_t failed;
+} IOTHUB_CLIENT_INFO;
+
+typedef struct THROUGHPUT_CLIENT_TAG
+{
+    // Only one of the handles is set
+    IOTHUB_CLIENT_LL_HANDLE ll_handle;
+    IOTHUB_CLIENT_HANDLE ul_handle;
+    size_t payload_size;
+    IOTHUB_CLIENT_INFO info;
+} THROUGHPUT_CLIENT;
+
+typedef struct STEP_RESULT_TAG
+{
+    // Messages per second, 0 pushes as fast as the client accepts them
+    double offered_rate;
+    size_t sent;
+    size_t confirmed;
+    size_t failed;
+    size_t queue_peak;
+    size_t queue_end;
+    // gballoc is reset when the step starts, the peak is its maximum at the end
+    size_t start_memory;
+    size_t peak_memory;
+    uint64_t bytes_sent;
+    uint64_t cpu_ns;
+    uint64_t duration_ns;
+} STEP_RESULT;
+
+static IOTHUB_CLIENT_TRANSPORT_PROVIDER initialize(MEM_ANALYSIS_INFO* iot_mem_info, PROTOCOL_TYPE protocol)
+{
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER result;
+    iot_mem_info->iothub_version = IoTHubClient_GetVersionString();
+
+    iot_mem_info->iothub_protocol = protocol;
+    switch (protocol)
+    {
+#ifdef USE_MQTT
+        case PROTOCOL_MQTT:
+            result = MQTT_Protocol;
+            break;
+        case PROTOCOL_MQTT_WS:
+            result = MQTT_WebSocket_Protocol;
+            break;
+#endif
+#ifdef USE_AMQP
+        case PROTOCOL_AMQP:
+            result = AMQP_Protocol;
+            break;
+        case PROTOCOL_AMQP_WS:
+            result = AMQP_Protocol_over_WebSocketsTls;
+            break;
+#endif
+        default:
+            result = NULL;
+            break;
+    }
+    return result;
+}
+
+// The websocket and http transports reach the hub through the http proxy when one is
+// given, mqtt and amqp are pointed at the proxy's port forwards instead
+static bool get_proxy_options(const CONNECTION_INFO* conn_info, PROTOCOL_TYPE protocol, char* proxy_host, size_t host_len, HTTP_PROXY_OPTIONS* proxy_options)
+{
+    bool result = false;
+    const char* port = conn_info->http_proxy == NULL ? NULL : strrchr(conn_info->http_proxy, ':');
+    if ((protocol == PROTOCOL_MQTT_WS || protocol == PROTOCOL_AMQP_WS || protocol == PROTOCOL_HTTP) && port != NULL && port != conn_info->http_proxy && (size_t)(port - conn_info->http_proxy) < host_len)
+    {
+        memcpy(proxy_host, conn_info->http_proxy, (size_t)(port - conn_info->http_proxy));
+        proxy_host[port - conn_info->http_proxy] = '\0';
+        memset(proxy_options, 0, sizeof(HTTP_PROXY_OPTIONS));
+        proxy_options->host_address = proxy_host;
+        proxy_options->port = atoi(port + 1);
+        result = true;
+    }
+    return result;
+}
+
+static void iothub_connection_status(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* user_context)
+{
+    (void)reason;
+    if (user_context == NULL)
+    {
+        (void)printf("iothub_connection_status user_context is NULL\r\n");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INFO* iothub_info = (IOTHUB_CLIENT_INFO*)user_context;
+        if (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED)
+        {
+            iothub_info->connected = 1;
+        }
+        else
+        {
+            iothub_info->connected = 0;
+            iothub_info->stop_running = 1;
+        }
+    }
+}
+
+static void send_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* user_context)
+{
+    IOTHUB_CLIENT_INFO* iothub_info = (IOTHUB_CLIENT_INFO*)user_context;
+    if (Lock(iothub_info->lock) != LOCK_OK)
+    {
+        (void)printf("Failure locking the confirmation counters\r\n");
+    }
+    else
+    {
+        if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+        {
+            iothub_info->confirmed++;
+        }
+        else
+        {
+            iothub_info->failed++;
+        }
+        (void)Unlock(iothub_info->lock);
+    }
+}
+
+static void get_confirm_counts(IOTHUB_CLIENT_INFO* iothub_info, size_t* confirmed, size_t* failed)
+{
+    if (Lock(iothub_info->lock) != LOCK_OK)
+    {
+        (void)printf("Failure locking the confirmation counters\r\n");
+        *confirmed = 0;
+        *failed = 0;
+    }
+    else
+    {
+        *confirmed = iothub_info->confirmed;
+        *failed = iothub_info->failed;
+        (void)Unlock(iothub_info->lock);
+    }
+}
+
+// Only the sending thread changes enqueued
+static size_t get_queue_length(IOTHUB_CLIENT_INFO* iothub_info)
+{
+    size_t confirmed;
+    size_t failed;
+    get_confirm_counts(iothub_info, &confirmed, &failed);
+    return iothub_info->enqueued - confirmed - failed;
+}
+
+static int send_message(THROUGHPUT_CLIENT* client)
+{
+    int result;
+    IOTHUB_MESSAGE_HANDLE msg_handle;
+    if ((msg_handle = IoTHubMessage_CreateFromByteArray(g_payload, client->payload_size)) == NULL)
+    {
+        (void)printf("ERROR: iotHubMessageHandle is NULL!\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        IOTHUB_CLIENT_RESULT send_result;
+        // Count it first, on the upper layer the confirmation can come back before SendEventAsync returns
+        client->info.enqueued++;
+        if (client->ll_handle != NULL)
+        {
+            send_result = IoTHubClient_LL_SendEventAsync(client->ll_handle, msg_handle, send_confirm_callback, &client->info);
+        }
+        else
+        {
+            send_result = IoTHubClient_SendEventAsync(client->ul_handle, msg_handle, send_confirm_callback, &client->info);
+        }
+        if (send_result != IOTHUB_CLIENT_OK)
+        {
+            (void)printf("ERROR: IoTHubClient_SendEventAsync..........FAILED!\r\n");
+            client->info.enqueued--;
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+        IoTHubMessage_Destroy(msg_handle);
+    }
+    return result;
+}
+
+static void do_work(THROUGHPUT_CLIENT* client, bool idle)
+{
+    if (client->ll_handle != NULL)
+    {
+        IoTHubClient_LL_DoWork(client->ll_handle);
+    }
+    if (idle)
+    {
+        ThreadAPI_Sleep(1);
+    }
+}
+
+static bool wait_for_connection(THROUGHPUT_CLIENT* client)
+{
+    uint64_t start_time = latency_stats_get_time_ns();
+    while (client->info.connected == 0 && client->info.stop_running == 0 && (latency_stats_get_time_ns() - start_time) / NS_PER_MS < CONNECT_TIMEOUT_MS)
+    {
+        do_work(client, true);
+    }
+    return client->info.connected != 0;
+}
+
+// Every step starts with an empty queue so a backlog doesn't carry over into the next rate
+static bool drain_queue(THROUGHPUT_CLIENT* client)
+{
+    uint64_t start_time = latency_stats_get_time_ns();
+    while (client->info.stop_running == 0 && get_queue_length(&client->info) > 0 && (latency_stats_get_time_ns() - start_time) / NS_PER_MS < DRAIN_TIMEOUT_MS)
+    {
+        do_work(client, true);
+    }
+    return client->info.stop_running == 0 && get_queue_length(&client->info) == 0;
+}
+
+static void run_step(THROUGHPUT_CLIENT* client, double msg_rate, STEP_RESULT* step)
+{
+    IOTHUB_CLIENT_INFO* iothub_info = &client->info;
+    size_t start_enqueued = iothub_info->enqueued;
+    size_t start_confirmed;
+    size_t start_failed;
+    size_t end_confirmed;
+    size_t end_failed;
+    uint64_t start_bytes = gbnetwork_getBytesSent();
+    uint64_t start_cpu = latency_stats_get_process_cpu_ns();
+    uint64_t start_time = latency_stats_get_time_ns();
+    uint64_t elapsed;
+
+    get_confirm_counts(iothub_info, &start_confirmed, &start_failed);
+    memset(step, 0, sizeof(STEP_RESULT));
+    step->offered_rate = msg_rate;
+    gballoc_resetMetrics();
+    step->start_memory = gballoc_getCurrentMemoryUsed();
+
+    while (iothub_info->stop_running == 0 && (elapsed = latency_stats_get_time_ns() - start_time) < (uint64_t)STEP_DURATION_MS * NS_PER_MS)
+    {
+        size_t sent_now = 0;
+        size_t target = msg_rate == 0.0 ? (size_t)-1 : (size_t)(msg_rate * elapsed / NS_PER_SEC) + 1;
+        size_t queue_length;
+
+        while (sent_now < SEND_BURST && iothub_info->enqueued - start_enqueued < target &&
+            (msg_rate != 0.0 || get_queue_length(iothub_info) < SATURATION_QUEUE_LIMIT) && send_message(client) == 0)
+        {
+            sent_now++;
+        }
+
+        if ((queue_length = get_queue_length(iothub_info)) > step->queue_peak)
+        {
+            step->queue_peak = queue_length;
+        }
+        // The lower layer keeps calling DoWork while it is saturated, the upper layer's
+        // worker thread needs the cpu more than the sending thread does
+        do_work(client, sent_now == 0 && (msg_rate != 0.0 || client->ll_handle == NULL));
+    }
+
+    step->duration_ns = latency_stats_get_time_ns() - start_time;
+    step->peak_memory = gballoc_getMaximumMemoryUsed();
+    step->cpu_ns = latency_stats_get_process_cpu_ns() - start_cpu;
+    step->bytes_sent = gbnetwork_getBytesSent() - start_bytes;
+    get_confirm_counts(iothub_info, &end_confirmed, &end_failed);
+    step->sent = iothub_info->enqueued - start_enqueued;
+    step->confirmed = end_confirmed - start_confirmed;
+    step->failed = end_failed - start_failed;
+    step->queue_end = iothub_info->enqueued - end_confirmed - end_failed;
+}
+
+static double get_step_rate(const STEP_RESULT* step, uint64_t value)
+{
+    return step->duration_ns == 0 ? 0.0 : value * NS_PER_SEC / step->duration_ns;
+}
+
+static bool is_sustainable(const STEP_RESULT* step)
+{
+    size_t queue_bound = (size_t)(step->offered_rate * QUEUE_BOUND_MS / 1000);
+    if (queue_bound < QUEUE_BOUND_MIN)
+    {
+        queue_bound = QUEUE_BOUND_MIN;
+    }
+    return step->failed == 0 && step->queue_end <= queue_bound && get_step_rate(step, step->confirmed) >= step->offered_rate * MIN_DELIVERY_RATIO;
+}
+
+static void report_throughput(REPORT_HANDLE report_handle, const MEM_ANALYSIS_INFO* iot_mem_info, THROUGHPUT_CLIENT* client, size_t baseline_memory, const STEP_RESULT* saturation, const STEP_RESULT* sustained, size_t search_steps)
+{
+    REPORT_METRIC metrics[THROUGHPUT_METRIC_COUNT];
+    size_t count = 0;
+    size_t confirmed;
+    size_t failed;
+
+    get_confirm_counts(&client->info, &confirmed, &failed);
+    metrics[count].name = "payloadSize";
+    metrics[count++].value = (double)client->payload_size;
+    metrics[count].name = "heapBaseline";
+    metrics[count++].value = (double)baseline_memory;
+
+    metrics[count].name = "saturationMsgsPerSec";
+    metrics[count++].value = get_step_rate(saturation, saturation->confirmed);
+    metrics[count].name = "saturationQueuePeak";
+    metrics[count++].value = (double)saturation->queue_peak;
+    metrics[count].name = "saturationPeakHeapDelta";
+    metrics[count++].value = saturation->peak_memory > saturation->start_memory ? (double)(saturation->peak_memory - saturation->start_memory) : 0.0;
+    metrics[count].name = "saturationCpuUsPerMsg";
+    metrics[count++].value = saturation->confirmed == 0 ? 0.0 : saturation->cpu_ns / NS_PER_US / saturation->confirmed;
+
+    // All zero when not even the lowest rate of the search kept the queue bounded
+    metrics[count].name = "searchSteps";
+    metrics[count++].value = (double)search_steps;
+    metrics[count].name = "sustainedOfferedRate";
+    metrics[count++].value = sustained->offered_rate;
+    metrics[count].name = "sustainedMsgsPerSec";
+    metrics[count++].value = get_step_rate(sustained, sustained->confirmed);
+    metrics[count].name = "sustainedPayloadBytesPerSec";
+    metrics[count++].value = get_step_rate(sustained, (uint64_t)sustained->confirmed * client->payload_size);
+    metrics[count].name = "sustainedNetworkBytesPerSec";
+    metrics[count++].value = get_step_rate(sustained, sustained->bytes_sent);
+    metrics[count].name = "sustainedCpuUsPerMsg";
+    metrics[count++].value = sustained->confirmed == 0 ? 0.0 : sustained->cpu_ns / NS_PER_US / sustained->confirmed;
+    metrics[count].name = "sustainedCpuPct";
+    metrics[count++].value = sustained->duration_ns == 0 ? 0.0 : sustained->cpu_ns * 100.0 / sustained->duration_ns;
+    metrics[count].name = "sustainedQueuePeak";
+    metrics[count++].value = (double)sustained->queue_peak;
+    metrics[count].name = "sustainedPeakHeapDelta";
+    metrics[count++].value = sustained->peak_memory > sustained->start_memory ? (double)(sustained->peak_memory - sustained->start_memory) : 0.0;
+    metrics[count].name = "msgsFailed";
+    metrics[count++].value = (double)failed;
+
+    report_metrics(report_handle, iot_mem_info, THROUGHPUT_REPORT_NAME, metrics, count);
+}
+
+// Pushes as fast as the client accepts to find the ceiling, then searches below it for
+// the highest offered rate the client keeps up with
+static int run_benchmark(THROUGHPUT_CLIENT* client, REPORT_HANDLE report_handle, MEM_ANALYSIS_INFO* iot_mem_info)
+{
+    int result;
+    if (!wait_for_connection(client))
+    {
+        (void)printf("Failed connecting to the hub\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t baseline_memory = gballoc_getCurrentMemoryUsed();
+        STEP_RESULT saturation;
+        STEP_RESULT sustained;
+        size_t search_steps = 0;
+
+        memset(&sustained, 0, sizeof(STEP_RESULT));
+        run_step(client, 0.0, &saturation);
+        if (!drain_queue(client))
+        {
+            (void)printf("Failure draining the queue after saturation\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            double low_rate = 0.0;
+            double high_rate = get_step_rate(&saturation, saturation.confirmed) * SEARCH_HEADROOM;
+
+            result = 0;
+            while (search_steps < SEARCH_STEPS && high_rate >= 1.0)
+            {
+                STEP_RESULT step;
+                double msg_rate = (low_rate + high_rate) / 2;
+
+                run_step(client, msg_rate < 1.0 ? 1.0 : msg_rate, &step);
+                search_steps++;
+                if (is_sustainable(&step))
+                {
+                    sustained = step;
+                    low_rate = msg_rate;
+                }
+                else
+                {
+                    high_rate = msg_rate;
+                }
+                if (!drain_queue(client))
+                {
+                    (void)printf("Failure draining the queue at %.0f messages per second\r\n", msg_rate);
+                    result = __LINE__;
+                    break;
+                }
+            }
+        }
+
+        iot_mem_info->msg_sent = client->info.enqueued;
+        report_throughput(report_handle, iot_mem_info, client, baseline_memory, &saturation, &sustained, search_steps);
+    }
+    return result;
+}
+
+static int initialize_client(THROUGHPUT_CLIENT* client, const SCENARIO_INFO* scenario)
+{
+    int result;
+    memset(client, 0, sizeof(THROUGHPUT_CLIENT));
+    client->payload_size = scenario->payload_size > MAX_PAYLOAD_SIZE ? MAX_PAYLOAD_SIZE : scenario->payload_size;
+    memset(g_payload, 'a', client->payload_size);
+    if ((client->info.lock = Lock_Init()) == NULL)
+    {
+        (void)printf("Failure creating the confirmation lock\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario)
+{
+    int result;
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
+
+    MEM_ANALYSIS_INFO iot_mem_info;
+    memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
+
+    if ((iothub_transport = initialize(&iot_mem_info, protocol)) == NULL)
+    {
+        (void)printf("Failed setting transport failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        THROUGHPUT_CLIENT client;
+        HTTP_PROXY_OPTIONS proxy_options;
+        char proxy_host[MAX_PROXY_HOST_LEN];
+        if (initialize_client(&client, scenario) != 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            gballoc_resetMetrics();
+            gbnetwork_resetMetrics();
+            iot_mem_info.operation_type = OPERATION_MEMORY;
+            iot_mem_info.feature_type = FEATURE_TELEMETRY_LL;
+
+            if ((client.ll_handle = IoTHubClient_LL_CreateFromConnectionString(conn_info->device_conn_string, iothub_transport)) == NULL)
+            {
+                (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_info->device_conn_string);
+                result = __LINE__;
+            }
+            else
+            {
+                (void)IoTHubClient_LL_SetConnectionStatusCallback(client.ll_handle, iothub_connection_status, &client.info);
+
+                // Always set the cert so we can compare apples to apples
+                (void)IoTHubClient_LL_SetOption(client.ll_handle, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+                if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
+                {
+                    (void)IoTHubClient_LL_SetOption(client.ll_handle, OPTION_HTTP_PROXY, &proxy_options);
+                }
+
+                result = run_benchmark(&client, report_handle, &iot_mem_info);
+
+                IoTHubClient_LL_Destroy(client.ll_handle);
+
+                report_memory_usage(report_handle, &iot_mem_info);
+            }
+            Lock_Deinit(client.info.lock);
+        }
+    }
+    return result;
+}
+
+int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario)
+{
+    int result;
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
+
+    MEM_ANALYSIS_INFO iot_mem_info;
+    memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
+
+    if ((iothub_transport = initialize(&iot_mem_info, protocol)) == NULL)
+    {
+        (void)printf("Failed setting transport failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        THROUGHPUT_CLIENT client;
+        HTTP_PROXY_OPTIONS proxy_options;
+        char proxy_host[MAX_PROXY_HOST_LEN];
+        if (initialize_client(&client, scenario) != 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            gballoc_resetMetrics();
+            gbnetwork_resetMetrics();
+            iot_mem_info.operation_type = OPERATION_MEMORY;
+            iot_mem_info.feature_type = FEATURE_TELEMETRY_UL;
+
+            if ((client.ul_handle = IoTHubClient_CreateFromConnectionString(conn_info->device_conn_string, iothub_transport)) == NULL)
+            {
+                (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_info->device_conn_string);
+                result = __LINE__;
+            }
+            else
+            {
+                (void)IoTHubClient_SetConnectionStatusCallback(client.ul_handle, iothub_connection_status, &client.info);
+
+                // Always set the cert so we can compare apples to apples
+                (void)IoTHubClient_SetOption(client.ul_handle, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+                if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
+                {
+                    (void)IoTHubClient_SetOption(client.ul_handle, OPTION_HTTP_PROXY, &proxy_options);
+                }
+
+                result = run_benchmark(&client, report_handle, &iot_mem_info);
+
+                IoTHubClient_Destroy(client.ul_handle);
+
+                report_memory_usage(report_handle, &iot_mem_info);
+            }
+            Lock_Deinit(client.info.lock);
+        }
+    }
+    return result;
+}
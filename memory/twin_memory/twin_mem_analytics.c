@@ -0,0 +1,619 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "twin_mem_analytics.h"
+#include "latency_stats.h"
+#include "hub_control.h"
+#include "parson.h"
+
+#include "iothub_client.h"
+#include "iothub_message.h"
+
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/shared_util_options.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/gbnetwork.h"
+
+#ifdef USE_MQTT
+    #include "iothubtransportmqtt.h"
+    #include "iothubtransportmqtt_websockets.h"
+#endif
+#ifdef USE_AMQP
+    #include "iothubtransportamqp.h"
+    #include "iothubtransportamqp_websockets.h"
+#endif
+
+#include "../certs/certs.h"
+
+#include "iothub_client_version.h"
+
+#define CONNECT_TIMEOUT_MS          30000
+#define PATCH_TIMEOUT_MS            60000
+#define REPORTED_TIMEOUT_MS         10000
+#define UL_WAIT_SLEEP_MS            10
+#define TWIN_COMMAND_LEN            128
+#define MAX_PROXY_HOST_LEN          256
+#define TWIN_PATCH_SIZE             128
+#define REPORTED_STATE_LEN          64
+#define NS_PER_US                   1000.0
+#define TWIN_METRIC_COUNT           (11 + LATENCY_METRIC_COUNT)
+
+static const char* const TWIN_REPORT_NAME = "TWIN";
+static const char* const REPORTED_STATE_FMT = "{\"analytics\":{\"update\":%zu}}";
+
+typedef struct IOTHUB_CLIENT_INFO_TAG
+{
+    int connected;
+    int stop_running;
+    int twin_received;
+    size_t patch_count;
+    size_t connected_memory;
+    size_t twin_memory;
+    size_t twin_peak_memory;
+    size_t patch_peak_memory;
+    LATENCY_STATS_HANDLE callback_cpu;
+
+    int reported_pending;
+    int reported_status;
+    uint64_t reported_sent_ns;
+    LATENCY_STATS_HANDLE reported_latency;
+} IOTHUB_CLIENT_INFO;
+
+typedef struct TWIN_RESULT_TAG
+{
+    uint64_t patch_bytes;
+    size_t patch_baseline_memory;
+    size_t reported_count;
+} TWIN_RESULT;
+
+static IOTHUB_CLIENT_TRANSPORT_PROVIDER initialize(MEM_ANALYSIS_INFO* iot_mem_info, PROTOCOL_TYPE protocol, size_t num_msgs_to_send)
+{
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER result;
+    iot_mem_info->msg_sent = num_msgs_to_send;
+    iot_mem_info->iothub_version = IoTHubClient_GetVersionString();
+
+    iot_mem_info->iothub_protocol = protocol;
+    switch (protocol)
+    {
+#ifdef USE_MQTT
+        case PROTOCOL_MQTT:
+            result = MQTT_Protocol;
+            break;
+        case PROTOCOL_MQTT_WS:
+            result = MQTT_WebSocket_Protocol;
+            break;
+#endif
+#ifdef USE_AMQP
+        case PROTOCOL_AMQP:
+            result = AMQP_Protocol;
+            break;
+        case PROTOCOL_AMQP_WS:
+            result = AMQP_Protocol_over_WebSocketsTls;
+            break;
+#endif
+        default:
+            result = NULL;
+            break;
+    }
+    return result;
+}
+
+// The websocket and http transports reach the hub through the http proxy when one is
+// given, a local hub running without root only has its https port behind it
+static bool get_proxy_options(const CONNECTION_INFO* conn_info, PROTOCOL_TYPE protocol, char* proxy_host, size_t host_len, HTTP_PROXY_OPTIONS* proxy_options)
+{
+    bool result = false;
+    const char* port = conn_info->http_proxy == NULL ? NULL : strrchr(conn_info->http_proxy, ':');
+    if ((protocol == PROTOCOL_MQTT_WS || protocol == PROTOCOL_AMQP_WS || protocol == PROTOCOL_HTTP) && port != NULL && port != conn_info->http_proxy && (size_t)(port - conn_info->http_proxy) < host_len)
+    {
+        memcpy(proxy_host, conn_info->http_proxy, (size_t)(port - conn_info->http_proxy));
+        proxy_host[port - conn_info->http_proxy] = '\0';
+        memset(proxy_options, 0, sizeof(HTTP_PROXY_OPTIONS));
+        proxy_options->host_address = proxy_host;
+        proxy_options->port = atoi(port + 1);
+        result = true;
+    }
+    return result;
+}
+
+static void device_twin_callback(DEVICE_TWIN_UPDATE_STATE update_state, const unsigned char* payload, size_t size, void* user_context)
+{
+    IOTHUB_CLIENT_INFO* iothub_info = (IOTHUB_CLIENT_INFO*)user_context;
+    uint64_t cpu_start = latency_stats_get_thread_cpu_ns();
+    // Sample before the copy below so it doesn't count against the sdk
+    size_t current_memory = gballoc_getCurrentMemoryUsed();
+    char* twin_json;
+
+    // Parse the document the way an application would consume it
+    if ((twin_json = (char*)malloc(size + 1)) == NULL)
+    {
+        (void)printf("Failure allocating twin payload\r\n");
+    }
+    else
+    {
+        JSON_Value* root_value;
+        memcpy(twin_json, payload, size);
+        twin_json[size] = '\0';
+        if ((root_value = json_parse_string(twin_json)) == NULL)
+        {
+            (void)printf("Failure parsing twin payload\r\n");
+        }
+        else
+        {
+            json_value_free(root_value);
+        }
+        free(twin_json);
+    }
+
+    if (update_state == DEVICE_TWIN_UPDATE_COMPLETE)
+    {
+        // The whole document is still held by the sdk while the callback runs
+        iothub_info->twin_memory = current_memory;
+        iothub_info->twin_received = 1;
+    }
+    else
+    {
+        iothub_info->patch_count++;
+    }
+    latency_stats_add(iothub_info->callback_cpu, latency_stats_get_thread_cpu_ns() - cpu_start);
+}
+
+static void reported_state_callback(int status_code, void* user_context)
+{
+    IOTHUB_CLIENT_INFO* iothub_info = (IOTHUB_CLIENT_INFO*)user_context;
+    uint64_t now = latency_stats_get_time_ns();
+
+    iothub_info->reported_status = status_code;
+    if (status_code >= 200 && status_code < 300)
+    {
+        latency_stats_add(iothub_info->reported_latency, now - iothub_info->reported_sent_ns);
+    }
+    iothub_info->reported_pending = 0;
+}
+
+static void iothub_connection_status(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* user_context)
+{
+    (void)reason;
+    if (user_context == NULL)
+    {
+        (void)printf("iothub_connection_status user_context is NULL\r\n");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INFO* iothub_info = (IOTHUB_CLIENT_INFO*)user_context;
+        if (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED)
+        {
+            iothub_info->connected = 1;
+        }
+        else
+        {
+            iothub_info->connected = 0;
+            iothub_info->stop_running = 1;
+        }
+    }
+}
+
+static uint64_t get_network_bytes(void)
+{
+    return gbnetwork_getBytesSent() + gbnetwork_getBytesRecv();
+}
+
+// The sdk asks for the twin once the callback is set, the metrics are reset before
+// that on the connected client so the connect peak is not part of the twin's
+static IOTHUB_CLIENT_RESULT request_twin_ll(IOTHUB_CLIENT_LL_HANDLE iothub_client, IOTHUB_CLIENT_INFO* iothub_info)
+{
+    gballoc_resetMetrics();
+    iothub_info->connected_memory = gballoc_getCurrentMemoryUsed();
+    return IoTHubClient_LL_SetDeviceTwinCallback(iothub_client, device_twin_callback, iothub_info);
+}
+
+static IOTHUB_CLIENT_RESULT request_twin_ul(IOTHUB_CLIENT_HANDLE iothub_client, IOTHUB_CLIENT_INFO* iothub_info)
+{
+    gballoc_resetMetrics();
+    iothub_info->connected_memory = gballoc_getCurrentMemoryUsed();
+    return IoTHubClient_SetDeviceTwinCallback(iothub_client, device_twin_callback, iothub_info);
+}
+
+// The maximum since the twin was requested is the peak of the get
+static void start_patch_phase(IOTHUB_CLIENT_INFO* iothub_info, TWIN_RESULT* twin_result)
+{
+    iothub_info->twin_peak_memory = gballoc_getMaximumMemoryUsed();
+    gballoc_resetMetrics();
+    twin_result->patch_baseline_memory = gballoc_getCurrentMemoryUsed();
+}
+
+static size_t get_patch_timeout_ms(const SCENARIO_INFO* scenario)
+{
+    return PATCH_TIMEOUT_MS + (scenario->msg_rate == 0 ? 0 : (scenario->msg_count * 1000) / scenario->msg_rate);
+}
+
+static int create_client_info(IOTHUB_CLIENT_INFO* iothub_info, const SCENARIO_INFO* scenario)
+{
+    int result;
+    memset(iothub_info, 0, sizeof(IOTHUB_CLIENT_INFO));
+    if ((iothub_info->callback_cpu = latency_stats_create(scenario->msg_count + 1)) == NULL)
+    {
+        result = __LINE__;
+    }
+    else if ((iothub_info->reported_latency = latency_stats_create(scenario->msg_count)) == NULL)
+    {
+        latency_stats_destroy(iothub_info->callback_cpu);
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static void destroy_client_info(IOTHUB_CLIENT_INFO* iothub_info)
+{
+    latency_stats_destroy(iothub_info->callback_cpu);
+    latency_stats_destroy(iothub_info->reported_latency);
+}
+
+// The document size has to be in place before the device asks for the twin
+static int set_twin_size(const CONNECTION_INFO* conn_info, const SCENARIO_INFO* scenario)
+{
+    int result;
+    if (conn_info->hub_control == NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        char command[TWIN_COMMAND_LEN];
+        char response[HUB_CONTROL_RESPONSE_LEN];
+        (void)snprintf(command, sizeof(command), "TWIN %zu", scenario->payload_size);
+        result = hub_control_execute(conn_info->hub_control, command, response, sizeof(response));
+    }
+    return result;
+}
+
+static int request_twin_patches(const CONNECTION_INFO* conn_info, const SCENARIO_INFO* scenario)
+{
+    int result;
+    if (conn_info->hub_control == NULL)
+    {
+        (void)printf("Update the desired properties %zu times now\r\n", scenario->msg_count);
+        result = 0;
+    }
+    else
+    {
+        char command[TWIN_COMMAND_LEN];
+        char response[HUB_CONTROL_RESPONSE_LEN];
+        (void)snprintf(command, sizeof(command), "TWIN_PATCH * %zu %d %zu", scenario->msg_count, TWIN_PATCH_SIZE, scenario->msg_rate);
+        result = hub_control_execute(conn_info->hub_control, command, response, sizeof(response));
+    }
+    return result;
+}
+
+static void report_twin_usage(REPORT_HANDLE report_handle, const MEM_ANALYSIS_INFO* iot_mem_info, const SCENARIO_INFO* scenario, const IOTHUB_CLIENT_INFO* iothub_info, const TWIN_RESULT* twin_result)
+{
+    REPORT_METRIC metrics[TWIN_METRIC_COUNT];
+    LATENCY_SUMMARY cpu_summary;
+    LATENCY_SUMMARY reported_summary;
+    size_t count = 0;
+
+    latency_stats_get_summary(iothub_info->callback_cpu, &cpu_summary);
+    latency_stats_get_summary(iothub_info->reported_latency, &reported_summary);
+
+    metrics[count].name = "twinDocumentSize";
+    metrics[count++].value = (double)scenario->payload_size;
+    metrics[count].name = "twinGetHeapDelta";
+    metrics[count++].value = iothub_info->twin_memory > iothub_info->connected_memory ? (double)(iothub_info->twin_memory - iothub_info->connected_memory) : 0.0;
+    metrics[count].name = "twinGetPeakHeapDelta";
+    metrics[count++].value = iothub_info->twin_peak_memory > iothub_info->connected_memory ? (double)(iothub_info->twin_peak_memory - iothub_info->connected_memory) : 0.0;
+    metrics[count].name = "patchRate";
+    metrics[count++].value = (double)scenario->msg_rate;
+    metrics[count].name = "patchesReceived";
+    metrics[count++].value = (double)iothub_info->patch_count;
+    metrics[count].name = "patchHeapDelta";
+    metrics[count++].value = iothub_info->patch_peak_memory > twin_result->patch_baseline_memory ? (double)(iothub_info->patch_peak_memory - twin_result->patch_baseline_memory) : 0.0;
+    metrics[count].name = "networkBytesPerPatch";
+    metrics[count++].value = iothub_info->patch_count == 0 ? 0.0 : (double)twin_result->patch_bytes / iothub_info->patch_count;
+    metrics[count].name = "callbackCpuAvgUs";
+    metrics[count++].value = cpu_summary.avg_ns / NS_PER_US;
+    metrics[count].name = "callbackCpuP99Us";
+    metrics[count++].value = cpu_summary.p99_ns / NS_PER_US;
+    metrics[count].name = "callbackCpuMaxUs";
+    metrics[count++].value = cpu_summary.max_ns / NS_PER_US;
+    // The latency metrics below are for the reported property updates
+    metrics[count].name = "reportedUpdates";
+    metrics[count++].value = (double)twin_result->reported_count;
+    count += latency_stats_fill_metrics(&reported_summary, &metrics[count]);
+
+    report_metrics(report_handle, iot_mem_info, TWIN_REPORT_NAME, metrics, count);
+}
+
+int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario)
+{
+    int result;
+    HTTP_PROXY_OPTIONS proxy_options;
+    char proxy_host[MAX_PROXY_HOST_LEN];
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
+    IOTHUB_CLIENT_INFO iothub_info;
+
+    MEM_ANALYSIS_INFO iot_mem_info;
+    memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
+
+    if ((iothub_transport = initialize(&iot_mem_info, protocol, scenario->msg_count)) == NULL)
+    {
+        (void)printf("Failed setting transport failed\r\n");
+        result = __LINE__;
+    }
+    else if (create_client_info(&iothub_info, scenario) != 0)
+    {
+        (void)printf("Failed creating twin stats\r\n");
+        result = __LINE__;
+    }
+    else if (set_twin_size(conn_info, scenario) != 0)
+    {
+        destroy_client_info(&iothub_info);
+        result = __LINE__;
+    }
+    else
+    {
+        gballoc_resetMetrics();
+        iot_mem_info.operation_type = OPERATION_MEMORY;
+        iot_mem_info.feature_type = FEATURE_TWIN_LL;
+
+        IOTHUB_CLIENT_LL_HANDLE iothub_client;
+        if ((iothub_client = IoTHubClient_LL_CreateFromConnectionString(conn_info->device_conn_string, iothub_transport) ) == NULL)
+        {
+            (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_info->device_conn_string);
+            result = __LINE__;
+        }
+        else
+        {
+            (void)IoTHubClient_LL_SetConnectionStatusCallback(iothub_client, iothub_connection_status, &iothub_info);
+
+            // Always set the cert so we can compare apples to apples
+            (void)IoTHubClient_LL_SetOption(iothub_client, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+            if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
+            {
+                (void)IoTHubClient_LL_SetOption(iothub_client, OPTION_HTTP_PROXY, &proxy_options);
+            }
+
+            uint64_t start_time = latency_stats_get_time_ns();
+            do
+            {
+                IoTHubClient_LL_DoWork(iothub_client);
+                ThreadAPI_Sleep(1);
+            } while (iothub_info.connected == 0 && iothub_info.stop_running == 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < CONNECT_TIMEOUT_MS);
+
+            if (iothub_info.connected == 0)
+            {
+                (void)printf("Failed connecting to the hub\r\n");
+                result = __LINE__;
+            }
+            else if (request_twin_ll(iothub_client, &iothub_info) != IOTHUB_CLIENT_OK)
+            {
+                (void)printf("failed setting device twin callback!\r\n");
+                result = __LINE__;
+            }
+            else
+            {
+                start_time = latency_stats_get_time_ns();
+                do
+                {
+                    IoTHubClient_LL_DoWork(iothub_client);
+                    ThreadAPI_Sleep(1);
+                } while (iothub_info.twin_received == 0 && iothub_info.stop_running == 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < CONNECT_TIMEOUT_MS);
+
+                if (iothub_info.twin_received == 0)
+                {
+                    (void)printf("Failed retrieving the device twin\r\n");
+                    result = __LINE__;
+                }
+                else
+                {
+                    TWIN_RESULT twin_result;
+                    uint64_t baseline_bytes = get_network_bytes();
+                    memset(&twin_result, 0, sizeof(TWIN_RESULT));
+                    start_patch_phase(&iothub_info, &twin_result);
+
+                    if (request_twin_patches(conn_info, scenario) != 0)
+                    {
+                        result = __LINE__;
+                    }
+                    else
+                    {
+                        size_t timeout_ms = get_patch_timeout_ms(scenario);
+                        start_time = latency_stats_get_time_ns();
+                        do
+                        {
+                            IoTHubClient_LL_DoWork(iothub_client);
+                            ThreadAPI_Sleep(1);
+                        } while (iothub_info.stop_running == 0 && iothub_info.patch_count < scenario->msg_count && (latency_stats_get_time_ns() - start_time) / 1000000 < timeout_ms);
+                        twin_result.patch_bytes = get_network_bytes() - baseline_bytes;
+                        iothub_info.patch_peak_memory = gballoc_getMaximumMemoryUsed();
+
+                        // One reported update at a time so each round trip is measured on its own
+                        for (size_t index = 0; index < scenario->msg_count && iothub_info.stop_running == 0; index++)
+                        {
+                            char reported_state[REPORTED_STATE_LEN];
+                            int reported_len = snprintf(reported_state, sizeof(reported_state), REPORTED_STATE_FMT, index);
+
+                            iothub_info.reported_pending = 1;
+                            iothub_info.reported_sent_ns = latency_stats_get_time_ns();
+                            if (IoTHubClient_LL_SendReportedState(iothub_client, (const unsigned char*)reported_state, (size_t)reported_len, reported_state_callback, &iothub_info) != IOTHUB_CLIENT_OK)
+                            {
+                                (void)printf("Failed sending reported state\r\n");
+                                break;
+                            }
+
+                            start_time = latency_stats_get_time_ns();
+                            do
+                            {
+                                IoTHubClient_LL_DoWork(iothub_client);
+                                ThreadAPI_Sleep(1);
+                            } while (iothub_info.reported_pending != 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < REPORTED_TIMEOUT_MS);
+
+                            if (iothub_info.reported_pending != 0)
+                            {
+                                (void)printf("Timed out waiting for the reported state response\r\n");
+                                break;
+                            }
+                            twin_result.reported_count++;
+                        }
+
+                        report_twin_usage(report_handle, &iot_mem_info, scenario, &iothub_info, &twin_result);
+                        result = 0;
+                    }
+                }
+            }
+            IoTHubClient_LL_Destroy(iothub_client);
+
+            report_memory_usage(report_handle, &iot_mem_info);
+        }
+        destroy_client_info(&iothub_info);
+    }
+    return result;
+}
+
+int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario)
+{
+    int result;
+    HTTP_PROXY_OPTIONS proxy_options;
+    char proxy_host[MAX_PROXY_HOST_LEN];
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
+    IOTHUB_CLIENT_INFO iothub_info;
+
+    MEM_ANALYSIS_INFO iot_mem_info;
+    memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
+
+    if ((iothub_transport = initialize(&iot_mem_info, protocol, scenario->msg_count)) == NULL)
+    {
+        (void)printf("Failed setting transport failed\r\n");
+        result = __LINE__;
+    }
+    else if (create_client_info(&iothub_info, scenario) != 0)
+    {
+        (void)printf("Failed creating twin stats\r\n");
+        result = __LINE__;
+    }
+    else if (set_twin_size(conn_info, scenario) != 0)
+    {
+        destroy_client_info(&iothub_info);
+        result = __LINE__;
+    }
+    else
+    {
+        gballoc_resetMetrics();
+        iot_mem_info.operation_type = OPERATION_MEMORY;
+        iot_mem_info.feature_type = FEATURE_TWIN_UL;
+
+        IOTHUB_CLIENT_HANDLE iothub_client;
+        if ((iothub_client = IoTHubClient_CreateFromConnectionString(conn_info->device_conn_string, iothub_transport)) == NULL)
+        {
+            (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_info->device_conn_string);
+            result = __LINE__;
+        }
+        else
+        {
+            (void)IoTHubClient_SetConnectionStatusCallback(iothub_client, iothub_connection_status, &iothub_info);
+
+            // Always set the cert so we can compare apples to apples
+            (void)IoTHubClient_SetOption(iothub_client, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+            if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
+            {
+                (void)IoTHubClient_SetOption(iothub_client, OPTION_HTTP_PROXY, &proxy_options);
+            }
+
+            uint64_t start_time = latency_stats_get_time_ns();
+            while (iothub_info.connected == 0 && iothub_info.stop_running == 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < CONNECT_TIMEOUT_MS)
+            {
+                ThreadAPI_Sleep(UL_WAIT_SLEEP_MS);
+            }
+
+            if (iothub_info.connected == 0)
+            {
+                (void)printf("Failed connecting to the hub\r\n");
+                result = __LINE__;
+            }
+            else if (request_twin_ul(iothub_client, &iothub_info) != IOTHUB_CLIENT_OK)
+            {
+                (void)printf("failed setting device twin callback!\r\n");
+                result = __LINE__;
+            }
+            else
+            {
+                start_time = latency_stats_get_time_ns();
+                while (iothub_info.twin_received == 0 && iothub_info.stop_running == 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < CONNECT_TIMEOUT_MS)
+                {
+                    ThreadAPI_Sleep(UL_WAIT_SLEEP_MS);
+                }
+
+                if (iothub_info.twin_received == 0)
+                {
+                    (void)printf("Failed retrieving the device twin\r\n");
+                    result = __LINE__;
+                }
+                else
+                {
+                    TWIN_RESULT twin_result;
+                    uint64_t baseline_bytes = get_network_bytes();
+                    memset(&twin_result, 0, sizeof(TWIN_RESULT));
+                    start_patch_phase(&iothub_info, &twin_result);
+
+                    if (request_twin_patches(conn_info, scenario) != 0)
+                    {
+                        result = __LINE__;
+                    }
+                    else
+                    {
+                        size_t timeout_ms = get_patch_timeout_ms(scenario);
+                        start_time = latency_stats_get_time_ns();
+                        while (iothub_info.stop_running == 0 && iothub_info.patch_count < scenario->msg_count && (latency_stats_get_time_ns() - start_time) / 1000000 < timeout_ms)
+                        {
+                            ThreadAPI_Sleep(UL_WAIT_SLEEP_MS);
+                        }
+                        twin_result.patch_bytes = get_network_bytes() - baseline_bytes;
+                        iothub_info.patch_peak_memory = gballoc_getMaximumMemoryUsed();
+
+                        for (size_t index = 0; index < scenario->msg_count && iothub_info.stop_running == 0; index++)
+                        {
+                            char reported_state[REPORTED_STATE_LEN];
+                            int reported_len = snprintf(reported_state, sizeof(reported_state), REPORTED_STATE_FMT, index);
+
+                            iothub_info.reported_pending = 1;
+                            iothub_info.reported_sent_ns = latency_stats_get_time_ns();
+                            if (IoTHubClient_SendReportedState(iothub_client, (const unsigned char*)reported_state, (size_t)reported_len, reported_state_callback, &iothub_info) != IOTHUB_CLIENT_OK)
+                            {
+                                (void)printf("Failed sending reported state\r\n");
+                                break;
+                            }
+
+                            start_time = latency_stats_get_time_ns();
+                            while (iothub_info.reported_pending != 0 && (latency_stats_get_time_ns() - start_time) / 1000000 < REPORTED_TIMEOUT_MS)
+                            {
+                                ThreadAPI_Sleep(1);
+                            }
+
+                            if (iothub_info.reported_pending != 0)
+                            {
+                                (void)printf("Timed out waiting for the reported state response\r\n");
+                                break;
+                            }
+                            twin_result.reported_count++;
+                        }
+
+                        report_twin_usage(report_handle, &iot_mem_info, scenario, &iothub_info, &twin_result);
+                        result = 0;
+                    }
+                }
+            }
+            IoTHubClient_Destroy(iothub_client);
+
+            report_memory_usage(report_handle, &iot_mem_info);
+        }
+        destroy_client_info(&iothub_info);
+    }
+    return result;
+}
@@ -0,0 +1,26 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TWIN_MEM_ANALYTICS_H
+#define TWIN_MEM_ANALYTICS_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdbool>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#endif
+
+#include "mem_reporter.h"
+
+extern int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario);
+extern int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const SCENARIO_INFO* scenario);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif  /* TWIN_MEM_ANALYTICS_H */
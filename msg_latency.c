@@ -0,0 +1,197 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Do not include gballoc.h here, the entries must not be part of the measurements
+#include "msg_latency.h"
+#include "latency_stats.h"
+
+typedef enum MSG_STATE_TAG
+{
+    MSG_STATE_QUEUED,
+    MSG_STATE_CONFIRMED,
+    MSG_STATE_FAILED
+} MSG_STATE;
+
+typedef struct MSG_ENTRY_TAG
+{
+    struct MSG_LATENCY_TAG* owner;
+    MSG_STATE state;
+    uint64_t enqueue_ns;
+    uint64_t dispatch_ns;
+    uint64_t confirm_ns;
+} MSG_ENTRY;
+
+typedef struct MSG_LATENCY_TAG
+{
+    MSG_ENTRY* entries;
+    size_t max_msgs;
+    size_t enqueued;
+    size_t first_undispatched;
+    size_t confirmed;
+    size_t failed;
+} MSG_LATENCY;
+
+MSG_LATENCY_HANDLE msg_latency_create(size_t max_msgs)
+{
+    MSG_LATENCY* result;
+    if ((result = (MSG_LATENCY*)calloc(1, sizeof(MSG_LATENCY))) == NULL)
+    {
+        (void)printf("Failure allocating message latency\r\n");
+    }
+    else if ((result->entries = (MSG_ENTRY*)calloc(max_msgs == 0 ? 1 : max_msgs, sizeof(MSG_ENTRY))) == NULL)
+    {
+        (void)printf("Failure allocating message latency entries\r\n");
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        result->max_msgs = max_msgs;
+    }
+    return result;
+}
+
+void msg_latency_destroy(MSG_LATENCY_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        free(handle->entries);
+        free(handle);
+    }
+}
+
+void* msg_latency_enqueue(MSG_LATENCY_HANDLE handle)
+{
+    MSG_ENTRY* result;
+    if (handle == NULL || handle->enqueued == handle->max_msgs)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = &handle->entries[handle->enqueued++];
+        result->owner = handle;
+        result->state = MSG_STATE_QUEUED;
+        result->enqueue_ns = latency_stats_get_time_ns();
+    }
+    return result;
+}
+
+void msg_latency_dispatched(MSG_LATENCY_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        uint64_t now = latency_stats_get_time_ns();
+        for (; handle->first_undispatched < handle->enqueued; handle->first_undispatched++)
+        {
+            MSG_ENTRY* entry = &handle->entries[handle->first_undispatched];
+            // Transports that answer within the same DoWork confirm before we get here
+            entry->dispatch_ns = entry->state != MSG_STATE_QUEUED && entry->confirm_ns < now ? entry->confirm_ns : now;
+        }
+    }
+}
+
+void msg_latency_confirmed(void* context, bool succeeded)
+{
+    MSG_ENTRY* entry = (MSG_ENTRY*)context;
+    if (entry != NULL && entry->state == MSG_STATE_QUEUED)
+    {
+        entry->confirm_ns = latency_stats_get_time_ns();
+        if (succeeded)
+        {
+            entry->state = MSG_STATE_CONFIRMED;
+            entry->owner->confirmed++;
+        }
+        else
+        {
+            entry->state = MSG_STATE_FAILED;
+            entry->owner->failed++;
+        }
+    }
+}
+
+size_t msg_latency_get_pending(MSG_LATENCY_HANDLE handle)
+{
+    return handle == NULL ? 0 : handle->enqueued - handle->confirmed - handle->failed;
+}
+
+size_t msg_latency_get_confirmed(MSG_LATENCY_HANDLE handle)
+{
+    return handle == NULL ? 0 : handle->confirmed;
+}
+
+size_t msg_latency_get_failed(MSG_LATENCY_HANDLE handle)
+{
+    return handle == NULL ? 0 : handle->failed;
+}
+
+static void report_latency(REPORT_HANDLE report_handle, const MEM_ANALYSIS_INFO* iot_mem_info, const char* rpt_name, LATENCY_STATS_HANDLE latency, const REPORT_METRIC* counts, size_t count_len)
+{
+    REPORT_METRIC metrics[4 + LATENCY_METRIC_COUNT];
+    LATENCY_SUMMARY summary;
+    size_t count = 0;
+
+    for (size_t index = 0; index < count_len; index++)
+    {
+        metrics[count++] = counts[index];
+    }
+    latency_stats_get_summary(latency, &summary);
+    count += latency_stats_fill_metrics(&summary, &metrics[count]);
+    report_metrics(report_handle, iot_mem_info, rpt_name, metrics, count);
+}
+
+void msg_latency_report(MSG_LATENCY_HANDLE handle, REPORT_HANDLE report_handle, const MEM_ANALYSIS_INFO* iot_mem_info)
+{
+    if (handle != NULL)
+    {
+        LATENCY_STATS_HANDLE total_latency = latency_stats_create(handle->enqueued);
+        LATENCY_STATS_HANDLE queue_latency = latency_stats_create(handle->enqueued);
+        LATENCY_STATS_HANDLE wire_latency = latency_stats_create(handle->enqueued);
+        if (total_latency == NULL || queue_latency == NULL || wire_latency == NULL)
+        {
+            (void)printf("Failure creating send latency stats\r\n");
+        }
+        else
+        {
+            REPORT_METRIC counts[4];
+            size_t dispatched = 0;
+
+            for (size_t index = 0; index < handle->enqueued; index++)
+            {
+                const MSG_ENTRY* entry = &handle->entries[index];
+                if (entry->state == MSG_STATE_CONFIRMED)
+                {
+                    latency_stats_add(total_latency, entry->confirm_ns - entry->enqueue_ns);
+                    // The upper layer sends from its own thread, only the total is known there
+                    if (entry->dispatch_ns != 0)
+                    {
+                        latency_stats_add(queue_latency, entry->dispatch_ns - entry->enqueue_ns);
+                        latency_stats_add(wire_latency, entry->confirm_ns - entry->dispatch_ns);
+                        dispatched++;
+                    }
+                }
+            }
+
+            counts[0].name = "msgsEnqueued";
+            counts[0].value = (double)handle->enqueued;
+            counts[1].name = "msgsConfirmed";
+            counts[1].value = (double)handle->confirmed;
+            counts[2].name = "msgsFailed";
+            counts[2].value = (double)handle->failed;
+            counts[3].name = "msgsPending";
+            counts[3].value = (double)msg_latency_get_pending(handle);
+            report_latency(report_handle, iot_mem_info, "SEND_LATENCY", total_latency, counts, 4);
+            if (dispatched > 0)
+            {
+                report_latency(report_handle, iot_mem_info, "SEND_QUEUE_LATENCY", queue_latency, NULL, 0);
+                report_latency(report_handle, iot_mem_info, "SEND_WIRE_LATENCY", wire_latency, NULL, 0);
+            }
+        }
+        latency_stats_destroy(total_latency);
+        latency_stats_destroy(queue_latency);
+        latency_stats_destroy(wire_latency);
+    }
+}
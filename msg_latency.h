@@ -0,0 +1,45 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef MSG_LATENCY_H
+#define MSG_LATENCY_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdbool>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#include "mem_reporter.h"
+
+typedef struct MSG_LATENCY_TAG* MSG_LATENCY_HANDLE;
+
+// Matches every SendEventAsync with its confirmation. A message is queued from the
+// enqueue until the first DoWork that wrote message bytes on the authenticated
+// connection, the rest is wire time.
+// The entries are allocated up front, outside of gballoc, for max_msgs messages.
+extern MSG_LATENCY_HANDLE msg_latency_create(size_t max_msgs);
+extern void msg_latency_destroy(MSG_LATENCY_HANDLE handle);
+
+// Returns the context to hand to SendEventAsync, NULL once max_msgs were enqueued
+extern void* msg_latency_enqueue(MSG_LATENCY_HANDLE handle);
+// Call after a DoWork that sent message bytes, the upper layer can't observe this
+extern void msg_latency_dispatched(MSG_LATENCY_HANDLE handle);
+// Call from the send_confirm_callback with its context
+extern void msg_latency_confirmed(void* context, bool succeeded);
+extern size_t msg_latency_get_pending(MSG_LATENCY_HANDLE handle);
+extern size_t msg_latency_get_confirmed(MSG_LATENCY_HANDLE handle);
+extern size_t msg_latency_get_failed(MSG_LATENCY_HANDLE handle);
+
+extern void msg_latency_report(MSG_LATENCY_HANDLE handle, REPORT_HANDLE report_handle, const MEM_ANALYSIS_INFO* iot_mem_info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* MSG_LATENCY_H */
@@ -0,0 +1,1044 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "net_overhead.h"
+#include "net_tracker.h"
+
+#ifdef USE_NET_TRACKER
+    #include "azure_c_shared_utility/xio.h"
+    #include "azure_c_shared_utility/optionhandler.h"
+    #include "azure_c_shared_utility/platform.h"
+#endif
+
+// Enough of an amqp frame to read the attach link name and handle
+#define PARSER_PEEK_LEN             128
+#define UNMASK_CHUNK_LEN            512
+#define MAX_TRACKED_HANDLES         64
+
+#define WS_OPCODE_CLOSE             0x8
+#define WS_OPCODE_PING              0x9
+#define WS_OPCODE_PONG              0xA
+#define HTTP_HEADER_END             0x0D0A0D0A
+
+#define AMQP_FRAME_HEADER_LEN       8
+#define AMQP_FRAME_TYPE_SASL        1
+#define AMQP_OPEN                   0x10
+#define AMQP_BEGIN                  0x11
+#define AMQP_ATTACH                 0x12
+#define AMQP_FLOW                   0x13
+#define AMQP_TRANSFER               0x14
+#define AMQP_DISPOSITION            0x15
+#define AMQP_DETACH                 0x16
+#define AMQP_END                    0x17
+#define AMQP_CLOSE                  0x18
+
+static const char* const CATEGORY_SENT_NAMES[NET_CATEGORY_COUNT] = {
+    "wsUpgradeSent", "wsFramingSent", "connectSent", "authSent", "subscribeSent", "messageSent", "keepaliveSent", "disconnectSent", "pollSent", "otherSent" };
+static const char* const CATEGORY_RECV_NAMES[NET_CATEGORY_COUNT] = {
+    "wsUpgradeRecv", "wsFramingRecv", "connectRecv", "authRecv", "subscribeRecv", "messageRecv", "keepaliveRecv", "disconnectRecv", "pollRecv", "otherRecv" };
+static const char* const CATEGORY_RTT_NAMES[NET_CATEGORY_COUNT] = {
+    "wsUpgradeRoundTrips", "wsFramingRoundTrips", "connectRoundTrips", "authRoundTrips", "subscribeRoundTrips", "messageRoundTrips", "keepaliveRoundTrips", "disconnectRoundTrips", "pollRoundTrips", "otherRoundTrips" };
+
+#ifdef USE_NET_TRACKER
+
+// The cbs links used for the sas token put are created with these names by uamqp
+static const char* const CBS_LINK_PREFIX = "cbs";
+static const char* const TLS_TAP_OPTIONS = "net_overhead_tls_options";
+// The http transport polls for cloud to device messages and posts telemetry on these paths
+static const char* const HTTP_POLL_PATH = "/messages/devicebound";
+static const char* const HTTP_EVENT_PATH = "/messages/events";
+static const char* const HTTP_CONTENT_LENGTH = "content-length:";
+
+typedef enum WS_STATE_TAG
+{
+    WS_STATE_UPGRADE,
+    WS_STATE_FRAME
+} WS_STATE;
+
+typedef struct STREAM_PARSER_TAG
+{
+    bool is_send;
+    bool use_ws;
+    bool is_amqp;
+    bool is_http;
+
+    // Websocket layer, the upgrade is followed by frames whose data is fed to the protocol layer
+    WS_STATE ws_state;
+    bool upgrade_started;
+    uint32_t upgrade_tail;
+    unsigned char ws_header[14];
+    size_t ws_header_len;
+    uint64_t ws_remaining;
+    bool ws_is_data;
+    NET_CATEGORY ws_category;
+    unsigned char ws_mask[4];
+    size_t ws_mask_index;
+
+    // Protocol layer, the start of each mqtt packet or amqp frame is held until it can be classified
+    unsigned char unit_header[PARSER_PEEK_LEN];
+    size_t unit_header_len;
+    uint64_t unit_remaining;
+    NET_CATEGORY unit_category;
+    uint64_t cbs_handles;
+    NET_CATEGORY* link_category;
+
+    // Http layer, each request or response is a header block followed by content-length bytes
+    bool http_first_line_done;
+    uint32_t http_tail;
+    uint64_t http_header_bytes;
+    uint64_t http_content_length;
+} STREAM_PARSER;
+
+typedef struct TLS_TAP_INSTANCE_TAG
+{
+    CONCRETE_IO_HANDLE tlsio;
+    ON_IO_OPEN_COMPLETE on_io_open_complete;
+    void* on_io_open_complete_context;
+    ON_BYTES_RECEIVED on_bytes_received;
+    void* on_bytes_received_context;
+    bool in_handshake;
+    // Flow and disposition belong to whichever link was last active on the connection
+    NET_CATEGORY link_category;
+    STREAM_PARSER send_parser;
+    STREAM_PARSER recv_parser;
+} TLS_TAP_INSTANCE;
+
+static const IO_INTERFACE_DESCRIPTION* g_tls_interface;
+static PROTOCOL_TYPE g_protocol;
+static NET_OVERHEAD_INFO g_overhead_info;
+
+extern const IO_INTERFACE_DESCRIPTION* __real_platform_get_default_tlsio(void);
+
+static void add_bytes(NET_CATEGORY category, bool is_send, size_t size)
+{
+    if (is_send)
+    {
+        g_overhead_info.category[category].bytes_sent += size;
+    }
+    else
+    {
+        g_overhead_info.category[category].bytes_recv += size;
+    }
+}
+
+// A round trip is counted each time the hub answers something the device sent in the same category
+static void record_unit(NET_CATEGORY category, bool is_send)
+{
+    NET_CATEGORY_INFO* category_info = &g_overhead_info.category[category];
+    if (is_send)
+    {
+        category_info->units_sent++;
+        category_info->awaiting_reply = true;
+    }
+    else
+    {
+        category_info->units_recv++;
+        if (category_info->awaiting_reply)
+        {
+            category_info->round_trips++;
+            category_info->awaiting_reply = false;
+        }
+    }
+}
+
+static NET_CATEGORY get_mqtt_category(unsigned char packet_type)
+{
+    NET_CATEGORY result;
+    switch (packet_type)
+    {
+        case 1:     // CONNECT
+        case 2:     // CONNACK
+            result = NET_CATEGORY_CONNECT;
+            break;
+        case 3:     // PUBLISH
+        case 4:     // PUBACK
+        case 5:     // PUBREC
+        case 6:     // PUBREL
+        case 7:     // PUBCOMP
+            result = NET_CATEGORY_MESSAGE;
+            break;
+        case 8:     // SUBSCRIBE
+        case 9:     // SUBACK
+        case 10:    // UNSUBSCRIBE
+        case 11:    // UNSUBACK
+            result = NET_CATEGORY_SUBSCRIBE;
+            break;
+        case 12:    // PINGREQ
+        case 13:    // PINGRESP
+            result = NET_CATEGORY_KEEPALIVE;
+            break;
+        case 14:    // DISCONNECT
+            result = NET_CATEGORY_DISCONNECT;
+            break;
+        default:
+            result = NET_CATEGORY_OTHER;
+            break;
+    }
+    return result;
+}
+
+static bool classify_mqtt(STREAM_PARSER* parser, uint64_t* unit_len, NET_CATEGORY* category)
+{
+    bool result = false;
+    const unsigned char* header = parser->unit_header;
+    size_t header_len = parser->unit_header_len;
+
+    // Fixed header byte followed by a 1 to 4 byte remaining length
+    if (header_len >= 2 && ((header[header_len - 1] & 0x80) == 0 || header_len == 5))
+    {
+        uint64_t remaining = 0;
+        uint64_t multiplier = 1;
+        for (size_t index = 1; index < header_len; index++)
+        {
+            remaining += (uint64_t)(header[index] & 0x7F) * multiplier;
+            multiplier *= 128;
+        }
+        *unit_len = header_len + remaining;
+        *category = get_mqtt_category(header[0] >> 4);
+        result = true;
+    }
+    return result;
+}
+
+static bool read_amqp_list_start(const unsigned char* buffer, size_t length, size_t* position)
+{
+    bool result;
+    if (*position < length && buffer[*position] == 0xC0)
+    {
+        // list8: size and count follow
+        *position += 3;
+        result = true;
+    }
+    else if (*position < length && buffer[*position] == 0xD0)
+    {
+        *position += 9;
+        result = true;
+    }
+    else
+    {
+        result = false;
+    }
+    return result;
+}
+
+static bool read_amqp_uint(const unsigned char* buffer, size_t length, size_t* position, uint32_t* value)
+{
+    bool result = false;
+    if (*position < length)
+    {
+        unsigned char code = buffer[*position];
+        if (code == 0x43)
+        {
+            *value = 0;
+            *position += 1;
+            result = true;
+        }
+        else if (code == 0x52 && *position + 2 <= length)
+        {
+            *value = buffer[*position + 1];
+            *position += 2;
+            result = true;
+        }
+        else if (code == 0x70 && *position + 5 <= length)
+        {
+            *value = ((uint32_t)buffer[*position + 1] << 24) | ((uint32_t)buffer[*position + 2] << 16) | ((uint32_t)buffer[*position + 3] << 8) | buffer[*position + 4];
+            *position += 5;
+            result = true;
+        }
+    }
+    return result;
+}
+
+static bool read_amqp_string(const unsigned char* buffer, size_t length, size_t* position, const unsigned char** value, size_t* value_len)
+{
+    bool result = false;
+    if (*position + 2 <= length && buffer[*position] == 0xA1)
+    {
+        *value_len = buffer[*position + 1];
+        *value = &buffer[*position + 2];
+        *position += 2 + *value_len;
+        result = *position <= length;
+    }
+    else if (*position + 5 <= length && buffer[*position] == 0xB1)
+    {
+        *value_len = ((size_t)buffer[*position + 1] << 24) | ((size_t)buffer[*position + 2] << 16) | ((size_t)buffer[*position + 3] << 8) | buffer[*position + 4];
+        *value = &buffer[*position + 5];
+        *position += 5 + *value_len;
+        result = *position <= length;
+    }
+    return result;
+}
+
+static NET_CATEGORY classify_attach(STREAM_PARSER* parser, const unsigned char* body, size_t body_len, size_t position)
+{
+    NET_CATEGORY result = NET_CATEGORY_SUBSCRIBE;
+    const unsigned char* name;
+    size_t name_len;
+    uint32_t handle;
+    size_t prefix_len = strlen(CBS_LINK_PREFIX);
+
+    if (read_amqp_list_start(body, body_len, &position) &&
+        read_amqp_string(body, body_len, &position, &name, &name_len) &&
+        read_amqp_uint(body, body_len, &position, &handle))
+    {
+        bool is_cbs = name_len >= prefix_len && memcmp(name, CBS_LINK_PREFIX, prefix_len) == 0;
+        if (handle < MAX_TRACKED_HANDLES)
+        {
+            if (is_cbs)
+            {
+                parser->cbs_handles |= ((uint64_t)1 << handle);
+            }
+            else
+            {
+                parser->cbs_handles &= ~((uint64_t)1 << handle);
+            }
+        }
+        if (is_cbs)
+        {
+            result = NET_CATEGORY_AUTH;
+        }
+    }
+    return result;
+}
+
+static NET_CATEGORY classify_transfer(const STREAM_PARSER* parser, const unsigned char* body, size_t body_len, size_t position)
+{
+    NET_CATEGORY result = NET_CATEGORY_MESSAGE;
+    uint32_t handle;
+    if (read_amqp_list_start(body, body_len, &position) &&
+        read_amqp_uint(body, body_len, &position, &handle) &&
+        handle < MAX_TRACKED_HANDLES && (parser->cbs_handles & ((uint64_t)1 << handle)) != 0)
+    {
+        result = NET_CATEGORY_AUTH;
+    }
+    return result;
+}
+
+static NET_CATEGORY get_amqp_category(STREAM_PARSER* parser, unsigned char frame_type, const unsigned char* body, size_t body_len)
+{
+    NET_CATEGORY result;
+    unsigned char performative = 0;
+    size_t position = 0;
+
+    if (body_len >= 3 && body[0] == 0x00 && body[1] == 0x53)
+    {
+        performative = body[2];
+        position = 3;
+    }
+    else if (body_len >= 10 && body[0] == 0x00 && body[1] == 0x80)
+    {
+        performative = body[9];
+        position = 10;
+    }
+
+    if (frame_type == AMQP_FRAME_TYPE_SASL)
+    {
+        result = NET_CATEGORY_CONNECT;
+    }
+    else
+    {
+        switch (performative)
+        {
+            case AMQP_OPEN:
+            case AMQP_BEGIN:
+                result = NET_CATEGORY_CONNECT;
+                break;
+            case AMQP_ATTACH:
+                result = classify_attach(parser, body, body_len, position);
+                *parser->link_category = result;
+                break;
+            case AMQP_TRANSFER:
+                result = classify_transfer(parser, body, body_len, position);
+                *parser->link_category = result;
+                break;
+            case AMQP_FLOW:
+            case AMQP_DISPOSITION:
+                result = *parser->link_category;
+                break;
+            case AMQP_DETACH:
+            case AMQP_END:
+            case AMQP_CLOSE:
+                result = NET_CATEGORY_DISCONNECT;
+                break;
+            default:
+                result = NET_CATEGORY_OTHER;
+                break;
+        }
+    }
+    return result;
+}
+
+static bool classify_amqp(STREAM_PARSER* parser, uint64_t* unit_len, NET_CATEGORY* category)
+{
+    bool result = false;
+    const unsigned char* header = parser->unit_header;
+    size_t header_len = parser->unit_header_len;
+
+    if (header[0] == 'A')
+    {
+        // Protocol header, a frame this large is not possible
+        if (header_len == AMQP_FRAME_HEADER_LEN)
+        {
+            *unit_len = AMQP_FRAME_HEADER_LEN;
+            *category = NET_CATEGORY_CONNECT;
+            result = true;
+        }
+    }
+    else if (header_len >= AMQP_FRAME_HEADER_LEN)
+    {
+        uint32_t frame_size = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | header[3];
+        size_t body_offset = (size_t)header[4] * 4;
+        size_t needed = frame_size < PARSER_PEEK_LEN ? frame_size : PARSER_PEEK_LEN;
+
+        if (frame_size <= AMQP_FRAME_HEADER_LEN || body_offset < AMQP_FRAME_HEADER_LEN)
+        {
+            // Empty frames are the amqp heartbeat
+            *unit_len = frame_size < header_len ? header_len : frame_size;
+            *category = frame_size == AMQP_FRAME_HEADER_LEN ? NET_CATEGORY_KEEPALIVE : NET_CATEGORY_OTHER;
+            result = true;
+        }
+        else if (header_len >= needed)
+        {
+            *unit_len = frame_size;
+            *category = body_offset < header_len ?
+                get_amqp_category(parser, header[5], &header[body_offset], header_len - body_offset) : NET_CATEGORY_OTHER;
+            result = true;
+        }
+    }
+    return result;
+}
+
+static void feed_protocol(STREAM_PARSER* parser, const unsigned char* buffer, size_t size)
+{
+    size_t position = 0;
+    while (position < size)
+    {
+        if (parser->unit_remaining > 0)
+        {
+            size_t chunk = (uint64_t)(size - position) < parser->unit_remaining ? size - position : (size_t)parser->unit_remaining;
+            add_bytes(parser->unit_category, parser->is_send, chunk);
+            parser->unit_remaining -= chunk;
+            position += chunk;
+        }
+        else
+        {
+            uint64_t unit_len;
+            NET_CATEGORY category;
+
+            parser->unit_header[parser->unit_header_len++] = buffer[position++];
+            if (parser->is_amqp ? classify_amqp(parser, &unit_len, &category) : classify_mqtt(parser, &unit_len, &category))
+            {
+                record_unit(category, parser->is_send);
+                add_bytes(category, parser->is_send, parser->unit_header_len);
+                parser->unit_remaining = unit_len - parser->unit_header_len;
+                parser->unit_category = category;
+                parser->unit_header_len = 0;
+            }
+        }
+    }
+}
+
+static bool line_contains(const unsigned char* line, size_t line_len, const char* text)
+{
+    bool result = false;
+    size_t text_len = strlen(text);
+    for (size_t index = 0; !result && index + text_len <= line_len; index++)
+    {
+        result = memcmp(&line[index], text, text_len) == 0;
+    }
+    return result;
+}
+
+static bool line_starts_with_nocase(const unsigned char* line, size_t line_len, const char* text)
+{
+    bool result;
+    size_t text_len = strlen(text);
+    if (line_len < text_len)
+    {
+        result = false;
+    }
+    else
+    {
+        result = true;
+        for (size_t index = 0; result && index < text_len; index++)
+        {
+            result = tolower(line[index]) == text[index];
+        }
+    }
+    return result;
+}
+
+static uint64_t read_content_length(const unsigned char* line, size_t line_len)
+{
+    uint64_t result = 0;
+    for (size_t index = strlen(HTTP_CONTENT_LENGTH); index < line_len; index++)
+    {
+        if (line[index] >= '0' && line[index] <= '9')
+        {
+            result = (result * 10) + (line[index] - '0');
+        }
+    }
+    return result;
+}
+
+static void parse_http_line(STREAM_PARSER* parser)
+{
+    const unsigned char* line = parser->unit_header;
+    size_t line_len = parser->unit_header_len;
+
+    if (!parser->http_first_line_done)
+    {
+        // Responses take the category of the request they answer
+        if (parser->is_send)
+        {
+            if (line_contains(line, line_len, HTTP_POLL_PATH))
+            {
+                *parser->link_category = NET_CATEGORY_POLL;
+            }
+            else if (line_contains(line, line_len, HTTP_EVENT_PATH))
+            {
+                *parser->link_category = NET_CATEGORY_MESSAGE;
+            }
+            else
+            {
+                *parser->link_category = NET_CATEGORY_OTHER;
+            }
+        }
+        parser->unit_category = *parser->link_category;
+        parser->http_first_line_done = true;
+    }
+    else if (line_starts_with_nocase(line, line_len, HTTP_CONTENT_LENGTH))
+    {
+        parser->http_content_length = read_content_length(line, line_len);
+    }
+}
+
+// Chunked transfer encoding is not used by the sdk's http transport and is not followed
+static void feed_http(STREAM_PARSER* parser, const unsigned char* buffer, size_t size)
+{
+    size_t position = 0;
+    while (position < size)
+    {
+        if (parser->unit_remaining > 0)
+        {
+            size_t chunk = (uint64_t)(size - position) < parser->unit_remaining ? size - position : (size_t)parser->unit_remaining;
+            add_bytes(parser->unit_category, parser->is_send, chunk);
+            parser->unit_remaining -= chunk;
+            position += chunk;
+        }
+        else
+        {
+            unsigned char value = buffer[position++];
+            parser->http_header_bytes++;
+            parser->http_tail = (parser->http_tail << 8) | value;
+            if (value == '\n')
+            {
+                parse_http_line(parser);
+                parser->unit_header_len = 0;
+            }
+            else if (value != '\r' && parser->unit_header_len < PARSER_PEEK_LEN)
+            {
+                parser->unit_header[parser->unit_header_len++] = value;
+            }
+
+            if (parser->http_tail == HTTP_HEADER_END)
+            {
+                record_unit(parser->unit_category, parser->is_send);
+                add_bytes(parser->unit_category, parser->is_send, (size_t)parser->http_header_bytes);
+                parser->unit_remaining = parser->http_content_length;
+                parser->http_first_line_done = false;
+                parser->http_tail = 0;
+                parser->http_header_bytes = 0;
+                parser->http_content_length = 0;
+            }
+        }
+    }
+}
+
+static bool parse_ws_header(STREAM_PARSER* parser)
+{
+    bool result = false;
+    const unsigned char* header = parser->ws_header;
+    size_t header_len = parser->ws_header_len;
+
+    if (header_len >= 2)
+    {
+        size_t length_bytes = (header[1] & 0x7F) == 126 ? 2 : ((header[1] & 0x7F) == 127 ? 8 : 0);
+        size_t mask_bytes = (header[1] & 0x80) != 0 ? 4 : 0;
+        if (header_len == 2 + length_bytes + mask_bytes)
+        {
+            unsigned char opcode = header[0] & 0x0F;
+            uint64_t payload_len = header[1] & 0x7F;
+            if (length_bytes > 0)
+            {
+                payload_len = 0;
+                for (size_t index = 0; index < length_bytes; index++)
+                {
+                    payload_len = (payload_len << 8) | header[2 + index];
+                }
+            }
+            if (mask_bytes > 0)
+            {
+                (void)memcpy(parser->ws_mask, &header[2 + length_bytes], sizeof(parser->ws_mask));
+            }
+            else
+            {
+                memset(parser->ws_mask, 0, sizeof(parser->ws_mask));
+            }
+            parser->ws_mask_index = 0;
+            parser->ws_remaining = payload_len;
+            parser->ws_is_data = opcode < WS_OPCODE_CLOSE;
+            if (opcode == WS_OPCODE_CLOSE)
+            {
+                parser->ws_category = NET_CATEGORY_DISCONNECT;
+                record_unit(NET_CATEGORY_DISCONNECT, parser->is_send);
+            }
+            else if (opcode == WS_OPCODE_PING || opcode == WS_OPCODE_PONG)
+            {
+                parser->ws_category = NET_CATEGORY_KEEPALIVE;
+                record_unit(NET_CATEGORY_KEEPALIVE, parser->is_send);
+            }
+            result = true;
+        }
+    }
+    return result;
+}
+
+static void feed_websocket(STREAM_PARSER* parser, const unsigned char* buffer, size_t size)
+{
+    size_t position = 0;
+    while (position < size)
+    {
+        if (parser->ws_state == WS_STATE_UPGRADE)
+        {
+            if (!parser->upgrade_started)
+            {
+                record_unit(NET_CATEGORY_WS_UPGRADE, parser->is_send);
+                parser->upgrade_started = true;
+            }
+            parser->upgrade_tail = (parser->upgrade_tail << 8) | buffer[position++];
+            add_bytes(NET_CATEGORY_WS_UPGRADE, parser->is_send, 1);
+            if (parser->upgrade_tail == HTTP_HEADER_END)
+            {
+                parser->ws_state = WS_STATE_FRAME;
+            }
+        }
+        else if (parser->ws_remaining > 0)
+        {
+            size_t chunk = (uint64_t)(size - position) < parser->ws_remaining ? size - position : (size_t)parser->ws_remaining;
+            if (parser->ws_is_data)
+            {
+                // The device masks its frames, the protocol layer needs the clear bytes
+                unsigned char unmasked[UNMASK_CHUNK_LEN];
+                size_t done = 0;
+                while (done < chunk)
+                {
+                    size_t piece = chunk - done < UNMASK_CHUNK_LEN ? chunk - done : UNMASK_CHUNK_LEN;
+                    for (size_t index = 0; index < piece; index++)
+                    {
+                        unmasked[index] = buffer[position + done + index] ^ parser->ws_mask[parser->ws_mask_index];
+                        parser->ws_mask_index = (parser->ws_mask_index + 1) % 4;
+                    }
+                    feed_protocol(parser, unmasked, piece);
+                    done += piece;
+                }
+            }
+            else
+            {
+                add_bytes(parser->ws_category, parser->is_send, chunk);
+            }
+            parser->ws_remaining -= chunk;
+            position += chunk;
+        }
+        else
+        {
+            parser->ws_header[parser->ws_header_len++] = buffer[position++];
+            if (parse_ws_header(parser))
+            {
+                add_bytes(NET_CATEGORY_WS_FRAMING, parser->is_send, parser->ws_header_len);
+                parser->ws_header_len = 0;
+            }
+        }
+    }
+}
+
+static void feed_parser(STREAM_PARSER* parser, const unsigned char* buffer, size_t size)
+{
+    if (parser->is_send)
+    {
+        g_overhead_info.plaintext_sent += size;
+    }
+    else
+    {
+        g_overhead_info.plaintext_recv += size;
+    }
+
+    if (parser->use_ws)
+    {
+        feed_websocket(parser, buffer, size);
+    }
+    else if (parser->is_http)
+    {
+        feed_http(parser, buffer, size);
+    }
+    else
+    {
+        feed_protocol(parser, buffer, size);
+    }
+}
+
+static void init_parser(STREAM_PARSER* parser, bool is_send, NET_CATEGORY* link_category)
+{
+    memset(parser, 0, sizeof(STREAM_PARSER));
+    parser->is_send = is_send;
+    parser->use_ws = g_protocol == PROTOCOL_MQTT_WS || g_protocol == PROTOCOL_AMQP_WS;
+    parser->is_amqp = g_protocol == PROTOCOL_AMQP || g_protocol == PROTOCOL_AMQP_WS;
+    parser->is_http = g_protocol == PROTOCOL_HTTP;
+    parser->ws_state = WS_STATE_UPGRADE;
+    parser->link_category = link_category;
+}
+
+// A tap closed or destroyed before its open completed still ends the handshake
+static void end_handshake(TLS_TAP_INSTANCE* tap)
+{
+    if (tap->in_handshake)
+    {
+        tap->in_handshake = false;
+        net_tracker_end_handshake();
+    }
+}
+
+static void on_tap_open_complete(void* context, IO_OPEN_RESULT open_result)
+{
+    TLS_TAP_INSTANCE* tap = (TLS_TAP_INSTANCE*)context;
+    end_handshake(tap);
+    if (open_result == IO_OPEN_OK)
+    {
+        g_overhead_info.tls_connects++;
+    }
+    tap->on_io_open_complete(tap->on_io_open_complete_context, open_result);
+}
+
+static void on_tap_bytes_received(void* context, const unsigned char* buffer, size_t size)
+{
+    TLS_TAP_INSTANCE* tap = (TLS_TAP_INSTANCE*)context;
+    feed_parser(&tap->recv_parser, buffer, size);
+    tap->on_bytes_received(tap->on_bytes_received_context, buffer, size);
+}
+
+static CONCRETE_IO_HANDLE tap_create(void* io_create_parameters)
+{
+    TLS_TAP_INSTANCE* result;
+    if ((result = (TLS_TAP_INSTANCE*)malloc(sizeof(TLS_TAP_INSTANCE))) == NULL)
+    {
+        (void)printf("Failure allocating tls tap\r\n");
+    }
+    else
+    {
+        memset(result, 0, sizeof(TLS_TAP_INSTANCE));
+        if ((result->tlsio = g_tls_interface->concrete_io_create(io_create_parameters)) == NULL)
+        {
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->link_category = NET_CATEGORY_SUBSCRIBE;
+            init_parser(&result->send_parser, true, &result->link_category);
+            init_parser(&result->recv_parser, false, &result->link_category);
+        }
+    }
+    return result;
+}
+
+static void tap_destroy(CONCRETE_IO_HANDLE handle)
+{
+    TLS_TAP_INSTANCE* tap = (TLS_TAP_INSTANCE*)handle;
+    if (tap != NULL)
+    {
+        end_handshake(tap);
+        g_tls_interface->concrete_io_destroy(tap->tlsio);
+        free(tap);
+    }
+}
+
+static int tap_open(CONCRETE_IO_HANDLE handle, ON_IO_OPEN_COMPLETE on_io_open_complete, void* on_io_open_complete_context, ON_BYTES_RECEIVED on_bytes_received, void* on_bytes_received_context, ON_IO_ERROR on_io_error, void* on_io_error_context)
+{
+    int result;
+    TLS_TAP_INSTANCE* tap = (TLS_TAP_INSTANCE*)handle;
+    if (tap == NULL || on_io_open_complete == NULL || on_bytes_received == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        tap->on_io_open_complete = on_io_open_complete;
+        tap->on_io_open_complete_context = on_io_open_complete_context;
+        tap->on_bytes_received = on_bytes_received;
+        tap->on_bytes_received_context = on_bytes_received_context;
+
+        // Every packet from here until the open completes is the tcp and tls handshake,
+        // the tcp connect is one round trip the socket never sees
+        end_handshake(tap);
+        tap->in_handshake = true;
+        g_overhead_info.handshake_round_trips++;
+        net_tracker_begin_handshake();
+
+        // A reopened connection starts a new upgrade and protocol stream
+        init_parser(&tap->send_parser, true, &tap->link_category);
+        init_parser(&tap->recv_parser, false, &tap->link_category);
+        result = g_tls_interface->concrete_io_open(tap->tlsio, on_tap_open_complete, tap, on_tap_bytes_received, tap, on_io_error, on_io_error_context);
+    }
+    return result;
+}
+
+static int tap_close(CONCRETE_IO_HANDLE handle, ON_IO_CLOSE_COMPLETE on_io_close_complete, void* callback_context)
+{
+    int result;
+    TLS_TAP_INSTANCE* tap = (TLS_TAP_INSTANCE*)handle;
+    if (tap == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        end_handshake(tap);
+        result = g_tls_interface->concrete_io_close(tap->tlsio, on_io_close_complete, callback_context);
+    }
+    return result;
+}
+
+static int tap_send(CONCRETE_IO_HANDLE handle, const void* buffer, size_t size, ON_SEND_COMPLETE on_send_complete, void* callback_context)
+{
+    int result;
+    TLS_TAP_INSTANCE* tap = (TLS_TAP_INSTANCE*)handle;
+    if (tap == NULL || buffer == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        feed_parser(&tap->send_parser, (const unsigned char*)buffer, size);
+        result = g_tls_interface->concrete_io_send(tap->tlsio, buffer, size, on_send_complete, callback_context);
+    }
+    return result;
+}
+
+static void tap_dowork(CONCRETE_IO_HANDLE handle)
+{
+    TLS_TAP_INSTANCE* tap = (TLS_TAP_INSTANCE*)handle;
+    if (tap != NULL)
+    {
+        g_tls_interface->concrete_io_dowork(tap->tlsio);
+    }
+}
+
+static int tap_setoption(CONCRETE_IO_HANDLE handle, const char* option_name, const void* value)
+{
+    int result;
+    TLS_TAP_INSTANCE* tap = (TLS_TAP_INSTANCE*)handle;
+    if (tap == NULL || option_name == NULL)
+    {
+        result = __LINE__;
+    }
+    else if (strcmp(option_name, TLS_TAP_OPTIONS) == 0)
+    {
+        result = OptionHandler_FeedOptions((OPTIONHANDLER_HANDLE)value, tap->tlsio) == OPTIONHANDLER_OK ? 0 : __LINE__;
+    }
+    else
+    {
+        result = g_tls_interface->concrete_io_setoption(tap->tlsio, option_name, value);
+    }
+    return result;
+}
+
+static void* clone_tap_option(const char* name, const void* value)
+{
+    void* result = NULL;
+    if (strcmp(name, TLS_TAP_OPTIONS) == 0)
+    {
+        result = OptionHandler_Clone((OPTIONHANDLER_HANDLE)value);
+    }
+    return result;
+}
+
+static void destroy_tap_option(const char* name, const void* value)
+{
+    if (strcmp(name, TLS_TAP_OPTIONS) == 0)
+    {
+        OptionHandler_Destroy((OPTIONHANDLER_HANDLE)value);
+    }
+}
+
+// The tlsio options are bound to the real tlsio handle so they are nested
+// under an option of the tap, feeding them back unwraps them again
+static OPTIONHANDLER_HANDLE tap_retrieveoptions(CONCRETE_IO_HANDLE handle)
+{
+    OPTIONHANDLER_HANDLE result;
+    OPTIONHANDLER_HANDLE tls_options;
+    TLS_TAP_INSTANCE* tap = (TLS_TAP_INSTANCE*)handle;
+    if (tap == NULL)
+    {
+        result = NULL;
+    }
+    else if ((result = OptionHandler_Create(clone_tap_option, destroy_tap_option, tap_setoption)) == NULL)
+    {
+        (void)printf("Failure creating tls tap options\r\n");
+    }
+    else if ((tls_options = g_tls_interface->concrete_io_retrieveoptions(tap->tlsio)) == NULL)
+    {
+        OptionHandler_Destroy(result);
+        result = NULL;
+    }
+    else
+    {
+        if (OptionHandler_AddOption(result, TLS_TAP_OPTIONS, tls_options) != OPTIONHANDLER_OK)
+        {
+            (void)printf("Failure adding tls tap options\r\n");
+            OptionHandler_Destroy(result);
+            result = NULL;
+        }
+        OptionHandler_Destroy(tls_options);
+    }
+    return result;
+}
+
+static const IO_INTERFACE_DESCRIPTION TLS_TAP_INTERFACE =
+{
+    tap_retrieveoptions,
+    tap_create,
+    tap_destroy,
+    tap_open,
+    tap_close,
+    tap_send,
+    tap_dowork,
+    tap_setoption
+};
+
+const IO_INTERFACE_DESCRIPTION* __wrap_platform_get_default_tlsio(void)
+{
+    const IO_INTERFACE_DESCRIPTION* result;
+    if ((g_tls_interface = __real_platform_get_default_tlsio()) == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = &TLS_TAP_INTERFACE;
+    }
+    return result;
+}
+
+bool net_overhead_is_enabled(void)
+{
+    return true;
+}
+
+void net_overhead_reset(PROTOCOL_TYPE protocol)
+{
+    g_protocol = protocol;
+    memset(&g_overhead_info, 0, sizeof(g_overhead_info));
+}
+
+void net_overhead_get_info(NET_OVERHEAD_INFO* info)
+{
+    if (info != NULL)
+    {
+        NET_TRACKER_INFO tracker_info;
+        *info = g_overhead_info;
+        net_tracker_get_info(&tracker_info);
+        info->handshake_sent = tracker_info.handshake_sent;
+        info->handshake_recv = tracker_info.handshake_recv;
+        info->handshake_round_trips += tracker_info.handshake_round_trips;
+    }
+}
+
+uint64_t net_overhead_get_bytes_sent(NET_CATEGORY category)
+{
+    return category < NET_CATEGORY_COUNT ? g_overhead_info.category[category].bytes_sent : 0;
+}
+#else
+bool net_overhead_is_enabled(void)
+{
+    return false;
+}
+
+void net_overhead_reset(PROTOCOL_TYPE protocol)
+{
+    (void)protocol;
+}
+
+void net_overhead_get_info(NET_OVERHEAD_INFO* info)
+{
+    if (info != NULL)
+    {
+        memset(info, 0, sizeof(NET_OVERHEAD_INFO));
+    }
+}
+
+uint64_t net_overhead_get_bytes_sent(NET_CATEGORY category)
+{
+    (void)category;
+    return 0;
+}
+#endif
+
+static double get_difference(uint64_t total, uint64_t part)
+{
+    return total > part ? (double)(total - part) : 0.0;
+}
+
+void net_overhead_report(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info, uint64_t payload_bytes)
+{
+    if (net_overhead_is_enabled())
+    {
+        NET_OVERHEAD_INFO info;
+        NET_TRACKER_INFO tracker_info;
+        REPORT_METRIC metrics[12 + (NET_CATEGORY_COUNT * 3)];
+        size_t count = 0;
+        uint64_t socket_total;
+        uint64_t message_sent;
+
+        net_overhead_get_info(&info);
+        net_tracker_get_info(&tracker_info);
+        socket_total = tracker_info.bytes_sent + tracker_info.bytes_recv;
+        message_sent = info.category[NET_CATEGORY_MESSAGE].bytes_sent;
+
+        metrics[count].name = "tlsConnects";
+        metrics[count++].value = (double)info.tls_connects;
+        metrics[count].name = "handshakeSent";
+        metrics[count++].value = (double)info.handshake_sent;
+        metrics[count].name = "handshakeRecv";
+        metrics[count++].value = (double)info.handshake_recv;
+        metrics[count].name = "handshakeRoundTrips";
+        metrics[count++].value = (double)info.handshake_round_trips;
+        // Record headers, padding, tags and post handshake messages such as session tickets
+        metrics[count].name = "tlsRecordSent";
+        metrics[count++].value = get_difference(tracker_info.bytes_sent, info.handshake_sent + info.plaintext_sent);
+        metrics[count].name = "tlsRecordRecv";
+        metrics[count++].value = get_difference(tracker_info.bytes_recv, info.handshake_recv + info.plaintext_recv);
+        for (size_t index = 0; index < NET_CATEGORY_COUNT; index++)
+        {
+            metrics[count].name = CATEGORY_SENT_NAMES[index];
+            metrics[count++].value = (double)info.category[index].bytes_sent;
+            metrics[count].name = CATEGORY_RECV_NAMES[index];
+            metrics[count++].value = (double)info.category[index].bytes_recv;
+            metrics[count].name = CATEGORY_RTT_NAMES[index];
+            metrics[count++].value = (double)info.category[index].round_trips;
+        }
+        metrics[count].name = "payloadBytes";
+        metrics[count++].value = (double)payload_bytes;
+        metrics[count].name = "messageFramingSent";
+        metrics[count++].value = get_difference(message_sent, payload_bytes);
+        metrics[count].name = "socketBytes";
+        metrics[count++].value = (double)socket_total;
+        metrics[count].name = "overheadPct";
+        metrics[count++].value = socket_total == 0 ? 0.0 : get_difference(socket_total, payload_bytes) * 100 / socket_total;
+        report_metrics(handle, iot_mem_info, "PROTOCOL_OVERHEAD", metrics, count);
+    }
+}
@@ -0,0 +1,71 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef NET_OVERHEAD_H
+#define NET_OVERHEAD_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdbool>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#include "mem_reporter.h"
+
+    // Where the plaintext bytes above the tls layer went
+    typedef enum NET_CATEGORY_TAG
+    {
+        NET_CATEGORY_WS_UPGRADE,
+        NET_CATEGORY_WS_FRAMING,
+        NET_CATEGORY_CONNECT,
+        NET_CATEGORY_AUTH,
+        NET_CATEGORY_SUBSCRIBE,
+        NET_CATEGORY_MESSAGE,
+        NET_CATEGORY_KEEPALIVE,
+        NET_CATEGORY_DISCONNECT,
+        NET_CATEGORY_POLL,
+        NET_CATEGORY_OTHER,
+        NET_CATEGORY_COUNT
+    } NET_CATEGORY;
+
+    typedef struct NET_CATEGORY_INFO_TAG
+    {
+        uint64_t bytes_sent;
+        uint64_t bytes_recv;
+        size_t units_sent;
+        size_t units_recv;
+        size_t round_trips;
+        bool awaiting_reply;
+    } NET_CATEGORY_INFO;
+
+    typedef struct NET_OVERHEAD_INFO_TAG
+    {
+        // Socket traffic while the tls layer was opening, the tcp handshake itself is below the socket
+        uint64_t handshake_sent;
+        uint64_t handshake_recv;
+        size_t handshake_round_trips;
+        size_t tls_connects;
+        uint64_t plaintext_sent;
+        uint64_t plaintext_recv;
+        NET_CATEGORY_INFO category[NET_CATEGORY_COUNT];
+    } NET_OVERHEAD_INFO;
+
+    // The sdk's tlsio is decorated through the linker's --wrap option on platform_get_default_tlsio,
+    // it is only active when the target was linked with add_net_tracker()
+    extern bool net_overhead_is_enabled(void);
+    extern void net_overhead_reset(PROTOCOL_TYPE protocol);
+    extern void net_overhead_get_info(NET_OVERHEAD_INFO* info);
+    // Plaintext bytes sent in the category so far, cheap enough to call around every DoWork
+    extern uint64_t net_overhead_get_bytes_sent(NET_CATEGORY category);
+    extern void net_overhead_report(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info, uint64_t payload_bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* NET_OVERHEAD_H */
@@ -0,0 +1,384 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "net_tracker.h"
+
+// Do not include gbnetwork.h here, it redefines send and recv
+#ifdef USE_NET_TRACKER
+    #include <sys/types.h>
+    #include <time.h>
+#endif
+
+// A TLS 1.2 record carries ~29 bytes of header, nonce and tag, sends this small
+// are mostly framing and show the sdk writing each protocol field on its own
+#define NET_SMALL_SEND_SIZE         128
+// Gaps this long between packets are counted as idle periods
+#define NET_IDLE_GAP_US             100000
+// Content type, version and length
+#define TLS_RECORD_HEADER_LEN       5
+
+static const char* const PHASE_NAMES[NET_PHASE_COUNT] = { "connect", "idle", "telemetry", "disconnect" };
+
+#ifdef USE_NET_TRACKER
+
+typedef struct TLS_RECORD_PARSER_TAG
+{
+    int sock;
+    unsigned char header[TLS_RECORD_HEADER_LEN];
+    size_t header_len;
+    size_t remaining;
+} TLS_RECORD_PARSER;
+
+static NET_PACKET g_packets[NET_TRACKER_MAX_PACKETS];
+static NET_PHASE_TOTALS g_phase_totals[NET_PHASE_COUNT];
+static TLS_RECORD_PARSER g_send_records;
+static TLS_RECORD_PARSER g_recv_records;
+static size_t g_packet_count;
+static size_t g_dropped_count;
+static uint64_t g_bytes_sent;
+static uint64_t g_bytes_recv;
+static uint64_t g_start_us;
+// The LL clients only touch the socket from DoWork so there is a single writer
+static NET_PHASE g_current_phase;
+static size_t g_open_handshakes;
+static bool g_handshake_last_was_send;
+static uint64_t g_handshake_sent;
+static uint64_t g_handshake_recv;
+static size_t g_handshake_round_trips;
+
+extern ssize_t __real_gbnetwork_send(int sock, const void* buf, size_t len, int flags);
+extern ssize_t __real_gbnetwork_recv(int sock, void* buf, size_t len, int flags);
+
+static uint64_t get_time_us(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000) + ((uint64_t)now.tv_nsec / 1000);
+}
+
+static void reset_record_parser(TLS_RECORD_PARSER* parser, int sock)
+{
+    memset(parser, 0, sizeof(TLS_RECORD_PARSER));
+    parser->sock = sock;
+}
+
+// Only the record headers are read, the encrypted bodies are skipped
+static void parse_records(TLS_RECORD_PARSER* parser, int sock, const unsigned char* buffer, size_t size, NET_PHASE_TOTALS* totals, bool is_send)
+{
+    // A new connection starts a new record stream
+    if (parser->sock != sock)
+    {
+        reset_record_parser(parser, sock);
+    }
+    while (size > 0)
+    {
+        if (parser->remaining > 0)
+        {
+            size_t skip = size < parser->remaining ? size : parser->remaining;
+            parser->remaining -= skip;
+            buffer += skip;
+            size -= skip;
+        }
+        else
+        {
+            parser->header[parser->header_len++] = *buffer++;
+            size--;
+            if (parser->header_len == TLS_RECORD_HEADER_LEN)
+            {
+                size_t record_len = ((size_t)parser->header[3] << 8) | parser->header[4];
+                parser->remaining = record_len;
+                parser->header_len = 0;
+                if (is_send)
+                {
+                    totals->records_sent++;
+                    if (record_len > totals->largest_record_sent)
+                    {
+                        totals->largest_record_sent = record_len;
+                    }
+                }
+                else
+                {
+                    totals->records_recv++;
+                }
+            }
+        }
+    }
+}
+
+static void record_packet(int sock, const void* buf, bool is_send, ssize_t size)
+{
+    // Would block and errors are polled on every DoWork, only actual traffic is kept
+    if (size > 0)
+    {
+        NET_PHASE_TOTALS* totals = &g_phase_totals[g_current_phase];
+        if (is_send)
+        {
+            g_bytes_sent += (uint64_t)size;
+            totals->bytes_sent += (uint64_t)size;
+            totals->sends++;
+            parse_records(&g_send_records, sock, (const unsigned char*)buf, (size_t)size, totals, true);
+        }
+        else
+        {
+            g_bytes_recv += (uint64_t)size;
+            totals->bytes_recv += (uint64_t)size;
+            totals->recvs++;
+            parse_records(&g_recv_records, sock, (const unsigned char*)buf, (size_t)size, totals, false);
+        }
+        if (g_open_handshakes > 0)
+        {
+            if (is_send)
+            {
+                g_handshake_sent += (uint64_t)size;
+            }
+            else
+            {
+                g_handshake_recv += (uint64_t)size;
+                if (g_handshake_last_was_send)
+                {
+                    g_handshake_round_trips++;
+                }
+            }
+            g_handshake_last_was_send = is_send;
+        }
+        if (g_packet_count < NET_TRACKER_MAX_PACKETS)
+        {
+            NET_PACKET* packet = &g_packets[g_packet_count++];
+            packet->time_us = get_time_us() - g_start_us;
+            packet->is_send = is_send;
+            packet->size = (size_t)size;
+            packet->phase = g_current_phase;
+        }
+        else
+        {
+            g_dropped_count++;
+        }
+    }
+}
+
+ssize_t __wrap_gbnetwork_send(int sock, const void* buf, size_t len, int flags)
+{
+    ssize_t result = __real_gbnetwork_send(sock, buf, len, flags);
+    record_packet(sock, buf, true, result);
+    return result;
+}
+
+ssize_t __wrap_gbnetwork_recv(int sock, void* buf, size_t len, int flags)
+{
+    ssize_t result = __real_gbnetwork_recv(sock, buf, len, flags);
+    record_packet(sock, buf, false, result);
+    return result;
+}
+
+bool net_tracker_is_enabled(void)
+{
+    return true;
+}
+
+void net_tracker_reset(void)
+{
+    g_packet_count = 0;
+    g_dropped_count = 0;
+    g_bytes_sent = 0;
+    g_bytes_recv = 0;
+    memset(g_phase_totals, 0, sizeof(g_phase_totals));
+    reset_record_parser(&g_send_records, -1);
+    reset_record_parser(&g_recv_records, -1);
+    g_current_phase = NET_PHASE_CONNECT;
+    g_open_handshakes = 0;
+    g_handshake_last_was_send = false;
+    g_handshake_sent = 0;
+    g_handshake_recv = 0;
+    g_handshake_round_trips = 0;
+    g_start_us = get_time_us();
+}
+
+void net_tracker_set_phase(NET_PHASE phase)
+{
+    if (phase < NET_PHASE_COUNT)
+    {
+        g_current_phase = phase;
+    }
+}
+
+void net_tracker_begin_handshake(void)
+{
+    g_open_handshakes++;
+    g_handshake_last_was_send = false;
+}
+
+void net_tracker_end_handshake(void)
+{
+    if (g_open_handshakes > 0)
+    {
+        g_open_handshakes--;
+    }
+}
+
+void net_tracker_get_info(NET_TRACKER_INFO* info)
+{
+    if (info != NULL)
+    {
+        info->packet_count = g_packet_count;
+        info->dropped_count = g_dropped_count;
+        info->bytes_sent = g_bytes_sent;
+        info->bytes_recv = g_bytes_recv;
+        info->packets = g_packets;
+        memcpy(info->phases, g_phase_totals, sizeof(g_phase_totals));
+        info->handshake_sent = g_handshake_sent;
+        info->handshake_recv = g_handshake_recv;
+        info->handshake_round_trips = g_handshake_round_trips;
+    }
+}
+#else
+bool net_tracker_is_enabled(void)
+{
+    return false;
+}
+
+void net_tracker_reset(void)
+{
+}
+
+void net_tracker_set_phase(NET_PHASE phase)
+{
+    (void)phase;
+}
+
+void net_tracker_begin_handshake(void)
+{
+}
+
+void net_tracker_end_handshake(void)
+{
+}
+
+void net_tracker_get_info(NET_TRACKER_INFO* info)
+{
+    if (info != NULL)
+    {
+        memset(info, 0, sizeof(NET_TRACKER_INFO));
+    }
+}
+#endif
+
+static void report_packet_metrics(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info, const NET_TRACKER_INFO* info, size_t msg_count)
+{
+    REPORT_METRIC metrics[14];
+    size_t count = 0;
+    size_t msg_sends = 0;
+    size_t msg_bytes = 0;
+    size_t msg_recvs = 0;
+    size_t small_sends = 0;
+    size_t total_sends = 0;
+    size_t largest_send = 0;
+    size_t idle_gaps = 0;
+    uint64_t max_gap = 0;
+    uint64_t idle_time = 0;
+
+    for (size_t index = 0; index < info->packet_count; index++)
+    {
+        const NET_PACKET* packet = &info->packets[index];
+        if (packet->is_send)
+        {
+            total_sends++;
+            if (packet->size < NET_SMALL_SEND_SIZE)
+            {
+                small_sends++;
+            }
+            if (packet->size > largest_send)
+            {
+                largest_send = packet->size;
+            }
+        }
+        if (packet->phase == NET_PHASE_TELEMETRY)
+        {
+            if (packet->is_send)
+            {
+                msg_sends++;
+                msg_bytes += packet->size;
+            }
+            else
+            {
+                msg_recvs++;
+            }
+        }
+        if (index > 0)
+        {
+            uint64_t gap = packet->time_us - info->packets[index - 1].time_us;
+            if (gap > max_gap)
+            {
+                max_gap = gap;
+            }
+            if (gap >= NET_IDLE_GAP_US)
+            {
+                idle_gaps++;
+                idle_time += gap;
+            }
+        }
+    }
+
+    metrics[count].name = "packets";
+    metrics[count++].value = (double)info->packet_count;
+    metrics[count].name = "droppedPackets";
+    metrics[count++].value = (double)info->dropped_count;
+    metrics[count].name = "bytesPerMsg";
+    metrics[count++].value = msg_count == 0 ? 0.0 : (double)msg_bytes / msg_count;
+    metrics[count].name = "sendsPerMsg";
+    metrics[count++].value = msg_count == 0 ? 0.0 : (double)msg_sends / msg_count;
+    metrics[count].name = "recvsPerMsg";
+    metrics[count++].value = msg_count == 0 ? 0.0 : (double)msg_recvs / msg_count;
+    metrics[count].name = "avgMsgSendSize";
+    metrics[count++].value = msg_sends == 0 ? 0.0 : (double)msg_bytes / msg_sends;
+    metrics[count].name = "largestSend";
+    metrics[count++].value = (double)largest_send;
+    metrics[count].name = "smallSends";
+    metrics[count++].value = (double)small_sends;
+    metrics[count].name = "smallSendPct";
+    metrics[count++].value = total_sends == 0 ? 0.0 : (double)small_sends * 100 / total_sends;
+    metrics[count].name = "idleGaps";
+    metrics[count++].value = (double)idle_gaps;
+    metrics[count].name = "idleTimeMs";
+    metrics[count++].value = (double)idle_time / 1000;
+    metrics[count].name = "maxGapMs";
+    metrics[count++].value = (double)max_gap / 1000;
+    metrics[count].name = "durationMs";
+    metrics[count++].value = info->packet_count == 0 ? 0.0 : (double)info->packets[info->packet_count - 1].time_us / 1000;
+    report_metrics(handle, iot_mem_info, "NETWORK_PACKETS", metrics, count);
+}
+
+void net_tracker_report(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info, size_t msg_count)
+{
+    if (net_tracker_is_enabled())
+    {
+        NET_TRACKER_INFO info;
+        REPORT_PACKET* timeline;
+
+        net_tracker_get_info(&info);
+        report_packet_metrics(handle, iot_mem_info, &info, msg_count);
+
+        if (info.packet_count > 0)
+        {
+            if ((timeline = (REPORT_PACKET*)malloc(info.packet_count * sizeof(REPORT_PACKET))) == NULL)
+            {
+                (void)printf("Failure allocating packet timeline\r\n");
+            }
+            else
+            {
+                for (size_t index = 0; index < info.packet_count; index++)
+                {
+                    timeline[index].time_us = info.packets[index].time_us;
+                    timeline[index].is_send = info.packets[index].is_send;
+                    timeline[index].size = info.packets[index].size;
+                    timeline[index].phase = PHASE_NAMES[info.packets[index].phase];
+                }
+                report_packet_timeline(handle, iot_mem_info, "PACKET_TIMELINE", timeline, info.packet_count);
+                free(timeline);
+            }
+        }
+    }
+}
@@ -0,0 +1,88 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef NET_TRACKER_H
+#define NET_TRACKER_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdbool>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#include "mem_reporter.h"
+
+#define NET_TRACKER_MAX_PACKETS     8192
+// Largest plaintext a single TLS record can carry
+#define NET_TLS_MAX_RECORD_DATA     16384
+
+    // What the application was doing when a packet went out or came in
+    typedef enum NET_PHASE_TAG
+    {
+        NET_PHASE_CONNECT,
+        NET_PHASE_IDLE,
+        NET_PHASE_TELEMETRY,
+        NET_PHASE_DISCONNECT,
+        NET_PHASE_COUNT
+    } NET_PHASE;
+
+    typedef struct NET_PACKET_TAG
+    {
+        // Microseconds since the last reset
+        uint64_t time_us;
+        bool is_send;
+        size_t size;
+        NET_PHASE phase;
+    } NET_PACKET;
+
+    // Kept for every packet, including the ones past the end of the timeline
+    typedef struct NET_PHASE_TOTALS_TAG
+    {
+        uint64_t bytes_sent;
+        uint64_t bytes_recv;
+        size_t sends;
+        size_t recvs;
+        // TLS records whose header went out or came in during the phase
+        size_t records_sent;
+        size_t records_recv;
+        size_t largest_record_sent;
+    } NET_PHASE_TOTALS;
+
+    typedef struct NET_TRACKER_INFO_TAG
+    {
+        size_t packet_count;
+        // Packets that arrived after the timeline was full, they are still in the gbnetwork totals
+        size_t dropped_count;
+        // Totals include the dropped packets
+        uint64_t bytes_sent;
+        uint64_t bytes_recv;
+        const NET_PACKET* packets;
+        NET_PHASE_TOTALS phases[NET_PHASE_COUNT];
+        // Socket traffic while a tls open was in progress, counted on every packet
+        uint64_t handshake_sent;
+        uint64_t handshake_recv;
+        // Replies that followed a send, the tcp connect below the socket is not included
+        size_t handshake_round_trips;
+    } NET_TRACKER_INFO;
+
+    // The tracker sits between socketio and gbnetwork through the linker's --wrap option, it
+    // is only active when the target was linked with add_net_tracker()
+    extern bool net_tracker_is_enabled(void);
+    extern void net_tracker_reset(void);
+    extern void net_tracker_set_phase(NET_PHASE phase);
+    // Called by the tls tap around each open so the handshake does not depend on the timeline
+    extern void net_tracker_begin_handshake(void);
+    extern void net_tracker_end_handshake(void);
+    extern void net_tracker_get_info(NET_TRACKER_INFO* info);
+    extern void net_tracker_report(REPORT_HANDLE handle, const MEM_ANALYSIS_INFO* iot_mem_info, size_t msg_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* NET_TRACKER_H */
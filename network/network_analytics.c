@@ -6,11 +6,13 @@
 
 #ifdef IOTHUB_CLIENT
     #include "network_info.h"
+    #include "reconnect_info.h"
 #else
     #include "prov_net_info.h"
 #endif
 
 #include "azure_c_shared_utility/connection_string_parser.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/platform.h"
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/gbnetwork.h"
@@ -18,10 +20,21 @@
 #include "iothub_service_client_auth.h"
 #include "iothub_registrymanager.h"
 
+#include "hub_control.h"
+
 static const char* DEVICE_CONNECTION_STRING_FMT = "HostName=%s;DeviceId=%s;SharedAccessKey=%s";
+static const char* ANALYTICS_DEVICE_ID = "mem_analytics_device";
 
 #define USE_MSG_BYTE_ARRAY  1
+#define DEVICE_CREATED_REGISTRY 1
+#define DEVICE_CREATED_LOCAL    2
+#define MAX_DEVICE_KEY_LEN      128
 #define MESSAGES_TO_USE    1
+#define DEFAULT_PAYLOAD_SIZE    962
+// IoT Hub caps a device to cloud message at 256KB, properties included
+#define MAX_SWEEP_PAYLOAD_SIZE  (255 * 1024)
+
+static const size_t SWEEP_PAYLOAD_SIZES[] = { 1, 16, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536, 131072, MAX_SWEEP_PAYLOAD_SIZE };
 
 typedef enum ARGUEMENT_TYPE_TAG
 {
@@ -30,15 +43,31 @@ typedef enum ARGUEMENT_TYPE_TAG
     ARGUEMENT_TYPE_SCOPE_ID,
     ARGUEMENT_TYPE_DEVICE_ID,
     ARGUEMENT_TYPE_DEVICE_KEY,
-    ARGUEMENT_TYPE_EXCLUDE_CONN_HEADER
+    ARGUEMENT_TYPE_EXCLUDE_CONN_HEADER,
+    ARGUEMENT_TYPE_TRUSTED_CERT,
+    ARGUEMENT_TYPE_HUB_CONTROL,
+    ARGUEMENT_TYPE_MSG_COUNT,
+    ARGUEMENT_TYPE_PAYLOAD_SIZE,
+    ARGUEMENT_TYPE_IDLE_SECONDS,
+    ARGUEMENT_TYPE_FAULT_CONTROL,
+    ARGUEMENT_TYPE_HTTP_PROXY,
+    ARGUEMENT_TYPE_OUTPUT_FILE
 } ARGUEMENT_TYPE;
 
 typedef struct MEM_ANALYTIC_INFO_TAG
 {
     int create_device;
     const char* connection_string;
+    const char* trusted_cert_file;
     IOTHUB_DEVICE device_info;
     int exclude_conn_header;
+    size_t msg_count;
+    size_t payload_size;
+    bool random_payload;
+    bool payload_sweep;
+    size_t idle_seconds;
+    const char* fault_control;
+    const char* output_file;
 } MEM_ANALYTIC_INFO;
 
 static int initialize_sdk()
@@ -90,7 +119,7 @@ static int create_device(MEM_ANALYTIC_INFO* mem_info)
             IOTHUB_REGISTRY_DEVICE_CREATE register_device;
             memset(&register_device, 0, sizeof(register_device));
 
-            register_device.deviceId = "mem_analytics_device";
+            register_device.deviceId = ANALYTICS_DEVICE_ID;
             register_device.primaryKey = "";
             register_device.secondaryKey = "";
             register_device.authMethod = IOTHUB_REGISTRYMANAGER_AUTH_SPK;
@@ -102,7 +131,7 @@ static int create_device(MEM_ANALYTIC_INFO* mem_info)
             }
             else
             {
-                mem_info->create_device = 1;
+                mem_info->create_device = DEVICE_CREATED_REGISTRY;
                 result = 0;
             }
             IoTHubRegistryManager_Destroy(reg_mgr_handle);
@@ -112,6 +141,37 @@ static int create_device(MEM_ANALYTIC_INFO* mem_info)
     return result;
 }
 
+// The local hub keeps its own registry, the device is created over the control channel
+static int create_local_device(MEM_ANALYTIC_INFO* mem_info, const CONNECTION_INFO* conn_info)
+{
+    int result;
+    char command[HUB_CONTROL_RESPONSE_LEN];
+    char response[HUB_CONTROL_RESPONSE_LEN];
+    char device_key[MAX_DEVICE_KEY_LEN];
+
+    (void)snprintf(command, sizeof(command), "DEVICE %s", ANALYTICS_DEVICE_ID);
+    if (hub_control_execute(conn_info->hub_control, command, response, sizeof(response)) != 0 ||
+        hub_control_get_string(response, "key", device_key, sizeof(device_key)) != 0)
+    {
+        (void)printf("Failed creating device on the local hub\r\n");
+        result = __LINE__;
+    }
+    else if (mallocAndStrcpy_s((char**)&mem_info->device_info.deviceId, ANALYTICS_DEVICE_ID) != 0 ||
+        mallocAndStrcpy_s((char**)&mem_info->device_info.primaryKey, device_key) != 0)
+    {
+        (void)printf("Failure allocating local device info\r\n");
+        free((char*)mem_info->device_info.deviceId);
+        mem_info->device_info.deviceId = NULL;
+        result = __LINE__;
+    }
+    else
+    {
+        mem_info->create_device = DEVICE_CREATED_LOCAL;
+        result = 0;
+    }
+    return result;
+}
+
 static void remove_device(MEM_ANALYTIC_INFO* mem_info)
 {
     IOTHUB_SERVICE_CLIENT_AUTH_HANDLE svc_client_handle = IoTHubServiceClientAuth_CreateFromConnectionString(mem_info->connection_string);
@@ -210,9 +270,43 @@ static int construct_dev_conn_string(MEM_ANALYTIC_INFO* mem_info, CONNECTION_INF
     return result;
 }
 
+static char* load_trusted_cert(const char* cert_file)
+{
+    char* result = NULL;
+    FILE* file = fopen(cert_file, "rb");
+    if (file == NULL)
+    {
+        (void)printf("Failure opening certificate file %s\r\n", cert_file);
+    }
+    else
+    {
+        long file_len;
+        if (fseek(file, 0, SEEK_END) != 0 || (file_len = ftell(file)) <= 0 || fseek(file, 0, SEEK_SET) != 0)
+        {
+            (void)printf("Failure reading certificate file %s\r\n", cert_file);
+        }
+        else if ((result = malloc(file_len + 1)) == NULL)
+        {
+            (void)printf("Failure allocating certificate\r\n");
+        }
+        else if (fread(result, 1, file_len, file) != (size_t)file_len)
+        {
+            (void)printf("Failure reading certificate file %s\r\n", cert_file);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result[file_len] = '\0';
+        }
+        fclose(file);
+    }
+    return result;
+}
+
 static int parse_command_line(int argc, char* argv[], MEM_ANALYTIC_INFO* mem_info, CONNECTION_INFO* conn_info)
 {
-    // -c "[connection_string]" -d [device_name] -k [device_key] -x -s [scope_id]
+    // -c "[connection_string]" -d [device_name] -k [device_key] -x -s [scope_id] -t [trusted_cert_file] -l [hub_control] -n [msg_count] -p [payload_size] -r -w -i [idle_seconds] -f [fault_control] -e [http_proxy] -o [output_file]
     int result = 0;
     ARGUEMENT_TYPE argument_type = ARGUEMENT_TYPE_UNKNOWN;
 
@@ -241,6 +335,47 @@ static int parse_command_line(int argc, char* argv[], MEM_ANALYTIC_INFO* mem_inf
                 argument_type = ARGUEMENT_TYPE_EXCLUDE_CONN_HEADER;
                 mem_info->exclude_conn_header = 1;
             }
+            else if (argv[index][0] == '-' && (argv[index][1] == 't' || argv[index][1] == 'T'))
+            {
+                argument_type = ARGUEMENT_TYPE_TRUSTED_CERT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'l' || argv[index][1] == 'L'))
+            {
+                argument_type = ARGUEMENT_TYPE_HUB_CONTROL;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'n' || argv[index][1] == 'N'))
+            {
+                argument_type = ARGUEMENT_TYPE_MSG_COUNT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'p' || argv[index][1] == 'P'))
+            {
+                argument_type = ARGUEMENT_TYPE_PAYLOAD_SIZE;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'i' || argv[index][1] == 'I'))
+            {
+                argument_type = ARGUEMENT_TYPE_IDLE_SECONDS;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'f' || argv[index][1] == 'F'))
+            {
+                argument_type = ARGUEMENT_TYPE_FAULT_CONTROL;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'e' || argv[index][1] == 'E'))
+            {
+                argument_type = ARGUEMENT_TYPE_HTTP_PROXY;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'o' || argv[index][1] == 'O'))
+            {
+                argument_type = ARGUEMENT_TYPE_OUTPUT_FILE;
+            }
+            // Flags without a value
+            else if (argv[index][0] == '-' && (argv[index][1] == 'r' || argv[index][1] == 'R'))
+            {
+                mem_info->random_payload = true;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'w' || argv[index][1] == 'W'))
+            {
+                mem_info->payload_sweep = true;
+            }
         }
         else
         {
@@ -258,6 +393,30 @@ static int parse_command_line(int argc, char* argv[], MEM_ANALYTIC_INFO* mem_inf
                 case ARGUEMENT_TYPE_SCOPE_ID:
                     conn_info->scope_id = argv[index];
                     break;
+                case ARGUEMENT_TYPE_TRUSTED_CERT:
+                    mem_info->trusted_cert_file = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_HUB_CONTROL:
+                    conn_info->hub_control = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_MSG_COUNT:
+                    mem_info->msg_count = (size_t)atoi(argv[index]);
+                    break;
+                case ARGUEMENT_TYPE_PAYLOAD_SIZE:
+                    mem_info->payload_size = (size_t)atoi(argv[index]);
+                    break;
+                case ARGUEMENT_TYPE_IDLE_SECONDS:
+                    mem_info->idle_seconds = (size_t)atoi(argv[index]);
+                    break;
+                case ARGUEMENT_TYPE_FAULT_CONTROL:
+                    mem_info->fault_control = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_HTTP_PROXY:
+                    conn_info->http_proxy = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_OUTPUT_FILE:
+                    mem_info->output_file = argv[index];
+                    break;
                 case ARGUEMENT_TYPE_UNKNOWN:
                 default:
                     result = __LINE__;
@@ -267,7 +426,15 @@ static int parse_command_line(int argc, char* argv[], MEM_ANALYTIC_INFO* mem_inf
         }
     }
 
-    if (mem_info->device_info.deviceId == NULL && conn_info->scope_id == NULL)
+    if (result == 0 && mem_info->trusted_cert_file != NULL && (conn_info->trusted_cert = load_trusted_cert(mem_info->trusted_cert_file)) == NULL)
+    {
+        result = __LINE__;
+    }
+    else if (result == 0 && mem_info->device_info.deviceId == NULL && conn_info->scope_id == NULL && conn_info->hub_control != NULL)
+    {
+        result = create_local_device(mem_info, conn_info);
+    }
+    else if (result == 0 && mem_info->device_info.deviceId == NULL && conn_info->scope_id == NULL)
     {
 #ifdef USE_HTTP
         result = create_device(mem_info);
@@ -278,19 +445,72 @@ static int parse_command_line(int argc, char* argv[], MEM_ANALYTIC_INFO* mem_inf
     return result;
 }
 
-static void send_network_info(CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, int exclude_conn_header)
+#ifdef IOTHUB_CLIENT
+static void send_network_info(CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, const MEM_ANALYTIC_INFO* mem_info, size_t payload_size)
+{
+    size_t msg_count = mem_info->msg_count;
+    size_t idle_seconds = mem_info->idle_seconds;
+    int exclude_conn_header = mem_info->exclude_conn_header;
+
+    // With the fault proxy in the path only the reconnects are measured
+    if (mem_info->fault_control != NULL)
+    {
+#ifdef USE_MQTT
+        initiate_reconnect_operation(conn_info, report_handle, PROTOCOL_MQTT, mem_info->fault_control, msg_count);
+        initiate_reconnect_operation(conn_info, report_handle, PROTOCOL_MQTT_WS, mem_info->fault_control, msg_count);
+#endif
+#ifdef USE_AMQP
+        initiate_reconnect_operation(conn_info, report_handle, PROTOCOL_AMQP, mem_info->fault_control, msg_count);
+        initiate_reconnect_operation(conn_info, report_handle, PROTOCOL_AMQP_WS, mem_info->fault_control, msg_count);
+#endif
+    }
+    else
+    {
+        // MQTT Sending
+#ifdef USE_MQTT
+        initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_MQTT, msg_count, USE_MSG_BYTE_ARRAY, payload_size, mem_info->random_payload, idle_seconds, exclude_conn_header);
+        initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_MQTT_WS, msg_count, USE_MSG_BYTE_ARRAY, payload_size, mem_info->random_payload, idle_seconds, exclude_conn_header);
+#endif
+        // AMQP Sending
+#ifdef USE_AMQP
+        initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_AMQP, msg_count, USE_MSG_BYTE_ARRAY, payload_size, mem_info->random_payload, idle_seconds, exclude_conn_header);
+        initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_AMQP_WS, msg_count, USE_MSG_BYTE_ARRAY, payload_size, mem_info->random_payload, idle_seconds, exclude_conn_header);
+#endif
+        // HTTP Polling, only measured while idle
+#ifdef USE_HTTP
+        initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_HTTP, msg_count, USE_MSG_BYTE_ARRAY, payload_size, mem_info->random_payload, idle_seconds, exclude_conn_header);
+#endif
+    }
+}
+#else
+static void send_network_info(CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, const MEM_ANALYTIC_INFO* mem_info, size_t payload_size)
 {
-    // MQTT Sending
+    size_t msg_count = mem_info->msg_count;
+    int exclude_conn_header = mem_info->exclude_conn_header;
+
+    // Registrations have no payload
+    (void)payload_size;
+
+#ifdef USE_MQTT
+    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_MQTT, msg_count, USE_MSG_BYTE_ARRAY, exclude_conn_header);
+    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_MQTT_WS, msg_count, USE_MSG_BYTE_ARRAY, exclude_conn_header);
+#endif
+#ifdef USE_AMQP
+    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_AMQP, msg_count, USE_MSG_BYTE_ARRAY, exclude_conn_header);
+    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_AMQP_WS, msg_count, USE_MSG_BYTE_ARRAY, exclude_conn_header);
+#endif
+
+    // The provisioning client has an upper layer on top of the same transports
 #ifdef USE_MQTT
-    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_MQTT, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY, exclude_conn_header);
-    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_MQTT_WS, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY, exclude_conn_header);
+    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_MQTT, msg_count, USE_MSG_BYTE_ARRAY, exclude_conn_header);
+    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_MQTT_WS, msg_count, USE_MSG_BYTE_ARRAY, exclude_conn_header);
 #endif
-    // AMQP Sending
 #ifdef USE_AMQP
-    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_AMQP, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY, exclude_conn_header);
-    initiate_lower_level_operation(conn_info, report_handle, PROTOCOL_AMQP_WS, MESSAGES_TO_USE, USE_MSG_BYTE_ARRAY, exclude_conn_header);
+    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_AMQP, msg_count, USE_MSG_BYTE_ARRAY, exclude_conn_header);
+    initiate_upper_level_operation(conn_info, report_handle, PROTOCOL_AMQP_WS, msg_count, USE_MSG_BYTE_ARRAY, exclude_conn_header);
 #endif
 }
+#endif
 
 int main(int argc, char* argv[])
 {
@@ -301,6 +521,8 @@ int main(int argc, char* argv[])
 
     memset(&mem_info, 0, sizeof(mem_info));
     memset(&conn_info, 0, sizeof(conn_info));
+    mem_info.msg_count = MESSAGES_TO_USE;
+    mem_info.payload_size = DEFAULT_PAYLOAD_SIZE;
 
     if (parse_command_line(argc, argv, &mem_info, &conn_info) != 0)
     {
@@ -326,11 +548,21 @@ int main(int argc, char* argv[])
     }
     else
     {
-        send_network_info(&conn_info, report_handle, mem_info.exclude_conn_header);
+        if (mem_info.payload_sweep)
+        {
+            for (size_t index = 0; index < sizeof(SWEEP_PAYLOAD_SIZES) / sizeof(SWEEP_PAYLOAD_SIZES[0]); index++)
+            {
+                send_network_info(&conn_info, report_handle, &mem_info, SWEEP_PAYLOAD_SIZES[index]);
+            }
+        }
+        else
+        {
+            send_network_info(&conn_info, report_handle, &mem_info, mem_info.payload_size);
+        }
 
         result = 0;
 
-        if (mem_info.create_device != 0)
+        if (mem_info.create_device == DEVICE_CREATED_REGISTRY)
         {
 #ifdef USE_HTTP
             remove_device(&mem_info);
@@ -341,7 +573,7 @@ int main(int argc, char* argv[])
         platform_deinit();
         gbnetwork_deinit();
 
-        report_write(report_handle, NULL, NULL);
+        report_write(report_handle, mem_info.output_file, NULL);
 
         report_deinitialize(report_handle);
 
@@ -351,6 +583,7 @@ int main(int argc, char* argv[])
             free((char*)mem_info.device_info.primaryKey);
         }
         free(conn_info.device_conn_string);
+        free((char*)conn_info.trusted_cert);
         free((char*)mem_info.device_info.secondaryKey);
         free((char*)mem_info.device_info.generationId);
         free((char*)mem_info.device_info.eTag);
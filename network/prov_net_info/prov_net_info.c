@@ -2,16 +2,15 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "prov_net_info.h"
-#include "mem_reporter.h"
-
-#include "iothub_client.h"
-#include "iothub_message.h"
+#include "latency_stats.h"
+#include "hub_control.h"
 
 #include "azure_c_shared_utility/threadapi.h"
-#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/connection_string_parser.h"
 #include "azure_c_shared_utility/shared_util_options.h"
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/gbnetwork.h"
@@ -20,31 +19,48 @@
 #include "azure_prov_client/prov_device_ll_client.h"
 #include "azure_prov_client/prov_security_factory.h"
 
-#include "azure_prov_client/prov_transport_http_client.h"
-#include "azure_prov_client/prov_transport_amqp_client.h"
-#include "azure_prov_client/prov_transport_amqp_ws_client.h"
-#include "azure_prov_client/prov_transport_mqtt_ws_client.h"
-#include "azure_prov_client/prov_transport_mqtt_client.h"
+#ifdef USE_MQTT
+    #include "azure_prov_client/prov_transport_mqtt_client.h"
+    #include "azure_prov_client/prov_transport_mqtt_ws_client.h"
+#endif
+#ifdef USE_AMQP
+    #include "azure_prov_client/prov_transport_amqp_client.h"
+    #include "azure_prov_client/prov_transport_amqp_ws_client.h"
+#endif
+#ifdef USE_HTTP
+    #include "azure_prov_client/prov_transport_http_client.h"
+#endif
 
 #include "../certs/certs.h"
 
-#include "iothub_client_version.h"
+#define REGISTER_TIMEOUT_MS         60000
+#define UL_WAIT_SLEEP_MS            10
+#define MAX_PROXY_HOST_LEN          256
+#define PROV_METRIC_COUNT           (3 + LATENCY_METRIC_COUNT)
 
 static const char* const GLOBAL_PROV_URI = "global.azure-devices-provisioning.net";
-
-#define WAIT_TIME           2*1000
+static const char* const PROV_REPORT_NAME = "PROVISIONING";
 
 typedef struct PROV_TEST_INFO_TAG
 {
-    int connected;
     int registration_complete;
     int error;
+    uint64_t complete_ns;
 } PROV_TEST_INFO;
 
+// HostName=<endpoint>;DeviceId=<registration id>;SharedAccessKey=<key>, without
+// a DeviceId the device registers with the X509 identity of the hsm
+typedef struct PROV_DEVICE_INFO_TAG
+{
+    MAP_HANDLE parse_handle;
+    const char* prov_uri;
+    const char* registration_id;
+    const char* symmetric_key;
+} PROV_DEVICE_INFO;
+
 static PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION initialize(MEM_ANALYSIS_INFO* prov_mem_info, PROTOCOL_TYPE protocol, size_t num_msgs_to_send)
 {
     PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION result;
-    (void)num_msgs_to_send;
 
     prov_mem_info->msg_sent = num_msgs_to_send;
     prov_mem_info->iothub_version = Prov_Device_GetVersionString();
@@ -53,24 +69,48 @@ static PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION initialize(MEM_ANALYSIS_INFO* pro
 
     switch (protocol)
     {
-    case PROTOCOL_MQTT:
-        result = Prov_Device_MQTT_Protocol;
-        break;
-    case PROTOCOL_MQTT_WS:
-        result = Prov_Device_MQTT_WS_Protocol;
-        break;
-    case PROTOCOL_HTTP:
-        result = Prov_Device_HTTP_Protocol;
-        break;
-    case PROTOCOL_AMQP:
-        result = Prov_Device_AMQP_Protocol;
-        break;
-    case PROTOCOL_AMQP_WS:
-        result = Prov_Device_AMQP_WS_Protocol;
-        break;
-    default:
-        result = NULL;
-        break;
+#ifdef USE_MQTT
+        case PROTOCOL_MQTT:
+            result = Prov_Device_MQTT_Protocol;
+            break;
+        case PROTOCOL_MQTT_WS:
+            result = Prov_Device_MQTT_WS_Protocol;
+            break;
+#endif
+#ifdef USE_HTTP
+        case PROTOCOL_HTTP:
+            result = Prov_Device_HTTP_Protocol;
+            break;
+#endif
+#ifdef USE_AMQP
+        case PROTOCOL_AMQP:
+            result = Prov_Device_AMQP_Protocol;
+            break;
+        case PROTOCOL_AMQP_WS:
+            result = Prov_Device_AMQP_WS_Protocol;
+            break;
+#endif
+        default:
+            result = NULL;
+            break;
+    }
+    return result;
+}
+
+// The websocket and http transports reach the hub through the http proxy when one is
+// given, a local hub running without root only has its https port behind it
+static bool get_proxy_options(const CONNECTION_INFO* conn_info, PROTOCOL_TYPE protocol, char* proxy_host, size_t host_len, HTTP_PROXY_OPTIONS* proxy_options)
+{
+    bool result = false;
+    const char* port = conn_info->http_proxy == NULL ? NULL : strrchr(conn_info->http_proxy, ':');
+    if ((protocol == PROTOCOL_MQTT_WS || protocol == PROTOCOL_AMQP_WS || protocol == PROTOCOL_HTTP) && port != NULL && port != conn_info->http_proxy && (size_t)(port - conn_info->http_proxy) < host_len)
+    {
+        memcpy(proxy_host, conn_info->http_proxy, (size_t)(port - conn_info->http_proxy));
+        proxy_host[port - conn_info->http_proxy] = '\0';
+        memset(proxy_options, 0, sizeof(HTTP_PROXY_OPTIONS));
+        proxy_options->host_address = proxy_host;
+        proxy_options->port = atoi(port + 1);
+        result = true;
     }
     return result;
 }
@@ -78,6 +118,10 @@ static PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION initialize(MEM_ANALYSIS_INFO* pro
 static void register_device_callback(PROV_DEVICE_RESULT register_result, const char* iothub_uri, const char* device_id, void* user_context)
 {
     PROV_TEST_INFO* prov_info = (PROV_TEST_INFO*)user_context;
+    (void)iothub_uri;
+    (void)device_id;
+
+    prov_info->complete_ns = latency_stats_get_time_ns();
     if (register_result == PROV_DEVICE_RESULT_OK)
     {
         prov_info->registration_complete = 1;
@@ -88,75 +132,260 @@ static void register_device_callback(PROV_DEVICE_RESULT register_result, const c
     }
 }
 
-int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg)
+static int parse_device_info(const CONNECTION_INFO* conn_info, PROV_DEVICE_INFO* device_info)
+{
+    int result;
+    memset(device_info, 0, sizeof(PROV_DEVICE_INFO));
+
+    if (conn_info->scope_id == NULL)
+    {
+        (void)printf("Failure the scope id is required for provisioning\r\n");
+        result = __LINE__;
+    }
+    else if ((device_info->parse_handle = connectionstringparser_parse_from_char(conn_info->device_conn_string)) == NULL)
+    {
+        (void)printf("Failure parsing connection string\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        device_info->prov_uri = Map_GetValueFromKey(device_info->parse_handle, "HostName");
+        device_info->registration_id = Map_GetValueFromKey(device_info->parse_handle, "DeviceId");
+        device_info->symmetric_key = Map_GetValueFromKey(device_info->parse_handle, "SharedAccessKey");
+        if (device_info->prov_uri == NULL || device_info->registration_id == NULL)
+        {
+            device_info->prov_uri = GLOBAL_PROV_URI;
+            device_info->registration_id = NULL;
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static int init_security(const PROV_DEVICE_INFO* device_info)
+{
+    int result;
+    if (device_info->registration_id == NULL)
+    {
+        result = prov_dev_security_init(SECURE_DEVICE_TYPE_X509);
+    }
+    else if (prov_dev_set_symmetric_key_info(device_info->registration_id, device_info->symmetric_key) != 0)
+    {
+        (void)printf("prov_dev_set_symmetric_key_info failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        result = prov_dev_security_init(SECURE_DEVICE_TYPE_SYMMETRIC_KEY);
+    }
+    return result;
+}
+
+static int register_device_ll(const CONNECTION_INFO* conn_info, const PROV_DEVICE_INFO* device_info, PROTOCOL_TYPE protocol, PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION prov_transport, PROV_TEST_INFO* prov_info, uint64_t* start_time)
+{
+    int result;
+    HTTP_PROXY_OPTIONS proxy_options;
+    char proxy_host[MAX_PROXY_HOST_LEN];
+    PROV_DEVICE_LL_HANDLE prov_device_handle;
+
+    if ((prov_device_handle = Prov_Device_LL_Create(device_info->prov_uri, conn_info->scope_id, prov_transport)) == NULL)
+    {
+        (void)printf("failed calling Prov_Device_LL_Create\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        (void)Prov_Device_LL_SetOption(prov_device_handle, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+        if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
+        {
+            (void)Prov_Device_LL_SetOption(prov_device_handle, OPTION_HTTP_PROXY, &proxy_options);
+        }
+
+        *start_time = latency_stats_get_time_ns();
+        if (Prov_Device_LL_Register_Device(prov_device_handle, register_device_callback, prov_info, NULL, NULL) != PROV_DEVICE_RESULT_OK)
+        {
+            (void)printf("failed calling Prov_Device_LL_Register_Device\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            do
+            {
+                Prov_Device_LL_DoWork(prov_device_handle);
+                ThreadAPI_Sleep(1);
+            } while (prov_info->registration_complete == 0 && prov_info->error == 0 && (latency_stats_get_time_ns() - *start_time) / 1000000 < REGISTER_TIMEOUT_MS);
+            result = 0;
+        }
+        Prov_Device_LL_Destroy(prov_device_handle);
+    }
+    return result;
+}
+
+static int register_device_ul(const CONNECTION_INFO* conn_info, const PROV_DEVICE_INFO* device_info, PROTOCOL_TYPE protocol, PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION prov_transport, PROV_TEST_INFO* prov_info, uint64_t* start_time)
 {
     int result;
-    SECURE_DEVICE_TYPE hsm_type;
-    //hsm_type = SECURE_DEVICE_TYPE_TPM;
-    hsm_type = SECURE_DEVICE_TYPE_X509;
+    HTTP_PROXY_OPTIONS proxy_options;
+    char proxy_host[MAX_PROXY_HOST_LEN];
+    PROV_DEVICE_HANDLE prov_device_handle;
 
-    if (prov_dev_security_init(hsm_type) != 0)
+    if ((prov_device_handle = Prov_Device_Create(device_info->prov_uri, conn_info->scope_id, prov_transport)) == NULL)
     {
-        (void)printf("prov_dev_security_init failed\r\n");
+        (void)printf("failed calling Prov_Device_Create\r\n");
         result = __LINE__;
     }
     else
     {
-        PROV_TEST_INFO prov_info;
-        PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION prov_transport;
-        PROV_DEVICE_LL_HANDLE prov_device_handle;
-        MEM_ANALYSIS_INFO prov_mem_info;
-        memset(&prov_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
-        memset(&prov_info, 0, sizeof(PROV_TEST_INFO));
+        (void)Prov_Device_SetOption(prov_device_handle, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+        if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
+        {
+            (void)Prov_Device_SetOption(prov_device_handle, OPTION_HTTP_PROXY, &proxy_options);
+        }
+
+        *start_time = latency_stats_get_time_ns();
+        if (Prov_Device_Register_Device(prov_device_handle, register_device_callback, prov_info, NULL, NULL) != PROV_DEVICE_RESULT_OK)
+        {
+            (void)printf("failed calling Prov_Device_Register_Device\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            while (prov_info->registration_complete == 0 && prov_info->error == 0 && (latency_stats_get_time_ns() - *start_time) / 1000000 < REGISTER_TIMEOUT_MS)
+            {
+                ThreadAPI_Sleep(UL_WAIT_SLEEP_MS);
+            }
+            result = 0;
+        }
+        Prov_Device_Destroy(prov_device_handle);
+    }
+    return result;
+}
 
-        prov_mem_info.operation_type = OPERATION_MEMORY;
-        prov_mem_info.feature_type = FEATURE_PROVISIONING_LL;
+// Registration requests and status polls the local DPS stand-in answered, 0 against the real service
+static uint64_t get_dps_round_trips(const CONNECTION_INFO* conn_info)
+{
+    uint64_t result = 0;
+    char response[HUB_CONTROL_RESPONSE_LEN];
+    uint64_t registrations;
+    uint64_t polls;
 
-        gballoc_resetMetrics();
+    if (conn_info->hub_control != NULL &&
+        hub_control_execute(conn_info->hub_control, "STATS", response, sizeof(response)) == 0 &&
+        hub_control_get_value(response, "dps_registrations", &registrations) == 0 &&
+        hub_control_get_value(response, "dps_polls", &polls) == 0)
+    {
+        result = registrations + polls;
+    }
+    return result;
+}
 
-        if ((prov_transport = initialize(&prov_mem_info, protocol, num_msgs_to_send)) == NULL)
+static int execute_registrations(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, size_t num_registrations, FEATURE_TYPE feature_type)
+{
+    int result;
+    PROV_DEVICE_INFO device_info;
+    PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION prov_transport;
+    LATENCY_STATS_HANDLE latency_stats;
+    MEM_ANALYSIS_INFO prov_mem_info;
+    memset(&prov_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
+
+    if ((prov_transport = initialize(&prov_mem_info, protocol, num_registrations)) == NULL)
+    {
+        (void)printf("failed initializing operation\r\n");
+        result = __LINE__;
+    }
+    else if (parse_device_info(conn_info, &device_info) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        if ((latency_stats = latency_stats_create(num_registrations)) == NULL)
         {
-            (void)printf("failed initializing operation\r\n");
+            (void)printf("Failed creating latency stats\r\n");
             result = __LINE__;
         }
-        else if ((prov_device_handle = Prov_Device_LL_Create(GLOBAL_PROV_URI, conn_info->scope_id, prov_transport)) == NULL)
+        else if (init_security(&device_info) != 0)
         {
-            (void)printf("failed calling Prov_Device_Create\r\n");
+            (void)printf("prov_dev_security_init failed\r\n");
             result = __LINE__;
         }
         else
         {
-            Prov_Device_LL_SetOption(prov_device_handle, OPTION_TRUSTED_CERT, certificates);
+            REPORT_METRIC metrics[PROV_METRIC_COUNT];
+            LATENCY_SUMMARY summary;
+            size_t metric_count = 0;
+            size_t assigned = 0;
+            size_t attempts;
 
-            if (Prov_Device_LL_Register_Device(prov_device_handle, register_device_callback, &prov_info, NULL, NULL) != PROV_DEVICE_RESULT_OK)
+            if (conn_info->hub_control != NULL)
             {
-                (void)printf("failed calling Prov_Device_LL_Register_Device\r\n");
-                result = __LINE__;
+                char response[HUB_CONTROL_RESPONSE_LEN];
+                (void)hub_control_execute(conn_info->hub_control, "RESET", response, sizeof(response));
             }
-            else
+
+            prov_mem_info.operation_type = OPERATION_NETWORK;
+            prov_mem_info.feature_type = feature_type;
+
+            gballoc_resetMetrics();
+            gbnetwork_resetMetrics();
+
+            result = 0;
+            for (attempts = 0; attempts < num_registrations && result == 0; attempts++)
             {
-                result = 0;
-                do
+                PROV_TEST_INFO prov_info;
+                uint64_t start_time;
+                memset(&prov_info, 0, sizeof(PROV_TEST_INFO));
+
+                if (feature_type == FEATURE_PROVISIONING_LL)
                 {
-                    Prov_Device_LL_DoWork(prov_device_handle);
-                    ThreadAPI_Sleep(WAIT_TIME);
-                } while (prov_info.registration_complete == 0);
+                    result = register_device_ll(conn_info, &device_info, protocol, prov_transport, &prov_info, &start_time);
+                }
+                else
+                {
+                    result = register_device_ul(conn_info, &device_info, protocol, prov_transport, &prov_info, &start_time);
+                }
+
+                if (result == 0 && prov_info.registration_complete != 0)
+                {
+                    latency_stats_add(latency_stats, prov_info.complete_ns - start_time);
+                    assigned++;
+                }
+                else if (result == 0)
+                {
+                    (void)printf("Registration of %s failed or timed out\r\n", device_info.registration_id == NULL ? "x509 device" : device_info.registration_id);
+                }
             }
-            Prov_Device_LL_Destroy(prov_device_handle);
-        }
-        prov_dev_security_deinit();
 
-        report_network_usage(&prov_mem_info);
+            report_network_usage(report_handle, &prov_mem_info);
+
+            latency_stats_get_summary(latency_stats, &summary);
+            metrics[metric_count].name = "registrations";
+            metrics[metric_count++].value = (double)attempts;
+            metrics[metric_count].name = "registrationsAssigned";
+            metrics[metric_count++].value = (double)assigned;
+            metrics[metric_count].name = "roundTripsPerRegistration";
+            metrics[metric_count++].value = attempts == 0 ? 0.0 : (double)get_dps_round_trips(conn_info) / attempts;
+            metric_count += latency_stats_fill_metrics(&summary, &metrics[metric_count]);
+            report_metrics(report_handle, &prov_mem_info, PROV_REPORT_NAME, metrics, metric_count);
+
+            prov_dev_security_deinit();
+        }
+        latency_stats_destroy(latency_stats);
+        Map_Destroy(device_info.parse_handle);
     }
     return result;
 }
 
-int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg)
+int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg, int exclude_conn_header)
 {
-    (void)conn_info;
-    (void)protocol;
-    (void)num_msgs_to_send;
+    // Registration is all connection setup, there is no header to exclude
     (void)use_byte_array_msg;
-    int result = 0;
-    return result;
+    (void)exclude_conn_header;
+    return execute_registrations(conn_info, report_handle, protocol, num_msgs_to_send, FEATURE_PROVISIONING_LL);
+}
+
+int initiate_upper_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg, int exclude_conn_header)
+{
+    (void)use_byte_array_msg;
+    (void)exclude_conn_header;
+    return execute_registrations(conn_info, report_handle, protocol, num_msgs_to_send, FEATURE_PROVISIONING_UL);
 }
@@ -5,6 +5,11 @@
 
 #include "network_info.h"
 #include "mem_reporter.h"
+#include "net_tracker.h"
+#include "net_overhead.h"
+#include "msg_latency.h"
+#include "latency_stats.h"
+#include "sim_clock.h"
 
 #include "iothub_client_version.h"
 #include "iothub_device_client_ll.h"
@@ -27,20 +32,48 @@
     #include "iothubtransportamqp_websockets.h"
 #endif
 
+#ifdef USE_HTTP
+    #include "iothubtransporthttp.h"
+#endif
+
 #include "../certs/certs.h"
 
 #define PROXY_PORT              8888
 #define MESSAGES_TO_USE         1
 #define TIME_BETWEEN_MESSAGES   1
-#define MESSAGE_PAYLOAD_LENGTH  962
+#define MAX_PAYLOAD_LENGTH      (256 * 1024)
+#define CONFIRM_TIMEOUT_MS      30000
+#define PAYLOAD_METRIC_COUNT    14
+// Quiet DoWork calls before the simulated clock is moved, the stack gets to answer first
+#define IDLE_QUIET_LOOPS        10
+#define IDLE_CLOCK_STEP_MS      1000
+#define IDLE_METRIC_COUNT       18
+#define SECONDS_PER_HOUR        3600.0
+#define MAX_PROXY_HOST_LEN      256
+
+static char g_payload[MAX_PAYLOAD_LENGTH + 1];
 
 typedef struct IOTHUB_CLIENT_SAMPLE_INFO_TAG
 {
     int connected;
     int stop_running;
     int exclude_conn_header;
+    int authenticated;
+    int in_idle;
+    size_t disconnects;
+    size_t reconnects;
 } IOTHUB_CLIENT_INFO;
 
+typedef struct IDLE_SNAPSHOT_TAG
+{
+    uint64_t bytes_sent;
+    uint64_t bytes_recv;
+    size_t heap_used;
+    size_t disconnects;
+    size_t reconnects;
+    NET_OVERHEAD_INFO overhead;
+} IDLE_SNAPSHOT;
+
 static IOTHUB_CLIENT_TRANSPORT_PROVIDER initialize(MEM_ANALYSIS_INFO* iot_mem_info, PROTOCOL_TYPE protocol, size_t num_msgs_to_send)
 {
     IOTHUB_CLIENT_TRANSPORT_PROVIDER result;
@@ -62,7 +95,11 @@ static IOTHUB_CLIENT_TRANSPORT_PROVIDER initialize(MEM_ANALYSIS_INFO* iot_mem_in
         case PROTOCOL_AMQP_WS:
             result = AMQP_Protocol_over_WebSocketsTls;
             break;
+#ifdef USE_HTTP
         case PROTOCOL_HTTP:
+            result = HTTP_Protocol;
+            break;
+#endif
         default:
             result = NULL;
             break;
@@ -70,6 +107,24 @@ static IOTHUB_CLIENT_TRANSPORT_PROVIDER initialize(MEM_ANALYSIS_INFO* iot_mem_in
     return result;
 }
 
+// The websocket and http transports reach the hub through the http proxy when one is
+// given, mqtt and amqp are pointed at the proxy's port forwards instead
+static bool get_proxy_options(const CONNECTION_INFO* conn_info, PROTOCOL_TYPE protocol, char* proxy_host, size_t host_len, HTTP_PROXY_OPTIONS* proxy_options)
+{
+    bool result = false;
+    const char* port = conn_info->http_proxy == NULL ? NULL : strrchr(conn_info->http_proxy, ':');
+    if ((protocol == PROTOCOL_MQTT_WS || protocol == PROTOCOL_AMQP_WS || protocol == PROTOCOL_HTTP) && port != NULL && port != conn_info->http_proxy && (size_t)(port - conn_info->http_proxy) < host_len)
+    {
+        memcpy(proxy_host, conn_info->http_proxy, (size_t)(port - conn_info->http_proxy));
+        proxy_host[port - conn_info->http_proxy] = '\0';
+        memset(proxy_options, 0, sizeof(HTTP_PROXY_OPTIONS));
+        proxy_options->host_address = proxy_host;
+        proxy_options->port = atoi(port + 1);
+        result = true;
+    }
+    return result;
+}
+
 static void iothub_connection_status(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* user_context)
 {
     (void)reason;
@@ -83,11 +138,29 @@ static void iothub_connection_status(IOTHUB_CLIENT_CONNECTION_STATUS result, IOT
         if (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED)
         {
             iothub_info->connected = 1;
-            // Reset the Metrics so to not get the connection preamble included, just the sends
-            if (iothub_info->exclude_conn_header == 0)
+            if (iothub_info->authenticated == 0)
+            {
+                iothub_info->authenticated = 1;
+                net_tracker_set_phase(NET_PHASE_IDLE);
+                // Reset the Metrics so to not get the connection preamble included, just the sends
+                if (iothub_info->exclude_conn_header == 0)
+                {
+                    gbnetwork_resetMetrics();
+                }
+            }
+            else
+            {
+                iothub_info->reconnects++;
+            }
+        }
+        else if (iothub_info->in_idle != 0)
+        {
+            // Sas token renewals and keepalive failures reconnect on their own while idle
+            if (iothub_info->connected != 0)
             {
-                gbnetwork_resetMetrics();
+                iothub_info->disconnects++;
             }
+            iothub_info->connected = 0;
         }
         else
         {
@@ -97,23 +170,243 @@ static void iothub_connection_status(IOTHUB_CLIENT_CONNECTION_STATUS result, IOT
     }
 }
 
+static IOTHUBMESSAGE_DISPOSITION_RESULT receive_msg_callback(IOTHUB_MESSAGE_HANDLE message, void* user_context)
+{
+    (void)message;
+    (void)user_context;
+    return IOTHUBMESSAGE_ACCEPTED;
+}
+
 static void send_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* user_context)
 {
-    if (user_context == NULL)
+    msg_latency_confirmed(user_context, result == IOTHUB_CLIENT_CONFIRMATION_OK);
+}
+
+// The queued messages are on the wire once a DoWork on the authenticated connection
+// wrote message bytes, the connect, auth and keep alive traffic doesn't count
+static void do_work_and_track(IOTHUB_DEVICE_CLIENT_LL_HANDLE device_client, const IOTHUB_CLIENT_INFO* iothub_info, MSG_LATENCY_HANDLE msg_latency)
+{
+    uint64_t message_bytes = net_overhead_get_bytes_sent(NET_CATEGORY_MESSAGE);
+    IoTHubDeviceClient_LL_DoWork(device_client);
+    if (iothub_info->connected != 0 && net_overhead_get_bytes_sent(NET_CATEGORY_MESSAGE) != message_bytes)
     {
-        (void)printf("iothub_connection_status user_context is NULL\r\n");
+        msg_latency_dispatched(msg_latency);
     }
-    else
+}
+
+// Repeating letters compress trivially, the random payload shows the cost on a link
+// that compresses. A string message ends at the first zero so it is kept to letters.
+static size_t fill_payload(size_t payload_size, bool random_payload, bool use_byte_array_msg)
+{
+    size_t result = payload_size > MAX_PAYLOAD_LENGTH ? MAX_PAYLOAD_LENGTH : payload_size;
+    // xorshift32 with a fixed seed, every run sends the same bytes
+    uint32_t random_state = 2463534242u;
+    char current_value = 'a';
+    for (size_t index = 0; index < result; index++)
     {
-        IOTHUB_CLIENT_INFO* iothub_info = (IOTHUB_CLIENT_INFO*)user_context;
-        iothub_info->stop_running = 1;
+        if (random_payload)
+        {
+            random_state ^= random_state << 13;
+            random_state ^= random_state >> 17;
+            random_state ^= random_state << 5;
+            g_payload[index] = use_byte_array_msg ? (char)(random_state & 0xFF) : (char)('a' + (random_state % 26));
+        }
+        else
+        {
+            g_payload[index] = current_value;
+            if (current_value == 'z')
+            {
+                current_value = 'a';
+            }
+            else
+            {
+                current_value++;
+            }
+        }
+    }
+    g_payload[result] = '\0';
+    return result;
+}
+
+static void report_payload_efficiency(REPORT_HANDLE report_handle, const MEM_ANALYSIS_INFO* iot_mem_info, size_t msg_count, size_t payload_len, bool random_payload)
+{
+    if (net_tracker_is_enabled())
+    {
+        REPORT_METRIC metrics[PAYLOAD_METRIC_COUNT];
+        NET_TRACKER_INFO info;
+        const NET_PHASE_TOTALS* telemetry;
+        uint64_t payload_bytes = (uint64_t)msg_count * payload_len;
+        size_t count = 0;
+
+        net_tracker_get_info(&info);
+        telemetry = &info.phases[NET_PHASE_TELEMETRY];
+
+        metrics[count].name = "payloadSize";
+        metrics[count++].value = (double)payload_len;
+        metrics[count].name = "randomPayload";
+        metrics[count++].value = random_payload ? 1.0 : 0.0;
+        metrics[count].name = "msgCount";
+        metrics[count++].value = (double)msg_count;
+        metrics[count].name = "wireBytesSentPerMsg";
+        metrics[count++].value = msg_count == 0 ? 0.0 : (double)telemetry->bytes_sent / msg_count;
+        metrics[count].name = "wireBytesRecvPerMsg";
+        metrics[count++].value = msg_count == 0 ? 0.0 : (double)telemetry->bytes_recv / msg_count;
+        // Sent and received, the acknowledgements are part of the cost of a message
+        metrics[count].name = "wireBytesPerPayloadByte";
+        metrics[count++].value = payload_bytes == 0 ? 0.0 : (double)(telemetry->bytes_sent + telemetry->bytes_recv) / payload_bytes;
+        metrics[count].name = "payloadEfficiencyPct";
+        metrics[count++].value = telemetry->bytes_sent == 0 ? 0.0 : (double)payload_bytes * 100 / telemetry->bytes_sent;
+        metrics[count].name = "sendsPerMsg";
+        metrics[count++].value = msg_count == 0 ? 0.0 : (double)telemetry->sends / msg_count;
+        metrics[count].name = "recvsPerMsg";
+        metrics[count++].value = msg_count == 0 ? 0.0 : (double)telemetry->recvs / msg_count;
+        // More records than the payload needs means the sdk hands the tls layer each protocol field on its own
+        metrics[count].name = "tlsRecordsPerMsg";
+        metrics[count++].value = msg_count == 0 ? 0.0 : (double)telemetry->records_sent / msg_count;
+        metrics[count].name = "minTlsRecordsPerMsg";
+        metrics[count++].value = payload_len == 0 ? 1.0 : (double)((payload_len + NET_TLS_MAX_RECORD_DATA - 1) / NET_TLS_MAX_RECORD_DATA);
+        metrics[count].name = "avgTlsRecordSize";
+        metrics[count++].value = telemetry->records_sent == 0 ? 0.0 : (double)telemetry->bytes_sent / telemetry->records_sent;
+        metrics[count].name = "largestTlsRecord";
+        metrics[count++].value = (double)telemetry->largest_record_sent;
+        metrics[count].name = "tlsRecordsRecvPerMsg";
+        metrics[count++].value = msg_count == 0 ? 0.0 : (double)telemetry->records_recv / msg_count;
+        report_metrics(report_handle, iot_mem_info, "PAYLOAD_EFFICIENCY", metrics, count);
     }
 }
 
-int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg, int exclude_conn_header)
+static void take_idle_snapshot(const IOTHUB_CLIENT_INFO* iothub_info, IDLE_SNAPSHOT* snapshot)
+{
+    snapshot->bytes_sent = gbnetwork_getBytesSent();
+    snapshot->bytes_recv = gbnetwork_getBytesRecv();
+    snapshot->heap_used = gballoc_getCurrentMemoryUsed();
+    snapshot->disconnects = iothub_info->disconnects;
+    snapshot->reconnects = iothub_info->reconnects;
+    net_overhead_get_info(&snapshot->overhead);
+}
+
+static double get_per_hour(uint64_t end_value, uint64_t start_value, double hours)
+{
+    return hours <= 0.0 || end_value < start_value ? 0.0 : (double)(end_value - start_value) / hours;
+}
+
+static uint64_t get_category_bytes(const NET_OVERHEAD_INFO* overhead, NET_CATEGORY category)
+{
+    return overhead->category[category].bytes_sent + overhead->category[category].bytes_recv;
+}
+
+// Keeps the connection open without sending anything for idle_seconds. With the simulated
+// clock the sdk's timers are moved ahead whenever the stack has gone quiet, so the
+// keepalives, polls and sas renewals of hours happen within seconds of wall clock.
+static void run_idle_period(IOTHUB_DEVICE_CLIENT_LL_HANDLE device_client, IOTHUB_CLIENT_INFO* iothub_info, REPORT_HANDLE report_handle, const MEM_ANALYSIS_INFO* iot_mem_info, size_t idle_seconds)
+{
+    IDLE_SNAPSHOT start;
+    IDLE_SNAPSHOT end;
+    REPORT_METRIC metrics[IDLE_METRIC_COUNT];
+    size_t count = 0;
+    size_t quiet_loops = IDLE_QUIET_LOOPS;
+    size_t wakeups = 0;
+    size_t heap_peak;
+    uint64_t idle_ms = (uint64_t)idle_seconds * 1000;
+    uint64_t elapsed_ms = 0;
+    uint64_t real_start = latency_stats_get_time_ns();
+    uint64_t sim_start = sim_clock_get_offset_ms();
+    double hours;
+
+    iothub_info->in_idle = 1;
+    net_tracker_set_phase(NET_PHASE_IDLE);
+    take_idle_snapshot(iothub_info, &start);
+    heap_peak = start.heap_used;
+
+    while (elapsed_ms < idle_ms)
+    {
+        uint64_t sends = gbnetwork_getNumSends();
+        uint64_t recvs = gbnetwork_getNumRecv();
+        size_t heap_used;
+
+        IoTHubDeviceClient_LL_DoWork(device_client);
+        if (gbnetwork_getNumSends() != sends || gbnetwork_getNumRecv() != recvs)
+        {
+            // Traffic after the stack had gone quiet is a radio wakeup on a real device
+            if (quiet_loops >= IDLE_QUIET_LOOPS)
+            {
+                wakeups++;
+            }
+            quiet_loops = 0;
+        }
+        else if (quiet_loops < IDLE_QUIET_LOOPS)
+        {
+            quiet_loops++;
+        }
+        else if (sim_clock_is_enabled())
+        {
+            sim_clock_advance_ms(IDLE_CLOCK_STEP_MS);
+        }
+        if ((heap_used = gballoc_getCurrentMemoryUsed()) > heap_peak)
+        {
+            heap_peak = heap_used;
+        }
+        ThreadAPI_Sleep(1);
+        elapsed_ms = ((latency_stats_get_time_ns() - real_start) / 1000000) + (sim_clock_get_offset_ms() - sim_start);
+    }
+
+    take_idle_snapshot(iothub_info, &end);
+    iothub_info->in_idle = 0;
+    hours = (double)elapsed_ms / 1000 / SECONDS_PER_HOUR;
+
+    metrics[count].name = "idleSeconds";
+    metrics[count++].value = (double)elapsed_ms / 1000;
+    metrics[count].name = "idleRealSeconds";
+    metrics[count++].value = (double)(latency_stats_get_time_ns() - real_start) / 1000000000;
+    metrics[count].name = "bytesSentPerHour";
+    metrics[count++].value = get_per_hour(end.bytes_sent, start.bytes_sent, hours);
+    metrics[count].name = "bytesRecvPerHour";
+    metrics[count++].value = get_per_hour(end.bytes_recv, start.bytes_recv, hours);
+    metrics[count].name = "wakeupsPerHour";
+    metrics[count++].value = get_per_hour(wakeups, 0, hours);
+    metrics[count].name = "reconnectsPerHour";
+    metrics[count++].value = get_per_hour(end.reconnects, start.reconnects, hours);
+    metrics[count].name = "disconnectsPerHour";
+    metrics[count++].value = get_per_hour(end.disconnects, start.disconnects, hours);
+    metrics[count].name = "heapStart";
+    metrics[count++].value = (double)start.heap_used;
+    metrics[count].name = "heapEnd";
+    metrics[count++].value = (double)end.heap_used;
+    // A steady client returns to the same heap, anything else grows with uptime
+    metrics[count].name = "heapDriftPerHour";
+    metrics[count++].value = hours <= 0.0 ? 0.0 : ((double)end.heap_used - (double)start.heap_used) / hours;
+    metrics[count].name = "heapPeakDelta";
+    metrics[count++].value = (double)(heap_peak - start.heap_used);
+    if (net_overhead_is_enabled())
+    {
+        const NET_OVERHEAD_INFO* first = &start.overhead;
+        const NET_OVERHEAD_INFO* last = &end.overhead;
+
+        metrics[count].name = "keepaliveBytesPerHour";
+        metrics[count++].value = get_per_hour(get_category_bytes(last, NET_CATEGORY_KEEPALIVE), get_category_bytes(first, NET_CATEGORY_KEEPALIVE), hours);
+        metrics[count].name = "keepalivesPerHour";
+        metrics[count++].value = get_per_hour(last->category[NET_CATEGORY_KEEPALIVE].units_sent, first->category[NET_CATEGORY_KEEPALIVE].units_sent, hours);
+        // The cbs put of a renewed sas token, mqtt renews by reconnecting instead
+        metrics[count].name = "authBytesPerHour";
+        metrics[count++].value = get_per_hour(get_category_bytes(last, NET_CATEGORY_AUTH), get_category_bytes(first, NET_CATEGORY_AUTH), hours);
+        metrics[count].name = "reconnectBytesPerHour";
+        metrics[count++].value = get_per_hour(get_category_bytes(last, NET_CATEGORY_CONNECT) + last->handshake_sent + last->handshake_recv,
+            get_category_bytes(first, NET_CATEGORY_CONNECT) + first->handshake_sent + first->handshake_recv, hours);
+        metrics[count].name = "pollBytesPerHour";
+        metrics[count++].value = get_per_hour(get_category_bytes(last, NET_CATEGORY_POLL), get_category_bytes(first, NET_CATEGORY_POLL), hours);
+        metrics[count].name = "pollsPerHour";
+        metrics[count++].value = get_per_hour(last->category[NET_CATEGORY_POLL].units_sent, first->category[NET_CATEGORY_POLL].units_sent, hours);
+        metrics[count].name = "subscribeBytesPerHour";
+        metrics[count++].value = get_per_hour(get_category_bytes(last, NET_CATEGORY_SUBSCRIBE), get_category_bytes(first, NET_CATEGORY_SUBSCRIBE), hours);
+    }
+    report_metrics(report_handle, iot_mem_info, "IDLE_COST", metrics, count);
+}
+
+int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, size_t num_msgs_to_send, bool use_byte_array_msg, size_t payload_size, bool random_payload, size_t idle_seconds, int exclude_conn_header)
 {
     int result;
-    if (protocol == PROTOCOL_HTTP)
+    // Http is only of interest for the cost of its polling
+    if (protocol == PROTOCOL_HTTP && idle_seconds == 0)
     {
         result = 0;
     }
@@ -121,10 +414,14 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
     {
         IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport;
         TICK_COUNTER_HANDLE tick_counter_handle;
+        MSG_LATENCY_HANDLE msg_latency;
         MEM_ANALYSIS_INFO iot_mem_info;
         memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
 
         gbnetwork_resetMetrics();
+        net_tracker_reset();
+        net_overhead_reset(protocol);
+        sim_clock_reset();
 
         if ((iothub_transport = initialize(&iot_mem_info, protocol, num_msgs_to_send)) == NULL)
         {
@@ -136,6 +433,12 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
             (void)printf("tickcounter_create failed\r\n");
             result = __LINE__;
         }
+        else if ((msg_latency = msg_latency_create(num_msgs_to_send)) == NULL)
+        {
+            (void)printf("Failed creating message latency\r\n");
+            tickcounter_destroy(tick_counter_handle);
+            result = __LINE__;
+        }
         else
         {
             gballoc_resetMetrics();
@@ -153,9 +456,17 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
                 result = 0;
                 IOTHUB_CLIENT_INFO iothub_info;
                 size_t msg_count = 0;
+                uint64_t send_start = 0;
+                HTTP_PROXY_OPTIONS proxy_options;
+                char proxy_host[MAX_PROXY_HOST_LEN];
+                size_t payload_len = fill_payload(payload_size, random_payload, use_byte_array_msg);
                 iothub_info.stop_running = 0;
                 iothub_info.connected = 0;
                 iothub_info.exclude_conn_header = exclude_conn_header;
+                iothub_info.authenticated = 0;
+                iothub_info.in_idle = 0;
+                iothub_info.disconnects = 0;
+                iothub_info.reconnects = 0;
 
                 if (protocol == PROTOCOL_HTTP)
                 {
@@ -163,9 +474,18 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
                 }
 
                 (void)IoTHubDeviceClient_LL_SetConnectionStatusCallback(device_client, iothub_connection_status, &iothub_info);
+                if (idle_seconds > 0)
+                {
+                    // A device that listens for cloud to device messages subscribes, attaches or polls
+                    (void)IoTHubDeviceClient_LL_SetMessageCallback(device_client, receive_msg_callback, &iothub_info);
+                }
 
                 // Set the certificate
-                IoTHubDeviceClient_LL_SetOption(device_client, OPTION_TRUSTED_CERT, certificates);
+                IoTHubDeviceClient_LL_SetOption(device_client, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+                if (get_proxy_options(conn_info, protocol, proxy_host, sizeof(proxy_host), &proxy_options))
+                {
+                    (void)IoTHubDeviceClient_LL_SetOption(device_client, OPTION_HTTP_PROXY, &proxy_options);
+                }
                 do
                 {
                     if (iothub_info.connected != 0)
@@ -174,30 +494,15 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
                         if (msg_count < num_msgs_to_send)
                         {
                             IOTHUB_MESSAGE_HANDLE msg_handle;
-                            static char msgText[MESSAGE_PAYLOAD_LENGTH + 1];
-                            memset(msgText, 0, MESSAGE_PAYLOAD_LENGTH + 1);
-                            char current_value = 'a';
-                            for (size_t index = 0; index < MESSAGE_PAYLOAD_LENGTH; index++)
-                            {
-                                msgText[index] = current_value;
-                                if (current_value == 'z')
-                                {
-                                    current_value = 'a';
-                                }
-                                else
-                                {
-                                    current_value++;
-                                }
-                            }
 
-                            iot_mem_info.msg_sent = strlen(msgText);
+                            iot_mem_info.msg_sent = payload_len;
                             if (use_byte_array_msg)
                             {
-                                msg_handle = IoTHubMessage_CreateFromByteArray((const unsigned char*)msgText, iot_mem_info.msg_sent);
+                                msg_handle = IoTHubMessage_CreateFromByteArray((const unsigned char*)g_payload, payload_len);
                             }
                             else
                             {
-                                msg_handle = IoTHubMessage_CreateFromString(msgText);
+                                msg_handle = IoTHubMessage_CreateFromString(g_payload);
                             }
                             if (msg_handle == NULL)
                             {
@@ -218,32 +523,63 @@ int initiate_lower_level_operation(const CONNECTION_INFO* conn_info, REPORT_HAND
                                 iot_mem_info.msg_sent += strlen("property_key");
                                 iot_mem_info.msg_sent += strlen("property_value");
 
-                                if (IoTHubDeviceClient_LL_SendEventAsync(device_client, msg_handle, send_confirm_callback, &iothub_info) != IOTHUB_CLIENT_OK)
+                                // Everything on the wire until the confirmation is attributed to the messages
+                                net_tracker_set_phase(NET_PHASE_TELEMETRY);
+
+                                void* msg_context = msg_latency_enqueue(msg_latency);
+                                if (IoTHubDeviceClient_LL_SendEventAsync(device_client, msg_handle, send_confirm_callback, msg_context) != IOTHUB_CLIENT_OK)
                                 {
                                     (void)printf("ERROR: IoTHubDeviceClient_LL_SendEventAsync..........FAILED!\r\n");
+                                    msg_latency_confirmed(msg_context, false);
                                 }
                                 else
                                 {
-                                    msg_count++;
+                                    if (msg_count++ == 0)
+                                    {
+                                        send_start = latency_stats_get_time_ns();
+                                    }
                                 }
                                 IoTHubMessage_Destroy(msg_handle);
                             }
                         }
                     }
-                    IoTHubDeviceClient_LL_DoWork(device_client);
+                    do_work_and_track(device_client, &iothub_info, msg_latency);
                     ThreadAPI_Sleep(1);
+
+                    // Done once every message was answered
+                    if (msg_count == num_msgs_to_send && msg_latency_get_pending(msg_latency) == 0)
+                    {
+                        iothub_info.stop_running = 1;
+                        net_tracker_set_phase(NET_PHASE_IDLE);
+                    }
+                    else if (msg_count > 0 && (latency_stats_get_time_ns() - send_start) / 1000000 > CONFIRM_TIMEOUT_MS)
+                    {
+                        (void)printf("Timed out waiting for the message confirmations\r\n");
+                        iothub_info.stop_running = 1;
+                    }
                 } while (iothub_info.stop_running == 0);
 
+                if (idle_seconds > 0 && msg_count == num_msgs_to_send)
+                {
+                    run_idle_period(device_client, &iothub_info, report_handle, &iot_mem_info, idle_seconds);
+                }
+
                 size_t index = 0;
                 for (index = 0; index < 10; index++)
                 {
                     IoTHubDeviceClient_LL_DoWork(device_client);
                     ThreadAPI_Sleep(1);
                 }
+                net_tracker_set_phase(NET_PHASE_DISCONNECT);
                 IoTHubDeviceClient_LL_Destroy(device_client);
 
                 report_network_usage(report_handle, &iot_mem_info);
+                net_tracker_report(report_handle, &iot_mem_info, msg_count);
+                net_overhead_report(report_handle, &iot_mem_info, (uint64_t)msg_count * payload_len);
+                report_payload_efficiency(report_handle, &iot_mem_info, msg_count, payload_len, random_payload);
+                msg_latency_report(msg_latency, report_handle, &iot_mem_info);
             }
+            msg_latency_destroy(msg_latency);
             tickcounter_destroy(tick_counter_handle);
         }
     }
@@ -0,0 +1,437 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reconnect_info.h"
+#include "mem_reporter.h"
+#include "net_tracker.h"
+#include "net_overhead.h"
+#include "msg_latency.h"
+#include "latency_stats.h"
+#include "sim_clock.h"
+#include "hub_control.h"
+
+#include "iothub_client_version.h"
+#include "iothub_device_client_ll.h"
+#include "iothub_message.h"
+
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/shared_util_options.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/gbnetwork.h"
+
+#ifdef USE_MQTT
+    #include "iothubtransportmqtt.h"
+    #include "iothubtransportmqtt_websockets.h"
+#endif
+
+#ifdef USE_AMQP
+    #include "iothubtransportamqp.h"
+    #include "iothubtransportamqp_websockets.h"
+#endif
+
+#include "../certs/certs.h"
+
+#define PROXY_PORT              8888
+#define MAX_PROXY_HOST_LEN      256
+#define MAX_REPORT_NAME_LEN     64
+#define RETRY_TIMEOUT_SEC       300
+// Device time, a blackholed connection is only noticed by the keepalive
+#define SCENARIO_TIMEOUT_MS     600000
+#define QUIET_LOOPS             10
+#define CLOCK_STEP_MS           1000
+#define RECONNECT_METRIC_COUNT  17
+
+static const char* const RECONNECT_PAYLOAD = "{\"reconnect\":\"analytics\"}";
+
+typedef struct FAULT_TYPE_TAG
+{
+    const char* command;
+    const char* report_name;
+} FAULT_TYPE;
+
+typedef struct RETRY_TYPE_TAG
+{
+    IOTHUB_CLIENT_RETRY_POLICY policy;
+    const char* report_name;
+} RETRY_TYPE;
+
+// Names the fault_proxy FAULT command understands
+static const FAULT_TYPE FAULT_TYPES[] = {
+    { "drop", "DROP" },
+    { "reset", "RESET" },
+    { "blackhole", "BLACKHOLE" },
+    { "tls", "TLS_ALERT" }
+};
+
+static const RETRY_TYPE RETRY_TYPES[] = {
+    { IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER, "EXPONENTIAL_JITTER" },
+    { IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF, "EXPONENTIAL" },
+    { IOTHUB_CLIENT_RETRY_LINEAR_BACKOFF, "LINEAR" },
+    { IOTHUB_CLIENT_RETRY_INTERVAL, "INTERVAL" },
+    { IOTHUB_CLIENT_RETRY_IMMEDIATE, "IMMEDIATE" }
+};
+
+typedef struct RECONNECT_CLIENT_INFO_TAG
+{
+    int connected;
+    int authenticated;
+    int fault_armed;
+    size_t disconnects;
+    size_t reconnects;
+    uint64_t fault_ms;
+    uint64_t disconnect_ms;
+    uint64_t reconnect_ms;
+} RECONNECT_CLIENT_INFO;
+
+typedef struct RECONNECT_SNAPSHOT_TAG
+{
+    size_t heap_used;
+    uint64_t bytes_sent;
+    uint64_t bytes_recv;
+    uint64_t hub_telemetry;
+    NET_OVERHEAD_INFO overhead;
+} RECONNECT_SNAPSHOT;
+
+// The sdk's timers follow the simulated clock, so the scenario is timed by it as well
+static uint64_t get_device_time_ms(void)
+{
+    return (latency_stats_get_time_ns() / 1000000) + sim_clock_get_offset_ms();
+}
+
+static IOTHUB_CLIENT_TRANSPORT_PROVIDER get_transport(PROTOCOL_TYPE protocol)
+{
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER result;
+    switch (protocol)
+    {
+#ifdef USE_MQTT
+        case PROTOCOL_MQTT:
+            result = MQTT_Protocol;
+            break;
+        case PROTOCOL_MQTT_WS:
+            result = MQTT_WebSocket_Protocol;
+            break;
+#endif
+#ifdef USE_AMQP
+        case PROTOCOL_AMQP:
+            result = AMQP_Protocol;
+            break;
+        case PROTOCOL_AMQP_WS:
+            result = AMQP_Protocol_over_WebSocketsTls;
+            break;
+#endif
+        default:
+            result = NULL;
+            break;
+    }
+    return result;
+}
+
+static void reconnect_connection_status(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* user_context)
+{
+    RECONNECT_CLIENT_INFO* client_info = (RECONNECT_CLIENT_INFO*)user_context;
+    (void)reason;
+    if (client_info == NULL)
+    {
+        (void)printf("reconnect_connection_status user_context is NULL\r\n");
+    }
+    else if (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED)
+    {
+        if (client_info->authenticated != 0)
+        {
+            if (client_info->reconnects++ == 0)
+            {
+                client_info->reconnect_ms = get_device_time_ms();
+            }
+        }
+        client_info->authenticated = 1;
+        client_info->connected = 1;
+    }
+    else
+    {
+        if (client_info->connected != 0 && client_info->disconnects++ == 0)
+        {
+            client_info->disconnect_ms = get_device_time_ms();
+        }
+        client_info->connected = 0;
+    }
+}
+
+static void reconnect_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* user_context)
+{
+    msg_latency_confirmed(user_context, result == IOTHUB_CLIENT_CONFIRMATION_OK);
+}
+
+static int send_fault_command(const char* fault_control, const char* fault_name)
+{
+    char command[MAX_REPORT_NAME_LEN];
+    char response[HUB_CONTROL_RESPONSE_LEN];
+    (void)snprintf(command, sizeof(command), "FAULT %s 0", fault_name);
+    return hub_control_execute(fault_control, command, response, sizeof(response));
+}
+
+// The hub counts what arrived, anything beyond the confirmations was delivered twice
+static uint64_t get_hub_telemetry(const CONNECTION_INFO* conn_info)
+{
+    uint64_t result = 0;
+    char response[HUB_CONTROL_RESPONSE_LEN];
+    if (conn_info->hub_control != NULL && hub_control_execute(conn_info->hub_control, "STATS", response, sizeof(response)) == 0)
+    {
+        (void)hub_control_get_value(response, "telemetry", &result);
+    }
+    return result;
+}
+
+static void take_snapshot(const CONNECTION_INFO* conn_info, RECONNECT_SNAPSHOT* snapshot)
+{
+    snapshot->heap_used = gballoc_getCurrentMemoryUsed();
+    snapshot->bytes_sent = gbnetwork_getBytesSent();
+    snapshot->bytes_recv = gbnetwork_getBytesRecv();
+    snapshot->hub_telemetry = get_hub_telemetry(conn_info);
+    net_overhead_get_info(&snapshot->overhead);
+}
+
+static uint64_t get_reconnect_bytes(const NET_OVERHEAD_INFO* overhead)
+{
+    uint64_t result = overhead->handshake_sent + overhead->handshake_recv;
+    const NET_CATEGORY categories[] = { NET_CATEGORY_WS_UPGRADE, NET_CATEGORY_CONNECT, NET_CATEGORY_AUTH, NET_CATEGORY_SUBSCRIBE };
+    for (size_t index = 0; index < sizeof(categories) / sizeof(categories[0]); index++)
+    {
+        result += overhead->category[categories[index]].bytes_sent + overhead->category[categories[index]].bytes_recv;
+    }
+    return result;
+}
+
+static void report_reconnect(REPORT_HANDLE report_handle, const MEM_ANALYSIS_INFO* iot_mem_info, const char* rpt_name, const CONNECTION_INFO* conn_info,
+    const RECONNECT_CLIENT_INFO* client_info, MSG_LATENCY_HANDLE msg_latency, size_t msg_count, const RECONNECT_SNAPSHOT* before, const RECONNECT_SNAPSHOT* after, size_t heap_peak)
+{
+    REPORT_METRIC metrics[RECONNECT_METRIC_COUNT];
+    size_t count = 0;
+    size_t confirmed = msg_latency_get_confirmed(msg_latency);
+    bool reconnected = client_info->reconnects > 0;
+
+    metrics[count].name = "reconnected";
+    metrics[count++].value = reconnected ? 1.0 : 0.0;
+    // From the fault until the sdk noticed, then until it was authenticated again
+    metrics[count].name = "detectMs";
+    metrics[count++].value = client_info->disconnects == 0 ? 0.0 : (double)(client_info->disconnect_ms - client_info->fault_ms);
+    metrics[count].name = "reconnectMs";
+    metrics[count++].value = !reconnected || client_info->disconnects == 0 ? 0.0 : (double)(client_info->reconnect_ms - client_info->disconnect_ms);
+    metrics[count].name = "disconnects";
+    metrics[count++].value = (double)client_info->disconnects;
+    metrics[count].name = "reconnects";
+    metrics[count++].value = (double)client_info->reconnects;
+    metrics[count].name = "tlsConnects";
+    metrics[count++].value = (double)(after->overhead.tls_connects - before->overhead.tls_connects);
+    metrics[count].name = "rehandshakeBytes";
+    metrics[count++].value = (double)((after->overhead.handshake_sent + after->overhead.handshake_recv) - (before->overhead.handshake_sent + before->overhead.handshake_recv));
+    // The tls handshake plus everything the transport needs before it is usable again
+    metrics[count].name = "reconnectBytes";
+    metrics[count++].value = (double)(get_reconnect_bytes(&after->overhead) - get_reconnect_bytes(&before->overhead));
+    metrics[count].name = "bytesSent";
+    metrics[count++].value = (double)(after->bytes_sent - before->bytes_sent);
+    metrics[count].name = "bytesRecv";
+    metrics[count++].value = (double)(after->bytes_recv - before->bytes_recv);
+    metrics[count].name = "heapGrowth";
+    metrics[count++].value = (double)after->heap_used - (double)before->heap_used;
+    metrics[count].name = "heapPeakDelta";
+    metrics[count++].value = heap_peak > before->heap_used ? (double)(heap_peak - before->heap_used) : 0.0;
+    metrics[count].name = "msgsSent";
+    metrics[count++].value = (double)msg_count;
+    metrics[count].name = "msgsConfirmed";
+    metrics[count++].value = (double)confirmed;
+    metrics[count].name = "msgsFailed";
+    metrics[count++].value = (double)msg_latency_get_failed(msg_latency);
+    // Never answered before the scenario gave up
+    metrics[count].name = "msgsLost";
+    metrics[count++].value = (double)msg_latency_get_pending(msg_latency);
+    if (conn_info->hub_control != NULL)
+    {
+        uint64_t received = after->hub_telemetry - before->hub_telemetry;
+        metrics[count].name = "msgsDuplicated";
+        metrics[count++].value = received > confirmed ? (double)(received - confirmed) : 0.0;
+    }
+    report_metrics(report_handle, iot_mem_info, rpt_name, metrics, count);
+}
+
+static void run_reconnect_scenario(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const char* fault_control,
+    const FAULT_TYPE* fault_type, const RETRY_TYPE* retry_type, size_t num_msgs_to_send)
+{
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER iothub_transport = get_transport(protocol);
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE device_client;
+    MSG_LATENCY_HANDLE msg_latency;
+    MEM_ANALYSIS_INFO iot_mem_info;
+
+    memset(&iot_mem_info, 0, sizeof(MEM_ANALYSIS_INFO));
+    iot_mem_info.iothub_version = IoTHubClient_GetVersionString();
+    iot_mem_info.iothub_protocol = protocol;
+    iot_mem_info.operation_type = OPERATION_NETWORK;
+    iot_mem_info.msg_sent = num_msgs_to_send;
+
+    gbnetwork_resetMetrics();
+    net_tracker_reset();
+    net_overhead_reset(protocol);
+    sim_clock_reset();
+
+    if (iothub_transport == NULL)
+    {
+        (void)printf("Transport not available for reconnect analysis\r\n");
+    }
+    else if ((msg_latency = msg_latency_create(num_msgs_to_send)) == NULL)
+    {
+        (void)printf("Failed creating message latency\r\n");
+    }
+    else
+    {
+        gballoc_resetMetrics();
+        if ((device_client = IoTHubDeviceClient_LL_CreateFromConnectionString(conn_info->device_conn_string, iothub_transport)) == NULL)
+        {
+            (void)printf("failed create IoTHub client from connection string %s!\r\n", conn_info->device_conn_string);
+        }
+        else
+        {
+            RECONNECT_CLIENT_INFO client_info;
+            RECONNECT_SNAPSHOT before;
+            RECONNECT_SNAPSHOT after;
+            char rpt_name[MAX_REPORT_NAME_LEN];
+            size_t msg_count = 0;
+            size_t quiet_loops = 0;
+            size_t heap_peak = 0;
+            uint64_t start_ms = get_device_time_ms();
+            bool done = false;
+
+            memset(&client_info, 0, sizeof(client_info));
+            memset(&before, 0, sizeof(before));
+            (void)IoTHubDeviceClient_LL_SetConnectionStatusCallback(device_client, reconnect_connection_status, &client_info);
+            (void)IoTHubDeviceClient_LL_SetRetryPolicy(device_client, retry_type->policy, RETRY_TIMEOUT_SEC);
+            (void)IoTHubDeviceClient_LL_SetOption(device_client, OPTION_TRUSTED_CERT, conn_info->trusted_cert != NULL ? conn_info->trusted_cert : certificates);
+            if (protocol == PROTOCOL_MQTT_WS || protocol == PROTOCOL_AMQP_WS)
+            {
+                // The websocket transports reach the hub through the proxy's CONNECT port,
+                // the others through its forwards on the transport ports
+                char proxy_host[MAX_PROXY_HOST_LEN];
+                const char* port = strrchr(fault_control, ':');
+                size_t host_len = port == NULL ? 0 : (size_t)(port - fault_control);
+                HTTP_PROXY_OPTIONS proxy_options;
+
+                if (host_len > 0 && host_len < sizeof(proxy_host))
+                {
+                    memcpy(proxy_host, fault_control, host_len);
+                    proxy_host[host_len] = '\0';
+                    memset(&proxy_options, 0, sizeof(proxy_options));
+                    proxy_options.host_address = proxy_host;
+                    proxy_options.port = PROXY_PORT;
+                    (void)IoTHubDeviceClient_LL_SetOption(device_client, OPTION_HTTP_PROXY, &proxy_options);
+                }
+            }
+
+            do
+            {
+                uint64_t sends = gbnetwork_getNumSends();
+                uint64_t recvs = gbnetwork_getNumRecv();
+                size_t heap_used;
+
+                // One message at a time, each is either answered or failed before the next
+                if (client_info.connected != 0 && msg_count < num_msgs_to_send && msg_latency_get_pending(msg_latency) == 0)
+                {
+                    IOTHUB_MESSAGE_HANDLE msg_handle;
+
+                    // Halfway through the connection is broken at the next byte on the wire
+                    if (msg_count == num_msgs_to_send / 2 && client_info.fault_armed == 0)
+                    {
+                        take_snapshot(conn_info, &before);
+                        heap_peak = before.heap_used;
+                        if (send_fault_command(fault_control, fault_type->command) == 0)
+                        {
+                            client_info.fault_armed = 1;
+                            client_info.fault_ms = get_device_time_ms();
+                        }
+                    }
+
+                    if ((msg_handle = IoTHubMessage_CreateFromString(RECONNECT_PAYLOAD)) == NULL)
+                    {
+                        (void)printf("ERROR: iotHubMessageHandle is NULL!\r\n");
+                    }
+                    else
+                    {
+                        void* msg_context = msg_latency_enqueue(msg_latency);
+                        if (IoTHubDeviceClient_LL_SendEventAsync(device_client, msg_handle, reconnect_confirm_callback, msg_context) != IOTHUB_CLIENT_OK)
+                        {
+                            (void)printf("ERROR: IoTHubDeviceClient_LL_SendEventAsync..........FAILED!\r\n");
+                            msg_latency_confirmed(msg_context, false);
+                        }
+                        msg_count++;
+                        IoTHubMessage_Destroy(msg_handle);
+                    }
+                }
+
+                IoTHubDeviceClient_LL_DoWork(device_client);
+                if (gbnetwork_getNumSends() != sends || gbnetwork_getNumRecv() != recvs)
+                {
+                    quiet_loops = 0;
+                }
+                else if (++quiet_loops >= QUIET_LOOPS && client_info.fault_armed != 0 && sim_clock_is_enabled())
+                {
+                    // Keepalive and retry timers run ahead while the device waits on them
+                    sim_clock_advance_ms(CLOCK_STEP_MS);
+                }
+                if (client_info.fault_armed != 0 && (heap_used = gballoc_getCurrentMemoryUsed()) > heap_peak)
+                {
+                    heap_peak = heap_used;
+                }
+                ThreadAPI_Sleep(1);
+
+                if (client_info.fault_armed != 0 && msg_count == num_msgs_to_send && msg_latency_get_pending(msg_latency) == 0 &&
+                    (client_info.disconnects == 0 || client_info.connected != 0))
+                {
+                    done = true;
+                }
+                else if (get_device_time_ms() - start_ms > SCENARIO_TIMEOUT_MS)
+                {
+                    (void)printf("Timed out waiting for the %s %s reconnect\r\n", fault_type->report_name, retry_type->report_name);
+                    done = true;
+                }
+            } while (!done);
+
+            take_snapshot(conn_info, &after);
+            IoTHubDeviceClient_LL_Destroy(device_client);
+            (void)send_fault_command(fault_control, "none");
+
+            if (client_info.fault_armed == 0)
+            {
+                (void)printf("The fault was never armed for %s %s\r\n", fault_type->report_name, retry_type->report_name);
+            }
+            else
+            {
+                (void)snprintf(rpt_name, sizeof(rpt_name), "RECONNECT_%s_%s", fault_type->report_name, retry_type->report_name);
+                report_reconnect(report_handle, &iot_mem_info, rpt_name, conn_info, &client_info, msg_latency, msg_count, &before, &after, heap_peak);
+            }
+        }
+        msg_latency_destroy(msg_latency);
+    }
+}
+
+int initiate_reconnect_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const char* fault_control, size_t num_msgs_to_send)
+{
+    int result;
+    if (conn_info == NULL || fault_control == NULL || num_msgs_to_send < 2)
+    {
+        (void)printf("The reconnect analysis needs the fault proxy and at least 2 messages\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        for (size_t fault_index = 0; fault_index < sizeof(FAULT_TYPES) / sizeof(FAULT_TYPES[0]); fault_index++)
+        {
+            for (size_t retry_index = 0; retry_index < sizeof(RETRY_TYPES) / sizeof(RETRY_TYPES[0]); retry_index++)
+            {
+                run_reconnect_scenario(conn_info, report_handle, protocol, fault_control, &FAULT_TYPES[fault_index], &RETRY_TYPES[retry_index], num_msgs_to_send);
+            }
+        }
+        result = 0;
+    }
+    return result;
+}
@@ -0,0 +1,24 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef RECONNECT_INFO_H
+#define RECONNECT_INFO_H
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C" {
+#else
+#include <stddef.h>
+#endif
+
+#include "mem_reporter.h"
+
+// Breaks the connection through the fault_proxy control channel at fault_control
+// ("<host>:<port>") halfway through the messages, once for every fault and retry policy
+extern int initiate_reconnect_operation(const CONNECTION_INFO* conn_info, REPORT_HANDLE report_handle, PROTOCOL_TYPE protocol, const char* fault_control, size_t num_msgs_to_send);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* RECONNECT_INFO_H */
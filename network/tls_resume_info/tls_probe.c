@@ -0,0 +1,382 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "tls_probe.h"
+#include "latency_stats.h"
+
+// The tickets follow the handshake right away, the local hub sends nothing else unasked
+#define TICKET_WAIT_MS      100
+#define TICKET_READ_LEN     256
+
+// Keeps the size in front of every OpenSSL allocation so frees can be counted
+typedef union ALLOC_HEADER_TAG
+{
+    size_t size;
+    long double align;
+} ALLOC_HEADER;
+
+typedef struct TLS_PROBE_TAG
+{
+    TLS_PROBE_CONFIG config;
+    SSL_SESSION* session;
+    uint64_t bytes_sent;
+    uint64_t bytes_recv;
+    size_t round_trips;
+    bool last_was_write;
+} TLS_PROBE;
+
+static size_t g_heap_current = 0;
+static size_t g_heap_peak = 0;
+
+static void* probe_malloc(size_t size, const char* file, int line)
+{
+    void* result;
+    ALLOC_HEADER* header = (ALLOC_HEADER*)malloc(sizeof(ALLOC_HEADER) + size);
+    (void)file;
+    (void)line;
+    if (header == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        header->size = size;
+        g_heap_current += size;
+        if (g_heap_current > g_heap_peak)
+        {
+            g_heap_peak = g_heap_current;
+        }
+        result = header + 1;
+    }
+    return result;
+}
+
+static void* probe_realloc(void* ptr, size_t size, const char* file, int line)
+{
+    void* result;
+    if (ptr == NULL)
+    {
+        result = probe_malloc(size, file, line);
+    }
+    else
+    {
+        ALLOC_HEADER* header = (ALLOC_HEADER*)ptr - 1;
+        size_t old_size = header->size;
+        if ((header = (ALLOC_HEADER*)realloc(header, sizeof(ALLOC_HEADER) + size)) == NULL)
+        {
+            result = NULL;
+        }
+        else
+        {
+            header->size = size;
+            g_heap_current = g_heap_current - old_size + size;
+            if (g_heap_current > g_heap_peak)
+            {
+                g_heap_peak = g_heap_current;
+            }
+            result = header + 1;
+        }
+    }
+    return result;
+}
+
+static void probe_free(void* ptr, const char* file, int line)
+{
+    (void)file;
+    (void)line;
+    if (ptr != NULL)
+    {
+        ALLOC_HEADER* header = (ALLOC_HEADER*)ptr - 1;
+        g_heap_current -= header->size;
+        free(header);
+    }
+}
+
+// A round trip is counted whenever the client has to read after it wrote
+static long count_traffic(BIO* bio, int oper, const char* argp, size_t len, int argi, long argl, int ret, size_t* processed)
+{
+    TLS_PROBE* probe = (TLS_PROBE*)BIO_get_callback_arg(bio);
+    (void)argp;
+    (void)len;
+    (void)argi;
+    (void)argl;
+    if (probe != NULL && ret > 0 && processed != NULL)
+    {
+        if (oper == (BIO_CB_WRITE | BIO_CB_RETURN))
+        {
+            probe->bytes_sent += *processed;
+            probe->last_was_write = true;
+        }
+        else if (oper == (BIO_CB_READ | BIO_CB_RETURN))
+        {
+            if (probe->last_was_write)
+            {
+                probe->round_trips++;
+                probe->last_was_write = false;
+            }
+            probe->bytes_recv += *processed;
+        }
+    }
+    return ret;
+}
+
+static int connect_socket(const TLS_PROBE_CONFIG* config)
+{
+    int result;
+    char port_text[8];
+    struct addrinfo hints;
+    struct addrinfo* addr_list;
+
+    (void)snprintf(port_text, sizeof(port_text), "%u", config->port);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(config->hostname, port_text, &hints, &addr_list) != 0)
+    {
+        (void)printf("Failure resolving %s\r\n", config->hostname);
+        result = -1;
+    }
+    else
+    {
+        int no_delay = 1;
+        if ((result = socket(addr_list->ai_family, addr_list->ai_socktype, addr_list->ai_protocol)) < 0)
+        {
+            (void)printf("Failure creating socket\r\n");
+        }
+        else if (connect(result, addr_list->ai_addr, addr_list->ai_addrlen) != 0)
+        {
+            (void)printf("Failure connecting to %s:%u: %s\r\n", config->hostname, config->port, strerror(errno));
+            (void)close(result);
+            result = -1;
+        }
+        else
+        {
+            (void)setsockopt(result, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        }
+        freeaddrinfo(addr_list);
+    }
+    return result;
+}
+
+// Mirrors the sdk's openssl tlsio, every connection gets its own context
+static SSL_CTX* create_context(const TLS_PROBE_CONFIG* config)
+{
+    SSL_CTX* result;
+    if ((result = SSL_CTX_new(TLS_client_method())) == NULL)
+    {
+        (void)printf("Failure creating ssl context\r\n");
+    }
+    else if (SSL_CTX_set_min_proto_version(result, config->tls_version) != 1 || SSL_CTX_set_max_proto_version(result, config->tls_version) != 1)
+    {
+        (void)printf("Failure pinning the tls version\r\n");
+        SSL_CTX_free(result);
+        result = NULL;
+    }
+    else if (config->trusted_cert_file != NULL && SSL_CTX_load_verify_locations(result, config->trusted_cert_file, NULL) != 1)
+    {
+        (void)printf("Failure loading trusted certificate %s\r\n", config->trusted_cert_file);
+        SSL_CTX_free(result);
+        result = NULL;
+    }
+    else
+    {
+        if (config->trusted_cert_file != NULL)
+        {
+            SSL_CTX_set_verify(result, SSL_VERIFY_PEER, NULL);
+        }
+        if (config->resume_mode == TLS_RESUME_SESSION_ID)
+        {
+            // Without a ticket the server has to look the session up in its cache
+            (void)SSL_CTX_set_options(result, SSL_OP_NO_TICKET);
+        }
+    }
+    return result;
+}
+
+// Lets OpenSSL process what followed the handshake, for tls 1.3 these are the tickets
+static void read_tickets(SSL* ssl, int sock)
+{
+    struct pollfd poll_sock;
+    unsigned char discard[TICKET_READ_LEN];
+    int flags = fcntl(sock, F_GETFL, 0);
+
+    (void)fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    poll_sock.fd = sock;
+    poll_sock.events = POLLIN;
+    while (poll(&poll_sock, 1, TICKET_WAIT_MS) > 0)
+    {
+        int read_result = SSL_read(ssl, discard, sizeof(discard));
+        if (read_result > 0 || SSL_get_error(ssl, read_result) != SSL_ERROR_WANT_READ)
+        {
+            break;
+        }
+    }
+    (void)fcntl(sock, F_SETFL, flags);
+}
+
+int tls_probe_init(void)
+{
+    int result;
+    if (CRYPTO_set_mem_functions(probe_malloc, probe_realloc, probe_free) != 1)
+    {
+        (void)printf("Failure routing OpenSSL allocations, OpenSSL was used before\r\n");
+        result = __LINE__;
+    }
+    else if (OPENSSL_init_ssl(0, NULL) != 1)
+    {
+        (void)printf("Failure initializing OpenSSL\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+TLS_PROBE_HANDLE tls_probe_create(const TLS_PROBE_CONFIG* config)
+{
+    TLS_PROBE* result;
+    if (config == NULL || config->hostname == NULL || (config->resume_mode == TLS_RESUME_SESSION_ID && config->tls_version != TLS1_2_VERSION))
+    {
+        (void)printf("Invalid tls probe configuration\r\n");
+        result = NULL;
+    }
+    else if ((result = (TLS_PROBE*)calloc(1, sizeof(TLS_PROBE))) == NULL)
+    {
+        (void)printf("Failure allocating tls probe\r\n");
+    }
+    else
+    {
+        result->config = *config;
+    }
+    return result;
+}
+
+void tls_probe_destroy(TLS_PROBE_HANDLE handle)
+{
+    if (handle != NULL)
+    {
+        SSL_SESSION_free(handle->session);
+        free(handle);
+    }
+}
+
+int tls_probe_handshake(TLS_PROBE_HANDLE handle, TLS_HANDSHAKE_INFO* info)
+{
+    int result;
+    if (handle == NULL || info == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        int sock;
+        SSL_CTX* ssl_ctx;
+        size_t heap_start = g_heap_current;
+        uint64_t start_wall = latency_stats_get_time_ns();
+        uint64_t start_cpu = latency_stats_get_thread_cpu_ns();
+
+        memset(info, 0, sizeof(TLS_HANDSHAKE_INFO));
+        handle->bytes_sent = 0;
+        handle->bytes_recv = 0;
+        handle->round_trips = 0;
+        handle->last_was_write = false;
+        g_heap_peak = g_heap_current;
+
+        if ((sock = connect_socket(&handle->config)) < 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            if ((ssl_ctx = create_context(&handle->config)) == NULL)
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                SSL* ssl;
+                BIO* bio;
+                if ((ssl = SSL_new(ssl_ctx)) == NULL || (bio = BIO_new_socket(sock, BIO_NOCLOSE)) == NULL)
+                {
+                    (void)printf("Failure creating ssl connection\r\n");
+                    result = __LINE__;
+                }
+                else
+                {
+                    BIO_set_callback_ex(bio, count_traffic);
+                    BIO_set_callback_arg(bio, (char*)handle);
+                    SSL_set_bio(ssl, bio, bio);
+                    (void)SSL_set_tlsext_host_name(ssl, handle->config.hostname);
+                    if (handle->config.trusted_cert_file != NULL)
+                    {
+                        (void)SSL_set1_host(ssl, handle->config.hostname);
+                    }
+                    if (handle->session != NULL)
+                    {
+                        (void)SSL_set_session(ssl, handle->session);
+                    }
+
+                    if (SSL_connect(ssl) != 1)
+                    {
+                        (void)printf("Failure in the tls handshake with %s:%u\r\n", handle->config.hostname, handle->config.port);
+                        ERR_print_errors_fp(stdout);
+                        result = __LINE__;
+                    }
+                    else
+                    {
+                        uint64_t handshake_recv;
+                        info->wall_ns = latency_stats_get_time_ns() - start_wall;
+                        info->cpu_ns = latency_stats_get_thread_cpu_ns() - start_cpu;
+                        info->heap_peak = g_heap_peak - heap_start;
+                        info->resumed = SSL_session_reused(ssl) == 1;
+                        info->bytes_sent = handle->bytes_sent;
+                        info->bytes_recv = handshake_recv = handle->bytes_recv;
+                        info->round_trips = handle->round_trips;
+
+                        read_tickets(ssl, sock);
+                        info->ticket_bytes = handle->bytes_recv - handshake_recv;
+
+                        // The newest session is the one a reconnect would offer
+                        if (handle->config.resume_mode != TLS_RESUME_NONE)
+                        {
+                            SSL_SESSION* session = SSL_get1_session(ssl);
+                            if (session != NULL && SSL_SESSION_is_resumable(session))
+                            {
+                                SSL_SESSION_free(handle->session);
+                                handle->session = session;
+                            }
+                            else
+                            {
+                                SSL_SESSION_free(session);
+                            }
+                        }
+                        (void)SSL_shutdown(ssl);
+                        result = 0;
+                    }
+                }
+                SSL_free(ssl);
+                SSL_CTX_free(ssl_ctx);
+            }
+            (void)close(sock);
+        }
+        // What stays allocated between connections, mostly the kept session
+        info->heap_retained = g_heap_current > heap_start ? g_heap_current - heap_start : 0;
+    }
+    return result;
+}
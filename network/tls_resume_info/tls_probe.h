@@ -0,0 +1,71 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TLS_PROBE_H
+#define TLS_PROBE_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+typedef struct TLS_PROBE_TAG* TLS_PROBE_HANDLE;
+
+typedef enum TLS_RESUME_MODE_TAG
+{
+    // Every handshake is a full one
+    TLS_RESUME_NONE,
+    // The server keeps the session in its cache, only tls 1.2 has these
+    TLS_RESUME_SESSION_ID,
+    // The server hands the session to the client encrypted, tls 1.3 resumes through these as well
+    TLS_RESUME_TICKET
+} TLS_RESUME_MODE;
+
+typedef struct TLS_PROBE_CONFIG_TAG
+{
+    const char* hostname;
+    uint16_t port;
+    // CA file to verify the server with, NULL does not verify
+    const char* trusted_cert_file;
+    // TLS1_2_VERSION or TLS1_3_VERSION, the handshake is pinned to it
+    int tls_version;
+    TLS_RESUME_MODE resume_mode;
+} TLS_PROBE_CONFIG;
+
+typedef struct TLS_HANDSHAKE_INFO_TAG
+{
+    bool resumed;
+    // Socket bytes from the tcp connect until the handshake completed
+    uint64_t bytes_sent;
+    uint64_t bytes_recv;
+    // Flights the client sent and had to wait on an answer for
+    size_t round_trips;
+    // tls 1.3 sends its tickets after the handshake, they are not part of the bytes above
+    uint64_t ticket_bytes;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    // OpenSSL's own allocations, the context is created per connection like the sdk's tlsio does
+    size_t heap_peak;
+    size_t heap_retained;
+} TLS_HANDSHAKE_INFO;
+
+// Routes OpenSSL's allocations through the probe, call before anything else uses OpenSSL
+extern int tls_probe_init(void);
+
+extern TLS_PROBE_HANDLE tls_probe_create(const TLS_PROBE_CONFIG* config);
+extern void tls_probe_destroy(TLS_PROBE_HANDLE handle);
+
+// Connects, handshakes and closes again. Once a handshake left a resumable session
+// behind the following ones offer it, as a device that reconnects would.
+extern int tls_probe_handshake(TLS_PROBE_HANDLE handle, TLS_HANDSHAKE_INFO* info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TLS_PROBE_H
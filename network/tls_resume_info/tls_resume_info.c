@@ -0,0 +1,343 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/ssl.h>
+#include <openssl/opensslv.h>
+
+#include "tls_probe.h"
+#include "mem_reporter.h"
+#include "latency_stats.h"
+
+#define DEFAULT_HANDSHAKES      20
+#define DEFAULT_MQTT_PORT       8883
+#define DEFAULT_AMQP_PORT       5671
+#define DEFAULT_HTTPS_PORT      443
+#define MAX_REPORT_NAME_LEN     64
+#define HANDSHAKE_METRIC_COUNT  (10 + LATENCY_METRIC_COUNT)
+
+typedef enum ARGUEMENT_TYPE_TAG
+{
+    ARGUEMENT_TYPE_UNKNOWN,
+    ARGUEMENT_TYPE_HOSTNAME,
+    ARGUEMENT_TYPE_TRUSTED_CERT,
+    ARGUEMENT_TYPE_HANDSHAKES,
+    ARGUEMENT_TYPE_MQTT_PORT,
+    ARGUEMENT_TYPE_AMQP_PORT,
+    ARGUEMENT_TYPE_HTTPS_PORT,
+    ARGUEMENT_TYPE_OUTPUT_FILE
+} ARGUEMENT_TYPE;
+
+typedef struct TLS_RESUME_ARGS_TAG
+{
+    const char* hostname;
+    const char* trusted_cert_file;
+    const char* output_file;
+    size_t handshakes;
+    uint16_t mqtt_port;
+    uint16_t amqp_port;
+    uint16_t https_port;
+} TLS_RESUME_ARGS;
+
+typedef struct HANDSHAKE_SCENARIO_TAG
+{
+    const char* name;
+    int tls_version;
+    TLS_RESUME_MODE resume_mode;
+} HANDSHAKE_SCENARIO;
+
+typedef struct TRANSPORT_PORT_TAG
+{
+    PROTOCOL_TYPE protocol;
+    uint16_t port;
+} TRANSPORT_PORT;
+
+static const HANDSHAKE_SCENARIO HANDSHAKE_SCENARIOS[] = {
+    { "TLS12_FULL", TLS1_2_VERSION, TLS_RESUME_NONE },
+    { "TLS12_SESSION_ID", TLS1_2_VERSION, TLS_RESUME_SESSION_ID },
+    { "TLS12_TICKET", TLS1_2_VERSION, TLS_RESUME_TICKET },
+    { "TLS13_FULL", TLS1_3_VERSION, TLS_RESUME_NONE },
+    { "TLS13_TICKET", TLS1_3_VERSION, TLS_RESUME_TICKET }
+};
+
+typedef struct HANDSHAKE_TOTALS_TAG
+{
+    size_t handshakes;
+    size_t resumed;
+    uint64_t bytes_sent;
+    uint64_t bytes_recv;
+    uint64_t round_trips;
+    uint64_t ticket_bytes;
+    uint64_t cpu_ns;
+    size_t heap_peak;
+    size_t heap_retained;
+} HANDSHAKE_TOTALS;
+
+static int parse_port(const char* value, uint16_t* port)
+{
+    int result;
+    char* end;
+    unsigned long parsed = strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || parsed > 65535)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        *port = (uint16_t)parsed;
+        result = 0;
+    }
+    return result;
+}
+
+static int parse_command_line(int argc, char* argv[], TLS_RESUME_ARGS* args)
+{
+    // -h [hostname] -t [trusted_cert_file] -n [handshakes] -m [mqtt port] -a [amqp port] -w [https port] -o [output_file]
+    int result = 0;
+    ARGUEMENT_TYPE argument_type = ARGUEMENT_TYPE_UNKNOWN;
+
+    for (int index = 1; index < argc && result == 0; index++)
+    {
+        if (argument_type == ARGUEMENT_TYPE_UNKNOWN)
+        {
+            if (argv[index][0] == '-' && (argv[index][1] == 'h' || argv[index][1] == 'H'))
+            {
+                argument_type = ARGUEMENT_TYPE_HOSTNAME;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 't' || argv[index][1] == 'T'))
+            {
+                argument_type = ARGUEMENT_TYPE_TRUSTED_CERT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'n' || argv[index][1] == 'N'))
+            {
+                argument_type = ARGUEMENT_TYPE_HANDSHAKES;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'm' || argv[index][1] == 'M'))
+            {
+                argument_type = ARGUEMENT_TYPE_MQTT_PORT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'a' || argv[index][1] == 'A'))
+            {
+                argument_type = ARGUEMENT_TYPE_AMQP_PORT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'w' || argv[index][1] == 'W'))
+            {
+                argument_type = ARGUEMENT_TYPE_HTTPS_PORT;
+            }
+            else if (argv[index][0] == '-' && (argv[index][1] == 'o' || argv[index][1] == 'O'))
+            {
+                argument_type = ARGUEMENT_TYPE_OUTPUT_FILE;
+            }
+            else
+            {
+                result = __LINE__;
+            }
+        }
+        else
+        {
+            switch (argument_type)
+            {
+                case ARGUEMENT_TYPE_HOSTNAME:
+                    args->hostname = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_TRUSTED_CERT:
+                    args->trusted_cert_file = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_HANDSHAKES:
+                    args->handshakes = (size_t)atoi(argv[index]);
+                    break;
+                case ARGUEMENT_TYPE_MQTT_PORT:
+                    result = parse_port(argv[index], &args->mqtt_port);
+                    break;
+                case ARGUEMENT_TYPE_AMQP_PORT:
+                    result = parse_port(argv[index], &args->amqp_port);
+                    break;
+                case ARGUEMENT_TYPE_HTTPS_PORT:
+                    result = parse_port(argv[index], &args->https_port);
+                    break;
+                case ARGUEMENT_TYPE_OUTPUT_FILE:
+                    args->output_file = argv[index];
+                    break;
+                case ARGUEMENT_TYPE_UNKNOWN:
+                default:
+                    result = __LINE__;
+                    break;
+            }
+            argument_type = ARGUEMENT_TYPE_UNKNOWN;
+        }
+    }
+
+    if (result == 0 && args->handshakes == 0)
+    {
+        result = __LINE__;
+    }
+    return result;
+}
+
+static double get_average(uint64_t total, size_t count)
+{
+    return count == 0 ? 0.0 : (double)total / count;
+}
+
+static void report_handshakes(REPORT_HANDLE report_handle, const MEM_ANALYSIS_INFO* iot_mem_info, const HANDSHAKE_SCENARIO* scenario, const HANDSHAKE_TOTALS* totals, LATENCY_STATS_HANDLE latency)
+{
+    REPORT_METRIC metrics[HANDSHAKE_METRIC_COUNT];
+    LATENCY_SUMMARY summary;
+    char rpt_name[MAX_REPORT_NAME_LEN];
+    size_t count = 0;
+
+    metrics[count].name = "handshakes";
+    metrics[count++].value = (double)totals->handshakes;
+    // Resumptions the server declined fall back to a full handshake and are averaged in
+    metrics[count].name = "resumed";
+    metrics[count++].value = (double)totals->resumed;
+    metrics[count].name = "bytesSent";
+    metrics[count++].value = get_average(totals->bytes_sent, totals->handshakes);
+    metrics[count].name = "bytesRecv";
+    metrics[count++].value = get_average(totals->bytes_recv, totals->handshakes);
+    metrics[count].name = "handshakeBytes";
+    metrics[count++].value = get_average(totals->bytes_sent + totals->bytes_recv, totals->handshakes);
+    metrics[count].name = "roundTrips";
+    metrics[count++].value = get_average(totals->round_trips, totals->handshakes);
+    metrics[count].name = "ticketBytes";
+    metrics[count++].value = get_average(totals->ticket_bytes, totals->handshakes);
+    metrics[count].name = "cpuUs";
+    metrics[count++].value = get_average(totals->cpu_ns, totals->handshakes) / 1000.0;
+    metrics[count].name = "heapPeak";
+    metrics[count++].value = get_average(totals->heap_peak, totals->handshakes);
+    // What a device pays in ram to keep the session between connections
+    metrics[count].name = "sessionHeap";
+    metrics[count++].value = (double)totals->heap_retained;
+    latency_stats_get_summary(latency, &summary);
+    count += latency_stats_fill_metrics(&summary, &metrics[count]);
+
+    (void)snprintf(rpt_name, sizeof(rpt_name), "TLS_HANDSHAKE_%s", scenario->name);
+    report_metrics(report_handle, iot_mem_info, rpt_name, metrics, count);
+}
+
+// The first handshake of a resumption scenario only obtains the session and is not counted
+static void run_scenario(REPORT_HANDLE report_handle, const TLS_RESUME_ARGS* args, const TRANSPORT_PORT* transport, const HANDSHAKE_SCENARIO* scenario)
+{
+    TLS_PROBE_CONFIG config;
+    TLS_PROBE_HANDLE probe;
+    LATENCY_STATS_HANDLE latency;
+
+    memset(&config, 0, sizeof(config));
+    config.hostname = args->hostname;
+    config.port = transport->port;
+    config.trusted_cert_file = args->trusted_cert_file;
+    config.tls_version = scenario->tls_version;
+    config.resume_mode = scenario->resume_mode;
+
+    if ((probe = tls_probe_create(&config)) == NULL)
+    {
+        (void)printf("Failure creating the tls probe for %s\r\n", scenario->name);
+    }
+    else if ((latency = latency_stats_create(args->handshakes)) == NULL)
+    {
+        (void)printf("Failure creating handshake latency\r\n");
+        tls_probe_destroy(probe);
+    }
+    else
+    {
+        HANDSHAKE_TOTALS totals;
+        TLS_HANDSHAKE_INFO info;
+        size_t handshake_count = args->handshakes + (scenario->resume_mode == TLS_RESUME_NONE ? 0 : 1);
+        int result = 0;
+
+        memset(&totals, 0, sizeof(totals));
+        for (size_t index = 0; index < handshake_count && result == 0; index++)
+        {
+            if ((result = tls_probe_handshake(probe, &info)) != 0)
+            {
+                (void)printf("Failure in handshake %zu of %s on port %u\r\n", index, scenario->name, transport->port);
+            }
+            else if (index == 0 && scenario->resume_mode != TLS_RESUME_NONE)
+            {
+                totals.heap_retained = info.heap_retained;
+            }
+            else
+            {
+                totals.handshakes++;
+                totals.resumed += info.resumed ? 1 : 0;
+                totals.bytes_sent += info.bytes_sent;
+                totals.bytes_recv += info.bytes_recv;
+                totals.round_trips += info.round_trips;
+                totals.ticket_bytes += info.ticket_bytes;
+                totals.cpu_ns += info.cpu_ns;
+                totals.heap_peak += info.heap_peak;
+                latency_stats_add(latency, info.wall_ns);
+            }
+        }
+
+        if (result == 0)
+        {
+            MEM_ANALYSIS_INFO iot_mem_info;
+            memset(&iot_mem_info, 0, sizeof(iot_mem_info));
+            iot_mem_info.iothub_version = OPENSSL_VERSION_TEXT;
+            iot_mem_info.iothub_protocol = transport->protocol;
+            iot_mem_info.operation_type = OPERATION_NETWORK;
+            iot_mem_info.msg_sent = totals.handshakes;
+            report_handshakes(report_handle, &iot_mem_info, scenario, &totals, latency);
+        }
+        latency_stats_destroy(latency);
+        tls_probe_destroy(probe);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int result;
+    TLS_RESUME_ARGS args;
+    REPORT_HANDLE report_handle;
+
+    memset(&args, 0, sizeof(args));
+    args.hostname = "localhost";
+    args.handshakes = DEFAULT_HANDSHAKES;
+    args.mqtt_port = DEFAULT_MQTT_PORT;
+    args.amqp_port = DEFAULT_AMQP_PORT;
+    args.https_port = DEFAULT_HTTPS_PORT;
+
+    // Has to come first, OpenSSL's allocator can't be changed once it allocated
+    if (tls_probe_init() != 0)
+    {
+        result = __LINE__;
+    }
+    else if (parse_command_line(argc, argv, &args) != 0)
+    {
+        (void)printf("Failure parsing command line\r\n");
+        (void)printf("usage: tls_resume_info -h [hostname] -t [trusted_cert_file] -n [handshakes] -m [mqtt port] -a [amqp port] -w [https port] -o [output_file]\r\n");
+        result = __LINE__;
+    }
+    else if ((report_handle = report_initialize(REPORTER_TYPE_JSON, SDK_TYPE_C)) == NULL)
+    {
+        (void)printf("Failure creating report handle\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        // The websocket transports share the https port, a port of 0 is skipped
+        TRANSPORT_PORT transports[] = {
+            { PROTOCOL_MQTT, args.mqtt_port },
+            { PROTOCOL_MQTT_WS, args.https_port },
+            { PROTOCOL_AMQP, args.amqp_port },
+            { PROTOCOL_AMQP_WS, args.https_port },
+            { PROTOCOL_HTTP, args.https_port }
+        };
+
+        for (size_t transport_index = 0; transport_index < sizeof(transports) / sizeof(transports[0]); transport_index++)
+        {
+            for (size_t scenario_index = 0; scenario_index < sizeof(HANDSHAKE_SCENARIOS) / sizeof(HANDSHAKE_SCENARIOS[0]) && transports[transport_index].port != 0; scenario_index++)
+            {
+                run_scenario(report_handle, &args, &transports[transport_index], &HANDSHAKE_SCENARIOS[scenario_index]);
+            }
+        }
+
+        report_write(report_handle, args.output_file, NULL);
+        report_deinitialize(report_handle);
+        result = 0;
+    }
+    return result;
+}
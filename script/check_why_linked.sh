@@ -0,0 +1,39 @@
+#!/bin/bash
+#set -o pipefail
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Builds the transports with the relocations binary_info -w follows and fails when it
+# cannot explain a symbol that is known to be linked in
+
+set -e
+
+script_dir=$(cd "$(dirname "$0")" && pwd)
+repo_root=$(cd "${script_dir}/.." && pwd)
+cmake_folder=$repo_root"/cmake/why_linked_linux"
+
+# A static of umqtt only reached by direct calls, it needs a chain from main
+# in the mqtt binary. The other transports do not have it, so binary_info fails.
+why_symbol="sendPacketItem"
+
+rm -r -f $cmake_folder
+mkdir -p $cmake_folder
+pushd $cmake_folder >/dev/null
+
+cmake $repo_root -DCMAKE_BUILD_TYPE=Release -Duse_why_linked=ON >/dev/null
+make -j >/dev/null
+
+mqtt_binary=./binary_info/lower_layer/mqtt_transport_ll/mqtt_transport_ll
+if nm --defined-only $mqtt_binary | grep -q -E " t $why_symbol(\..*)?$"; then
+    why_output=$(./binary_info/binary_info -c $cmake_folder -w $why_symbol | tr -d '\r' || true)
+    if ! echo "$why_output" | grep -A1 "^Why is $why_symbol linked into .*/mqtt_transport_ll$" | grep -q "is linked through"; then
+        echo "$why_output"
+        echo "binary_info -w found no chain to $why_symbol in $mqtt_binary"
+        exit 1
+    fi
+    echo "binary_info -w found the chain to $why_symbol"
+else
+    echo "$why_symbol was inlined into its callers, skipping the binary_info -w check"
+fi
+popd >/dev/null
@@ -0,0 +1,93 @@
+#!/bin/bash
+#set -o pipefail
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Builds the analysis apps against each malloc implementation and reports the
+# rss, peak rss, allocation latency and binary size delta against glibc
+
+set -e
+
+gcc --version
+uname -r
+
+script_dir=$(cd "$(dirname "$0")" && pwd)
+repo_root=$(cd "${script_dir}/.." && pwd)
+results_folder=$repo_root"/cmake/allocator_results"
+
+conn_string="${IOTHUB_CONNECTION_STRING}"
+
+declare -a allocators=(
+    "glibc"
+    "jemalloc"
+    "mimalloc"
+    "tlsf"
+)
+
+rm -r -f $results_folder
+mkdir -p $results_folder
+
+for item in "${allocators[@]}"
+do
+    cmake_folder=$repo_root"/cmake/allocator_$item"
+    rm -r -f $cmake_folder
+    mkdir -p $cmake_folder
+    pushd $cmake_folder >/dev/null
+
+    echo "executing cmake/make with allocator <<$item>>"
+    cmake $repo_root -DCMAKE_BUILD_TYPE=Release -Danalysis_allocator="$item" >/dev/null
+    make -j >/dev/null
+
+    echo "Retrieving binary info"
+    ./binary_info/binary_info -c $cmake_folder -l -t csv -o "$results_folder/binary_$item.csv"
+
+    if [ -n "$conn_string" ]; then
+        echo "Retrieving telemetry memory info"
+        ./memory/telemetry_memory/telemetry_memory -c "$conn_string" -o "$results_folder/memory_$item.json"
+    fi
+    popd >/dev/null
+done
+
+# Flash and static ram of every lower layer executable and the delta against glibc
+echo ""
+echo "Binary size (bytes)"
+printf "%-10s %-8s %-18s %10s %10s %10s %10s\n" "allocator" "layer" "transport" "flash" "delta" "staticRam" "delta"
+for item in "${allocators[@]}"
+do
+    awk -F', ' -v allocator="$item" '
+        $2 != "ROM_SECTIONS" { next }
+        FNR == NR { base_flash[$4 "," $6] = $9; base_ram[$4 "," $6] = $11; next }
+        {
+            key = $4 "," $6
+            printf "%-10s %-8s %-18s %10d %+10d %10d %+10d\n", allocator, $4, $6, $9, $9 - base_flash[key], $11, $11 - base_ram[key]
+        }' "$results_folder/binary_glibc.csv" "$results_folder/binary_$item.csv" | tr -d '\r'
+done
+
+if [ -n "$conn_string" ]; then
+    echo ""
+    echo "Allocator usage"
+    printf "%-10s %-8s %-12s %10s %10s %10s %10s %10s %10s\n" "allocator" "layer" "transport" "rssKb" "peakKb" "calls" "avgNs" "p99Ns" "maxNs"
+    for item in "${allocators[@]}"
+    do
+        # The report is pretty printed by parson, one field per line
+        awk -v allocator="$item" '
+            function field_value(line) { sub(/^[^:]*: */, "", line); gsub(/[",\r]/, "", line); return line }
+            /"rpt_type"/ { rpt_type = field_value($0) }
+            /"layer"/ { layer = field_value($0) }
+            /"transport"/ { transport = field_value($0) }
+            /"rssKb"/ { rss = field_value($0) }
+            /"rssPeakKb"/ { peak = field_value($0) }
+            /"allocCalls"/ { calls = field_value($0) }
+            /"allocAvgNs"/ { avg = field_value($0) }
+            /"allocP99Ns"/ { p99 = field_value($0) }
+            /"allocMaxNs"/ { max = field_value($0) }
+            /^ *}/ {
+                if (rpt_type == "ALLOCATOR")
+                {
+                    printf "%-10s %-8s %-12s %10d %10d %10d %10.1f %10d %10d\n", allocator, layer, transport, rss, peak, calls, avg, p99, max
+                }
+                rpt_type = ""
+            }' "$results_folder/memory_$item.json"
+    done
+fi
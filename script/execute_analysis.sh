@@ -17,6 +17,7 @@ run_binary_strip=0
 script_dir=$(cd "$(dirname "$0")" && pwd)
 repo_root=$(cd "${script_dir}/.." && pwd)
 cmake_folder=$repo_root"/cmake/analysis_linux"
+. "$script_dir/local_hub.sh"
 
 conn_string="${IOTHUB_CONNECTION_STRING}"
 rpt_conn_string="${REPORT_CONNECTION_STRING}"
@@ -64,5 +65,47 @@ echo "retrieving telemetry memory info"
 echo "retrieving telemetry network info"
 ./network/telemetry_net_info/telemetry_net_info -c $conn_string
 
-#./memory/prov_net_info/prov_net_info -c $DPS_C_CONNECTION_STRING -s $DPS_C_SCOPE_ID_VALUE
-#./memory/provisioning_mem/provisioning_mem -c $DPS_C_CONNECTION_STRING -s $DPS_C_SCOPE_ID_VALUE
+local_hub_conn_string="HostName=localhost;DeviceId=c2d_device;SharedAccessKey=bG9jYWxodWJsb2NhbGh1YmxvY2FsaHVibG9jYWxodWI="
+# Without -d the apps create mem_analytics_device through the local hub control channel
+local_hub_owner_string="HostName=localhost;SharedAccessKeyName=iothubowner;SharedAccessKey=bG9jYWxodWJsb2NhbGh1YmxvY2FsaHVibG9jYWxodWI="
+start_local_hub .
+
+echo "retrieving telemetry memory info against the local hub"
+./memory/telemetry_memory/telemetry_memory -c $local_hub_owner_string -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 || true
+echo "retrieving telemetry network info against the local hub"
+./network/telemetry_net_info/telemetry_net_info -c $local_hub_owner_string -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 || true
+echo "retrieving telemetry payload size sweep against the local hub"
+./network/telemetry_net_info/telemetry_net_info -c $local_hub_owner_string -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 -n 10 -w || true
+./network/telemetry_net_info/telemetry_net_info -c $local_hub_owner_string -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 -n 10 -w -r || true
+echo "retrieving idle keepalive cost against the local hub"
+./network/telemetry_net_info/telemetry_net_info -c $local_hub_owner_string -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 -i 7200 || true
+echo "retrieving full and resumed tls handshake cost against the local hub"
+./network/tls_resume_info/tls_resume_info -h localhost -t local_hub_ca.pem -w $local_hub_https_port -n 20 || true
+echo "retrieving c2d memory info against the local hub"
+./memory/c2d_memory/c2d_memory -c $local_hub_conn_string -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 -n 100 -p 256 || true
+echo "retrieving device method info against the local hub"
+./memory/device_method_mem/device_method_mem -c $local_hub_conn_string -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 -n 100 -p 256 -r 50 || true
+
+# The local hub answers DPS registrations on its mqtt, amqp and https endpoints.
+# Built with -Duse_prov_client=ON
+local_dps_conn_string="HostName=localhost;DeviceId=prov_device;SharedAccessKey=bG9jYWxodWJsb2NhbGh1YmxvY2FsaHVibG9jYWxodWI="
+if [ -x ./memory/provisioning_mem/provisioning_mem ]; then
+    echo "retrieving provisioning memory info against the local hub"
+    ./memory/provisioning_mem/provisioning_mem -c $local_dps_conn_string -s 0ne00000000 -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 -n 10 || true
+    echo "retrieving provisioning network info against the local hub"
+    ./network/prov_net_info/prov_net_info -c $local_dps_conn_string -s 0ne00000000 -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 || true
+fi
+stop_local_hub
+
+# The fault proxy takes over the transport ports and forwards them to a local hub on moved
+# ports, the websocket transports reach the hub through its http CONNECT port instead
+start_local_hub . -m 18883 -a 15671
+./fault_proxy/fault_proxy -p 8888 -l 8891 -f 8883:localhost:18883 -f 5671:localhost:15671 $local_hub_proxy_map &
+fault_proxy_pid=$!
+sleep 2
+
+echo "retrieving reconnect cost per fault and retry policy against the local hub"
+./network/telemetry_net_info/telemetry_net_info -c $local_hub_owner_string -t local_hub_ca.pem -l localhost:8890 -f localhost:8891 -n 10 || true
+kill $fault_proxy_pid 2>/dev/null || true
+wait $fault_proxy_pid 2>/dev/null || true
+stop_local_hub
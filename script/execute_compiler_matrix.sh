@@ -0,0 +1,114 @@
+#!/bin/bash
+#set -o pipefail
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Builds the analysis tree with every compiler, optimization level and -march
+# variant and reports the section sizes of each transport executable next to the
+# cpu time it spends per message against the local hub
+
+set -e
+
+uname -r
+
+script_dir=$(cd "$(dirname "$0")" && pwd)
+repo_root=$(cd "${script_dir}/.." && pwd)
+results_folder=$repo_root"/cmake/compiler_results"
+. "$script_dir/local_hub.sh"
+
+local_hub_conn_string="HostName=localhost;DeviceId=throughput_device;SharedAccessKey=bG9jYWxodWJsb2NhbGh1YmxvY2FsaHVibG9jYWxodWI="
+payload_size=512
+
+declare -a compilers=(
+    "gcc"
+    "clang"
+)
+declare -a opt_levels=(
+    "O2"
+    "Os"
+    "Oz"
+)
+declare -a march_variants=(
+    "x86-64"
+    "native"
+)
+
+rm -r -f $results_folder
+mkdir -p $results_folder
+echo -n "" > "$results_folder/builds.txt"
+
+for compiler in "${compilers[@]}"
+do
+    if ! command -v $compiler >/dev/null; then
+        echo "Skipping $compiler, it is not installed"
+        continue
+    fi
+    $compiler --version | head -n 1
+
+    for opt_level in "${opt_levels[@]}"
+    do
+        for march in "${march_variants[@]}"
+        do
+            # Older gcc releases have no -Oz
+            if ! echo "int main(void) { return 0; }" | $compiler -$opt_level -march=$march -x c -o /dev/null - 2>/dev/null; then
+                echo "Skipping $compiler -$opt_level -march=$march, the compiler does not support it"
+                continue
+            fi
+
+            build_name="${compiler}_${opt_level}_${march}"
+            cmake_folder=$repo_root"/cmake/compiler_$build_name"
+            rm -r -f $cmake_folder
+            mkdir -p $cmake_folder
+            pushd $cmake_folder >/dev/null
+
+            echo "executing cmake/make with <<$compiler -$opt_level -march=$march>>"
+            cmake $repo_root -DCMAKE_BUILD_TYPE=Release -DCMAKE_C_COMPILER=$compiler \
+                -DCMAKE_C_FLAGS_RELEASE="-$opt_level -march=$march -DNDEBUG" >/dev/null
+            make -j >/dev/null
+
+            echo "Retrieving binary info"
+            ./binary_info/binary_info -c $cmake_folder -t csv -o "$results_folder/binary_$build_name.csv"
+
+            echo "saturating with $payload_size byte messages"
+            start_local_hub .
+            ./memory/throughput_memory/throughput_memory -c $local_hub_conn_string -t local_hub_ca.pem $local_hub_proxy \
+                -p $payload_size -o "$results_folder/throughput_$build_name.json" || true
+            stop_local_hub
+
+            echo "$build_name|$compiler|$opt_level|$march" >> "$results_folder/builds.txt"
+            popd >/dev/null
+        done
+    done
+done
+
+echo ""
+echo "Size (bytes) and cpu time per message (us)"
+printf "%-8s %-4s %-8s %-12s %-18s %10s %10s %10s %10s %10s %10s\n" "compiler" "opt" "march" "layer" "transport" "text" "rodata" "data" "bss" "flash" "cpuUs/msg"
+while IFS='|' read -r build_name compiler opt_level march
+do
+    # A build whose benchmark failed is still listed, without its cpu time
+    throughput_file="$results_folder/throughput_$build_name.json"
+    if [ ! -f "$throughput_file" ]; then
+        throughput_file=""
+    fi
+    # The throughput report is pretty printed by parson, one field per line
+    awk -F', ' -v compiler="$compiler" -v opt_level="$opt_level" -v march="$march" '
+        function field_value(line) { sub(/^[^:]*: */, "", line); gsub(/[",\r]/, "", line); return line }
+        FILENAME ~ /\.json$/ {
+            if ($0 ~ /"rpt_type"/) { rpt_type = field_value($0) }
+            else if ($0 ~ /"layer"/) { layer = field_value($0) }
+            else if ($0 ~ /"transport"/) { transport = field_value($0) }
+            else if ($0 ~ /"sustainedCpuUsPerMsg"/) { cpu = field_value($0) }
+            else if ($0 ~ /^ *}/) {
+                if (rpt_type == "THROUGHPUT") { cpu_per_msg[layer "," transport] = cpu }
+                rpt_type = ""
+            }
+            next
+        }
+        $2 == "ROM_SECTIONS" {
+            key = $4 "," $6
+            cpu = (key in cpu_per_msg) ? sprintf("%10.1f", cpu_per_msg[key]) : sprintf("%10s", "-")
+            printf "%-8s %-4s %-8s %-12s %-18s %10d %10d %10d %10d %10d %s\n", compiler, opt_level, march, $4, $6, $13, $15, $17, $19, $9, cpu
+        }' $throughput_file "$results_folder/binary_$build_name.csv" | tr -d '\r'
+done < "$results_folder/builds.txt"
@@ -0,0 +1,146 @@
+#!/bin/bash
+#set -o pipefail
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Rebuilds the transport executables for every combination of the SDK feature
+# options and reports the flash and static ram of each build along with the
+# marginal cost of every feature per transport.
+#
+# usage: execute_feature_ablation.sh [feature ...]
+# Without arguments every feature below is toggled, 2^n builds for n features.
+
+set -e
+
+gcc --version
+uname -r
+
+script_dir=$(cd "$(dirname "$0")" && pwd)
+repo_root=$(cd "${script_dir}/.." && pwd)
+results_folder=$repo_root"/cmake/ablation_results"
+
+# name|cmake options with the feature in|cmake options with the feature out
+declare -a all_features=(
+    "logging|-Dno_logging=OFF|-Dno_logging=ON"
+    "upload_to_blob|-Ddont_use_uploadtoblob=OFF|-Ddont_use_uploadtoblob=ON"
+    "edge_modules|-Duse_edge_modules=ON|-Duse_edge_modules=OFF"
+)
+
+declare -a features=()
+if [ $# -eq 0 ]; then
+    features=("${all_features[@]}")
+else
+    for name in "$@"
+    do
+        found=0
+        for item in "${all_features[@]}"
+        do
+            if [ "${item%%|*}" == "$name" ]; then
+                features+=("$item")
+                found=1
+            fi
+        done
+        if [ $found -eq 0 ]; then
+            echo "Unknown feature $name"
+            exit 1
+        fi
+    done
+fi
+feature_count=${#features[@]}
+combination_count=$((1 << feature_count))
+
+# Names the combination after the features that are in, the bit of a feature is set when it is in
+combination_name()
+{
+    local mask=$1
+    local name=""
+    for ((index = 0; index < feature_count; index++))
+    do
+        if [ $((mask & (1 << index))) -ne 0 ]; then
+            local feature=${features[$index]}
+            name="$name+${feature%%|*}"
+        fi
+    done
+    if [ -z "$name" ]; then
+        name="+none"
+    fi
+    echo "${name:1}"
+}
+
+rm -r -f $results_folder
+mkdir -p $results_folder
+
+for ((mask = 0; mask < combination_count; mask++))
+do
+    cmake_cmd="-DCMAKE_BUILD_TYPE=Release"
+    for ((index = 0; index < feature_count; index++))
+    do
+        IFS='|' read -r name enabled_cmd disabled_cmd <<< "${features[$index]}"
+        if [ $((mask & (1 << index))) -ne 0 ]; then
+            cmake_cmd="$cmake_cmd $enabled_cmd"
+        else
+            cmake_cmd="$cmake_cmd $disabled_cmd"
+        fi
+    done
+
+    cmake_folder=$repo_root"/cmake/ablation_$mask"
+    rm -r -f $cmake_folder
+    mkdir -p $cmake_folder
+    pushd $cmake_folder >/dev/null
+
+    echo "executing cmake/make with features <<$(combination_name $mask)>>"
+    cmake $repo_root $cmake_cmd >/dev/null
+    make -j >/dev/null
+
+    echo "Retrieving binary info"
+    ./binary_info/binary_info -c $cmake_folder -t csv -o "$results_folder/binary_$mask.csv"
+    popd >/dev/null
+done
+
+# One line per build and transport: mask, layer, transport, flash, static ram
+for ((mask = 0; mask < combination_count; mask++))
+do
+    awk -F', ' -v mask="$mask" '$2 == "ROM_SECTIONS" { printf "%d|%s|%s|%d|%d\n", mask, $4, $6, $9, $11 }' "$results_folder/binary_$mask.csv" | tr -d '\r'
+done > "$results_folder/ablation.txt"
+
+echo ""
+echo "Flash and static ram per feature combination (bytes)"
+printf "%-40s %-12s %-18s %10s %10s\n" "features" "layer" "transport" "flash" "staticRam"
+while IFS='|' read -r mask layer transport flash ram
+do
+    printf "%-40s %-12s %-18s %10d %10d\n" "$(combination_name $mask)" "$layer" "$transport" $flash $ram
+done < "$results_folder/ablation.txt"
+
+# Removed is what taking the feature out of the full build saves, added is what putting it
+# into the bare build costs. The two differ when features share code.
+feature_names=""
+for item in "${features[@]}"
+do
+    feature_names="$feature_names ${item%%|*}"
+done
+echo ""
+echo "Marginal cost per feature (bytes)"
+printf "%-16s %-12s %-18s %12s %12s %12s %12s\n" "feature" "layer" "transport" "flashRemoved" "flashAdded" "ramRemoved" "ramAdded"
+awk -F'|' -v full=$((combination_count - 1)) -v feature_count=$feature_count -v feature_names="$feature_names" '
+    {
+        key = $2 "|" $3
+        if (!(key in seen)) { seen[key] = 1; keys[key_count++] = key }
+        flash[$1, key] = $4
+        ram[$1, key] = $5
+    }
+    END {
+        split(feature_names, names, " ")
+        for (index_feature = 0; index_feature < feature_count; index_feature++)
+        {
+            bit = 2 ^ index_feature
+            for (index_key = 0; index_key < key_count; index_key++)
+            {
+                key = keys[index_key]
+                split(key, parts, "|")
+                printf "%-16s %-12s %-18s %12d %12d %12d %12d\n", names[index_feature + 1], parts[1], parts[2],
+                    flash[full, key] - flash[full - bit, key], flash[bit, key] - flash[0, key],
+                    ram[full, key] - ram[full - bit, key], ram[bit, key] - ram[0, key]
+            }
+        }
+    }' "$results_folder/ablation.txt"
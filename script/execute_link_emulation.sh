@@ -0,0 +1,100 @@
+#!/bin/bash
+#set -o pipefail
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Runs the saturation benchmark and the send latency against the local hub behind the
+# fault proxy's link emulation, once per link profile, and prints them side by side
+
+set -e
+
+script_dir=$(cd "$(dirname "$0")" && pwd)
+repo_root=$(cd "${script_dir}/.." && pwd)
+cmake_folder=$repo_root"/cmake/analysis_linux"
+results_folder=$repo_root"/cmake/link_emulation_results"
+. "$script_dir/local_hub.sh"
+
+local_hub_conn_string="HostName=localhost;DeviceId=throughput_device;SharedAccessKey=bG9jYWxodWJsb2NhbGh1YmxvY2FsaHVibG9jYWxodWI="
+local_hub_owner_string="HostName=localhost;SharedAccessKeyName=iothubowner;SharedAccessKey=bG9jYWxodWJsb2NhbGh1YmxvY2FsaHVibG9jYWxodWI="
+payload_size=512
+
+declare -a link_profiles=(
+    "none"
+    "wifi"
+    "lte-m"
+    "nb-iot"
+    "gprs"
+    "satellite"
+)
+
+if [ ! -x "$cmake_folder/fault_proxy/fault_proxy" ]; then
+    mkdir -p $cmake_folder
+    pushd $cmake_folder >/dev/null
+    cmake $repo_root -DCMAKE_BUILD_TYPE=Release >/dev/null
+    make -j >/dev/null
+    popd >/dev/null
+fi
+
+rm -r -f $results_folder
+mkdir -p $results_folder
+pushd $results_folder >/dev/null
+
+# The proxy takes over the mqtt and amqp ports, the hub listens behind it
+start_local_hub $cmake_folder -m 18883 -a 15671
+trap stop_local_hub EXIT
+
+for link_profile in "${link_profiles[@]}"
+do
+    $cmake_folder/fault_proxy/fault_proxy -e $link_profile -f 8883:localhost:18883 -f 5671:localhost:15671 $local_hub_proxy_map &
+    fault_proxy_pid=$!
+    sleep 1
+
+    echo "saturating over the $link_profile link"
+    $cmake_folder/memory/throughput_memory/throughput_memory -c $local_hub_conn_string -t local_hub_ca.pem -e localhost:8888 \
+        -p $payload_size -o "throughput_${link_profile}.json" || true
+    echo "measuring send latency over the $link_profile link"
+    $cmake_folder/network/telemetry_net_info/telemetry_net_info -c $local_hub_owner_string -t local_hub_ca.pem -l localhost:8890 -e localhost:8888 \
+        -n 10 -p $payload_size -o "net_info_${link_profile}.json" || true
+
+    kill $fault_proxy_pid 2>/dev/null || true
+    wait $fault_proxy_pid 2>/dev/null || true
+done
+
+echo ""
+printf "%-10s %-18s %-12s %12s %12s %14s %12s %12s\n" "link" "transport" "layer" "satMsgs/s" "msgs/s" "netBytes/s" "heapDelta" "p50/p99 ms"
+for link_profile in "${link_profiles[@]}"
+do
+    # The report is pretty printed by parson, one field per line. The latency of each
+    # transport comes from the network report and is joined on the transport name.
+    awk -v link_profile="$link_profile" '
+        function field_value(line) { sub(/^[^:]*: */, "", line); gsub(/[",\r]/, "", line); return line }
+        /"rpt_type"/ { rpt_type = field_value($0) }
+        /"layer"/ { layer = field_value($0) }
+        /"transport"/ { transport = field_value($0) }
+        /"saturationMsgsPerSec"/ { sat_rate = field_value($0) }
+        /"sustainedMsgsPerSec"/ { rate = field_value($0) }
+        /"sustainedNetworkBytesPerSec"/ { net_rate = field_value($0) }
+        /"sustainedPeakHeapDelta"/ { heap = field_value($0) }
+        /"latencyP50Us"/ { p50 = field_value($0) }
+        /"latencyP99Us"/ { p99 = field_value($0) }
+        /^ *}/ {
+            if (rpt_type == "SEND_LATENCY")
+            {
+                latency[transport] = sprintf("%.0f/%.0f", p50 / 1000, p99 / 1000)
+            }
+            else if (rpt_type == "THROUGHPUT")
+            {
+                rows[++row_count] = sprintf("%-10s %-18s %-12s %12.1f %12.1f %14.1f %12d", link_profile, transport, layer, sat_rate, rate, net_rate, heap)
+                row_transport[row_count] = transport
+            }
+            rpt_type = ""
+        }
+        END {
+            for (index_row = 1; index_row <= row_count; index_row++)
+            {
+                printf "%s %12s\n", rows[index_row], (row_transport[index_row] in latency) ? latency[row_transport[index_row]] : "-"
+            }
+        }' "net_info_${link_profile}.json" "throughput_${link_profile}.json" 2>/dev/null || true
+done
+popd >/dev/null
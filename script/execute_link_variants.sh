@@ -0,0 +1,78 @@
+#!/bin/bash
+#set -o pipefail
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Builds the analysis tree with lto, section garbage collection and identical code
+# folding and reports how much flash and static ram each variant removes from a
+# baseline build with the same linker for every transport and layer
+
+set -e
+
+gcc --version
+uname -r
+
+script_dir=$(cd "$(dirname "$0")" && pwd)
+repo_root=$(cd "${script_dir}/.." && pwd)
+results_folder=$repo_root"/cmake/link_variant_results"
+
+# name|cmake options, each baseline is built with the same linker as the variants measured against it
+declare -a baselines=(
+    "ld|"
+    "gold|-Duse_gold=ON"
+)
+
+# name|baseline|cmake options, gold against ld is the cost of switching linker alone
+declare -a variants=(
+    "gold|ld|-Duse_gold=ON"
+    "gc_sections|ld|-Duse_gc_sections=ON"
+    "icf|gold|-Duse_icf=ON"
+    "lto|ld|-Duse_lto=ON"
+    "lto_gc_sections|ld|-Duse_lto=ON -Duse_gc_sections=ON"
+    "all|gold|-Duse_lto=ON -Duse_gc_sections=ON -Duse_icf=ON"
+)
+
+build_tree()
+{
+    rm -r -f $1
+    mkdir -p $1
+    pushd $1 >/dev/null
+    cmake $repo_root -DCMAKE_BUILD_TYPE=Release $2 >/dev/null
+    make -j >/dev/null
+    popd >/dev/null
+}
+
+rm -r -f $results_folder
+mkdir -p $results_folder
+
+for item in "${baselines[@]}"
+do
+    IFS='|' read -r baseline cmake_cmd <<< "$item"
+    echo "executing cmake/make for the $baseline baseline"
+    build_tree $repo_root"/cmake/link_variant_baseline_$baseline" "$cmake_cmd"
+done
+
+for item in "${variants[@]}"
+do
+    IFS='|' read -r name baseline cmake_cmd <<< "$item"
+    cmake_folder=$repo_root"/cmake/link_variant_$name"
+
+    echo "executing cmake/make with <<$cmake_cmd>>"
+    build_tree $cmake_folder "$cmake_cmd"
+
+    echo "Retrieving binary info against the $baseline baseline"
+    $cmake_folder/binary_info/binary_info -c $cmake_folder -b $repo_root"/cmake/link_variant_baseline_$baseline" -t csv -o "$results_folder/binary_$name.csv"
+done
+
+echo ""
+echo "Size against the baseline build with the same linker (bytes)"
+printf "%-16s %-8s %-12s %-18s %12s %12s %8s %10s %10s\n" "variant" "baseline" "layer" "transport" "baseFlash" "flashDelta" "pct" "ramDelta" "textDelta"
+for item in "${variants[@]}"
+do
+    IFS='|' read -r name baseline cmake_cmd <<< "$item"
+    awk -F', ' -v variant="$name" -v baseline="$baseline" '
+        $2 == "ROM_SECTION_DIFF" {
+            printf "%-16s %-8s %-12s %-18s %12d %+12d %+7.1f%% %+10d %+10d\n", variant, baseline, $4, $6, $9, $11, $13, $15, $17
+        }' "$results_folder/binary_$name.csv" | tr -d '\r'
+done
@@ -0,0 +1,157 @@
+#!/bin/bash
+#set -o pipefail
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Builds every configuration in its own folder, several at a time, and merges the
+# binary_info report of all of them into one csv. The compiles go through ccache
+# with one cache for every folder that is kept between runs, as are the build
+# folders, so a later run only compiles what changed and a configuration with the
+# same compile options as another takes its objects from the cache.
+#
+# usage: execute_matrix.sh [parallel builds] [configuration ...]
+# A configuration is "name|sdk version|cmake options", an empty sdk version builds
+# against deps/c-sdk and any other is a branch or tag checked out in its own worktree.
+
+set -e
+
+gcc --version
+uname -r
+
+script_dir=$(cd "$(dirname "$0")" && pwd)
+repo_root=$(cd "${script_dir}/.." && pwd)
+sdk_folder=$repo_root"/deps/c-sdk"
+worktree_folder=$repo_root"/cmake/sdk_worktrees"
+results_folder=$repo_root"/cmake/matrix_results"
+git_repo_uri="https://github.com/Azure/azure-iot-sdk-c.git"
+merged_report=$results_folder"/binary_matrix.csv"
+
+max_parallel=${1:-$(( $(nproc) / 4 > 1 ? $(nproc) / 4 : 1 ))}
+make_jobs=$(( $(nproc) / max_parallel > 1 ? $(nproc) / max_parallel : 1 ))
+
+# name|sdk version|cmake options, built when no configuration is given
+declare -a configurations=(
+    "release||-DCMAKE_BUILD_TYPE=Release"
+    "no_logging||-DCMAKE_BUILD_TYPE=Release -Dno_logging=ON"
+    "lts_10_2018|lts_10_2018|-DCMAKE_BUILD_TYPE=Release -Duse_http=OFF"
+    "2018-09-11|2018-09-11|-DCMAKE_BUILD_TYPE=Release -Duse_http=OFF"
+    "master|master|-DCMAKE_BUILD_TYPE=Release -Duse_http=OFF"
+)
+if [ $# -gt 1 ]; then
+    configurations=("${@:2}")
+fi
+
+cache_cmd=""
+if command -v ccache >/dev/null; then
+    # Every build folder is at the same depth under the base dir so the paths the
+    # compiler sees are the same relative paths in all of them
+    export CCACHE_DIR=$repo_root"/cmake/matrix_ccache"
+    export CCACHE_BASEDIR=$repo_root
+    export CCACHE_NOHASHDIR=1
+    cache_cmd="-DCMAKE_C_COMPILER_LAUNCHER=ccache -DCMAKE_CXX_COMPILER_LAUNCHER=ccache"
+else
+    echo "ccache is not installed, every configuration compiles the sdk on its own"
+fi
+
+build_configuration()
+{
+    local name=$1
+    local sdk_cmd=$2
+    local cmake_cmd=$3
+    local cmake_folder=$repo_root"/cmake/matrix_$name"
+    local log_file=$results_folder"/build_$name.log"
+    mkdir -p $cmake_folder
+    pushd $cmake_folder >/dev/null
+    # The builds run at the same time, every one logs its own ccache results
+    if cmake $repo_root $cmake_cmd $sdk_cmd $cache_cmd >$log_file 2>&1 && CCACHE_STATSLOG=$results_folder"/ccache_$name.log" make -j$make_jobs >>$log_file 2>&1; then
+        ./binary_info/binary_info -c $cmake_folder -t csv -o "$results_folder/binary_$name.csv" >>$log_file 2>&1 || true
+        echo "built <<$name>>"
+    else
+        echo "Failed building <<$name>>, see $log_file"
+    fi
+    popd >/dev/null
+}
+
+if [ ! -f "$sdk_folder/.gitmodules" ]; then
+    git clone -q --no-tags $git_repo_uri $sdk_folder
+    git -C $sdk_folder submodule update -q --init
+fi
+
+rm -r -f $results_folder
+mkdir -p $results_folder
+
+# The checkouts run one at a time before the builds, git locks the sdk repo for each.
+# The worktrees are shared with execute_version_matrix.sh and kept between runs
+for item in "${configurations[@]}"
+do
+    IFS='|' read -r name version cmake_cmd <<< "$item"
+    worktree=$worktree_folder/$version
+    if [ -n "$version" ] && [ ! -f "$worktree/.gitmodules" ]; then
+        echo "checking out sdk <<$version>>"
+        if ! git -C $sdk_folder fetch -q origin "$version" ||
+            ! git -C $sdk_folder worktree add -q -f --detach $worktree FETCH_HEAD ||
+            ! git -C $worktree submodule update -q --init; then
+            echo "Failed checking out sdk <<$version>>"
+        fi
+    fi
+done
+
+start_time=$(date +%s)
+build_count=0
+for item in "${configurations[@]}"
+do
+    IFS='|' read -r name version cmake_cmd <<< "$item"
+    sdk_cmd=""
+    if [ -n "$version" ]; then
+        if [ ! -f "$worktree_folder/$version/.gitmodules" ]; then
+            echo "Skipping <<$name>>, sdk <<$version>> is not checked out"
+            continue
+        fi
+        sdk_cmd="-Dsdk_dir=$worktree_folder/$version"
+    fi
+    echo "executing cmake/make for <<$name>> with <<$cmake_cmd>>"
+    while [ $(jobs -r | wc -l) -ge $max_parallel ]
+    do
+        wait -n || true
+    done
+    build_configuration "$name" "$sdk_cmd" "$cmake_cmd" &
+    build_count=$((build_count + 1))
+done
+wait
+echo "Built $build_count configurations in $(( $(date +%s) - start_time )) seconds"
+if [ -n "$cache_cmd" ]; then
+    echo ""
+    echo "ccache results per configuration, the misses of a run after the first are what changed"
+    printf "%-24s %10s %10s\n" "configuration" "hits" "misses"
+    for item in "${configurations[@]}"
+    do
+        name=${item%%|*}
+        # ccache 4 writes one line per result, direct_cache_hit, preprocessed_cache_hit, cache_miss ...
+        if [ -f "$results_folder/ccache_$name.log" ]; then
+            awk -v name="$name" '
+                /_cache_hit$/ { hits++ }
+                /^cache_miss$/ { misses++ }
+                END { printf "%-24s %10d %10d\n", name, hits, misses }' "$results_folder/ccache_$name.log"
+        fi
+    done
+fi
+
+# Every report line with the configuration in front
+echo -n "" > $merged_report
+for item in "${configurations[@]}"
+do
+    name=${item%%|*}
+    if [ -f "$results_folder/binary_$name.csv" ]; then
+        sed "s/^/$name, /" "$results_folder/binary_$name.csv" >> $merged_report
+    fi
+done
+echo "Merged report in $merged_report"
+
+echo ""
+echo "Size per configuration (bytes)"
+printf "%-24s %-12s %-18s %10s %10s %10s\n" "configuration" "layer" "transport" "flash" "staticRam" "file"
+awk -F', ' '
+    $3 == "ROM_SECTIONS" {
+        printf "%-24s %-12s %-18s %10d %10d %10d\n", $1, $5, $7, $10, $12, $32
+    }' $merged_report | tr -d '\r'
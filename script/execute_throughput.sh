@@ -0,0 +1,72 @@
+#!/bin/bash
+#set -o pipefail
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Runs the saturation benchmark against the local hub for every payload size and
+# prints the highest sustainable rate of each transport and layer
+
+set -e
+
+script_dir=$(cd "$(dirname "$0")" && pwd)
+repo_root=$(cd "${script_dir}/.." && pwd)
+cmake_folder=$repo_root"/cmake/analysis_linux"
+results_folder=$repo_root"/cmake/throughput_results"
+. "$script_dir/local_hub.sh"
+
+local_hub_conn_string="HostName=localhost;DeviceId=throughput_device;SharedAccessKey=bG9jYWxodWJsb2NhbGh1YmxvY2FsaHVibG9jYWxodWI="
+
+declare -a payload_sizes=(
+    "64"
+    "512"
+    "4096"
+)
+
+if [ ! -x "$cmake_folder/memory/throughput_memory/throughput_memory" ]; then
+    mkdir -p $cmake_folder
+    pushd $cmake_folder >/dev/null
+    cmake $repo_root -DCMAKE_BUILD_TYPE=Release >/dev/null
+    make -j >/dev/null
+    popd >/dev/null
+fi
+
+rm -r -f $results_folder
+mkdir -p $results_folder
+pushd $results_folder >/dev/null
+
+start_local_hub $cmake_folder
+trap stop_local_hub EXIT
+
+for payload_size in "${payload_sizes[@]}"
+do
+    echo "saturating with $payload_size byte messages"
+    $cmake_folder/memory/throughput_memory/throughput_memory -c $local_hub_conn_string -t local_hub_ca.pem $local_hub_proxy \
+        -p $payload_size -o "throughput_${payload_size}.json" || true
+done
+
+echo ""
+printf "%-8s %-18s %-12s %12s %12s %14s %10s %12s %14s\n" "payload" "transport" "layer" "satMsgs/s" "msgs/s" "netBytes/s" "cpuUs/msg" "heapDelta" "satHeapDelta"
+for payload_size in "${payload_sizes[@]}"
+do
+    # The report is pretty printed by parson, one field per line
+    awk -v payload_size="$payload_size" '
+        function field_value(line) { sub(/^[^:]*: */, "", line); gsub(/[",\r]/, "", line); return line }
+        /"rpt_type"/ { rpt_type = field_value($0) }
+        /"layer"/ { layer = field_value($0) }
+        /"transport"/ { transport = field_value($0) }
+        /"saturationMsgsPerSec"/ { sat_rate = field_value($0) }
+        /"saturationPeakHeapDelta"/ { sat_heap = field_value($0) }
+        /"sustainedMsgsPerSec"/ { rate = field_value($0) }
+        /"sustainedNetworkBytesPerSec"/ { net_rate = field_value($0) }
+        /"sustainedCpuUsPerMsg"/ { cpu = field_value($0) }
+        /"sustainedPeakHeapDelta"/ { heap = field_value($0) }
+        /^ *}/ {
+            if (rpt_type == "THROUGHPUT")
+            {
+                printf "%-8s %-18s %-12s %12.1f %12.1f %14.1f %10.1f %12d %14d\n", payload_size, transport, layer, sat_rate, rate, net_rate, cpu, heap, sat_heap
+            }
+            rpt_type = ""
+        }' "throughput_${payload_size}.json"
+done
+popd >/dev/null
@@ -0,0 +1,86 @@
+#!/bin/bash
+#set -o pipefail
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Runs the twin analysis against the local hub for every combination of full
+# twin document size and desired property patch rate
+
+set -e
+
+script_dir=$(cd "$(dirname "$0")" && pwd)
+repo_root=$(cd "${script_dir}/.." && pwd)
+cmake_folder=$repo_root"/cmake/analysis_linux"
+results_folder=$repo_root"/cmake/twin_results"
+. "$script_dir/local_hub.sh"
+
+local_hub_conn_string="HostName=localhost;DeviceId=twin_device;SharedAccessKey=bG9jYWxodWJsb2NhbGh1YmxvY2FsaHVibG9jYWxodWI="
+patch_count=50
+
+declare -a document_sizes=(
+    "1024"
+    "8192"
+    "32768"
+    "131072"
+)
+declare -a patch_rates=(
+    "1"
+    "10"
+    "100"
+    "0"
+)
+
+if [ ! -x "$cmake_folder/memory/twin_memory/twin_memory" ]; then
+    mkdir -p $cmake_folder
+    pushd $cmake_folder >/dev/null
+    cmake $repo_root -DCMAKE_BUILD_TYPE=Release >/dev/null
+    make -j >/dev/null
+    popd >/dev/null
+fi
+
+rm -r -f $results_folder
+mkdir -p $results_folder
+pushd $results_folder >/dev/null
+
+start_local_hub $cmake_folder
+trap stop_local_hub EXIT
+
+for doc_size in "${document_sizes[@]}"
+do
+    for rate in "${patch_rates[@]}"
+    do
+        echo "twin document $doc_size bytes, $rate patches per second (0 is unthrottled)"
+        $cmake_folder/memory/twin_memory/twin_memory -c $local_hub_conn_string -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 \
+            -n $patch_count -p $doc_size -r $rate -o "twin_${doc_size}_${rate}.json" || true
+    done
+done
+
+echo ""
+printf "%-10s %-8s %-12s %10s %10s %12s %12s %12s %12s %12s\n" "docSize" "rate" "transport" "layer" "getHeap" "getPeak" "bytes/patch" "cpuAvgUs" "cpuMaxUs" "reportP99Us"
+for doc_size in "${document_sizes[@]}"
+do
+    for rate in "${patch_rates[@]}"
+    do
+        # The report is pretty printed by parson, one field per line
+        awk -v doc_size="$doc_size" -v rate="$rate" '
+            function field_value(line) { sub(/^[^:]*: */, "", line); gsub(/[",\r]/, "", line); return line }
+            /"rpt_type"/ { rpt_type = field_value($0) }
+            /"layer"/ { layer = field_value($0) }
+            /"transport"/ { transport = field_value($0) }
+            /"twinGetHeapDelta"/ { get_heap = field_value($0) }
+            /"twinGetPeakHeapDelta"/ { get_peak = field_value($0) }
+            /"networkBytesPerPatch"/ { patch_bytes = field_value($0) }
+            /"callbackCpuAvgUs"/ { cpu_avg = field_value($0) }
+            /"callbackCpuMaxUs"/ { cpu_max = field_value($0) }
+            /"latencyP99Us"/ { report_p99 = field_value($0) }
+            /^ *}/ {
+                if (rpt_type == "TWIN")
+                {
+                    printf "%-10s %-8s %-12s %10s %10d %12d %12.1f %12.1f %12.1f %12.1f\n", doc_size, rate, transport, layer, get_heap, get_peak, patch_bytes, cpu_avg, cpu_max, report_p99
+                }
+                rpt_type = ""
+            }' "twin_${doc_size}_${rate}.json"
+    done
+done
+popd >/dev/null
@@ -0,0 +1,187 @@
+#!/bin/bash
+#set -o pipefail
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Builds the analysis tree against several versions of the sdk, each checked out
+# in its own worktree of deps/c-sdk, runs the binary, heap and network analysis
+# for every version and prints one table per feature, layer and transport with
+# the metrics of each version and the delta from one version to the next.
+#
+# usage: execute_version_matrix.sh [version ...]
+# The versions are branches or tags of the sdk, oldest first. A version that fails
+# to check out or build is listed with "-" for its metrics.
+
+set -e
+
+gcc --version
+uname -r
+
+script_dir=$(cd "$(dirname "$0")" && pwd)
+repo_root=$(cd "${script_dir}/.." && pwd)
+sdk_folder=$repo_root"/deps/c-sdk"
+worktree_folder=$repo_root"/cmake/sdk_worktrees"
+results_folder=$repo_root"/cmake/version_results"
+git_repo_uri="https://github.com/Azure/azure-iot-sdk-c.git"
+. "$script_dir/local_hub.sh"
+
+local_hub_owner_string="HostName=localhost;SharedAccessKeyName=iothubowner;SharedAccessKey=bG9jYWxodWJsb2NhbGh1YmxvY2FsaHVibG9jYWxodWI="
+
+declare -a versions=(
+    "lts_10_2018"
+    "2018-09-11"
+    "master"
+)
+if [ $# -gt 0 ]; then
+    versions=("$@")
+fi
+
+if [ ! -f "$sdk_folder/.gitmodules" ]; then
+    git clone -q --no-tags $git_repo_uri $sdk_folder
+fi
+
+rm -r -f $results_folder
+mkdir -p $results_folder
+echo -n "" > "$results_folder/metrics.txt"
+
+for version in "${versions[@]}"
+do
+    # The worktrees are kept between runs, the sdk is fetched only once per version
+    worktree=$worktree_folder/$version
+    if [ ! -f "$worktree/.gitmodules" ]; then
+        echo "checking out sdk <<$version>>"
+        if ! git -C $sdk_folder fetch -q origin "$version" ||
+            ! git -C $sdk_folder worktree add -q -f --detach $worktree FETCH_HEAD ||
+            ! git -C $worktree submodule update -q --init; then
+            echo "Failed checking out sdk <<$version>>"
+            continue
+        fi
+    fi
+
+    cmake_folder=$repo_root"/cmake/version_$version"
+    log_file=$results_folder"/build_$version.log"
+    rm -r -f $cmake_folder
+    mkdir -p $cmake_folder
+    pushd $cmake_folder >/dev/null
+
+    echo "executing cmake/make with sdk <<$version>>"
+    if ! cmake $repo_root -DCMAKE_BUILD_TYPE=Release -Dsdk_dir=$worktree >$log_file 2>&1 || ! make -j >>$log_file 2>&1; then
+        echo "Failed building with sdk <<$version>>, see $log_file"
+        popd >/dev/null
+        continue
+    fi
+
+    echo "Retrieving binary info"
+    ./binary_info/binary_info -c $cmake_folder -t csv -o "$results_folder/binary_$version.csv" || true
+
+    start_local_hub .
+    echo "Retrieving telemetry memory info against the local hub"
+    ./memory/telemetry_memory/telemetry_memory -c $local_hub_owner_string -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 \
+        -o "$results_folder/memory_$version.json" || true
+    echo "Retrieving telemetry network info against the local hub"
+    ./network/telemetry_net_info/telemetry_net_info -c $local_hub_owner_string -t local_hub_ca.pem $local_hub_proxy -l localhost:8890 \
+        -o "$results_folder/network_$version.json" || true
+    stop_local_hub
+    popd >/dev/null
+
+    # One line per metric: version|feature|layer|transport|metric|value
+    if [ -f "$results_folder/binary_$version.csv" ]; then
+        awk -F', ' -v version="$version" '
+            $2 == "ROM_SECTIONS" {
+                printf "%s|%s|%s|%s|flashSize|%d\n", version, $3, $4, $6, $9
+                printf "%s|%s|%s|%s|staticRamSize|%d\n", version, $3, $4, $6, $11
+                printf "%s|%s|%s|%s|fileSize|%d\n", version, $3, $4, $6, $31
+            }' "$results_folder/binary_$version.csv" | tr -d '\r' >> "$results_folder/metrics.txt"
+    fi
+
+    # The reports are pretty printed by parson, one field per line
+    for report_file in "$results_folder/memory_$version.json" "$results_folder/network_$version.json"
+    do
+        if [ -f "$report_file" ]; then
+            awk -v version="$version" '
+                function field_value(line) { sub(/^[^:]*: */, "", line); gsub(/[",\r]/, "", line); return line }
+                function add_metric(name, value) { metrics[metric_count, 0] = name; metrics[metric_count, 1] = value; metric_count++ }
+                BEGIN { metric_count = 0 }
+                /"rpt_type"/ { rpt_type = field_value($0) }
+                /"feature"/ { feature = field_value($0) }
+                /"layer"/ { layer = field_value($0) }
+                /"transport"/ { transport = field_value($0) }
+                /"maxMemory"/ { add_metric("maxMemory", field_value($0)) }
+                /"numAlloc"/ { add_metric("numAlloc", field_value($0)) }
+                /"bytesPerMsg"/ { add_metric("netBytesPerMsg", field_value($0)) }
+                /"sendsPerMsg"/ { add_metric("netSendsPerMsg", field_value($0)) }
+                /"recvsPerMsg"/ { add_metric("netRecvsPerMsg", field_value($0)) }
+                /^ *}/ {
+                    if (rpt_type == "RAM" || rpt_type == "NETWORK_PACKETS")
+                    {
+                        for (index_metric = 0; index_metric < metric_count; index_metric++)
+                        {
+                            printf "%s|%s|%s|%s|%s|%s\n", version, feature, layer, transport, metrics[index_metric, 0], metrics[index_metric, 1]
+                        }
+                    }
+                    rpt_type = ""
+                    metric_count = 0
+                }' "$report_file" >> "$results_folder/metrics.txt"
+        fi
+    done
+done
+
+echo ""
+version_list="${versions[*]}"
+awk -F'|' -v version_list="$version_list" '
+    {
+        key = $2 "|" $3 "|" $4
+        if (!(key in seen_key)) { seen_key[key] = 1; keys[key_count++] = key }
+        if (!((key, $5) in seen_metric)) { seen_metric[key, $5] = 1; metric_names[key, metric_counts[key]++] = $5 }
+        values[$1, key, $5] = $6
+        has_value[$1, key, $5] = 1
+    }
+    END {
+        version_count = split(version_list, versions, " ")
+        for (index_key = 0; index_key < key_count; index_key++)
+        {
+            key = keys[index_key]
+            split(key, parts, "|")
+            printf "%s, %s, %s\n", parts[1], parts[2], parts[3]
+            printf "%-16s", "metric"
+            for (index_version = 1; index_version <= version_count; index_version++)
+            {
+                printf " %14s", versions[index_version]
+            }
+            for (index_version = 2; index_version <= version_count; index_version++)
+            {
+                printf " %22s", versions[index_version - 1] ">" versions[index_version]
+            }
+            printf "\n"
+            for (index_metric = 0; index_metric < metric_counts[key]; index_metric++)
+            {
+                name = metric_names[key, index_metric]
+                printf "%-16s", name
+                for (index_version = 1; index_version <= version_count; index_version++)
+                {
+                    version = versions[index_version]
+                    if (has_value[version, key, name]) { printf " %14.1f", values[version, key, name] }
+                    else { printf " %14s", "-" }
+                }
+                # Delta from the previous version, with the change in percent
+                for (index_version = 2; index_version <= version_count; index_version++)
+                {
+                    previous = versions[index_version - 1]
+                    version = versions[index_version]
+                    if (has_value[previous, key, name] && has_value[version, key, name])
+                    {
+                        delta = values[version, key, name] - values[previous, key, name]
+                        if (values[previous, key, name] != 0) { printf " %+13.1f (%+5.1f%%)", delta, delta * 100 / values[previous, key, name] }
+                        else { printf " %+13.1f %8s", delta, "" }
+                    }
+                    else
+                    {
+                        printf " %22s", "-"
+                    }
+                }
+                printf "\n"
+            }
+            printf "\n"
+        }
+    }' "$results_folder/metrics.txt" | tee "$results_folder/version_matrix.txt"
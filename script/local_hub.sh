@@ -0,0 +1,57 @@
+#!/bin/bash
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+# Sourced by the scripts that run the analysis against the local hub. The local
+# hub writes its test CA to local_hub_ca.pem in the current directory.
+
+# The websocket and http transports always connect on 443. Without root the hub
+# takes 8443 and the apps reach it through a fault_proxy http CONNECT port that
+# maps 443 onto it, pass $local_hub_proxy to the apps and $local_hub_proxy_map to
+# any other fault_proxy they go through.
+local_hub_https_port=443
+local_hub_proxy=""
+local_hub_proxy_map=""
+if [ "$(id -u)" -ne 0 ]; then
+    local_hub_https_port=8443
+    local_hub_proxy="-e localhost:8889"
+    local_hub_proxy_map="-m 443:$local_hub_https_port"
+fi
+local_hub_pid=""
+local_hub_proxy_pid=""
+
+# start_local_hub <cmake folder> [local_hub arguments]
+start_local_hub()
+{
+    local hub_cmake_folder=$1
+    shift
+    $hub_cmake_folder/local_hub/local_hub -h localhost -w $local_hub_https_port -t local_hub_ca.pem "$@" &
+    local_hub_pid=$!
+    if [ -n "$local_hub_proxy" ]; then
+        # Kept off 8888 and 8891 so the scripts can still run their own fault_proxy
+        $hub_cmake_folder/fault_proxy/fault_proxy -p 8889 -l 8892 $local_hub_proxy_map &
+        local_hub_proxy_pid=$!
+    fi
+    sleep 2
+    if ! kill -0 $local_hub_pid 2>/dev/null; then
+        echo "Failure starting the local hub"
+        stop_local_hub
+        return 1
+    fi
+}
+
+# A hub that already exited is not an error, the runs against it reported that
+stop_local_hub()
+{
+    if [ -n "$local_hub_proxy_pid" ]; then
+        kill $local_hub_proxy_pid 2>/dev/null || true
+        wait $local_hub_proxy_pid 2>/dev/null || true
+        local_hub_proxy_pid=""
+    fi
+    if [ -n "$local_hub_pid" ]; then
+        kill $local_hub_pid 2>/dev/null || true
+        wait $local_hub_pid 2>/dev/null || true
+        local_hub_pid=""
+    fi
+}
@@ -0,0 +1,69 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_clock.h"
+
+#ifdef USE_SIM_CLOCK
+    #include "azure_c_shared_utility/tickcounter.h"
+    #include "azure_c_shared_utility/agenttime.h"
+#endif
+
+static uint64_t g_offset_ms;
+
+#ifdef USE_SIM_CLOCK
+
+extern int __real_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t* current_ms);
+extern time_t __real_get_time(time_t* current_time);
+
+int __wrap_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t* current_ms)
+{
+    int result = __real_tickcounter_get_current_ms(tick_counter, current_ms);
+    if (result == 0 && current_ms != NULL)
+    {
+        *current_ms += (tickcounter_ms_t)g_offset_ms;
+    }
+    return result;
+}
+
+// The sas tokens are stamped with get_time, moving it keeps their expiry in step with the tick counters
+time_t __wrap_get_time(time_t* current_time)
+{
+    time_t result = __real_get_time(NULL);
+    if (result != (time_t)-1)
+    {
+        result += (time_t)(g_offset_ms / 1000);
+    }
+    if (current_time != NULL)
+    {
+        *current_time = result;
+    }
+    return result;
+}
+
+bool sim_clock_is_enabled(void)
+{
+    return true;
+}
+#else
+bool sim_clock_is_enabled(void)
+{
+    return false;
+}
+#endif
+
+void sim_clock_reset(void)
+{
+    g_offset_ms = 0;
+}
+
+void sim_clock_advance_ms(uint64_t advance_ms)
+{
+    g_offset_ms += advance_ms;
+}
+
+uint64_t sim_clock_get_offset_ms(void)
+{
+    return g_offset_ms;
+}
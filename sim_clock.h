@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdbool>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+// Moves the sdk's clocks ahead of the wall clock so hours of idle time can be
+// simulated in seconds. tickcounter_get_current_ms and get_time are wrapped
+// through the linker's --wrap option, it is only active when the target was
+// linked with add_sim_clock(). Only advance it from the thread calling DoWork.
+extern bool sim_clock_is_enabled(void);
+extern void sim_clock_reset(void);
+extern void sim_clock_advance_ms(uint64_t advance_ms);
+extern uint64_t sim_clock_get_offset_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SIM_CLOCK_H */